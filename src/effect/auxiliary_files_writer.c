@@ -56,7 +56,8 @@ void write_genes_with_variants_file(cp_hashtable *gene_list, char *output_direct
 }
 
 
-void write_result_file(shared_options_data_t *shared_options, effect_options_data_t *effect_options, cp_hashtable *summary_count, char *output_directory) {
+void write_result_file(shared_options_data_t *shared_options, effect_options_data_t *effect_options, ws_scheduler_t *scheduler, 
+                       cp_hashtable *summary_count, char *output_directory) {
     char *aux_buffer, *input_vcf_buffer;
     result_file_t *result_file = NULL;
     
@@ -103,6 +104,9 @@ void write_result_file(shared_options_data_t *shared_options, effect_options_dat
     num_threads_buf = (char*) calloc (8, sizeof(char));
     sprintf(num_threads_buf, "%d", shared_options->num_threads);
     result_item_t *input_item_numthreads = result_item_new("number-threads", num_threads_buf, "Number of connections to the web-service", "MESSAGE", "", "", "");
+    result_item_t *input_item_backend = result_item_new("annotation-backend", 
+                                                        (effect_options->annotation_backend == LOCAL_BACKEND) ? "local" : "ws", 
+                                                        "Source of the consequence types", "MESSAGE", "", "", "");
     input_vcf_buffer = (char*) calloc (strlen(shared_options->vcf_filename), sizeof(char));
     get_filename_from_path(shared_options->vcf_filename, input_vcf_buffer);
     result_item_t *input_item_vcf_input = result_item_new(input_vcf_buffer, input_vcf_buffer, "VCF input file", "DATA", "", "Input", "");
@@ -111,8 +115,24 @@ void write_result_file(shared_options_data_t *shared_options, effect_options_dat
     result_add_input_item(input_item_outdir, result_file);
     result_add_input_item(input_item_vcf_file, result_file);
     result_add_input_item(input_item_species, result_file);
+    result_add_input_item(input_item_backend, result_file);
     result_add_input_item(input_item_vcf_input, result_file);
     
+    // Limits chosen by the scheduler for the web services, and the statistics they were based on
+    char ws_buffers[5][32];
+    if (scheduler) {
+        sprintf(ws_buffers[0], "%d", scheduler->max_in_flight);
+        sprintf(ws_buffers[1], "%d", scheduler->chunk_size);
+        sprintf(ws_buffers[2], "%.3f", scheduler->mean_latency);
+        sprintf(ws_buffers[3], "%.3f", scheduler->error_rate);
+        sprintf(ws_buffers[4], "%zu", scheduler->num_retries);
+        result_add_input_item(result_item_new("max-requests", ws_buffers[0], "Requests to the web services in flight at the end", "MESSAGE", "", "", ""), result_file);
+        result_add_input_item(result_item_new("variants-per-request", ws_buffers[1], "Variants per request to the web services at the end", "MESSAGE", "", "", ""), result_file);
+        result_add_input_item(result_item_new("ws-mean-latency", ws_buffers[2], "Mean seconds taken by a request to the web services", "MESSAGE", "", "", ""), result_file);
+        result_add_input_item(result_item_new("ws-error-rate", ws_buffers[3], "Fraction of requests to the web services that failed", "MESSAGE", "", "", ""), result_file);
+        result_add_input_item(result_item_new("ws-retries", ws_buffers[4], "Requests to the web services sent again after failing", "MESSAGE", "", "", ""), result_file);
+    }
+    
     result_item_t *output_item;
     
     // Add output files for summaries
@@ -140,7 +160,8 @@ void write_result_file(shared_options_data_t *shared_options, effect_options_dat
                                         "FILE", "HISTOGRAM", "Summary", "");
     result_add_output_item(output_item, result_file);
     
-    // Add output files retrieved from the WS
+    // Add output files retrieved from the WS, which are compressed if so requested
+    char *extension = effect_options->compress_output ? ".txt.gz" : ".txt";
     char *consequence_type, *consequence_type_filename;
     int *count, total_count = 0;
     
@@ -152,9 +173,9 @@ void write_result_file(shared_options_data_t *shared_options, effect_options_dat
         total_count += *count;
         
         if (strcmp(consequence_type, "all_variants") && strcmp(consequence_type, "summary")) {
-            consequence_type_filename = (char*) calloc (strlen(consequence_type) + 5, sizeof(char));
+            consequence_type_filename = (char*) calloc (strlen(consequence_type) + strlen(extension) + 1, sizeof(char));
             strncat(consequence_type_filename, consequence_type, strlen(consequence_type));
-            strncat(consequence_type_filename, ".txt", 4);
+            strncat(consequence_type_filename, extension, strlen(extension));
             
             aux_buffer = (char*) calloc (strlen(consequence_type) + 32, sizeof(char));
             sprintf(aux_buffer, "%s (%d)", consequence_type, *count);
@@ -170,15 +191,19 @@ void write_result_file(shared_options_data_t *shared_options, effect_options_dat
     // Add output data for all_variants
     all_count_buf = (char*) calloc (32, sizeof(char));
     sprintf(all_count_buf, "All (%d)", total_count);
-    output_item = result_item_new("all_variants.txt", "all_variants.txt", all_count_buf, 
+    char output_filenames[3][32];
+    sprintf(output_filenames[0], "all_variants%s", extension);
+    sprintf(output_filenames[1], "snp_phenotypes%s", extension);
+    sprintf(output_filenames[2], "mutation_phenotypes%s", extension);
+    output_item = result_item_new(output_filenames[0], output_filenames[0], all_count_buf, 
                                         "FILE", "CONSEQUENCE_TYPE_VARIANTS", "Variants by Consequence Type", "");
     result_add_output_item(output_item, result_file);
     
     // Add output files with phenotypic information
-    output_item = result_item_new("snp_phenotypes.txt", "snp_phenotypes.txt", "SNP phenotypes", 
+    output_item = result_item_new(output_filenames[1], output_filenames[1], "SNP phenotypes", 
                                         "FILE", "", "Variants with phenotypic information", "");
     result_add_output_item(output_item, result_file);
-    output_item = result_item_new("mutation_phenotypes.txt", "mutation_phenotypes.txt", "Mutations phenotypes", 
+    output_item = result_item_new(output_filenames[2], output_filenames[2], "Mutations phenotypes", 
                                         "FILE", "", "Variants with phenotypic information", "");
     result_add_output_item(output_item, result_file);
     
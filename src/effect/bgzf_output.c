@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bgzf_output.h"
+
+/**
+ * Empty block that marks the end of a BGZF file.
+ */
+static const unsigned char bgzf_eof[28] = { 0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+                                            0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+/**
+ * @brief Lines of the same chromosome in a block, as stored in the index.
+ */
+typedef struct bgzf_index_entry {
+    const char *chromosome;
+    int chromosome_len;
+    long start;
+    long end;
+    int block;
+} bgzf_index_entry_t;
+
+static size_t compress_bgzf_block(const char *data, size_t len, unsigned char *block);
+static int index_bgzf_block(const char *data, size_t len, int block, bgzf_index_entry_t **entries, int *num_entries, int *entries_capacity);
+static int compare_offsets(const void *a, const void *b);
+
+
+bgzf_file_t *bgzf_open(const char *filename, int indexed) {
+    FILE *file = fopen(filename, "a");
+    if (!file) {
+        return NULL;
+    }
+
+    bgzf_file_t *bgzf = (bgzf_file_t*) calloc (1, sizeof(bgzf_file_t));
+    bgzf->filename = strdup(filename);
+    bgzf->file = file;
+    if (indexed) {
+        char index_filename[strlen(filename) + strlen(BGZF_INDEX_EXTENSION) + 1];
+        sprintf(index_filename, "%s%s", filename, BGZF_INDEX_EXTENSION);
+        bgzf->index = fopen(index_filename, "a");
+        if (!bgzf->index) {
+            LOG_WARN_F("Can't create index %s, the file will not be indexed\n", index_filename);
+        }
+    }
+    omp_init_lock(&(bgzf->lock));
+    return bgzf;
+}
+
+int bgzf_write_lines(const char *text, size_t len, bgzf_file_t *file) {
+    if (len == 0) {
+        return 0;
+    }
+
+    // Blocks are compressed by the calling thread
+    size_t compressed_capacity = len / 2 + BGZF_MAX_BLOCK_SIZE;
+    size_t compressed_len = 0;
+    unsigned char *compressed = (unsigned char*) malloc (compressed_capacity);
+
+    int num_blocks = 0, blocks_capacity = len / BGZF_BLOCK_SIZE + 2;
+    size_t *block_offsets = (size_t*) malloc (blocks_capacity * sizeof(size_t));
+
+    int num_entries = 0, entries_capacity = 0;
+    bgzf_index_entry_t *entries = NULL;
+
+    size_t consumed = 0;
+    while (consumed < len) {
+        // Cut the block after the last complete line that fits in it
+        size_t block_len = len - consumed < BGZF_BLOCK_SIZE ? len - consumed : BGZF_BLOCK_SIZE;
+        if (consumed + block_len < len) {
+            const char *last_newline = memrchr(text + consumed, '\n', block_len);
+            if (last_newline) {
+                block_len = last_newline - (text + consumed) + 1;
+            }
+        }
+
+        if (compressed_len + BGZF_MAX_BLOCK_SIZE > compressed_capacity) {
+            compressed_capacity *= 2;
+            compressed = realloc(compressed, compressed_capacity);
+        }
+        if (num_blocks == blocks_capacity) {
+            blocks_capacity *= 2;
+            block_offsets = realloc(block_offsets, blocks_capacity * sizeof(size_t));
+        }
+
+        size_t block_size = compress_bgzf_block(text + consumed, block_len, compressed + compressed_len);
+        if (!block_size) {
+            LOG_ERROR_F("Can't compress block for file %s\n", file->filename);
+            free(compressed);
+            free(block_offsets);
+            free(entries);
+            return 1;
+        }
+        if (file->index) {
+            index_bgzf_block(text + consumed, block_len, num_blocks, &entries, &num_entries, &entries_capacity);
+        }
+
+        block_offsets[num_blocks++] = compressed_len;
+        compressed_len += block_size;
+        consumed += block_len;
+    }
+
+    // Only writing the blocks and their index entries is serialized
+    int ret_code = 0;
+    omp_set_lock(&(file->lock));
+    fseeko(file->file, 0, SEEK_END);
+    off_t base_offset = ftello(file->file);
+    if (fwrite(compressed, 1, compressed_len, file->file) != compressed_len) {
+        LOG_ERROR_F("Error writing %zu bytes to file %s\n", compressed_len, file->filename);
+        ret_code = 1;
+    }
+    for (int i = 0; i < num_entries && !ret_code; i++) {
+        fprintf(file->index, "%.*s\t%ld\t%ld\t%lld\n", entries[i].chromosome_len, entries[i].chromosome,
+                entries[i].start, entries[i].end, (long long) (base_offset + block_offsets[entries[i].block]));
+    }
+    omp_unset_lock(&(file->lock));
+
+    free(compressed);
+    free(block_offsets);
+    free(entries);
+    return ret_code;
+}
+
+void bgzf_close(bgzf_file_t *file) {
+    fwrite(bgzf_eof, 1, sizeof(bgzf_eof), file->file);
+    fclose(file->file);
+    if (file->index) {
+        fclose(file->index);
+    }
+    omp_destroy_lock(&(file->lock));
+    free(file->filename);
+    free(file);
+}
+
+int bgzf_query_region(const char *filename, const char *chromosome, long start, long end, FILE *output) {
+    char index_filename[strlen(filename) + strlen(BGZF_INDEX_EXTENSION) + 1];
+    sprintf(index_filename, "%s%s", filename, BGZF_INDEX_EXTENSION);
+    FILE *index = fopen(index_filename, "r");
+    FILE *file = fopen(filename, "rb");
+    if (!index || !file) {
+        LOG_ERROR_F("Can't read file %s or its index\n", filename);
+        if (index) { fclose(index); }
+        if (file) { fclose(file); }
+        return -1;
+    }
+
+    // Offsets of the blocks with lines in the region
+    int num_offsets = 0, offsets_capacity = 64;
+    long long *offsets = (long long*) malloc (offsets_capacity * sizeof(long long));
+    size_t chromosome_len = strlen(chromosome);
+    char *line = NULL;
+    size_t line_capacity = 0;
+
+    while (getline(&line, &line_capacity, index) != -1) {
+        char *tab = strchr(line, '\t');
+        long entry_start, entry_end;
+        long long offset;
+        if (!tab || tab - line != chromosome_len || strncmp(line, chromosome, chromosome_len) ||
+            sscanf(tab + 1, "%ld\t%ld\t%lld", &entry_start, &entry_end, &offset) != 3 ||
+            entry_end < start || entry_start > end) {
+            continue;
+        }
+        if (num_offsets == offsets_capacity) {
+            offsets_capacity *= 2;
+            offsets = realloc(offsets, offsets_capacity * sizeof(long long));
+        }
+        offsets[num_offsets++] = offset;
+    }
+    free(line);
+    fclose(index);
+
+    qsort(offsets, num_offsets, sizeof(long long), compare_offsets);
+
+    unsigned char *block = (unsigned char*) malloc (BGZF_MAX_BLOCK_SIZE);
+    char *data = (char*) malloc (BGZF_MAX_BLOCK_SIZE + 1);
+    int num_lines = 0;
+
+    for (int i = 0; i < num_offsets; i++) {
+        if (i > 0 && offsets[i] == offsets[i-1]) {
+            continue;   // Several runs of the chromosome in the same block
+        }
+
+        // Read and decompress the block
+        if (fseeko(file, offsets[i], SEEK_SET) || fread(block, 1, BGZF_HEADER_SIZE, file) != BGZF_HEADER_SIZE ||
+            block[0] != 0x1f || block[1] != 0x8b || block[12] != 'B' || block[13] != 'C') {
+            LOG_ERROR_F("Invalid block at offset %lld of file %s\n", offsets[i], filename);
+            num_lines = -1;
+            break;
+        }
+        size_t block_size = (block[16] | (block[17] << 8)) + 1;
+        if (block_size < BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE ||
+            fread(block + BGZF_HEADER_SIZE, 1, block_size - BGZF_HEADER_SIZE, file) != block_size - BGZF_HEADER_SIZE) {
+            LOG_ERROR_F("Truncated block at offset %lld of file %s\n", offsets[i], filename);
+            num_lines = -1;
+            break;
+        }
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(z_stream));
+        inflateInit2(&stream, -15);
+        stream.next_in = block + BGZF_HEADER_SIZE;
+        stream.avail_in = block_size - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+        stream.next_out = (unsigned char*) data;
+        stream.avail_out = BGZF_MAX_BLOCK_SIZE;
+        int status = inflate(&stream, Z_FINISH);
+        size_t data_len = stream.total_out;
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END) {
+            LOG_ERROR_F("Can't decompress block at offset %lld of file %s\n", offsets[i], filename);
+            num_lines = -1;
+            break;
+        }
+        data[data_len] = '\0';
+
+        // Write the lines in the region
+        for (char *current = data; current < data + data_len; ) {
+            char *newline = memchr(current, '\n', data + data_len - current);
+            size_t current_len = newline ? newline - current : data + data_len - current;
+            char *tab = memchr(current, '\t', current_len);
+            if (tab && tab - current == chromosome_len && !strncmp(current, chromosome, chromosome_len)) {
+                long position = strtol(tab + 1, NULL, 10);
+                if (position >= start && position <= end) {
+                    fwrite(current, 1, current_len, output);
+                    fputc('\n', output);
+                    num_lines++;
+                }
+            }
+            current += current_len + 1;
+        }
+    }
+
+    free(block);
+    free(data);
+    free(offsets);
+    fclose(file);
+    return num_lines;
+}
+
+
+/**
+ * Compresses some data into a BGZF block: a gzip member with the extra subfield BC, which holds
+ * the size of the whole block. Returns the size of the block, or zero if it could not be compressed.
+ */
+static size_t compress_bgzf_block(const char *data, size_t len, unsigned char *block) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+    stream.next_in = (unsigned char*) data;
+    stream.avail_in = len;
+    stream.next_out = block + BGZF_HEADER_SIZE;
+    stream.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+    int status = deflate(&stream, Z_FINISH);
+    size_t compressed_len = stream.total_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        return 0;
+    }
+
+    size_t block_size = BGZF_HEADER_SIZE + compressed_len + BGZF_FOOTER_SIZE;
+    const unsigned char header[BGZF_HEADER_SIZE] = { 0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 'B', 'C', 0x02, 0,
+                                                     (block_size - 1) & 0xff, ((block_size - 1) >> 8) & 0xff };
+    memcpy(block, header, BGZF_HEADER_SIZE);
+
+    unsigned long crc = crc32(crc32(0L, Z_NULL, 0), (unsigned char*) data, len);
+    unsigned char *footer = block + BGZF_HEADER_SIZE + compressed_len;
+    for (int i = 0; i < 4; i++) {
+        footer[i] = (crc >> (8 * i)) & 0xff;
+        footer[4 + i] = (len >> (8 * i)) & 0xff;
+    }
+
+    return block_size;
+}
+
+/**
+ * Adds an index entry for each run of lines of the same chromosome in a block. Lines that don't
+ * start with chromosome and position are not indexed. Returns the number of entries added.
+ */
+static int index_bgzf_block(const char *data, size_t len, int block, bgzf_index_entry_t **entries, int *num_entries, int *entries_capacity) {
+    int num_added = 0;
+    int current = -1;   // Index of the entry of the last run, which may be extended
+
+    for (const char *line = data; line < data + len; ) {
+        const char *newline = memchr(line, '\n', data + len - line);
+        size_t line_len = newline ? newline - line : data + len - line;
+        const char *tab = memchr(line, '\t', line_len);
+
+        char *position_end;
+        long position = tab ? strtol(tab + 1, &position_end, 10) : 0;
+        if (tab && position_end != tab + 1) {
+            int chromosome_len = tab - line;
+            bgzf_index_entry_t *entry = (current >= 0) ? *entries + current : NULL;
+            if (entry && entry->chromosome_len == chromosome_len && !strncmp(entry->chromosome, line, chromosome_len)) {
+                if (position < entry->start) { entry->start = position; }
+                if (position > entry->end) { entry->end = position; }
+            } else {
+                if (*num_entries == *entries_capacity) {
+                    *entries_capacity = *entries_capacity ? 2 * *entries_capacity : 16;
+                    *entries = realloc(*entries, *entries_capacity * sizeof(bgzf_index_entry_t));
+                }
+                current = (*num_entries)++;
+                (*entries)[current] = (bgzf_index_entry_t) { .chromosome = line, .chromosome_len = chromosome_len,
+                                                             .start = position, .end = position, .block = block };
+                num_added++;
+            }
+        }
+
+        line += line_len + 1;
+    }
+
+    return num_added;
+}
+
+static int compare_offsets(const void *a, const void *b) {
+    long long offset_a = *((const long long*) a), offset_b = *((const long long*) b);
+    return (offset_a > offset_b) - (offset_a < offset_b);
+}
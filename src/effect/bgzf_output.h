@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BGZF_OUTPUT_H
+#define BGZF_OUTPUT_H
+
+/**
+ * @file bgzf_output.h
+ * @brief BGZF-compressed output files with a coordinate index
+ *
+ * Lines are compressed in BGZF blocks (gzip members of at most 64 KB, readable by any gzip tool)
+ * by the thread that writes them, so several threads compress in parallel and only the write of
+ * the compressed blocks is serialized. Blocks never split a line.
+ *
+ * Files whose lines start with chromosome and position can be indexed. The index is a text file
+ * with the same name plus ".idx", with a line "chromosome\tstart\tend\toffset" for each run of
+ * lines of the same chromosome in a block, so a region is retrieved by decompressing only the
+ * blocks that overlap it, even if the lines are not sorted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+#include <zlib.h>
+
+#include <commons/log.h>
+
+/**
+ * Maximum uncompressed size of a block, so the compressed one never exceeds 64 KB.
+ */
+#define BGZF_BLOCK_SIZE         0xff00
+#define BGZF_MAX_BLOCK_SIZE     0x10000
+#define BGZF_HEADER_SIZE        18
+#define BGZF_FOOTER_SIZE        8
+
+#define BGZF_INDEX_EXTENSION    ".idx"
+
+typedef struct bgzf_file {
+    char *filename;
+    FILE *file;
+    FILE *index;        /**< Coordinate index, NULL if the file is not indexed. */
+    omp_lock_t lock;    /**< Held while the compressed blocks of a thread are written. */
+} bgzf_file_t;
+
+
+/**
+ * @brief Opens a compressed file for appending.
+ * @param filename name of the file
+ * @param indexed whether to index the lines by chromosome and position
+ * @return The file, or NULL if it can't be opened
+ */
+bgzf_file_t *bgzf_open(const char *filename, int indexed);
+
+/**
+ * @brief Compresses some lines in the calling thread, and appends them to a file.
+ * @param text complete lines, newline-terminated
+ * @param len length of the text
+ * @param file file to write to
+ * @return Zero if the lines were written, non-zero otherwise
+ */
+int bgzf_write_lines(const char *text, size_t len, bgzf_file_t *file);
+
+/**
+ * @brief Writes the end-of-file marker and closes a compressed file and its index.
+ */
+void bgzf_close(bgzf_file_t *file);
+
+/**
+ * @brief Writes the lines of an indexed file that belong to a region.
+ * @param filename name of the compressed file
+ * @param chromosome chromosome of the region
+ * @param start first position of the region
+ * @param end last position of the region
+ * @param output file to write the lines to
+ * @return The number of lines written, or -1 if the file or its index can't be read
+ */
+int bgzf_query_region(const char *filename, const char *chromosome, long start, long end, FILE *output);
+
+#endif
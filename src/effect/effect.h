@@ -43,13 +43,26 @@
 /**
  * Number of options applicable to the effect tool.
  */
-#define NUM_EFFECT_OPTIONS  2
+#define NUM_EFFECT_OPTIONS  10
+
+/**
+ * Sources the consequence types of the variants can be retrieved from.
+ */
+enum annotation_backend { WS_BACKEND, LOCAL_BACKEND };
 
 typedef struct effect_options {
     int num_options;
     
     struct arg_lit *no_phenotypes; /**< Flag asking not to retrieve phenotypical information. */
     struct arg_str *excludes; /**< Comma-separated consequence types to exclude from the query. */
+    struct arg_str *cache_directory; /**< Directory where the annotations retrieved from the web services are cached. */
+    struct arg_lit *no_cache; /**< Flag asking not to use the annotations cache. */
+    struct arg_int *max_requests; /**< Maximum number of requests to the web services in flight at the same time. */
+    struct arg_str *annotation_backend; /**< Source of the consequence types: web services (ws) or a local gene model (local). */
+    struct arg_file *gene_model_filename; /**< GFF file with the genes and transcripts used by the local backend. */
+    struct arg_lit *resume; /**< Flag asking to resume an interrupted run from its last checkpoint. */
+    struct arg_lit *redrive_errors; /**< Flag asking to annotate only the variants that failed in a previous run. */
+    struct arg_lit *compress_output; /**< Flag asking to write the annotations BGZF-compressed and indexed. */
 } effect_options_t;
 
 /**
@@ -61,6 +74,13 @@ typedef struct effect_options {
 typedef struct effect_options_data {
     int no_phenotypes;  /**< Flag asking not to retrieve phenotypical information. */
     char *excludes;     /**< Comma-separated consequence types to exclude from the query. */
+    char *cache_directory;  /**< Directory where the annotations are cached, NULL if the cache is disabled. */
+    int max_requests;   /**< Maximum number of requests to the web services in flight at the same time. */
+    enum annotation_backend annotation_backend; /**< Source of the consequence types. */
+    char *gene_model_filename;  /**< GFF file with the genes and transcripts used by the local backend. */
+    int resume;         /**< Flag asking to resume an interrupted run from its last checkpoint. */
+    int redrive_errors; /**< Flag asking to annotate only the variants that failed in a previous run. */
+    int compress_output;    /**< Flag asking to write the annotations BGZF-compressed and indexed. */
 } effect_options_data_t;
 
 
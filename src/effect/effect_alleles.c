@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "effect_alleles.h"
+
+static int is_symbolic_allele(const char *allele, int allele_len);
+static char *compose_line_allele_key(const char *line, size_t line_len);
+static void append_allele_lines(const char *lines, size_t lines_len, queried_allele_t *queried);
+static allele_waiter_t *release_waiters(queried_allele_t *queried, allele_waiter_t *released);
+
+
+array_list_t *split_alleles(array_list_t *records) {
+    array_list_t *alleles = array_list_new(records->size + 1, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+
+    for (int i = 0; i < records->size; i++) {
+        vcf_record_t *record = records->items[i];
+        int allele_start = 0;
+        for (int j = 0; j <= record->alternate_len; j++) {
+            if (j < record->alternate_len && record->alternate[j] != ',') {
+                continue;
+            }
+
+            vcf_record_t *allele = (vcf_record_t*) malloc (sizeof(vcf_record_t));
+            memcpy(allele, record, sizeof(vcf_record_t));
+            allele->alternate = record->alternate + allele_start;
+            allele->alternate_len = j - allele_start;
+
+            long position = record->position;
+            normalise_allele(&position, &(allele->reference), &(allele->reference_len),
+                             &(allele->alternate), &(allele->alternate_len));
+            allele->position = position;
+
+            array_list_insert(allele, alleles);
+            allele_start = j + 1;
+        }
+    }
+
+    return alleles;
+}
+
+void normalise_allele(long *position, char **reference, int *reference_len, char **alternate, int *alternate_len) {
+    if (is_symbolic_allele(*alternate, *alternate_len)) {
+        return;
+    }
+
+    while (*reference_len > 1 && *alternate_len > 1 &&
+           (*reference)[*reference_len - 1] == (*alternate)[*alternate_len - 1]) {
+        (*reference_len)--;
+        (*alternate_len)--;
+    }
+
+    while (*reference_len > 1 && *alternate_len > 1 && **reference == **alternate) {
+        (*reference)++;
+        (*reference_len)--;
+        (*alternate)++;
+        (*alternate_len)--;
+        (*position)++;
+    }
+}
+
+char *compose_allele_key(vcf_record_t *allele) {
+    size_t key_len = allele->chromosome_len + allele->reference_len + allele->alternate_len + 24;
+    char *key = (char*) malloc (key_len * sizeof(char));
+    snprintf(key, key_len, "%.*s:%ld:%.*s:%.*s",
+             allele->chromosome_len, allele->chromosome, (long) allele->position,
+             allele->reference_len, allele->reference, allele->alternate_len, allele->alternate);
+    return key;
+}
+
+queried_alleles_t *queried_alleles_new(void) {
+    queried_alleles_t *queried_alleles = (queried_alleles_t*) malloc (sizeof(queried_alleles_t));
+    queried_alleles->alleles = kh_init(queried_alleles);
+    omp_init_lock(&(queried_alleles->lock));
+    return queried_alleles;
+}
+
+void queried_alleles_free(queried_alleles_t *queried_alleles) {
+    khash_t(queried_alleles) *alleles = queried_alleles->alleles;
+    for (khiter_t iter = kh_begin(alleles); iter != kh_end(alleles); iter++) {
+        if (kh_exist(alleles, iter)) {
+            queried_allele_t *queried = kh_value(alleles, iter);
+            assert(!queried->waiters);
+            free(queried->lines);
+            free(queried);
+            free((char*) kh_key(alleles, iter));
+        }
+    }
+    kh_destroy(queried_alleles, alleles);
+    omp_destroy_lock(&(queried_alleles->lock));
+    free(queried_alleles);
+}
+
+int claim_queried_alleles(array_list_t *alleles, void *owner, queried_alleles_t *queried_alleles,
+                          array_list_t *requested_alleles, char **annotated_lines) {
+    size_t lines_len = 0, lines_capacity = 0;
+    int num_waiting = 0, ret;
+    *annotated_lines = NULL;
+
+    omp_set_lock(&(queried_alleles->lock));
+    for (int i = 0; i < alleles->size; i++) {
+        vcf_record_t *allele = alleles->items[i];
+        char *key = compose_allele_key(allele);
+        khiter_t iter = kh_put(queried_alleles, queried_alleles->alleles, key, &ret);
+        if (ret != 0) {
+            kh_value(queried_alleles->alleles, iter) = (queried_allele_t*) calloc (1, sizeof(queried_allele_t));
+        } else {
+            free(key);
+        }
+        queried_allele_t *queried = kh_value(queried_alleles->alleles, iter);
+
+        if (ret != 0 || queried->state == ALLELE_FAILED) {
+            // First occurrence, or the previous request failed: requested again from scratch
+            queried->state = ALLELE_QUERIED;
+            queried->lines_len = 0;
+            if (queried->lines) {
+                queried->lines[0] = '\0';
+            }
+            array_list_insert(allele, requested_alleles);
+        } else if (queried->state == ALLELE_ANNOTATED) {
+            if (lines_len + queried->lines_len + 1 > lines_capacity) {
+                lines_capacity = 2 * (lines_len + queried->lines_len + 1);
+                *annotated_lines = realloc(*annotated_lines, lines_capacity);
+            }
+            memcpy(*annotated_lines + lines_len, queried->lines, queried->lines_len);
+            lines_len += queried->lines_len;
+            (*annotated_lines)[lines_len] = '\0';
+        } else {
+            allele_waiter_t *waiter = (allele_waiter_t*) malloc (sizeof(allele_waiter_t));
+            *waiter = (allele_waiter_t) { .allele = allele, .owner = owner, .lines = NULL, .next = queried->waiters };
+            queried->waiters = waiter;
+            num_waiting++;
+        }
+    }
+    omp_unset_lock(&(queried_alleles->lock));
+
+    return num_waiting;
+}
+
+allele_waiter_t *annotate_queried_alleles(vcf_record_t **alleles, int num_alleles, const char *response,
+                                          queried_alleles_t *queried_alleles) {
+    allele_waiter_t *released = NULL;
+
+    omp_set_lock(&(queried_alleles->lock));
+
+    // Assign each line to the allele it starts with, as long as it is still being annotated
+    const char *line = response;
+    while (line && *line) {
+        const char *line_end = strchr(line, '\n');
+        size_t line_len = line_end ? line_end - line : strlen(line);
+
+        char *key = compose_line_allele_key(line, line_len);
+        if (key) {
+            khiter_t iter = kh_get(queried_alleles, queried_alleles->alleles, key);
+            if (iter != kh_end(queried_alleles->alleles) && kh_value(queried_alleles->alleles, iter)->state == ALLELE_QUERIED) {
+                append_allele_lines(line, line_len, kh_value(queried_alleles->alleles, iter));
+            }
+            free(key);
+        }
+
+        line = line_end ? line_end + 1 : NULL;
+    }
+
+    for (int i = 0; i < num_alleles; i++) {
+        char *key = compose_allele_key(alleles[i]);
+        khiter_t iter = kh_get(queried_alleles, queried_alleles->alleles, key);
+        free(key);
+        if (iter == kh_end(queried_alleles->alleles)) {
+            continue;
+        }
+
+        // An allele whose other requests failed meanwhile is not annotated, it will be requested again
+        queried_allele_t *queried = kh_value(queried_alleles->alleles, iter);
+        if (queried->state == ALLELE_QUERIED) {
+            queried->state = ALLELE_ANNOTATED;
+            if (!queried->lines) {
+                append_allele_lines("", 0, queried);
+            }
+            released = release_waiters(queried, released);
+        }
+    }
+
+    omp_unset_lock(&(queried_alleles->lock));
+
+    return released;
+}
+
+allele_waiter_t *fail_queried_alleles(vcf_record_t **alleles, int num_alleles, queried_alleles_t *queried_alleles) {
+    allele_waiter_t *released = NULL;
+
+    omp_set_lock(&(queried_alleles->lock));
+    for (int i = 0; i < num_alleles; i++) {
+        char *key = compose_allele_key(alleles[i]);
+        khiter_t iter = kh_get(queried_alleles, queried_alleles->alleles, key);
+        free(key);
+        if (iter == kh_end(queried_alleles->alleles)) {
+            continue;
+        }
+
+        // An allele annotated by the consequence type web service keeps its lines
+        queried_allele_t *queried = kh_value(queried_alleles->alleles, iter);
+        if (queried->state == ALLELE_QUERIED) {
+            queried->state = ALLELE_FAILED;
+            released = release_waiters(queried, released);
+        }
+    }
+    omp_unset_lock(&(queried_alleles->lock));
+
+    return released;
+}
+
+int record_has_allele(vcf_record_t *record, khash_t(allele_keys) *keys) {
+    int found = 0;
+    int allele_start = 0;
+
+    for (int j = 0; j <= record->alternate_len && !found; j++) {
+        if (j < record->alternate_len && record->alternate[j] != ',') {
+            continue;
+        }
+
+        vcf_record_t allele = *record;
+        allele.alternate = record->alternate + allele_start;
+        allele.alternate_len = j - allele_start;
+        long position = record->position;
+        normalise_allele(&position, &(allele.reference), &(allele.reference_len), &(allele.alternate), &(allele.alternate_len));
+        allele.position = position;
+
+        char *key = compose_allele_key(&allele);
+        found = kh_get(allele_keys, keys, key) != kh_end(keys);
+        free(key);
+        allele_start = j + 1;
+    }
+
+    return found;
+}
+
+
+/**
+ * Symbolic (<DEL>), breakend (A[1:100[), spanning deletion (*) and missing (.) alleles can't be trimmed.
+ */
+static int is_symbolic_allele(const char *allele, int allele_len) {
+    if (allele_len == 0 || *allele == '<' || *allele == '*' || *allele == '.') {
+        return 1;
+    }
+    for (int i = 0; i < allele_len; i++) {
+        if (allele[i] == '[' || allele[i] == ']') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Composes the key of the allele a consequence type line belongs to, joining its first four columns
+ * (chromosome, position, reference and alternate) with ':'. Returns NULL if the line is shorter.
+ */
+static char *compose_line_allele_key(const char *line, size_t line_len) {
+    char *key = strndup(line, line_len);
+    int num_columns = 1;
+    for (char *c = key; *c; c++) {
+        if (*c == '\t') {
+            if (num_columns == 4) {
+                *c = '\0';
+                return key;
+            }
+            *c = ':';
+            num_columns++;
+        }
+    }
+
+    if (num_columns < 4) {
+        free(key);
+        return NULL;
+    }
+    return key;
+}
+
+static void append_allele_lines(const char *lines, size_t lines_len, queried_allele_t *queried) {
+    if (queried->lines_len + lines_len + 2 > queried->lines_capacity) {
+        queried->lines_capacity = 2 * (queried->lines_len + lines_len + 2);
+        queried->lines = realloc(queried->lines, queried->lines_capacity);
+    }
+    memcpy(queried->lines + queried->lines_len, lines, lines_len);
+    queried->lines_len += lines_len;
+    if (lines_len > 0) {
+        queried->lines[queried->lines_len++] = '\n';
+    }
+    queried->lines[queried->lines_len] = '\0';
+}
+
+/**
+ * Moves the waiters of an allele to a list of released ones, giving them its lines if it was annotated.
+ */
+static allele_waiter_t *release_waiters(queried_allele_t *queried, allele_waiter_t *released) {
+    while (queried->waiters) {
+        allele_waiter_t *waiter = queried->waiters;
+        queried->waiters = waiter->next;
+        waiter->lines = (queried->state == ALLELE_ANNOTATED) ? queried->lines : NULL;
+        waiter->next = released;
+        released = waiter;
+    }
+    return released;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EFFECT_ALLELES_H
+#define EFFECT_ALLELES_H
+
+/**
+ * @file effect_alleles.h
+ * @brief Normalisation and deduplication of the alleles sent to the effect web services
+ *
+ * Each record that passed the filters is split into one allele per alternate, and every allele is
+ * trimmed to its minimal representation. Alleles are identified by chromosome:position:reference:alternate,
+ * and only the first occurrence of each one in the whole run is annotated. The consequence type lines
+ * returned for it are kept, and written again for every later occurrence of the allele, which waits
+ * for them while the first one is still being annotated.
+ *
+ * Alleles are shallow copies of their records: they point to the same text, so they must be freed
+ * with free() before the records they were created from.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <commons/log.h>
+#include <containers/array_list.h>
+#include <containers/khash.h>
+
+KHASH_SET_INIT_STR(allele_keys);
+
+enum queried_allele_state { ALLELE_QUERIED, ALLELE_ANNOTATED, ALLELE_FAILED };
+
+/**
+ * @brief Occurrence of an allele that waits for the annotation of the first one.
+ */
+typedef struct allele_waiter {
+    vcf_record_t *allele;           /**< Allele that was not requested. */
+    void *owner;                    /**< Batch the allele belongs to, which must be kept until it is annotated. */
+    const char *lines;              /**< Lines of the annotation once released, NULL if its request failed. */
+    struct allele_waiter *next;
+} allele_waiter_t;
+
+/**
+ * @brief State of an allele queried in the run.
+ */
+typedef struct queried_allele {
+    enum queried_allele_state state;
+    char *lines;                    /**< Consequence type lines returned for the allele, null-terminated. */
+    size_t lines_len;
+    size_t lines_capacity;
+    allele_waiter_t *waiters;       /**< Later occurrences waiting while the allele is queried. */
+} queried_allele_t;
+
+KHASH_MAP_INIT_STR(queried_alleles, queried_allele_t*);
+
+/**
+ * @brief Alleles queried in a run, indexed by their key.
+ *
+ * It is shared by the thread that composes the requests, which claims the alleles, and the ones that
+ * parse the responses, which annotate them or mark them as failed. Every function works holding the
+ * lock, so checking whether an allele was queried and registering it is a single step.
+ */
+typedef struct queried_alleles {
+    khash_t(queried_alleles) *alleles;
+    omp_lock_t lock;
+} queried_alleles_t;
+
+/**
+ * @brief Splits a list of records into their alternate alleles, normalising each of them.
+ * @param records records to split
+ * @return A new list with an allele per alternate of each record, in the same order
+ */
+array_list_t *split_alleles(array_list_t *records);
+
+/**
+ * @brief Trims the bases shared by the reference and alternate alleles.
+ *
+ * The common suffix is removed first, and then the common prefix, updating the position accordingly.
+ * One base is always kept in both alleles, so indels keep their anchor base as in VCF. Symbolic
+ * alleles are not modified.
+ */
+void normalise_allele(long *position, char **reference, int *reference_len, char **alternate, int *alternate_len);
+
+/**
+ * @brief Composes the chromosome:position:reference:alternate key of an allele.
+ */
+char *compose_allele_key(vcf_record_t *allele);
+
+queried_alleles_t *queried_alleles_new(void);
+
+/**
+ * @brief Frees the alleles queried in a run, which must have no waiters left.
+ */
+void queried_alleles_free(queried_alleles_t *queried_alleles);
+
+/**
+ * @brief Classifies the alleles of a batch by whether they were queried before in the run.
+ *
+ * Alleles never queried, or whose request failed, are registered and must be requested. Alleles
+ * already annotated get the lines of the first occurrence. Alleles still being annotated wait for
+ * them, with the batch they belong to as owner, until annotate_queried_alleles or fail_queried_alleles
+ * release them.
+ *
+ * @param alleles alleles to classify, which are not modified
+ * @param owner batch the alleles belong to
+ * @param queried_alleles alleles queried in the run
+ * @param[out] requested_alleles list the alleles that must be requested are inserted into
+ * @param[out] annotated_lines lines of the alleles already annotated, to be freed by the caller, NULL if none
+ * @return The number of alleles that wait for an annotation in progress
+ */
+int claim_queried_alleles(array_list_t *alleles, void *owner, queried_alleles_t *queried_alleles,
+                          array_list_t *requested_alleles, char **annotated_lines);
+
+/**
+ * @brief Stores the consequence type lines returned for some alleles, and marks them as annotated.
+ *
+ * Each line is assigned to the allele in its first columns (chromosome, position, reference and
+ * alternate), so the response of a request can be given as is.
+ *
+ * @param alleles alleles requested
+ * @param num_alleles number of alleles requested
+ * @param response lines returned for them
+ * @param queried_alleles alleles queried in the run
+ * @return The occurrences that were waiting for these alleles, with their lines, to be freed by the caller
+ */
+allele_waiter_t *annotate_queried_alleles(vcf_record_t **alleles, int num_alleles, const char *response,
+                                          queried_alleles_t *queried_alleles);
+
+/**
+ * @brief Marks some alleles as failed, so they are requested again if found later in the run.
+ * @return The occurrences that were waiting for these alleles, without lines, to be freed by the caller
+ */
+allele_waiter_t *fail_queried_alleles(vcf_record_t **alleles, int num_alleles, queried_alleles_t *queried_alleles);
+
+/**
+ * @brief Returns whether any of the alleles of a record is in a set of keys.
+ */
+int record_has_allele(vcf_record_t *record, khash_t(allele_keys) *keys);
+
+#endif
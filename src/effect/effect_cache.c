@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "effect_cache.h"
+
+KHASH_MAP_INIT_STR(cache_slots, int);
+
+static const char *source_names[NUM_CACHE_SOURCES] = { "consequence type", "SNP phenotype", "mutation phenotype" };
+
+static size_t index_cache_file(const char *contents, size_t contents_len, khash_t(cache_entries) *entries);
+static int insert_cache_entry(char *key, char *lines, size_t lines_len, effect_cache_t *cache);
+static int add_attribution_keys(enum effect_cache_source source, vcf_record_t *record, int slot, khash_t(cache_slots) *slots);
+static char *compose_line_key(enum effect_cache_source source, const char *line, size_t line_len);
+
+
+effect_cache_t *effect_cache_open(const char *directory, const char *species, const char *version, const char *excludes) {
+    effect_cache_t *cache = (effect_cache_t*) calloc (1, sizeof(effect_cache_t));
+    cache->entries = kh_init(cache_entries);
+    omp_init_lock(&(cache->lock));
+
+    if (directory == NULL) {
+        // The cache only lives in memory
+        return cache;
+    }
+
+    int ret_code = create_directory(directory);
+    if (ret_code != 0 && errno != EEXIST) {
+        LOG_ERROR_F("Can't create annotation cache directory: %s\n", directory);
+        effect_cache_close(cache);
+        return NULL;
+    }
+
+    // The excluded consequence types modify the responses, so they are part of the filename
+    unsigned long excludes_hash = 5381;
+    for (const char *c = excludes; c && *c; c++) {
+        excludes_hash = ((excludes_hash << 5) + excludes_hash) + *c;
+    }
+
+    cache->filename = (char*) calloc (strlen(directory) + strlen(species) + strlen(version) + 32, sizeof(char));
+    if (excludes && strlen(excludes) > 0) {
+        sprintf(cache->filename, "%s/%s_%s_%08lx.cache", directory, species, version, excludes_hash & 0xFFFFFFFF);
+    } else {
+        sprintf(cache->filename, "%s/%s_%s.cache", directory, species, version);
+    }
+
+    int fd = open(cache->filename, O_RDWR | O_CREAT, 0644);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        LOG_ERROR_F("Can't open annotation cache file: %s\n", cache->filename);
+        if (fd >= 0) { close(fd); }
+        effect_cache_close(cache);
+        return NULL;
+    }
+
+    // Map previous contents to memory and index them
+    size_t valid_len = 0;
+    if (file_stat.st_size > 0) {
+        cache->mapped = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (cache->mapped == MAP_FAILED) {
+            LOG_ERROR_F("Can't map annotation cache file to memory: %s\n", cache->filename);
+            cache->mapped = NULL;
+            close(fd);
+            effect_cache_close(cache);
+            return NULL;
+        }
+        cache->mapped_len = file_stat.st_size;
+        valid_len = index_cache_file(cache->mapped, cache->mapped_len, cache->entries);
+
+        if (valid_len == 0) {
+            LOG_WARN_F("Annotation cache file %s is not valid and will be overwritten\n", cache->filename);
+        } else if (valid_len < cache->mapped_len) {
+            LOG_WARN_F("Annotation cache file %s ends with an incomplete entry that will be discarded\n", cache->filename);
+        }
+    }
+
+    // Discard incomplete entries, so new ones are appended right after the last valid one
+    if (valid_len < (size_t) file_stat.st_size && ftruncate(fd, valid_len) != 0) {
+        LOG_ERROR_F("Can't truncate annotation cache file: %s\n", cache->filename);
+    }
+    close(fd);
+
+    cache->append_file = fopen(cache->filename, "a");
+    if (!cache->append_file) {
+        LOG_ERROR_F("Can't write to annotation cache file: %s\n", cache->filename);
+        effect_cache_close(cache);
+        return NULL;
+    }
+    if (valid_len == 0) {
+        fputs(EFFECT_CACHE_MAGIC, cache->append_file);
+    }
+
+    LOG_INFO_F("Annotation cache %s opened with %u entries\n", cache->filename, kh_size(cache->entries));
+
+    return cache;
+}
+
+void effect_cache_close(effect_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < NUM_CACHE_SOURCES; i++) {
+        if (cache->hits[i] + cache->misses[i] > 0) {
+            LOG_INFO_F("Annotation cache (%s): %zu hits, %zu misses, %zu new entries\n",
+                       source_names[i], cache->hits[i], cache->misses[i], cache->stored[i]);
+        }
+    }
+
+    if (cache->append_file) {
+        fclose(cache->append_file);
+    }
+
+    for (khiter_t iter = kh_begin(cache->entries); iter != kh_end(cache->entries); iter++) {
+        if (kh_exist(cache->entries, iter)) {
+            effect_cache_entry_t entry = kh_value(cache->entries, iter);
+            if (entry.owned) {
+                free((char*) entry.lines);
+            }
+            free((char*) kh_key(cache->entries, iter));
+        }
+    }
+    kh_destroy(cache_entries, cache->entries);
+
+    if (cache->mapped) {
+        munmap(cache->mapped, cache->mapped_len);
+    }
+
+    omp_destroy_lock(&(cache->lock));
+    free(cache->filename);
+    free(cache);
+}
+
+int effect_cache_lookup(enum effect_cache_source source, vcf_record_t *record, effect_cache_t *cache,
+                        const char **lines, size_t *lines_len) {
+    char *key = compose_effect_cache_key(source, record);
+    int found = 0;
+
+    omp_set_lock(&(cache->lock));
+    khiter_t iter = kh_get(cache_entries, cache->entries, key);
+    if (iter != kh_end(cache->entries)) {
+        effect_cache_entry_t entry = kh_value(cache->entries, iter);
+        *lines = entry.lines;
+        *lines_len = entry.len;
+        cache->hits[source]++;
+        found = 1;
+    } else {
+        cache->misses[source]++;
+    }
+    omp_unset_lock(&(cache->lock));
+
+    free(key);
+    return found;
+}
+
+int effect_cache_store_response(enum effect_cache_source source, vcf_record_t **records, int num_records,
+                                const char *response, effect_cache_t *cache) {
+    if (cache == NULL || num_records <= 0) {
+        return 0;
+    }
+
+    // A slot per distinct variant, and the keys that allow to assign a line to each slot
+    khash_t(cache_slots) *slots_by_key = kh_init(cache_slots);
+    khash_t(cache_slots) *slots_by_line_key = kh_init(cache_slots);
+    char **slot_keys = (char**) calloc (num_records, sizeof(char*));
+    char **slot_lines = (char**) calloc (num_records, sizeof(char*));
+    size_t *slot_len = (size_t*) calloc (num_records, sizeof(size_t));
+    size_t *slot_capacity = (size_t*) calloc (num_records, sizeof(size_t));
+    int num_slots = 0, ret;
+
+    for (int i = 0; i < num_records; i++) {
+        char *key = compose_effect_cache_key(source, records[i]);
+        khiter_t iter = kh_put(cache_slots, slots_by_key, key, &ret);
+        if (ret == 0) {
+            free(key);  // Repeated variant
+        } else {
+            kh_value(slots_by_key, iter) = num_slots;
+            slot_keys[num_slots] = key;
+            add_attribution_keys(source, records[i], num_slots, slots_by_line_key);
+            num_slots++;
+        }
+    }
+
+    // Assign each line of the response to a variant
+    int all_assigned = 1;
+    const char *line = response;
+    while (line && *line) {
+        const char *line_end = strchr(line, '\n');
+        size_t line_len = line_end ? line_end - line : strlen(line);
+
+        // Skip blank lines and comments, they are not part of any annotation
+        size_t first_char = strspn(line, " \t\r");
+        if (first_char < line_len && line[first_char] != '#') {
+            char *line_key = compose_line_key(source, line, line_len);
+            khiter_t iter = line_key ? kh_get(cache_slots, slots_by_line_key, line_key) : kh_end(slots_by_line_key);
+            free(line_key);
+
+            if (iter == kh_end(slots_by_line_key) || kh_value(slots_by_line_key, iter) < 0) {
+                LOG_DEBUG_F("Line '%.*s' can't be assigned to a single variant, response not cached\n", (int) line_len, line);
+                all_assigned = 0;
+                break;
+            }
+
+            int slot = kh_value(slots_by_line_key, iter);
+            if (slot_len[slot] + line_len + 2 > slot_capacity[slot]) {
+                slot_capacity[slot] = 2 * (slot_len[slot] + line_len + 2);
+                slot_lines[slot] = realloc(slot_lines[slot], slot_capacity[slot]);
+            }
+            memcpy(slot_lines[slot] + slot_len[slot], line, line_len);
+            slot_len[slot] += line_len;
+            slot_lines[slot][slot_len[slot]++] = '\n';
+        }
+
+        line = line_end ? line_end + 1 : NULL;
+    }
+
+    int num_stored = 0;
+    if (all_assigned) {
+        omp_set_lock(&(cache->lock));
+        for (int i = 0; i < num_slots; i++) {
+            if (insert_cache_entry(slot_keys[i], slot_lines[i], slot_len[i], cache)) {
+                slot_keys[i] = slot_lines[i] = NULL;  // Now owned by the cache
+                num_stored++;
+            }
+        }
+        cache->stored[source] += num_stored;
+        if (cache->append_file) {
+            fflush(cache->append_file);
+        }
+        omp_unset_lock(&(cache->lock));
+    } else {
+        num_stored = -1;
+    }
+
+    for (int i = 0; i < num_slots; i++) {
+        free(slot_keys[i]);
+        free(slot_lines[i]);
+    }
+    for (khiter_t iter = kh_begin(slots_by_line_key); iter != kh_end(slots_by_line_key); iter++) {
+        if (kh_exist(slots_by_line_key, iter)) {
+            free((char*) kh_key(slots_by_line_key, iter));
+        }
+    }
+    kh_destroy(cache_slots, slots_by_key);
+    kh_destroy(cache_slots, slots_by_line_key);
+    free(slot_keys);
+    free(slot_lines);
+    free(slot_len);
+    free(slot_capacity);
+
+    return num_stored;
+}
+
+
+/* **********************************************
+ *                  Key management              *
+ * **********************************************/
+
+char *compose_effect_cache_key(enum effect_cache_source source, vcf_record_t *record) {
+    size_t key_len = record->chromosome_len + record->reference_len + record->alternate_len + 32;
+    char *key = (char*) malloc (key_len * sizeof(char));
+    snprintf(key, key_len, "%d|%.*s:%ld:%.*s:%.*s", source,
+             record->chromosome_len, record->chromosome, (long) record->position,
+             record->reference_len, record->reference, record->alternate_len, record->alternate);
+    return key;
+}
+
+/**
+ * Registers the keys that identify the lines of a web service response belonging to a variant:
+ * chromosome, position, reference and each alternate allele for the consequence type WS, the SNP
+ * ID for the SNP phenotype WS, and chromosome and position for the mutation phenotype WS. A key
+ * shared by several variants is marked as ambiguous.
+ */
+static int add_attribution_keys(enum effect_cache_source source, vcf_record_t *record, int slot, khash_t(cache_slots) *slots) {
+    char *keys[record->alternate_len + 2];
+    int num_keys = 0, ret;
+
+    if (source == CONSEQUENCE_TYPE_CACHE) {
+        int allele_start = 0;
+        for (int i = 0; i <= record->alternate_len; i++) {
+            if (i == record->alternate_len || record->alternate[i] == ',') {
+                size_t key_len = record->chromosome_len + record->reference_len + (i - allele_start) + 24;
+                keys[num_keys] = (char*) malloc (key_len * sizeof(char));
+                snprintf(keys[num_keys], key_len, "%.*s:%ld:%.*s:%.*s",
+                         record->chromosome_len, record->chromosome, (long) record->position,
+                         record->reference_len, record->reference, i - allele_start, record->alternate + allele_start);
+                num_keys++;
+                allele_start = i + 1;
+            }
+        }
+    } else if (source == SNP_PHENOTYPE_CACHE) {
+        if (record->id_len > 0 && strncmp(record->id, ".", record->id_len)) {
+            keys[num_keys++] = strndup(record->id, record->id_len);
+        }
+    } else {
+        size_t key_len = record->chromosome_len + 24;
+        keys[num_keys] = (char*) malloc (key_len * sizeof(char));
+        snprintf(keys[num_keys], key_len, "%.*s:%ld", record->chromosome_len, record->chromosome, (long) record->position);
+        num_keys++;
+    }
+
+    for (int i = 0; i < num_keys; i++) {
+        khiter_t iter = kh_put(cache_slots, slots, keys[i], &ret);
+        if (ret == 0) {
+            if (kh_value(slots, iter) != slot) {
+                kh_value(slots, iter) = -1;
+            }
+            free(keys[i]);
+        } else {
+            kh_value(slots, iter) = slot;
+        }
+    }
+
+    return num_keys;
+}
+
+/**
+ * Composes the key that identifies the variant a line of a web service response belongs to, joining
+ * its first columns with ':'. Returns NULL if the line has not enough columns.
+ */
+static char *compose_line_key(enum effect_cache_source source, const char *line, size_t line_len) {
+    int num_columns = (source == CONSEQUENCE_TYPE_CACHE) ? 4 : (source == SNP_PHENOTYPE_CACHE) ? 1 : 2;
+    char *key = strndup(line, line_len);
+
+    int columns_found = 1;
+    for (char *c = key; *c; c++) {
+        if (*c == '\t') {
+            if (columns_found == num_columns) {
+                *c = '\0';
+                break;
+            }
+            *c = ':';
+            columns_found++;
+        }
+    }
+
+    if (columns_found < num_columns) {
+        free(key);
+        return NULL;
+    }
+    return key;
+}
+
+
+/* **********************************************
+ *                  File management             *
+ * **********************************************/
+
+/**
+ * Indexes the entries in the contents of a cache file. Each entry is stored as a header line
+ * "key\tlength\n" followed by the raw lines returned by the web service. Returns the length of
+ * the valid contents, or zero if the file doesn't start with the expected magic string.
+ */
+static size_t index_cache_file(const char *contents, size_t contents_len, khash_t(cache_entries) *entries) {
+    size_t magic_len = strlen(EFFECT_CACHE_MAGIC);
+    if (contents_len < magic_len || strncmp(contents, EFFECT_CACHE_MAGIC, magic_len)) {
+        return 0;
+    }
+
+    const char *current = contents + magic_len;
+    const char *end = contents + contents_len;
+    int ret;
+
+    while (current < end) {
+        const char *header_end = memchr(current, '\n', end - current);
+        if (!header_end) {
+            break;
+        }
+        const char *separator = memrchr(current, '\t', header_end - current);
+        if (!separator) {
+            break;
+        }
+
+        size_t lines_len = strtoull(separator + 1, NULL, 10);
+        const char *lines = header_end + 1;
+        if (lines + lines_len > end) {
+            break;
+        }
+
+        char *key = strndup(current, separator - current);
+        khiter_t iter = kh_put(cache_entries, entries, key, &ret);
+        if (ret == 0) {
+            free(key);
+        }
+        kh_value(entries, iter) = (effect_cache_entry_t) { .lines = lines, .len = lines_len, .owned = 0 };
+
+        current = lines + lines_len;
+    }
+
+    return current - contents;
+}
+
+/**
+ * Inserts an entry in the index and appends it to the cache file. Must be called holding the
+ * cache lock. Returns whether the entry was inserted, taking ownership of the key and lines.
+ */
+static int insert_cache_entry(char *key, char *lines, size_t lines_len, effect_cache_t *cache) {
+    int ret;
+    khiter_t iter = kh_put(cache_entries, cache->entries, key, &ret);
+    if (ret == 0) {
+        return 0;   // Already stored, maybe by another thread
+    }
+    kh_value(cache->entries, iter) = (effect_cache_entry_t) { .lines = lines ? lines : "", .len = lines_len, .owned = lines != NULL };
+
+    if (cache->append_file) {
+        fprintf(cache->append_file, "%s\t%zu\n", key, lines_len);
+        if (lines_len > 0) {
+            fwrite(lines, sizeof(char), lines_len, cache->append_file);
+        }
+    }
+
+    return 1;
+}
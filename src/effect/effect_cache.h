@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EFFECT_CACHE_H
+#define EFFECT_CACHE_H
+
+/**
+ * @file effect_cache.h
+ * @brief Persistent cache of the annotations retrieved from the effect web services
+ *
+ * This file declares an on-disk cache that stores the raw lines returned by the consequence type,
+ * SNP phenotype and mutation phenotype web services, keyed by the variant they belong to
+ * (chromosome:position:reference:alternate). The cache file is memory-mapped when opened, so
+ * annotations from previous runs are available without querying the web services again, and new
+ * responses are appended to it as they arrive.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <commons/file_utils.h>
+#include <commons/log.h>
+#include <containers/khash.h>
+
+#define EFFECT_CACHE_MAGIC      "#hpg-variant effect cache v1\n"
+
+/**
+ * Web services whose responses can be stored in the cache.
+ */
+enum effect_cache_source { CONSEQUENCE_TYPE_CACHE, SNP_PHENOTYPE_CACHE, MUTATION_PHENOTYPE_CACHE, NUM_CACHE_SOURCES };
+
+/**
+ * @brief Lines associated to a variant in the cache.
+ *
+ * The lines point either to the memory-mapped file or, for entries added in this run, to a buffer
+ * owned by the cache. An empty entry (length zero) means the web service returned nothing for
+ * the variant, which is also worth remembering.
+ */
+typedef struct effect_cache_entry {
+    const char *lines;  /**< Raw lines returned by the web service, each ending with a newline. */
+    size_t len;         /**< Length of the lines. */
+    int owned;          /**< Whether the lines must be freed when the cache is closed. */
+} effect_cache_entry_t;
+
+KHASH_MAP_INIT_STR(cache_entries, effect_cache_entry_t);
+
+typedef struct effect_cache {
+    char *filename;                 /**< Path to the cache file, NULL if the cache lives only in memory. */
+    char *mapped;                   /**< Contents of the cache file when it was opened. */
+    size_t mapped_len;              /**< Length of the memory-mapped contents. */
+    FILE *append_file;              /**< Descriptor new entries are appended to. */
+
+    khash_t(cache_entries) *entries; /**< Index from variant key to the lines returned for it. */
+
+    size_t hits[NUM_CACHE_SOURCES];     /**< Lookups that found a variant in the cache. */
+    size_t misses[NUM_CACHE_SOURCES];   /**< Lookups that had to be forwarded to the web service. */
+    size_t stored[NUM_CACHE_SOURCES];   /**< Entries added to the cache in this run. */
+
+    omp_lock_t lock;
+} effect_cache_t;
+
+
+/**
+ * @brief Opens the annotation cache for a species and version of the web service.
+ * @param directory folder where the cache files are stored, NULL for a cache that only lives in memory
+ * @param species species the annotations refer to
+ * @param version version of the web service the annotations were retrieved from
+ * @param excludes consequence types excluded from the query, which change the contents of the responses
+ * @return The cache, or NULL if it could not be created
+ *
+ * Opens (or creates) the file <directory>/<species>_<version>[_<excludes hash>].cache, maps it to
+ * memory and indexes all the entries it contains. A truncated entry at the end of the file, left
+ * by an interrupted run, is discarded.
+ */
+effect_cache_t *effect_cache_open(const char *directory, const char *species, const char *version, const char *excludes);
+
+/**
+ * @brief Closes the cache, flushing the new entries and logging its usage counters.
+ * @param cache the cache to close
+ */
+void effect_cache_close(effect_cache_t *cache);
+
+/**
+ * @brief Searches the lines a web service returned for a variant.
+ * @param source web service the lines were retrieved from
+ * @param record the variant to search
+ * @param cache the cache to search in
+ * @param[out] lines the lines stored for the variant, valid until the cache is closed
+ * @param[out] lines_len the length of the lines
+ * @return 1 if the variant was found, 0 otherwise
+ */
+int effect_cache_lookup(enum effect_cache_source source, vcf_record_t *record, effect_cache_t *cache,
+                        const char **lines, size_t *lines_len);
+
+/**
+ * @brief Stores the response of a web service for a group of variants.
+ * @param source web service the response was retrieved from
+ * @param records variants sent to the web service
+ * @param num_records number of variants sent
+ * @param response raw response, which is not modified
+ * @param cache the cache to store the response in
+ * @return The number of variants stored, or -1 if some line could not be assigned to a variant
+ *
+ * Splits the response in the lines associated to each variant and stores them, including the
+ * variants the web service returned no lines for. If a line can not be assigned to a single variant,
+ * nothing is stored so that the cache never contains partial responses.
+ */
+int effect_cache_store_response(enum effect_cache_source source, vcf_record_t **records, int num_records,
+                                const char *response, effect_cache_t *cache);
+
+
+/* **********************************************
+ *                  Key management              *
+ * **********************************************/
+
+/**
+ * @brief Composes the key of a variant in the cache.
+ * @return A newly allocated string with the format source|chromosome:position:reference:alternate
+ */
+char *compose_effect_cache_key(enum effect_cache_source source, vcf_record_t *record);
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "effect_checkpoint.h"
+
+KHASH_MAP_INIT_STR(checkpoint_counts, int);
+
+static int is_checkpointed_file(const char *filename);
+static char *get_checkpoint_path(const char *output_directory, const char *filename);
+static void add_summary_count(cp_hashtable *summary_count, const char *consequence_type, int count);
+
+
+int write_effect_checkpoint(int num_batches, shared_options_data_t *shared_options, cp_hashtable *summary_count,
+                            cp_hashtable *gene_list, effect_thread_output_t **outputs, int num_outputs) {
+    char *output_directory = shared_options->output_directory;
+
+    // Write all pending lines, so the size of the files matches the batches already processed
+    for (int i = 0; i < num_outputs; i++) {
+        omp_set_lock(&(outputs[i]->lock));
+        effect_thread_output_flush(outputs[i]);
+    }
+    fflush(NULL);
+
+    char *tmp_path = get_checkpoint_path(output_directory, EFFECT_CHECKPOINT_FILENAME ".tmp");
+    FILE *journal = fopen(tmp_path, "w");
+    if (!journal) {
+        LOG_ERROR_F("Can't create checkpoint file %s\n", tmp_path);
+        for (int i = 0; i < num_outputs; i++) {
+            omp_unset_lock(&(outputs[i]->lock));
+        }
+        free(tmp_path);
+        return 1;
+    }
+
+    fprintf(journal, "%s\n", EFFECT_CHECKPOINT_MAGIC);
+    fprintf(journal, "vcf\t%s\n", shared_options->vcf_filename);
+    fprintf(journal, "batch-lines\t%d\n", shared_options->batch_lines);
+    fprintf(journal, "batch-bytes\t%d\n", shared_options->batch_bytes);
+    fprintf(journal, "batches\t%d\n", num_batches);
+
+    // Size of every output file
+    DIR *dir = opendir(output_directory);
+    if (dir) {
+        struct dirent *entry;
+        struct stat file_stat;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!is_checkpointed_file(entry->d_name)) {
+                continue;
+            }
+            char *path = get_checkpoint_path(output_directory, entry->d_name);
+            if (!stat(path, &file_stat) && S_ISREG(file_stat.st_mode)) {
+                fprintf(journal, "file\t%s\t%lld\n", entry->d_name, (long long) file_stat.st_size);
+            }
+            free(path);
+        }
+        closedir(dir);
+    }
+
+    // Counters and genes, from previous checkpoints plus the ones found by each thread
+    khash_t(checkpoint_counts) *counts = kh_init(checkpoint_counts);
+    khash_t(gene_names_set) *genes = kh_init(gene_names_set);
+    int ret;
+    khiter_t iter;
+
+    char **keys = (char**) cp_hashtable_get_keys(summary_count);
+    int num_keys = cp_hashtable_count(summary_count);
+    for (int i = 0; i < num_keys; i++) {
+        iter = kh_put(checkpoint_counts, counts, keys[i], &ret);
+        kh_value(counts, iter) = *((int*) cp_hashtable_get(summary_count, keys[i]));
+    }
+    free(keys);
+
+    keys = (char**) cp_hashtable_get_keys(gene_list);
+    num_keys = cp_hashtable_count(gene_list);
+    for (int i = 0; i < num_keys; i++) {
+        kh_put(gene_names_set, genes, keys[i], &ret);
+    }
+    free(keys);
+
+    for (int i = 0; i < num_outputs; i++) {
+        effect_thread_output_t *output = outputs[i];
+        for (khiter_t k = kh_begin(output->consequence_types); k != kh_end(output->consequence_types); ++k) {
+            if (!kh_exist(output->consequence_types, k)) {
+                continue;
+            }
+            consequence_type_output_t *consequence_type = kh_value(output->consequence_types, k);
+            iter = kh_put(checkpoint_counts, counts, consequence_type->name, &ret);
+            if (ret) {
+                kh_value(counts, iter) = 0;
+            }
+            kh_value(counts, iter) += consequence_type->count;
+        }
+        for (khiter_t k = kh_begin(output->genes); k != kh_end(output->genes); ++k) {
+            if (kh_exist(output->genes, k)) {
+                kh_put(gene_names_set, genes, kh_key(output->genes, k), &ret);
+            }
+        }
+    }
+
+    for (iter = kh_begin(counts); iter != kh_end(counts); ++iter) {
+        if (kh_exist(counts, iter)) {
+            fprintf(journal, "count\t%d\t%s\n", kh_value(counts, iter), kh_key(counts, iter));
+        }
+    }
+    for (iter = kh_begin(genes); iter != kh_end(genes); ++iter) {
+        if (kh_exist(genes, iter)) {
+            fprintf(journal, "gene\t%s\n", kh_key(genes, iter));
+        }
+    }
+
+    // Keys are owned by the hashtables they were taken from
+    kh_destroy(checkpoint_counts, counts);
+    kh_destroy(gene_names_set, genes);
+
+    for (int i = 0; i < num_outputs; i++) {
+        omp_unset_lock(&(outputs[i]->lock));
+    }
+
+    // Replace the previous checkpoint only when the new one is safely stored
+    int error = fflush(journal) || fsync(fileno(journal));
+    error |= fclose(journal);
+
+    char *path = get_checkpoint_path(output_directory, EFFECT_CHECKPOINT_FILENAME);
+    if (!error) {
+        error = rename(tmp_path, path);
+    }
+    if (error) {
+        LOG_ERROR_F("Can't write checkpoint file %s\n", path);
+        unlink(tmp_path);
+    } else {
+        LOG_DEBUG_F("Checkpoint written after batch %d\n", num_batches);
+    }
+
+    free(path);
+    free(tmp_path);
+    return error;
+}
+
+int restore_effect_checkpoint(shared_options_data_t *shared_options, cp_hashtable *summary_count, cp_hashtable *gene_list) {
+    char *output_directory = shared_options->output_directory;
+    char *path = get_checkpoint_path(output_directory, EFFECT_CHECKPOINT_FILENAME);
+    FILE *journal = fopen(path, "r");
+    if (!journal) {
+        LOG_WARN_F("No checkpoint found in %s, the whole input file will be processed\n", output_directory);
+        free(path);
+        return -1;
+    }
+
+    // The whole journal is read before modifying anything, so an invalid one leaves the files untouched
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_len;
+    int num_lines = 0, lines_capacity = 64;
+    char **lines = (char**) malloc (lines_capacity * sizeof(char*));
+
+    int valid = 0, num_batches = -1;
+    while ((line_len = getline(&line, &line_capacity, journal)) != -1) {
+        if (line_len > 0 && line[line_len - 1] == '\n') {
+            line[--line_len] = '\0';
+        }
+        if (num_lines == 0) {
+            valid = !strcmp(line, EFFECT_CHECKPOINT_MAGIC);
+        } else if (!strncmp(line, "vcf\t", 4)) {
+            valid &= !strcmp(line + 4, shared_options->vcf_filename);
+        } else if (!strncmp(line, "batch-lines\t", 12)) {
+            valid &= atoi(line + 12) == shared_options->batch_lines;
+        } else if (!strncmp(line, "batch-bytes\t", 12)) {
+            valid &= atoi(line + 12) == shared_options->batch_bytes;
+        } else if (!strncmp(line, "batches\t", 8)) {
+            num_batches = atoi(line + 8);
+        }
+
+        if (num_lines == lines_capacity) {
+            lines_capacity *= 2;
+            lines = realloc(lines, lines_capacity * sizeof(char*));
+        }
+        lines[num_lines++] = strdup(line);
+    }
+    free(line);
+    fclose(journal);
+
+    if (!valid || num_batches < 0) {
+        LOG_ERROR_F("Checkpoint %s does not belong to this input file or batch size\n", path);
+        for (int i = 0; i < num_lines; i++) {
+            free(lines[i]);
+        }
+        free(lines);
+        free(path);
+        return -1;
+    }
+
+    // Files created after the checkpoint contain only annotations that will be processed again
+    khash_t(gene_names_set) *recorded_files = kh_init(gene_names_set);
+    int ret;
+    for (int i = 1; i < num_lines; i++) {
+        if (!strncmp(lines[i], "file\t", 5)) {
+            char *size = strrchr(lines[i], '\t');
+            *size = '\0';
+            kh_put(gene_names_set, recorded_files, lines[i] + 5, &ret);
+
+            char *file_path = get_checkpoint_path(output_directory, lines[i] + 5);
+            if (truncate(file_path, atoll(size + 1))) {
+                LOG_WARN_F("Can't restore file %s: %s\n", file_path, strerror(errno));
+            }
+            free(file_path);
+        } else if (!strncmp(lines[i], "count\t", 6)) {
+            char *consequence_type = strchr(lines[i] + 6, '\t');
+            if (consequence_type) {
+                add_summary_count(summary_count, consequence_type + 1, atoi(lines[i] + 6));
+            }
+        } else if (!strncmp(lines[i], "gene\t", 5)) {
+            if (!cp_hashtable_contains(gene_list, lines[i] + 5)) {
+                cp_hashtable_put(gene_list, strdup(lines[i] + 5), NULL);
+            }
+        }
+    }
+
+    DIR *dir = opendir(output_directory);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (is_checkpointed_file(entry->d_name) && kh_get(gene_names_set, recorded_files, entry->d_name) == kh_end(recorded_files)) {
+                char *file_path = get_checkpoint_path(output_directory, entry->d_name);
+                unlink(file_path);
+                free(file_path);
+            }
+        }
+        closedir(dir);
+    }
+
+    kh_destroy(gene_names_set, recorded_files);
+    for (int i = 0; i < num_lines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    free(path);
+
+    LOG_INFO_F("Resuming after batch %d\n", num_batches);
+    return num_batches;
+}
+
+void remove_effect_checkpoint(const char *output_directory) {
+    char *path = get_checkpoint_path(output_directory, EFFECT_CHECKPOINT_FILENAME);
+    unlink(path);
+    free(path);
+}
+
+int load_effect_summary(const char *output_directory, cp_hashtable *summary_count, cp_hashtable *gene_list) {
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_len;
+
+    char *path = get_checkpoint_path(output_directory, "summary.txt");
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        LOG_ERROR_F("Can't read summary of the previous run from %s\n", path);
+        free(path);
+        return 1;
+    }
+    while ((line_len = getline(&line, &line_capacity, file)) != -1) {
+        char *count = strrchr(line, '\t');
+        if (count) {
+            *count = '\0';
+            add_summary_count(summary_count, line, atoi(count + 1));
+        }
+    }
+    fclose(file);
+
+    // The summary is written again when the variants have been annotated
+    if (truncate(path, 0)) {
+        LOG_WARN_F("Can't empty file %s: %s\n", path, strerror(errno));
+    }
+    free(path);
+
+    path = get_checkpoint_path(output_directory, "genes_with_variants.txt");
+    file = fopen(path, "r");
+    if (file) {
+        while ((line_len = getline(&line, &line_capacity, file)) != -1) {
+            if (line_len > 0 && line[line_len - 1] == '\n') {
+                line[--line_len] = '\0';
+            }
+            if (line_len > 0 && !cp_hashtable_contains(gene_list, line)) {
+                cp_hashtable_put(gene_list, strdup(line), NULL);
+            }
+        }
+        fclose(file);
+    }
+    free(path);
+    free(line);
+
+    return 0;
+}
+
+
+/**
+ * Returns whether a file of the output directory must be restored when resuming: annotations and
+ * summary (.txt), compressed annotations and their indices (.gz and .idx), non-processed variants
+ * (.errors) and filtering output (.filtered and .rejected).
+ */
+static int is_checkpointed_file(const char *filename) {
+    const char *extension = strrchr(filename, '.');
+    return extension && (!strcmp(extension, ".txt") || !strcmp(extension, ".gz") || !strcmp(extension, ".idx") ||
+                         !strcmp(extension, ".errors") ||
+                         !strcmp(extension, ".filtered") || !strcmp(extension, ".rejected"));
+}
+
+static char *get_checkpoint_path(const char *output_directory, const char *filename) {
+    char *path = (char*) malloc ((strlen(output_directory) + strlen(filename) + 2) * sizeof(char));
+    sprintf(path, "%s/%s", output_directory, filename);
+    return path;
+}
+
+static void add_summary_count(cp_hashtable *summary_count, const char *consequence_type, int count) {
+    int *stored_count = (int*) cp_hashtable_get(summary_count, (char*) consequence_type);
+    if (stored_count == NULL) {
+        stored_count = (int*) malloc (sizeof(int));
+        *stored_count = 0;
+        cp_hashtable_put(summary_count, strdup(consequence_type), stored_count);
+    }
+    *stored_count += count;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EFFECT_CHECKPOINT_H
+#define EFFECT_CHECKPOINT_H
+
+/**
+ * @file effect_checkpoint.h
+ * @brief Checkpoints that allow to resume an interrupted run of the effect tool
+ *
+ * A checkpoint journal in the output directory records how many batches of the input file have
+ * been completely annotated and written, the size of every output file at that moment, and the
+ * summary counters and genes found so far. A resumed run truncates the output files to those
+ * sizes, restores the counters and skips the batches already annotated.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include <commons/log.h>
+#include <containers/khash.h>
+#include <containers/cprops/hashtable.h>
+
+#include "effect_output.h"
+#include "shared_options.h"
+
+#define EFFECT_CHECKPOINT_FILENAME  "effect.checkpoint"
+#define EFFECT_CHECKPOINT_MAGIC     "#hpg-variant effect checkpoint v1"
+
+/**
+ * Number of batches processed between two checkpoints.
+ */
+#define EFFECT_CHECKPOINT_INTERVAL  20
+
+
+/**
+ * @brief Writes a checkpoint of the output generated so far.
+ * @param num_batches number of batches of the input file completely annotated
+ * @param shared_options options of the run, used to validate the checkpoint when it is restored
+ * @param summary_count counters restored from a previous checkpoint, if any
+ * @param gene_list genes restored from a previous checkpoint, if any
+ * @param outputs output buffers of the threads, whose pending lines are written before the checkpoint
+ * @param num_outputs number of output buffers
+ * @return Zero if the checkpoint was written, non-zero otherwise
+ *
+ * No batch must be being processed while the checkpoint is written. The journal is written to a
+ * temporary file and then renamed, so it is never left half-written.
+ */
+int write_effect_checkpoint(int num_batches, shared_options_data_t *shared_options, cp_hashtable *summary_count,
+                            cp_hashtable *gene_list, effect_thread_output_t **outputs, int num_outputs);
+
+/**
+ * @brief Restores the output directory to the state recorded in the checkpoint journal.
+ * @param shared_options options of the run, which must match the ones of the checkpoint
+ * @param summary_count counters where the ones in the checkpoint are loaded
+ * @param gene_list list where the genes in the checkpoint are loaded
+ * @return The number of batches already annotated, or -1 if there is no valid checkpoint
+ *
+ * The output files are truncated to the size they had when the checkpoint was written, and the
+ * annotation files created afterwards are removed.
+ */
+int restore_effect_checkpoint(shared_options_data_t *shared_options, cp_hashtable *summary_count, cp_hashtable *gene_list);
+
+/**
+ * @brief Removes the checkpoint journal once a run has finished successfully.
+ */
+void remove_effect_checkpoint(const char *output_directory);
+
+/**
+ * @brief Loads the summary counters and genes of a finished run from its output files.
+ * @return Zero if the summary could be read, non-zero otherwise
+ *
+ * Used when re-annotating the variants that failed in a previous run, so its results are merged
+ * with the new ones. The summary file is emptied, because it is written again at the end.
+ */
+int load_effect_summary(const char *output_directory, cp_hashtable *summary_count, cp_hashtable *gene_list);
+
+#endif
@@ -59,6 +59,42 @@ int read_effect_configuration(const char *filename, effect_options_t *effect_opt
         LOG_DEBUG_F("batch-lines = %ld\n", *(shared_options->batch_size->ival));
     }*/
     
+    // Read maximum number of requests in flight at the same time
+    ret_code = config_lookup_int(config, "effect.max-requests", effect_options->max_requests->ival);
+    if (ret_code == CONFIG_FALSE) {
+        LOG_DEBUG("Maximum number of requests in flight not found in config file, it will depend on the number of threads\n");
+    } else {
+        LOG_DEBUG_F("max-requests = %ld\n", *(effect_options->max_requests->ival));
+    }
+    
+    // Read directory where the annotations are cached
+    const char *tmp_string;
+    ret_code = config_lookup_string(config, "effect.cache-dir", &tmp_string);
+    if (ret_code == CONFIG_FALSE) {
+        LOG_DEBUG("Annotations cache directory not found in config file, the cache will be disabled\n");
+    } else {
+        *(effect_options->cache_directory->sval) = strdup(tmp_string);
+        LOG_DEBUG_F("cache-dir = %s\n", *(effect_options->cache_directory->sval));
+    }
+    
+    // Read source of the consequence types and, for the local backend, the file with the gene model
+    ret_code = config_lookup_string(config, "effect.annotation-backend", &tmp_string);
+    if (ret_code == CONFIG_FALSE) {
+        LOG_DEBUG("Annotation backend not found in config file, the web services will be used\n");
+    } else {
+        *(effect_options->annotation_backend->sval) = strdup(tmp_string);
+        LOG_DEBUG_F("annotation-backend = %s\n", *(effect_options->annotation_backend->sval));
+    }
+    
+    ret_code = config_lookup_string(config, "effect.gene-model", &tmp_string);
+    if (ret_code == CONFIG_FALSE) {
+        LOG_DEBUG("Gene model file not found in config file\n");
+    } else {
+        *(effect_options->gene_model_filename->filename) = strdup(tmp_string);
+        effect_options->gene_model_filename->count = 1;
+        LOG_DEBUG_F("gene-model = %s\n", *(effect_options->gene_model_filename->filename));
+    }
+    
     config_destroy(config);
     free(config);
 
@@ -78,7 +114,7 @@ void **parse_effect_options(int argc, char *argv[], effect_options_t *effect_opt
 }
 
 void **merge_effect_options(effect_options_t *effect_options, shared_options_t *shared_options, struct arg_end *arg_end) {
-    void **tool_options = malloc (30 * sizeof(void*));
+    void **tool_options = malloc (38 * sizeof(void*));
     
     // Input/output files
     tool_options[0] = shared_options->vcf_filename;
@@ -92,36 +128,44 @@ void **merge_effect_options(effect_options_t *effect_options, shared_options_t *
     // Effect arguments
     tool_options[5] = effect_options->no_phenotypes;
     tool_options[6] = effect_options->excludes;
+    tool_options[7] = effect_options->cache_directory;
+    tool_options[8] = effect_options->no_cache;
+    tool_options[9] = effect_options->max_requests;
+    tool_options[10] = effect_options->annotation_backend;
+    tool_options[11] = effect_options->gene_model_filename;
+    tool_options[12] = effect_options->resume;
+    tool_options[13] = effect_options->redrive_errors;
+    tool_options[14] = effect_options->compress_output;
     
     // Filter arguments
-    tool_options[7] = shared_options->num_alleles;
-    tool_options[8] = shared_options->coverage;
-    tool_options[9] = shared_options->quality;
-    tool_options[10] = shared_options->maf;
-    tool_options[11] = shared_options->missing;
-    tool_options[12] = shared_options->gene;
-    tool_options[13] = shared_options->region;
-    tool_options[14] = shared_options->region_file;
-    tool_options[15] = shared_options->region_type;
-    tool_options[16] = shared_options->snp;
-    tool_options[17] = shared_options->indel;
-    tool_options[18] = shared_options->dominant;
-    tool_options[19] = shared_options->recessive;
+    tool_options[15] = shared_options->num_alleles;
+    tool_options[16] = shared_options->coverage;
+    tool_options[17] = shared_options->quality;
+    tool_options[18] = shared_options->maf;
+    tool_options[19] = shared_options->missing;
+    tool_options[20] = shared_options->gene;
+    tool_options[21] = shared_options->region;
+    tool_options[22] = shared_options->region_file;
+    tool_options[23] = shared_options->region_type;
+    tool_options[24] = shared_options->snp;
+    tool_options[25] = shared_options->indel;
+    tool_options[26] = shared_options->dominant;
+    tool_options[27] = shared_options->recessive;
     
     // Configuration file
-    tool_options[20] = shared_options->log_level;
-    tool_options[21] = shared_options->config_file;
+    tool_options[28] = shared_options->log_level;
+    tool_options[29] = shared_options->config_file;
     
     // Advanced configuration
-    tool_options[22] = shared_options->host_url;
-    tool_options[23] = shared_options->version;
-    tool_options[24] = shared_options->max_batches;
-    tool_options[25] = shared_options->batch_lines;
-    tool_options[26] = shared_options->batch_bytes;
-    tool_options[27] = shared_options->num_threads;
-    tool_options[28] = shared_options->mmap_vcf_files;
+    tool_options[30] = shared_options->host_url;
+    tool_options[31] = shared_options->version;
+    tool_options[32] = shared_options->max_batches;
+    tool_options[33] = shared_options->batch_lines;
+    tool_options[34] = shared_options->batch_bytes;
+    tool_options[35] = shared_options->num_threads;
+    tool_options[36] = shared_options->mmap_vcf_files;
     
-    tool_options[29] = arg_end;
+    tool_options[37] = arg_end;
     
     return tool_options;
 }
@@ -141,14 +185,32 @@ int verify_effect_options(effect_options_t *effect_options, shared_options_t *sh
         return PED_FILE_NOT_SPECIFIED;
     }
     
-    // Check whether the host URL is defined
-    if (shared_options->host_url->sval == NULL || strlen(*(shared_options->host_url->sval)) == 0) {
+    // Check whether the annotation backend is valid, and the gene model is defined when needed
+    const char *backend = *(effect_options->annotation_backend->sval);
+    if (strlen(backend) > 0 && strcmp(backend, "ws") && strcmp(backend, "local")) {
+        LOG_ERROR("Please specify a valid annotation backend (ws or local).\n");
+        return EFFECT_BACKEND_NOT_VALID;
+    }
+    int local_backend = !strcmp(backend, "local");
+    if (local_backend && effect_options->gene_model_filename->count == 0) {
+        LOG_ERROR("Please specify the GFF file with the gene model for the local annotation backend.\n");
+        return EFFECT_GENE_MODEL_NOT_SPECIFIED;
+    }
+    
+    // Check that an interrupted run and the failed variants of a finished one are not processed at the same time
+    if (effect_options->resume->count && effect_options->redrive_errors->count) {
+        LOG_ERROR("Please specify only one of --resume and --redrive-errors.\n");
+        return EFFECT_RESUME_AND_REDRIVE_SPECIFIED;
+    }
+    
+    // Check whether the host URL is defined (not needed when annotating locally)
+    if (!local_backend && (shared_options->host_url->sval == NULL || strlen(*(shared_options->host_url->sval)) == 0)) {
         LOG_ERROR("Please specify the host URL to the web service.\n");
         return HOST_URL_NOT_SPECIFIED;
     }
 
-    // Check whether the version is defined
-    if (shared_options->version->sval == NULL || strlen(*(shared_options->version->sval)) == 0) {
+    // Check whether the version is defined (not needed when annotating locally)
+    if (!local_backend && (shared_options->version->sval == NULL || strlen(*(shared_options->version->sval)) == 0)) {
         LOG_ERROR("Please specify the version.\n");
         return VERSION_NOT_SPECIFIED;
     }
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "effect_output.h"
+
+static void append_to_buffer(const char *text, size_t text_len, effect_output_buffer_t *buffer);
+static void write_buffer(effect_output_buffer_t *buffer, void *file, int compressed);
+static void *get_consequence_type_file(consequence_type_output_t *consequence_type, effect_thread_output_t *output);
+
+
+effect_thread_output_t *effect_thread_output_new(char *output_directory, cp_hashtable *output_files, int compressed) {
+    effect_thread_output_t *output = (effect_thread_output_t*) calloc (1, sizeof(effect_thread_output_t));
+    output->consequence_types = kh_init(consequence_type_outputs);
+    output->genes = kh_init(gene_names_set);
+    output->output_directory = output_directory;
+    output->output_files = output_files;
+    output->compressed = compressed;
+    omp_init_lock(&(output->lock));
+    return output;
+}
+
+void effect_thread_output_free(effect_thread_output_t *output, cp_hashtable *summary_count, cp_hashtable *gene_list) {
+    effect_thread_output_flush(output);
+
+    // Merge counters and genes with the ones from other threads
+#pragma omp critical (effect_output_merge)
+    {
+        for (khiter_t iter = kh_begin(output->consequence_types); iter != kh_end(output->consequence_types); ++iter) {
+            if (!kh_exist(output->consequence_types, iter)) {
+                continue;
+            }
+            consequence_type_output_t *consequence_type = kh_value(output->consequence_types, iter);
+            int *count = (int*) cp_hashtable_get(summary_count, consequence_type->name);
+            if (count == NULL) {
+                count = (int*) malloc (sizeof(int));
+                *count = 0;
+                cp_hashtable_put(summary_count, strdup(consequence_type->name), count);
+            }
+            *count += consequence_type->count;
+        }
+
+        for (khiter_t iter = kh_begin(output->genes); iter != kh_end(output->genes); ++iter) {
+            if (kh_exist(output->genes, iter) && !cp_hashtable_contains(gene_list, (char*) kh_key(output->genes, iter))) {
+                cp_hashtable_put(gene_list, strdup(kh_key(output->genes, iter)), NULL);
+            }
+        }
+    }
+
+    for (khiter_t iter = kh_begin(output->consequence_types); iter != kh_end(output->consequence_types); ++iter) {
+        if (kh_exist(output->consequence_types, iter)) {
+            consequence_type_output_t *consequence_type = kh_value(output->consequence_types, iter);
+            free(consequence_type->name);
+            free(consequence_type->buffer.text);
+            free(consequence_type);
+        }
+    }
+    kh_destroy(consequence_type_outputs, output->consequence_types);
+
+    for (khiter_t iter = kh_begin(output->genes); iter != kh_end(output->genes); ++iter) {
+        if (kh_exist(output->genes, iter)) {
+            free((char*) kh_key(output->genes, iter));
+        }
+    }
+    kh_destroy(gene_names_set, output->genes);
+
+    free(output->all_variants.text);
+    free(output->snp_phenotypes.text);
+    free(output->mutation_phenotypes.text);
+    omp_destroy_lock(&(output->lock));
+    free(output);
+}
+
+void effect_thread_output_flush(effect_thread_output_t *output) {
+    // The file descriptors are thread-safe, and each block contains whole lines (compressed blocks are
+    // written under the lock of their file)
+    write_buffer(&(output->all_variants), cp_hashtable_get(output->output_files, "all_variants"), output->compressed);
+    write_buffer(&(output->snp_phenotypes), cp_hashtable_get(output->output_files, "snp_phenotypes"), output->compressed);
+    write_buffer(&(output->mutation_phenotypes), cp_hashtable_get(output->output_files, "mutation_phenotypes"), output->compressed);
+
+    for (khiter_t iter = kh_begin(output->consequence_types); iter != kh_end(output->consequence_types); ++iter) {
+        if (!kh_exist(output->consequence_types, iter)) {
+            continue;
+        }
+        consequence_type_output_t *consequence_type = kh_value(output->consequence_types, iter);
+        if (consequence_type->buffer.len > 0) {
+            write_buffer(&(consequence_type->buffer), get_consequence_type_file(consequence_type, output), output->compressed);
+        }
+    }
+}
+
+void add_consequence_type_line(const char *line, size_t line_len, int SO, const char *consequence_type, size_t consequence_type_len,
+                               const char *gene, size_t gene_len, effect_thread_output_t *output) {
+    int ret;
+    consequence_type_output_t *ct_output;
+    khiter_t iter = kh_get(consequence_type_outputs, output->consequence_types, SO);
+    if (iter == kh_end(output->consequence_types)) {
+        ct_output = (consequence_type_output_t*) calloc (1, sizeof(consequence_type_output_t));
+        ct_output->SO = SO;
+        ct_output->name = strndup(consequence_type, consequence_type_len);
+        iter = kh_put(consequence_type_outputs, output->consequence_types, SO, &ret);
+        kh_value(output->consequence_types, iter) = ct_output;
+    } else {
+        ct_output = kh_value(output->consequence_types, iter);
+    }
+
+    ct_output->count++;
+    append_to_buffer(line, line_len, &(ct_output->buffer));
+    if (ct_output->buffer.len >= EFFECT_OUTPUT_BUFFER_SIZE) {
+        write_buffer(&(ct_output->buffer), get_consequence_type_file(ct_output, output), output->compressed);
+    }
+
+    append_to_buffer(line, line_len, &(output->all_variants));
+    if (output->all_variants.len >= EFFECT_OUTPUT_BUFFER_SIZE) {
+        write_buffer(&(output->all_variants), cp_hashtable_get(output->output_files, "all_variants"), output->compressed);
+    }
+
+    if (gene_len > 0) {
+        char gene_name[gene_len + 1];
+        memcpy(gene_name, gene, gene_len);
+        gene_name[gene_len] = '\0';
+        if (kh_get(gene_names_set, output->genes, gene_name) == kh_end(output->genes)) {
+            kh_put(gene_names_set, output->genes, strdup(gene_name), &ret);
+        }
+    }
+}
+
+void add_snp_phenotype_lines(const char *lines, size_t lines_len, effect_thread_output_t *output) {
+    append_to_buffer(lines, lines_len, &(output->snp_phenotypes));
+    if (output->snp_phenotypes.len >= EFFECT_OUTPUT_BUFFER_SIZE) {
+        write_buffer(&(output->snp_phenotypes), cp_hashtable_get(output->output_files, "snp_phenotypes"), output->compressed);
+    }
+}
+
+void add_mutation_phenotype_lines(const char *lines, size_t lines_len, effect_thread_output_t *output) {
+    append_to_buffer(lines, lines_len, &(output->mutation_phenotypes));
+    if (output->mutation_phenotypes.len >= EFFECT_OUTPUT_BUFFER_SIZE) {
+        write_buffer(&(output->mutation_phenotypes), cp_hashtable_get(output->output_files, "mutation_phenotypes"), output->compressed);
+    }
+}
+
+
+/**
+ * Appends a line to a buffer, adding the trailing newline.
+ */
+static void append_to_buffer(const char *text, size_t text_len, effect_output_buffer_t *buffer) {
+    if (buffer->len + text_len + 1 > buffer->capacity) {
+        size_t new_capacity = buffer->capacity ? 2 * buffer->capacity : 4096;
+        while (buffer->len + text_len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        buffer->text = realloc(buffer->text, new_capacity);
+        buffer->capacity = new_capacity;
+    }
+    memcpy(buffer->text + buffer->len, text, text_len);
+    buffer->len += text_len;
+    buffer->text[buffer->len++] = '\n';
+}
+
+static void write_buffer(effect_output_buffer_t *buffer, void *file, int compressed) {
+    if (buffer->len == 0 || file == NULL) {
+        return;
+    }
+    if (compressed) {
+        if (bgzf_write_lines(buffer->text, buffer->len, file)) {
+            LOG_ERROR_F("Error compressing %zu bytes of annotations to file\n", buffer->len);
+        }
+    } else if (fwrite(buffer->text, sizeof(char), buffer->len, file) != buffer->len) {
+        LOG_ERROR_F("Error writing %zu bytes of annotations to file\n", buffer->len);
+    }
+    buffer->len = 0;
+}
+
+/**
+ * Returns the file of a consequence type, creating it the first time it is found by any thread.
+ */
+static void *get_consequence_type_file(consequence_type_output_t *consequence_type, effect_thread_output_t *output) {
+    void *file = cp_hashtable_get(output->output_files, &(consequence_type->SO));
+    if (file) {
+        return file;
+    }
+
+#pragma omp critical (effect_output_files)
+    {
+        // This construction avoids 2 threads trying to create the same file
+        file = cp_hashtable_get(output->output_files, &(consequence_type->SO));
+        if (!file) {
+            char filename[strlen(output->output_directory) + strlen(consequence_type->name) + 9];
+            if (output->compressed) {
+                sprintf(filename, "%s/%s.txt.gz", output->output_directory, consequence_type->name);
+                file = bgzf_open(filename, 1);
+            } else {
+                sprintf(filename, "%s/%s.txt", output->output_directory, consequence_type->name);
+                file = fopen(filename, "a");
+            }
+            if (file) {
+                int *SO_stored = (int*) malloc (sizeof(int));
+                *SO_stored = consequence_type->SO;
+                cp_hashtable_put(output->output_files, SO_stored, file);
+                LOG_INFO_F("[%d] New consequence type found = %s\n", omp_get_thread_num(), consequence_type->name);
+            } else {
+                LOG_ERROR_F("Can't create file for consequence type %s\n", consequence_type->name);
+            }
+        }
+    }
+
+    return file;
+}
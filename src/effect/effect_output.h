@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EFFECT_OUTPUT_H
+#define EFFECT_OUTPUT_H
+
+/**
+ * @file effect_output.h
+ * @brief Per-thread buffering of the effect tool output
+ *
+ * Every thread that parses annotations owns an effect_thread_output_t, where the lines of each
+ * consequence type are accumulated together with the summary counters and the list of genes.
+ * Buffers are written to the output files in large blocks, and the counters are merged once
+ * all the annotations have been processed, so threads don't need to synchronize per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include <commons/log.h>
+#include <containers/khash.h>
+#include <containers/cprops/hashtable.h>
+
+#include "bgzf_output.h"
+
+/**
+ * Size a buffer must reach before being written to its file.
+ */
+#define EFFECT_OUTPUT_BUFFER_SIZE   (256 * 1024)
+
+/**
+ * @brief Growable text buffer.
+ */
+typedef struct effect_output_buffer {
+    char *text;
+    size_t len;
+    size_t capacity;
+} effect_output_buffer_t;
+
+/**
+ * @brief Lines and counter of a consequence type found by a thread.
+ */
+typedef struct consequence_type_output {
+    int SO;                             /**< Numerical part of the SO accession. */
+    char *name;                         /**< Name of the consequence type, also used for its file. */
+    int count;                          /**< Lines found by the thread. */
+    effect_output_buffer_t buffer;      /**< Lines not yet written to the file. */
+} consequence_type_output_t;
+
+KHASH_MAP_INIT_INT(consequence_type_outputs, consequence_type_output_t*);
+KHASH_SET_INIT_STR(gene_names_set);
+
+typedef struct effect_thread_output {
+    khash_t(consequence_type_outputs) *consequence_types;
+    khash_t(gene_names_set) *genes;
+
+    effect_output_buffer_t all_variants;
+    effect_output_buffer_t snp_phenotypes;
+    effect_output_buffer_t mutation_phenotypes;
+
+    char *output_directory;
+    cp_hashtable *output_files;         /**< Shared by all threads, the consequence type files are created on demand. */
+    int compressed;                     /**< Whether output_files contains bgzf_file_t instead of FILE. */
+    
+    omp_lock_t lock;                    /**< Held by the owner thread while it adds lines, so other threads can flush the buffers safely. */
+} effect_thread_output_t;
+
+
+/**
+ * @brief Creates the output buffers of a thread.
+ * @param output_directory directory where the consequence type files are created
+ * @param output_files file descriptors shared by all threads, which must contain all_variants,
+ * snp_phenotypes and mutation_phenotypes
+ * @param compressed whether the files are BGZF-compressed, in which case the consequence type files
+ * are created with the extension .txt.gz and indexed
+ */
+effect_thread_output_t *effect_thread_output_new(char *output_directory, cp_hashtable *output_files, int compressed);
+
+/**
+ * @brief Writes the pending lines and frees the output buffers of a thread.
+ *
+ * The summary counters and genes of the thread are previously added to the global ones.
+ */
+void effect_thread_output_free(effect_thread_output_t *output, cp_hashtable *summary_count, cp_hashtable *gene_list);
+
+/**
+ * @brief Writes the pending lines of a thread to their files.
+ */
+void effect_thread_output_flush(effect_thread_output_t *output);
+
+/**
+ * @brief Adds a line to the buffer of its consequence type and all_variants.
+ * @param line line to add, not null-terminated
+ * @param line_len length of the line
+ * @param SO numerical part of the SO accession of the consequence type
+ * @param consequence_type name of the consequence type, not null-terminated
+ * @param consequence_type_len length of the name of the consequence type
+ * @param gene name of the gene, not null-terminated
+ * @param gene_len length of the name of the gene, zero if it is not available
+ * @param output buffers of the thread
+ */
+void add_consequence_type_line(const char *line, size_t line_len, int SO, const char *consequence_type, size_t consequence_type_len,
+                               const char *gene, size_t gene_len, effect_thread_output_t *output);
+
+void add_snp_phenotype_lines(const char *lines, size_t lines_len, effect_thread_output_t *output);
+
+void add_mutation_phenotype_lines(const char *lines, size_t lines_len, effect_thread_output_t *output);
+
+#endif
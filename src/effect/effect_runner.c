@@ -25,7 +25,33 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
     int ret_code = 0;
     double start, stop, total;
     
-    vcf_file_t *vcf_file = vcf_open(shared_options_data->vcf_filename, shared_options_data->max_batches);
+    char *output_directory = shared_options_data->output_directory;
+    size_t output_directory_len = strlen(output_directory);
+    
+    // Filename structure outdir/vcfname.errors
+    char *prefix_filename = calloc(strlen(shared_options_data->vcf_filename), sizeof(char));
+    get_filename_from_path(shared_options_data->vcf_filename, prefix_filename);
+    char *non_processed_filename = malloc((output_directory_len + strlen(prefix_filename) + 9) * sizeof(char));
+    sprintf(non_processed_filename, "%s/%s.errors", output_directory, prefix_filename);
+    free(prefix_filename);
+    
+    // When re-driving, the input are the variants that failed in the previous run (outdir/vcfname.errors.retry)
+    char *input_filename = shared_options_data->vcf_filename;
+    char *redrive_filename = NULL;
+    if (options_data->redrive_errors) {
+        redrive_filename = malloc((strlen(non_processed_filename) + 7) * sizeof(char));
+        sprintf(redrive_filename, "%s.retry", non_processed_filename);
+        // A .retry file is left by a re-drive that was interrupted, and must be processed again
+        if (access(redrive_filename, F_OK) && rename(non_processed_filename, redrive_filename)) {
+            LOG_INFO_F("No variants to annotate again, %s not found\n", non_processed_filename);
+            free(redrive_filename);
+            free(non_processed_filename);
+            return 0;
+        }
+        input_filename = redrive_filename;
+    }
+    
+    vcf_file_t *vcf_file = vcf_open(input_filename, shared_options_data->max_batches);
     if (!vcf_file) {
         LOG_FATAL("VCF file does not exist!\n");
     }
@@ -44,42 +70,111 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
         }
     }
     
-    char *output_directory = shared_options_data->output_directory;
-    size_t output_directory_len = strlen(output_directory);
-    
     ret_code = create_directory(output_directory);
     if (ret_code != 0 && errno != EEXIST) {
         LOG_FATAL_F("Can't create output directory: %s\n", output_directory);
     }
     
-    // Remove all .txt files in folder
-    ret_code = delete_files_by_extension(output_directory, "txt");
-    if (ret_code != 0) {
-        return ret_code;
+    // Consequence type counters (for summary, merged from all threads at the end)
+    static cp_hashtable *summary_count = NULL;
+    // Gene list (for genes-with-variants, merged from all threads at the end)
+    static cp_hashtable *gene_list = NULL;
+    initialize_output_data_structures(&summary_count, &gene_list);
+    
+    // Number of batches already annotated by an interrupted run, which are skipped
+    int num_skipped_batches = 0;
+    if (options_data->resume) {
+        num_skipped_batches = restore_effect_checkpoint(shared_options_data, summary_count, gene_list);
+    } else if (options_data->redrive_errors) {
+        // The annotations of the previous run are kept, and the new ones appended to them
+        load_effect_summary(output_directory, summary_count, gene_list);
     }
     
-    // Initialize environment for connecting to the web service
-    ret_code = init_http_environment(0);
-    if (ret_code != 0) {
-        return ret_code;
+    if (num_skipped_batches < 0 || (!options_data->resume && !options_data->redrive_errors)) {
+        num_skipped_batches = 0;
+        // Remove all .txt files in folder, and the compressed ones with their indices
+        ret_code = delete_files_by_extension(output_directory, "txt");
+        if (ret_code == 0 && options_data->compress_output) {
+            ret_code = delete_files_by_extension(output_directory, "gz") || 
+                       delete_files_by_extension(output_directory, "idx");
+        }
+        if (ret_code != 0) {
+            return ret_code;
+        }
+    }
+    
+    // Checkpoints are not needed when re-driving, because the .retry file is kept until it finishes
+    int checkpoints_enabled = !options_data->redrive_errors;
+    
+    // Gene model used to annotate the variants without querying the web services
+    gene_model_t *gene_model = NULL;
+    if (options_data->annotation_backend == LOCAL_BACKEND) {
+        gene_model = gene_model_load(options_data->gene_model_filename);
+        if (!gene_model) {
+            LOG_FATAL_F("Can't load the gene model from %s\n", options_data->gene_model_filename);
+        }
+        if (!options_data->no_phenotypes) {
+            LOG_WARN("Phenotypical information is only available through the web services and will not be retrieved\n");
+            options_data->no_phenotypes = 1;
+        }
+    } else {
+        // Initialize environment for connecting to the web service
+        ret_code = init_http_environment(0);
+        if (ret_code != 0) {
+            return ret_code;
+        }
+    }
+    
+    // Cache of annotations retrieved in previous runs (the local backend doesn't need it)
+    effect_cache_t *cache = NULL;
+    if (options_data->cache_directory && !gene_model) {
+        cache = effect_cache_open(options_data->cache_directory, shared_options_data->species, 
+                                  shared_options_data->version, options_data->excludes);
+        if (!cache) {
+            LOG_WARN("Annotations cache could not be opened, all variants will be sent to the web services\n");
+        }
     }
     
     // Output file descriptors
     static cp_hashtable *output_files = NULL;
-    // Lines of the output data in the main .txt files
-    static list_t *output_list = NULL;
-    // Consequence type counters (for summary, must be kept between web service calls)
-    static cp_hashtable *summary_count = NULL;
-    // Gene list (for genes-with-variants, must be kept between web service calls)
-    static cp_hashtable *gene_list = NULL;
+    FILE *summary_file = NULL;
 
-    // Initialize collections of file descriptors and summary counters
-    ret_code = initialize_output_files(output_directory, output_directory_len, &output_files);
+    // Initialize collection of file descriptors
+    ret_code = initialize_output_files(output_directory, output_directory_len, options_data->compress_output, 
+                                       &output_files, &summary_file);
     if (ret_code != 0) {
         return ret_code;
     }
-    initialize_output_data_structures(shared_options_data, &output_list, &summary_count, &gene_list);
-    initialize_ws_buffers(shared_options_data->num_threads);
+    
+    // A resumed run keeps the variants that failed before the checkpoint
+    FILE *non_processed_file = fopen(non_processed_filename, num_skipped_batches > 0 ? "a" : "w");
+    free(non_processed_filename);
+    
+    // Lines and counters are accumulated per thread: the first output is used for the annotations 
+    // retrieved from the cache, and the rest by the threads that parse the responses
+    int num_outputs = shared_options_data->num_threads + 1;
+    effect_thread_output_t *thread_outputs[num_outputs];
+    for (int i = 0; i < num_outputs; i++) {
+        thread_outputs[i] = effect_thread_output_new(output_directory, output_files, options_data->compress_output);
+    }
+    
+    // Batches read but not completely annotated and written yet
+    int num_pending_batches = 0;
+    
+    // Alleles already sent to be annotated, so each one is queried only once in the run
+    queried_alleles_t *queried_alleles = queried_alleles_new();
+    
+    // Responses from the web services, waiting to be parsed
+    int max_requests = options_data->max_requests > 0 ? options_data->max_requests : 3 * shared_options_data->num_threads;
+    list_t *response_list = (list_t*) malloc (sizeof(list_t));
+    list_init("responses", 1, 2 * max_requests, response_list);
+    
+    // Scheduler that keeps up to max_requests requests in flight, among all web services
+    ws_scheduler_t *scheduler = NULL;
+    if (!gene_model) {
+        scheduler = ws_scheduler_new(max_requests, MAX_WS_ATTEMPTS, WS_RETRY_DELAY, enqueue_ws_response, response_list);
+        LOG_DEBUG_F("max-requests = %d\n", max_requests);
+    }
     
     // Create job.status file
     char job_status_filename[output_directory_len + 10];
@@ -91,8 +186,8 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
         update_job_status_file(0, job_status);
     }
     
- 
-#pragma omp parallel sections private(start, stop, total)
+    // Reader, producer of requests, network I/O and parsers must run at the same time
+#pragma omp parallel sections private(start, stop, total) num_threads(4)
     {
 #pragma omp section
         {
@@ -119,9 +214,6 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
         
 #pragma omp section
         {
-            // Enable nested parallelism and set the number of threads the user has chosen
-            omp_set_nested(1);
-            
             LOG_DEBUG_F("Thread %d processes data\n", omp_get_thread_num());
             
             // Filters and files for filtering output
@@ -130,20 +222,19 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
             if (shared_options_data->chain != NULL) {
                 filters = sort_filter_chain(shared_options_data->chain, &num_filters);
             }
-            FILE *passed_file = NULL, *failed_file = NULL, *non_processed_file = NULL;
-            get_filtering_output_files(shared_options_data, &passed_file, &failed_file);
+            FILE *passed_file = NULL, *failed_file = NULL;
+            if (num_skipped_batches > 0) {
+                append_filtering_output_files(shared_options_data, &passed_file, &failed_file);
+            } else if (!options_data->redrive_errors) {
+                get_filtering_output_files(shared_options_data, &passed_file, &failed_file);
+            }
             
             // Pedigree information (used in some filters)
             individual_t **individuals;
             khash_t(ids) *sample_ids = NULL;
             
-            // Filename structure outdir/vcfname.errors
-            char *prefix_filename = calloc(strlen(shared_options_data->vcf_filename), sizeof(char));
-            get_filename_from_path(shared_options_data->vcf_filename, prefix_filename);
-            char *non_processed_filename = malloc((strlen(shared_options_data->output_directory) + strlen(prefix_filename) + 9) * sizeof(char));
-            sprintf(non_processed_filename, "%s/%s.errors", shared_options_data->output_directory, prefix_filename);
-            non_processed_file = fopen(non_processed_filename, "w");
-            free(non_processed_filename);
+            // Output of the annotations retrieved from the cache
+            effect_thread_output_t *cache_output = thread_outputs[0];
             
             // Maximum size processed by each thread (never allow more than 1000 variants per query)
             if (shared_options_data->batch_lines > 0) {
@@ -153,10 +244,16 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
                 shared_options_data->entries_per_thread = MAX_VARIANTS_PER_QUERY;
             }
             LOG_DEBUG_F("entries-per-thread = %d\n", shared_options_data->entries_per_thread);
+            
+            // Variants per request start at entries-per-thread and adapt to the latency of the web services
+            if (scheduler) {
+                ws_scheduler_adapt_chunk_size(shared_options_data->entries_per_thread, MIN_VARIANTS_PER_QUERY, 
+                                              MAX_VARIANTS_PER_QUERY, WS_TARGET_LATENCY, scheduler);
+            }
     
             int i = 0;
             vcf_batch_t *batch = NULL;
-            int ret_ws_0 = 0, ret_ws_1 = 0, ret_ws_2 = 0;
+            int num_services = options_data->no_phenotypes ? 1 : NUM_WS_SERVICES;
             
             start = omp_get_wtime();
 
@@ -168,12 +265,14 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
                         add_vcf_header_entry(filter_headers[j], vcf_file);
                     }
                         
-                    // Write file format, header entries and delimiter
-                    if (passed_file != NULL) { write_vcf_header(vcf_file, passed_file); }
-                    if (failed_file != NULL) { write_vcf_header(vcf_file, failed_file); }
-                    if (non_processed_file != NULL) { write_vcf_header(vcf_file, non_processed_file); }
-                    
-                    LOG_DEBUG("VCF header written\n");
+                    // Write file format, header entries and delimiter (already written when resuming)
+                    if (num_skipped_batches == 0) {
+                        if (passed_file != NULL) { write_vcf_header(vcf_file, passed_file); }
+                        if (failed_file != NULL) { write_vcf_header(vcf_file, failed_file); }
+                        if (non_processed_file != NULL) { write_vcf_header(vcf_file, non_processed_file); }
+                        
+                        LOG_DEBUG("VCF header written\n");
+                    }
                     
                     if (ped_file) {
                         // Create map to associate the position of individuals in the list of samples defined in the VCF file
@@ -183,105 +282,125 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
                     }
                 }
                 
-//                     printf("batch loaded = '%.*s'\n", 50, batch->text);
-//                     printf("batch text len = %zu\n", strlen(batch->text));
-
-//                 if (i % 10 == 0) {
-                    LOG_INFO_F("Batch %d reached by thread %d - %zu/%zu records \n", 
-                            i, omp_get_thread_num(),
-                            batch->records->size, batch->records->capacity);
-//                 }
-
-                int reconnections = 0;
-                int max_reconnections = 3; // TODO allow to configure?
+                // Batches annotated before the checkpoint of an interrupted run
+                if (i < num_skipped_batches) {
+                    vcf_batch_free(batch);
+                    i++;
+                    continue;
+                }
+                
+                LOG_INFO_F("Batch %d reached by thread %d - %zu/%zu records \n", 
+                        i, omp_get_thread_num(),
+                        batch->records->size, batch->records->capacity);
 
                 // Write records that passed to a separate file, and query the WS with them as args
                 array_list_t *failed_records = NULL;
                 int num_variables = ped_file? get_num_variables(ped_file): 0;
                 array_list_t *passed_records = filter_records(filters, num_filters, individuals, sample_ids, num_variables, batch->records, &failed_records);
-                if (passed_records->size > 0) {
-                    // Divide the list of passed records in ranges of size defined in config file
+                write_filtering_output_files(passed_records, failed_records, passed_file, failed_file);
+                
+                // Split and normalise the alleles of each record
+                array_list_t *alleles = split_alleles(passed_records);
+                
+                // The alleles whose annotations are in the cache are not requested
+                array_list_t *not_cached = alleles;
+                if (cache && alleles->size > 0) {
+                    omp_set_lock(&(cache_output->lock));
+                    not_cached = retrieve_cached_annotations(alleles, options_data->no_phenotypes, cache, cache_output);
+                    omp_unset_lock(&(cache_output->lock));
+                }
+                
+                // Each allele is requested once in the run: later occurrences get the lines of the first one, 
+                // waiting for them while it is being annotated
+                effect_batch_t *effect_batch = effect_batch_new(i, batch, passed_records, failed_records, alleles, 
+                                                                not_cached->size, &num_pending_batches);
+                array_list_t *requested_records = effect_batch->requested_records;
+                char *annotated_lines;
+                int num_waiting = claim_queried_alleles(not_cached, effect_batch, queried_alleles, requested_records, &annotated_lines);
+                
+                // Only the alleles that wait keep the batch, besides the requests
+                int num_unclaimed = not_cached->size - num_waiting;
+#pragma omp atomic
+                effect_batch->pending_requests -= num_unclaimed;
+                
+                if (annotated_lines) {
+                    omp_set_lock(&(cache_output->lock));
+                    parse_effect_response(omp_get_thread_num(), annotated_lines, cache_output);
+                    omp_unset_lock(&(cache_output->lock));
+                    free(annotated_lines);
+                }
+                
+                LOG_DEBUG_F("[%d] %zu records split into %zu alleles, %zu requested, %d waiting for a previous request\n", 
+                            omp_get_thread_num(), passed_records->size, alleles->size, requested_records->size, num_waiting);
+                if (not_cached != alleles) {
+                    array_list_free(not_cached, NULL);
+                }
+                
+                if (requested_records->size > 0 && gene_model) {
+                    // Chunks are annotated by the parser threads, without querying any web service
                     int num_chunks;
                     int *chunk_sizes;
-                    int *chunk_starts = create_chunks(passed_records->size, shared_options_data->entries_per_thread, &num_chunks, &chunk_sizes);
+                    int *chunk_starts = create_chunks(requested_records->size, shared_options_data->entries_per_thread, &num_chunks, &chunk_sizes);
                     
-                    do {
-                        // OpenMP: Launch a thread for each range
-                        #pragma omp parallel for num_threads(shared_options_data->num_threads)
-                        for (int j = 0; j < num_chunks; j++) {
-                            int tid = omp_get_thread_num();
-                            LOG_DEBUG_F("[%d] WS invocation\n", tid);
-                            LOG_DEBUG_F("[%d] -- effect WS\n", tid);
-                            if (!reconnections || ret_ws_0) {
-                                ret_ws_0 = invoke_effect_ws(urls[0], (vcf_record_t**) (passed_records->items + chunk_starts[j]), 
-                                                            chunk_sizes[j], options_data->excludes);
-                                parse_effect_response(tid, output_directory, output_directory_len, output_files, output_list, summary_count, gene_list);
-                                free(effect_line[tid]);
-                                effect_line[tid] = (char*) calloc (max_line_size[tid], sizeof(char));
-                            }
-                            
-                            if (!options_data->no_phenotypes) {
-                                if (!reconnections || ret_ws_1) {
-                                    LOG_DEBUG_F("[%d] -- snp WS\n", omp_get_thread_num());
-                                    ret_ws_1 = invoke_snp_phenotype_ws(urls[1], (vcf_record_t**) (passed_records->items + chunk_starts[j]), chunk_sizes[j]);
-                                    parse_snp_phenotype_response(tid, output_list);
-                                    free(snp_line[tid]);
-                                    snp_line[tid] = (char*) calloc (snp_max_line_size[tid], sizeof(char));
-                                }
-                                 
-                                if (!reconnections || ret_ws_2) {
-                                    LOG_DEBUG_F("[%d] -- mutation WS\n", omp_get_thread_num());
-                                    ret_ws_2 = invoke_mutation_phenotype_ws(urls[2], (vcf_record_t**) (passed_records->items + chunk_starts[j]), chunk_sizes[j]);
-                                    parse_mutation_phenotype_response(tid, output_list);
-                                    free(mutation_line[tid]);
-                                    mutation_line[tid] = (char*) calloc (mutation_max_line_size[tid], sizeof(char));
-                                }
-                            }
-                        }
-                        
-                        LOG_DEBUG_F("*** %dth web services invocation finished\n", i);
-                        
-                        if (ret_ws_0 || ret_ws_1 || ret_ws_2) {
-                            if (ret_ws_0) {
-                                LOG_ERROR_F("Effect web service error: %s\n", get_last_http_error(ret_ws_0));
-                            }
-                            if (ret_ws_1) {
-                                LOG_ERROR_F("SNP phenotype web service error: %s\n", get_last_http_error(ret_ws_1));
-                            }
-                            if (ret_ws_2) {
-                                LOG_ERROR_F("Mutations phenotype web service error: %s\n", get_last_http_error(ret_ws_2));
+#pragma omp atomic
+                    effect_batch->pending_requests += num_chunks;
+                    for (int j = 0; j < num_chunks; j++) {
+                        list_item_t *item = list_item_new(i, LOCAL_ANNOTATION_JOB, 
+                                                          effect_chunk_new(effect_batch, chunk_starts[j], chunk_sizes[j]));
+                        list_insert_item(item, response_list);
+                    }
+                    
+                    free(chunk_starts);
+                    free(chunk_sizes);
+                } else if (requested_records->size > 0) {
+                    // Divide the list of requested records in ranges of the size currently chosen by the scheduler
+                    int num_chunks;
+                    int *chunk_sizes;
+                    int *chunk_starts = create_chunks(requested_records->size, ws_scheduler_chunk_size(scheduler), &num_chunks, &chunk_sizes);
+                    
+                    // Compose all the requests before submitting them, so the batch is not released too early
+                    ws_request_t *requests[num_chunks * num_services];
+                    int num_requests = 0;
+                    for (int j = 0; j < num_chunks; j++) {
+                        vcf_record_t **chunk_records = (vcf_record_t**) (requested_records->items + chunk_starts[j]);
+                        for (int s = 0; s < num_services; s++) {
+                            char *body = compose_effect_ws_body(s, chunk_records, chunk_sizes[j], options_data->excludes);
+                            if (body) {
+                                requests[num_requests++] = ws_request_new(urls[s], body, s, 
+                                                                          effect_chunk_new(effect_batch, chunk_starts[j], chunk_sizes[j]));
                             }
-                            
-                            // In presence of errors, wait 4 seconds before retrying
-                            reconnections++;
-                            LOG_ERROR_F("Some errors ocurred, reconnection #%d\n", reconnections);
-                            sleep(4);
-                        } else {
-                            free(chunk_starts);
-                            free(chunk_sizes);
                         }
-                    } while (reconnections < max_reconnections && (ret_ws_0 || ret_ws_1 || ret_ws_2));
-                }
-                
-                // If the maximum number of reconnections was reached still with errors, 
-                // write the non-processed batch to the corresponding file
-                if (reconnections == max_reconnections && (ret_ws_0 || ret_ws_1 || ret_ws_2)) {
-                #pragma omp critical
-                    {
-                        write_vcf_batch(batch, non_processed_file);
                     }
+                    
+#pragma omp atomic
+                    effect_batch->pending_requests += num_requests;
+                    for (int j = 0; j < num_requests; j++) {
+                        ws_scheduler_submit(requests[j], scheduler);
+                    }
+                    
+                    free(chunk_starts);
+                    free(chunk_sizes);
                 }
                 
-                // Write records that passed and failed filters to separate files, and free them
-                write_filtering_output_files(passed_records, failed_records, passed_file, failed_file);
-                free_filtered_records(passed_records, failed_records, batch->records);
-                
-                // Free batch and its contents
-                vcf_batch_free(batch);
+                // The batch is freed once its requests and waiting alleles have been processed
+                release_effect_batch(effect_batch, non_processed_file);
                 
                 i++;
+                
+                // Checkpoints are written when all the batches read so far have been annotated
+                if (checkpoints_enabled && i % EFFECT_CHECKPOINT_INTERVAL == 0) {
+                    wait_for_pending_batches(&num_pending_batches);
+                    write_effect_checkpoint(i, shared_options_data, summary_count, gene_list, thread_outputs, num_outputs);
+                }
             }
 
+            // No more requests will be sent to the web services
+            if (scheduler) {
+                ws_scheduler_close(scheduler);
+            } else {
+                list_decr_writers(response_list);
+            }
+            
             stop = omp_get_wtime();
 
             total = stop - start;
@@ -292,7 +411,6 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
             // Free resources
             if (passed_file) { fclose(passed_file); }
             if (failed_file) { fclose(failed_file); }
-            if (non_processed_file) { fclose(non_processed_file); }
             
             // Free filters
             for (i = 0; i < num_filters; i++) {
@@ -300,72 +418,124 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
                 filter->free_func(filter);
             }
             free(filters);
-            
-            // Decrease list writers count
-            for (i = 0; i < shared_options_data->num_threads; i++) {
-                list_decr_writers(output_list);
+        }
+        
+#pragma omp section
+        {
+            // Thread which sends the requests to the web services and receives their responses
+            if (scheduler) {
+                LOG_DEBUG_F("Thread %d invokes the web services\n", omp_get_thread_num());
+                
+                int num_failed = ws_scheduler_run(scheduler);
+                if (num_failed > 0) {
+                    LOG_ERROR_F("%d web service requests failed after %d attempts\n", num_failed, MAX_WS_ATTEMPTS);
+                }
+                
+                list_decr_writers(response_list);
             }
         }
         
 #pragma omp section
         {
-            // Thread which writes the results to all_variants, summary and one file per consequence type
-            int ret = 0;
-            char *line;
-            list_item_t* item = NULL;
-            FILE *fd = NULL;
+            // Enable nested parallelism and set the number of threads the user has chosen
+            omp_set_nested(1);
             
-            FILE *all_variants_file = cp_hashtable_get(output_files, "all_variants");
-            FILE *snp_phenotype_file = cp_hashtable_get(output_files, "snp_phenotypes");
-            FILE *mutation_phenotype_file = cp_hashtable_get(output_files, "mutation_phenotypes");
+            LOG_DEBUG_F("Thread %d parses the web services responses\n", omp_get_thread_num());
             
-            while ((item = list_remove_item(output_list)) != NULL) {
-                line = item->data_p;
+#pragma omp parallel num_threads(shared_options_data->num_threads)
+            {
+                int tid = omp_get_thread_num();
+                list_item_t *item = NULL;
                 
-                // Type greater than 0: consequence type identified by its SO code
-                // Type equals to -1: SNP phenotype
-                // Type equals to -2: mutation phenotype
-                if (item->type > 0) {
-                    // Write entry in the consequence type file
-                    fd = cp_hashtable_get(output_files, &(item->type));
-                    int ret = fprintf(fd, "%s\n", line);
-                    if (ret < 0) {
-                        LOG_ERROR_F("Error writing to file: '%s'\n", line);
-                    }
+                // Lines and counters are accumulated per thread, and written in blocks
+                effect_thread_output_t *thread_output = thread_outputs[tid + 1];
+                
+                while ((item = list_remove_item(response_list)) != NULL) {
+                    // Checkpoints can't be written while the buffers are being modified
+                    omp_set_lock(&(thread_output->lock));
                     
-                    // Write in all_variants
-                    ret = fprintf(all_variants_file, "%s\n", line);
-                    if (ret < 0) {
-                        LOG_ERROR_F("Error writing to all_variants: '%s'\n", line);
+                    if (item->type == LOCAL_ANNOTATION_JOB) {
+                        effect_chunk_t *chunk = item->data_p;
+                        vcf_record_t **chunk_records = (vcf_record_t**) (chunk->batch->requested_records->items + chunk->start);
+                        
+                        char *response = annotate_variants_locally(chunk_records, chunk->size, gene_model, options_data->excludes);
+                        parse_effect_response(tid, response, thread_output);
+                        release_allele_waiters(tid, annotate_queried_alleles(chunk_records, chunk->size, response, queried_alleles), 
+                                               thread_output, non_processed_file);
+                        free(response);
+                        
+                        release_effect_chunk(chunk, non_processed_file);
+                        list_item_free(item);
+                        omp_unset_lock(&(thread_output->lock));
+                        continue;
                     }
                     
-                } else if (item->type == SNP_PHENOTYPE) {
-                    ret = fprintf(snp_phenotype_file, "%s\n", line);
-                    if (ret < 0) {
-                        LOG_ERROR_F("Error writing to snp_phenotypes: '%s'\n", line);
-                    }
+                    ws_request_t *request = item->data_p;
+                    effect_chunk_t *chunk = request->data;
+                    vcf_record_t **chunk_records = (vcf_record_t**) (chunk->batch->requested_records->items + chunk->start);
                     
-                } else if (item->type == MUTATION_PHENOTYPE) {
-                    ret = fprintf(mutation_phenotype_file, "%s\n", line);
-                    if (ret < 0) {
-                        LOG_ERROR_F("Error writing to mutation_phenotypes: '%s'\n", line);
+                    if (ws_request_succeeded(request)) {
+                        if (cache) {
+                            effect_cache_store_response(request->service, chunk_records, chunk->size, request->response, cache);
+                        }
+                        
+                        if (request->service == EFFECT_WS) {
+                            parse_effect_response(tid, request->response, thread_output);
+                            release_allele_waiters(tid, annotate_queried_alleles(chunk_records, chunk->size, request->response, queried_alleles), 
+                                                   thread_output, non_processed_file);
+                        } else if (request->service == SNP_PHENOTYPE_WS) {
+                            parse_snp_phenotype_response(tid, request->response, thread_output);
+                        } else {
+                            parse_mutation_phenotype_response(tid, request->response, thread_output);
+                        }
+                    } else {
+                        LOG_ERROR_F("[%d] Error in %s web service for batch %d: %s\n", tid, 
+                                    ws_service_names[request->service], chunk->batch->id, ws_request_error(request));
+#pragma omp critical (effect_batch_failed)
+                        {
+                            memset(chunk->batch->failed_requested + chunk->start, 1, chunk->size);
+                            chunk->batch->failed = 1;
+                        }
+                        // The occurrences waiting for these alleles fail too, and later ones are requested again
+                        release_allele_waiters(tid, fail_queried_alleles(chunk_records, chunk->size, queried_alleles), 
+                                               thread_output, non_processed_file);
                     }
+                    
+                    release_effect_chunk(chunk, non_processed_file);
+                    ws_request_free(request);
+                    list_item_free(item);
+                    omp_unset_lock(&(thread_output->lock));
                 }
-                
-                free(line);
-                list_item_free(item);
             }
-            
         }
     }
 
-    write_summary_file(summary_count, cp_hashtable_get(output_files, "summary"));
+    for (int i = 0; i < num_outputs; i++) {
+        effect_thread_output_free(thread_outputs[i], summary_count, gene_list);
+    }
+    
+    write_summary_file(summary_count, summary_file);
+    fclose(summary_file);
     write_genes_with_variants_file(gene_list, output_directory);
-    write_result_file(shared_options_data, options_data, summary_count, output_directory);
+    write_result_file(shared_options_data, options_data, scheduler, summary_count, output_directory);
 
+    if (non_processed_file) { fclose(non_processed_file); }
+    
+    // The run finished, so there is nothing to resume or re-drive from
+    if (checkpoints_enabled) {
+        remove_effect_checkpoint(output_directory);
+    }
+    if (redrive_filename) {
+        unlink(redrive_filename);
+        free(redrive_filename);
+    }
+    
     free_output_data_structures(output_files, summary_count, gene_list);
-    free_ws_buffers(shared_options_data->num_threads);
-    free(output_list);
+    queried_alleles_free(queried_alleles);
+    effect_cache_close(cache);
+    if (scheduler) { ws_scheduler_free(scheduler); }
+    gene_model_free(gene_model);
+    free(response_list);
     vcf_close(vcf_file);
     
     update_job_status_file(100, job_status);
@@ -375,130 +545,347 @@ int run_effect(char **urls, shared_options_data_t *shared_options_data, effect_o
 }
 
 
+/* **********************************************
+ *          Web services invocation             *
+ * **********************************************/
 
-static void parse_effect_response(int tid, char *output_directory, size_t output_directory_len, cp_hashtable *output_files, 
-                                  list_t *output_list, cp_hashtable *summary_count, cp_hashtable *gene_list) {
-    int *SO_found = (int*) malloc (sizeof(int)); // Whether the SO code field has been found
-    int *count;
-    char tmp_consequence_type[128];
-    
-    int num_lines;
-    char **split_batch = split(effect_line[tid], "\n", &num_lines);
+static char *compose_effect_ws_body(int service, vcf_record_t **records, int num_records, char *excludes) {
+    size_t variants_len = 1;
+    for (int i = 0; i < num_records; i++) {
+        variants_len += records[i]->chromosome_len + records[i]->reference_len + records[i]->alternate_len + 
+                        records[i]->id_len + 24;
+    }
     
-    for (int i = 0; i < num_lines; i++) {
-        int num_columns;
-        char *copy_buf = strdup(split_batch[i]);
-        char **split_result = split(copy_buf, "\t", &num_columns);
-        free(copy_buf);
+    char *variants = (char*) calloc (variants_len, sizeof(char));
+    char *current = variants;
+    for (int i = 0; i < num_records; i++) {
+        vcf_record_t *record = records[i];
+        // Alleles of the same record share its ID, and phenotypes only need to be requested once for them
+        if (service != EFFECT_WS && i > 0 && record->id && record->id == records[i-1]->id) {
+            continue;
+        }
         
-        // Find consequence type name (always after SO field)
-        *SO_found = 0;
-        if (num_columns == 25) {
-//             LOG_DEBUG_F("gene = %s\tSO = %d\tCT = %s\n", split_result[17], atoi(split_result[18] + 3), split_result[19]);
-            if (!cp_hashtable_contains(gene_list, split_result[17])) {
-                cp_hashtable_put(gene_list, strdup(split_result[17]), NULL);
+        if (service == SNP_PHENOTYPE_WS) {
+            // Only variants with an ID can be searched in the SNP phenotype web service
+            if (record->id_len > 0 && strncmp(record->id, ".", record->id_len)) {
+                current += sprintf(current, "%.*s,", record->id_len, record->id);
             }
-            *SO_found = atoi(split_result[18] + 3);
-           memset(tmp_consequence_type, 0, 128 * sizeof(char));
-           strncat(tmp_consequence_type, split_result[19], strlen(split_result[19]));
         } else {
-            if (strlen(split_batch[i]) == 0) { // Last line in batch could be only a newline
-                continue;
+            current += sprintf(current, "%.*s:%ld:%.*s:%.*s,", record->chromosome_len, record->chromosome, 
+                               (long) record->position, record->reference_len, record->reference, 
+                               record->alternate_len, record->alternate);
+        }
+    }
+    
+    if (current == variants) {
+        free(variants);
+        return NULL;
+    }
+    *(current - 1) = '\0';  // Remove last comma
+    
+    char *params[3] = { "of", (service == SNP_PHENOTYPE_WS) ? "snps" : "variants", "exclude" };
+    char *values[3] = { "txt", variants, (service == EFFECT_WS && excludes && strlen(excludes) > 0) ? excludes : NULL };
+    char *body = compose_ws_post_body(params, values, 3);
+    
+    free(variants);
+    return body;
+}
+
+static void enqueue_ws_response(ws_request_t *request, void *response_list) {
+    list_item_t *item = list_item_new(request->service, 0, request);
+    list_insert_item(item, response_list);
+}
+
+static effect_batch_t *effect_batch_new(int id, vcf_batch_t *vcf_batch, array_list_t *passed_records, 
+                                        array_list_t *failed_records, array_list_t *alleles, 
+                                        int max_requested, int *num_pending_batches) {
+    effect_batch_t *batch = (effect_batch_t*) malloc (sizeof(effect_batch_t));
+    batch->id = id;
+    batch->vcf_batch = vcf_batch;
+    batch->passed_records = passed_records;
+    batch->failed_records = failed_records;
+    batch->alleles = alleles;
+    batch->requested_records = array_list_new(max_requested + 1, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    batch->failed_requested = (char*) calloc (max_requested + 1, sizeof(char));
+    batch->failed_alleles = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    // Held by the thread composing the requests, and by every allele that may wait for another request
+    batch->pending_requests = 1 + max_requested;
+    batch->failed = 0;
+    batch->num_pending_batches = num_pending_batches;
+    
+#pragma omp atomic
+    (*num_pending_batches)++;
+    
+    return batch;
+}
+
+static void effect_batch_free(effect_batch_t *batch) {
+    int *num_pending_batches = batch->num_pending_batches;
+    
+    array_list_free(batch->requested_records, NULL);
+    array_list_free(batch->failed_alleles, NULL);
+    array_list_free(batch->alleles, free);
+    free_filtered_records(batch->passed_records, batch->failed_records, batch->vcf_batch->records);
+    vcf_batch_free(batch->vcf_batch);
+    free(batch->failed_requested);
+    free(batch);
+    
+#pragma omp atomic
+    (*num_pending_batches)--;
+}
+
+static effect_chunk_t *effect_chunk_new(effect_batch_t *batch, int start, int size) {
+    effect_chunk_t *chunk = (effect_chunk_t*) malloc (sizeof(effect_chunk_t));
+    chunk->batch = batch;
+    chunk->start = start;
+    chunk->size = size;
+    return chunk;
+}
+
+static void release_effect_chunk(effect_chunk_t *chunk, FILE *non_processed_file) {
+    effect_batch_t *batch = chunk->batch;
+    free(chunk);
+    release_effect_batch(batch, non_processed_file);
+}
+
+static void release_effect_batch(effect_batch_t *batch, FILE *non_processed_file) {
+    int pending_requests, failed;
+    
+#pragma omp atomic capture
+    pending_requests = --(batch->pending_requests);
+    
+    if (pending_requests > 0) {
+        return;
+    }
+    
+    // If some request failed after all its attempts, or some allele waited for a request that failed, 
+    // write the records with any of the non-processed alleles to the corresponding file
+#pragma omp atomic read
+    failed = batch->failed;
+    if (failed && non_processed_file) {
+        khash_t(allele_keys) *failed_alleles = kh_init(allele_keys);
+        int ret;
+        for (int i = 0; i < batch->requested_records->size; i++) {
+            if (batch->failed_requested[i]) {
+                char *key = compose_allele_key(batch->requested_records->items[i]);
+                kh_put(allele_keys, failed_alleles, key, &ret);
+                if (!ret) {
+                    free(key);
+                }
             }
-            
-            LOG_INFO_F("[%d] Non-valid line found (%d fields): '%s'\n", tid, num_columns, split_batch[i]);
-            
-            for (int s = 0; s < num_columns; s++) {
-                free(split_result[s]);
+        }
+        for (int i = 0; i < batch->failed_alleles->size; i++) {
+            char *key = compose_allele_key(batch->failed_alleles->items[i]);
+            kh_put(allele_keys, failed_alleles, key, &ret);
+            if (!ret) {
+                free(key);
             }
-            free(split_result);
-            continue;
         }
         
-        for (int s = 0; s < num_columns; s++) {
-            free(split_result[s]);
+#pragma omp critical
+        {
+            for (int i = 0; i < batch->passed_records->size; i++) {
+                if (record_has_allele(batch->passed_records->items[i], failed_alleles)) {
+                    write_vcf_record(batch->passed_records->items[i], non_processed_file);
+                }
+            }
         }
-        free(split_result);
         
-        if (!*SO_found) { // SO:000000 is not valid
-            LOG_INFO_F("[%d] Non-valid SO found (0)\n", tid);
-            continue;
+        for (khiter_t iter = kh_begin(failed_alleles); iter != kh_end(failed_alleles); ++iter) {
+            if (kh_exist(failed_alleles, iter)) {
+                free((char*) kh_key(failed_alleles, iter));
+            }
         }
+        kh_destroy(allele_keys, failed_alleles);
+    }
+    
+    effect_batch_free(batch);
+}
 
-//         LOG_DEBUG_F("[%d] SO found = %d\n", tid, *SO_found);
-        size_t consequence_type_len = strlen(tmp_consequence_type);
-     
-        // If file does not exist, create its descriptor and summary counter
-        FILE *aux_file = cp_hashtable_get(output_files, SO_found);
-        if (!aux_file) {
-#pragma omp critical
+static void release_allele_waiters(int tid, allele_waiter_t *waiters, effect_thread_output_t *output, FILE *non_processed_file) {
+    while (waiters) {
+        allele_waiter_t *waiter = waiters;
+        effect_batch_t *batch = waiter->owner;
+        waiters = waiter->next;
+        
+        if (waiter->lines) {
+            parse_effect_response(tid, (char*) waiter->lines, output);
+        } else {
+#pragma omp critical (effect_batch_failed)
             {
-                // This construction avoids 2 threads trying to insert the same CT
-                aux_file = cp_hashtable_get(output_files, SO_found);
-                if (!aux_file) {
-                    char filename[output_directory_len + consequence_type_len + 6];
-                    memset(filename, 0, (output_directory_len + consequence_type_len + 6) * sizeof(char));
-                    strncat(filename, output_directory, output_directory_len);
-                    strncat(filename, "/", 1);
-                    strncat(filename, tmp_consequence_type, consequence_type_len);
-                    strncat(filename, ".txt", 4);
-                    aux_file = fopen(filename, "a");
-                    
-                    // Add to hashtables (file descriptors and summary counters)
-                    int *SO_stored = (int*) malloc (sizeof(int));
-                    *SO_stored = *SO_found;
-                    cp_hashtable_put(output_files, SO_stored, aux_file);
+                array_list_insert(waiter->allele, batch->failed_alleles);
+                batch->failed = 1;
+            }
+        }
+        
+        free(waiter);
+        release_effect_batch(batch, non_processed_file);
+    }
+}
+
+static void wait_for_pending_batches(int *num_pending_batches) {
+    int pending_batches;
+    while (1) {
+#pragma omp atomic read
+        pending_batches = *num_pending_batches;
+        if (pending_batches == 0) {
+            break;
+        }
+        usleep(1000);
+    }
+}
+
+
+/* **********************************************
+ *              Response management             *
+ * **********************************************/
 
-                    LOG_INFO_F("[%d] New consequence type found = %s\n", tid, tmp_consequence_type);
+static void parse_effect_response(int tid, char *response, effect_thread_output_t *output) {
+    // Offset of the start of each column in the current line, plus one past the end of the last one
+    size_t column_starts[EFFECT_WS_NUM_COLUMNS + 1];
+    const char *line = response;
+    
+    while (*line) {
+        // Single pass over the line, recording where each column starts
+        const char *c = line;
+        int num_columns = 1;
+        column_starts[0] = 0;
+        for ( ; *c && *c != '\n'; c++) {
+            if (*c == '\t') {
+                if (num_columns < EFFECT_WS_NUM_COLUMNS) {
+                    column_starts[num_columns] = c - line + 1;
                 }
+                num_columns++;
             }
         }
+        size_t line_len = c - line;
         
-        // Write line[tid] to file corresponding to its consequence type
-        if (aux_file) { 
-#pragma omp critical
-            {
-                // TODO move critical one level below?
-                count = (int*) cp_hashtable_get(summary_count, tmp_consequence_type);
-                if (count == NULL) {
-                    char *consequence_type = (char*) calloc (consequence_type_len+1, sizeof(char));
-                    strncat(consequence_type, tmp_consequence_type, consequence_type_len);
-                    assert(!strcmp(consequence_type, tmp_consequence_type));
-                    count = (int*) malloc (sizeof(int));
-                    *count = 0;
-                    cp_hashtable_put(summary_count, consequence_type, count);
-//                     LOG_DEBUG_F("[%d] Initialized summary count for %s\n", tmp_consequence_type);
+        if (num_columns == EFFECT_WS_NUM_COLUMNS) {
+            column_starts[num_columns] = line_len + 1;
+            
+            const char *gene = line + column_starts[EFFECT_WS_GENE_COLUMN];
+            size_t gene_len = column_starts[EFFECT_WS_GENE_COLUMN + 1] - column_starts[EFFECT_WS_GENE_COLUMN] - 1;
+            const char *SO = line + column_starts[EFFECT_WS_SO_COLUMN];
+            size_t SO_len = column_starts[EFFECT_WS_SO_COLUMN + 1] - column_starts[EFFECT_WS_SO_COLUMN] - 1;
+            const char *consequence_type = line + column_starts[EFFECT_WS_CT_COLUMN];
+            size_t consequence_type_len = column_starts[EFFECT_WS_CT_COLUMN + 1] - column_starts[EFFECT_WS_CT_COLUMN] - 1;
+            
+            // Find consequence type code (SO:xxxxxxx), a non-digit always follows it
+            int SO_found = (SO_len > 3) ? atoi(SO + 3) : 0;
+            if (SO_found) {
+                if (gene_len == 1 && *gene == '-') {
+                    gene_len = 0;
                 }
-                // Increment counter for summary
-                (*count)++;
+                add_consequence_type_line(line, line_len, SO_found, consequence_type, consequence_type_len, 
+                                          gene, gene_len, output);
+            } else { // SO:000000 is not valid
+                LOG_INFO_F("[%d] Non-valid SO found (0)\n", tid);
             }
-            
-//             LOG_DEBUG_F("[%d] before writing %s\n", tid, tmp_consequence_type);
-            list_item_t *output_item = list_item_new(tid, *SO_found, strdup(split_batch[i]));
-            list_insert_item(output_item, output_list);
-//             LOG_DEBUG_F("[%d] after writing %s\n", tid, tmp_consequence_type);
+        } else if (line_len > 0) { // Last line in batch could be only a newline
+            LOG_INFO_F("[%d] Non-valid line found (%d fields): '%.*s'\n", tid, num_columns, (int) line_len, line);
         }
+        
+        line = *c ? c + 1 : c;
     }
-    
-    for (int i = 0; i < num_lines; i++) {
-        free(split_batch[i]);
+}
+
+static void parse_snp_phenotype_response(int tid, char *response, effect_thread_output_t *output) {
+    size_t lines_len;
+    const char *lines = trim_view(response, &lines_len);
+    if (lines_len > 0) {
+        add_snp_phenotype_lines(lines, lines_len, output);
     }
-    free(split_batch);
 }
 
-static void parse_snp_phenotype_response(int tid, list_t *output_list) {
-    list_item_t *output_item = list_item_new(tid, SNP_PHENOTYPE, trim(strdup(snp_line[tid])));
-    list_insert_item(output_item, output_list);
+static void parse_mutation_phenotype_response(int tid, char *response, effect_thread_output_t *output) {
+    size_t lines_len;
+    const char *lines = trim_view(response, &lines_len);
+    if (lines_len > 0) {
+        add_mutation_phenotype_lines(lines, lines_len, output);
+    }
+}
+
+static const char *trim_view(const char *text, size_t *len) {
+    while (isspace((unsigned char) *text)) {
+        text++;
+    }
+    size_t text_len = strlen(text);
+    while (text_len > 0 && isspace((unsigned char) text[text_len - 1])) {
+        text_len--;
+    }
+    *len = text_len;
+    return text;
 }
 
-static void parse_mutation_phenotype_response(int tid, list_t *output_list) {
-    list_item_t *output_item = list_item_new(tid, MUTATION_PHENOTYPE, trim(strdup(mutation_line[tid])));
-    list_insert_item(output_item, output_list);
+
+static array_list_t *retrieve_cached_annotations(array_list_t *records, int no_phenotypes, effect_cache_t *cache, 
+                                                 effect_thread_output_t *output) {
+    int tid = omp_get_thread_num();
+    array_list_t *requested_records = array_list_new(records->size + 1, 1, COLLECTION_MODE_ASYNCHRONIZED);
+    
+    // Lines of the cached variants, parsed all together as if they were a single response
+    size_t buffers_len[NUM_CACHE_SOURCES] = { 0, 0, 0 };
+    size_t buffers_capacity[NUM_CACHE_SOURCES] = { 0, 0, 0 };
+    char *buffers[NUM_CACHE_SOURCES] = { NULL, NULL, NULL };
+    vcf_record_t *previous_found = NULL;
+    
+    for (int i = 0; i < records->size; i++) {
+        vcf_record_t *record = records->items[i];
+        const char *lines[NUM_CACHE_SOURCES];
+        size_t lines_len[NUM_CACHE_SOURCES];
+        
+        // A variant is only taken from the cache if all the annotations required are stored
+        int num_sources = no_phenotypes ? 1 : NUM_CACHE_SOURCES;
+        int found = 1;
+        for (int s = 0; s < num_sources && found; s++) {
+            found = effect_cache_lookup(s, record, cache, &lines[s], &lines_len[s]);
+        }
+        
+        if (!found) {
+            array_list_insert(record, requested_records);
+            continue;
+        }
+        
+        for (int s = 0; s < num_sources; s++) {
+            // Alleles of the same record share their phenotypes, which are only written once
+            if (s != CONSEQUENCE_TYPE_CACHE && previous_found && record->id && record->id == previous_found->id) {
+                continue;
+            }
+            if (buffers_len[s] + lines_len[s] + 1 > buffers_capacity[s]) {
+                buffers_capacity[s] = 2 * (buffers_len[s] + lines_len[s] + 1);
+                buffers[s] = realloc(buffers[s], buffers_capacity[s]);
+            }
+            memcpy(buffers[s] + buffers_len[s], lines[s], lines_len[s]);
+            buffers_len[s] += lines_len[s];
+            buffers[s][buffers_len[s]] = '\0';
+        }
+        previous_found = record;
+    }
+    
+    LOG_DEBUG_F("[%d] %zu variants found in annotations cache, %zu will be requested\n", 
+                tid, records->size - requested_records->size, requested_records->size);
+    
+    if (buffers_len[CONSEQUENCE_TYPE_CACHE] > 0) {
+        parse_effect_response(tid, buffers[CONSEQUENCE_TYPE_CACHE], output);
+    }
+    if (buffers_len[SNP_PHENOTYPE_CACHE] > 0) {
+        parse_snp_phenotype_response(tid, buffers[SNP_PHENOTYPE_CACHE], output);
+    }
+    if (buffers_len[MUTATION_PHENOTYPE_CACHE] > 0) {
+        parse_mutation_phenotype_response(tid, buffers[MUTATION_PHENOTYPE_CACHE], output);
+    }
+    
+    for (int s = 0; s < NUM_CACHE_SOURCES; s++) {
+        free(buffers[s]);
+    }
+    
+    return requested_records;
 }
 
 
 
-static int initialize_output_files(char *output_directory, size_t output_directory_len, cp_hashtable **output_files) {
+static int initialize_output_files(char *output_directory, size_t output_directory_len, int compressed, 
+                                   cp_hashtable **output_files, FILE **summary_file) {
     // Initialize collections of file descriptors
     *output_files = cp_hashtable_create_by_option(COLLECTION_MODE_DEEP,
                                                   50,
@@ -507,12 +894,15 @@ static int initialize_output_files(char *output_directory, size_t output_directo
                                                   NULL,
                                                   (cp_destructor_fn) free_file_key1,
                                                   NULL,
-                                                  (cp_destructor_fn) free_file_descriptor
+                                                  compressed ? (cp_destructor_fn) free_compressed_file :
+                                                               (cp_destructor_fn) free_file_descriptor
                                                  );
     
-    char all_variants_filename[output_directory_len + 18];
-    sprintf(all_variants_filename, "%s/all_variants.txt", output_directory);
-    FILE *all_variants_file = fopen(all_variants_filename, "a");
+    // Only all_variants is indexed, as the phenotypes files don't start with the variant coordinates
+    char *extension = compressed ? "txt.gz" : "txt";
+    char all_variants_filename[output_directory_len + 21];
+    sprintf(all_variants_filename, "%s/all_variants.%s", output_directory, extension);
+    void *all_variants_file = open_output_file(all_variants_filename, compressed, 1);
     if (!all_variants_file) {   // Can't store results
         return 1;
     }
@@ -520,30 +910,28 @@ static int initialize_output_files(char *output_directory, size_t output_directo
     strncat(key, "all_variants", 12);
     cp_hashtable_put(*output_files, key, all_variants_file);
     
+    // The summary is always plain text, and written once at the end of the run
     char summary_filename[output_directory_len + 13];
     sprintf(summary_filename, "%s/summary.txt", output_directory);
-    FILE *summary_file = fopen(summary_filename, "a");
-    if (!summary_file) {   // Can't store results
+    *summary_file = fopen(summary_filename, "a");
+    if (!*summary_file) {   // Can't store results
         return 2;
     }
-    key = (char*) calloc (8, sizeof(char));
-    strncat(key, "summary", 7);
-    cp_hashtable_put(*output_files, key, summary_file);
     
-    char snp_phenotype_filename[output_directory_len + 20];
-    sprintf(snp_phenotype_filename, "%s/snp_phenotypes.txt", output_directory);
-    FILE *snp_phenotype_file = fopen(snp_phenotype_filename, "a");
-    if (!snp_phenotype_filename) {
+    char snp_phenotype_filename[output_directory_len + 23];
+    sprintf(snp_phenotype_filename, "%s/snp_phenotypes.%s", output_directory, extension);
+    void *snp_phenotype_file = open_output_file(snp_phenotype_filename, compressed, 0);
+    if (!snp_phenotype_file) {
         return 3;
     }
     key = (char*) calloc (15, sizeof(char));
     strncat(key, "snp_phenotypes", 14);
     cp_hashtable_put(*output_files, key, snp_phenotype_file);
     
-    char mutation_phenotype_filename[output_directory_len + 25];
-    sprintf(mutation_phenotype_filename, "%s/mutation_phenotypes.txt", output_directory);
-    FILE *mutation_phenotype_file = fopen(mutation_phenotype_filename, "a");
-    if (!mutation_phenotype_filename) {
+    char mutation_phenotype_filename[output_directory_len + 28];
+    sprintf(mutation_phenotype_filename, "%s/mutation_phenotypes.%s", output_directory, extension);
+    void *mutation_phenotype_file = open_output_file(mutation_phenotype_filename, compressed, 0);
+    if (!mutation_phenotype_file) {
         return 3;
     }
     key = (char*) calloc (20, sizeof(char));
@@ -553,11 +941,11 @@ static int initialize_output_files(char *output_directory, size_t output_directo
     return 0;
 }
 
-static void initialize_output_data_structures(shared_options_data_t *shared_options, list_t **output_list, cp_hashtable **summary_count, cp_hashtable **gene_list) {
-    // Initialize output text list
-    *output_list = (list_t*) malloc (sizeof(list_t));
-    list_init("output", shared_options->num_threads, shared_options->max_batches * shared_options->batch_lines, *output_list);
-    
+static void *open_output_file(char *filename, int compressed, int indexed) {
+    return compressed ? (void*) bgzf_open(filename, indexed) : (void*) fopen(filename, "a");
+}
+
+static void initialize_output_data_structures(cp_hashtable **summary_count, cp_hashtable **gene_list) {
     // Initialize summary counters and genes list
     *summary_count = cp_hashtable_create_by_option(COLLECTION_MODE_DEEP,
                                                  64,
@@ -597,6 +985,11 @@ static void free_file_descriptor(FILE *fd) {
     fclose(fd);
 }
 
+static void free_compressed_file(bgzf_file_t *file) {
+    LOG_DEBUG_F("Free compressed file %s\n", file->filename);
+    bgzf_close(file);
+}
+
 static void free_file_key2(char *key) {
     LOG_DEBUG_F("Free file key 2: %s\n", key);
     free(key);
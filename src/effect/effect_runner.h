@@ -31,10 +31,12 @@
  */ 
 
 #include <assert.h>
+#include <ctype.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <omp.h>
 
@@ -52,18 +54,81 @@
 #include <containers/list.h>
 #include <containers/cprops/hashtable.h>
 
+#include "bgzf_output.h"
 #include "effect.h"
+#include "effect_alleles.h"
+#include "effect_cache.h"
+#include "effect_checkpoint.h"
+#include "effect_output.h"
 #include "error.h"
 #include "hpg_variant_utils.h"
+#include "local_annotation.h"
+#include "ws_scheduler.h"
 
 #define MAX_VARIANTS_PER_QUERY  1000
+#define MIN_VARIANTS_PER_QUERY  10
+#define MAX_WS_ATTEMPTS         3
+/**
+ * Seconds a request to the web services should take, slower ones reduce the variants per request.
+ */
+#define WS_TARGET_LATENCY       10
+
+/**
+ * Columns of the lines returned by the consequence type web service.
+ */
+#define EFFECT_WS_NUM_COLUMNS   25
+#define EFFECT_WS_GENE_COLUMN   17
+#define EFFECT_WS_SO_COLUMN     18
+#define EFFECT_WS_CT_COLUMN     19
+#define WS_RETRY_DELAY          4
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
 
 enum phenotype_source { SNP_PHENOTYPE = -1, MUTATION_PHENOTYPE = -2};
 
-// Line buffers and their maximum size (one per thread)
-extern char **effect_line, **snp_line, **mutation_line;
-extern int *max_line_size, *snp_max_line_size, *mutation_max_line_size;
+/**
+ * Web services queried for each variant, in the same order as their URLs and the sources of the 
+ * annotations cache.
+ */
+enum ws_service { EFFECT_WS = CONSEQUENCE_TYPE_CACHE, SNP_PHENOTYPE_WS = SNP_PHENOTYPE_CACHE, 
+                  MUTATION_PHENOTYPE_WS = MUTATION_PHENOTYPE_CACHE, NUM_WS_SERVICES };
+
+static const char *ws_service_names[NUM_WS_SERVICES] = { "effect", "SNP phenotype", "mutation phenotype" };
+
+/**
+ * Type of the items of the responses list that contain a chunk to be annotated with the local gene 
+ * model, instead of the response of a web service.
+ */
+#define LOCAL_ANNOTATION_JOB    NUM_WS_SERVICES
+
+/**
+ * @brief Batch of variants whose annotations are being requested to the web services.
+ * 
+ * The records in a batch are shared by all the requests composed from it, so the batch is only 
+ * freed when the responses of all its requests have been processed, and its alleles that wait 
+ * for the annotation of a previous occurrence have received it.
+ */
+typedef struct effect_batch {
+    int id;                             /**< Position of the batch in the input file. */
+    vcf_batch_t *vcf_batch;             /**< Batch as read from the input file. */
+    array_list_t *passed_records;       /**< Records that passed the filters. */
+    array_list_t *failed_records;       /**< Records that did not pass the filters. */
+    array_list_t *alleles;              /**< Normalised alleles of the passed records. */
+    array_list_t *requested_records;    /**< Alleles whose annotations are not cached, nor queried before in the run. */
+    char *failed_requested;             /**< Whether each requested allele belongs to a failed request. */
+    array_list_t *failed_alleles;       /**< Alleles that waited for a request of another occurrence that failed. */
+    int pending_requests;               /**< Requests and waiting alleles not processed yet, plus one while composing the requests. */
+    int failed;                         /**< Whether any request failed after all its attempts. */
+    int *num_pending_batches;           /**< Batches of the run not freed yet, shared by all of them. */
+} effect_batch_t;
+
+/**
+ * @brief Range of records of a batch sent in a single request.
+ */
+typedef struct effect_chunk {
+    effect_batch_t *batch;
+    int start;
+    int size;
+} effect_chunk_t;
 
 
 /**
@@ -83,6 +148,58 @@ extern int *max_line_size, *snp_max_line_size, *mutation_max_line_size;
 int run_effect(char **urls, shared_options_data_t *global_options_data, effect_options_data_t *options_data);
 
 
+/* **********************************************
+ *          Web services invocation             *
+ * **********************************************/
+
+/**
+ * @brief Composes the body of a request to a web service for a range of records.
+ * @return The URL-encoded body, or NULL if no record can be searched in the web service
+ */
+static char *compose_effect_ws_body(int service, vcf_record_t **records, int num_records, char *excludes);
+
+/**
+ * @brief Callback of the web services scheduler, which queues a finished request for parsing.
+ */
+static void enqueue_ws_response(ws_request_t *request, void *response_list);
+
+/**
+ * @brief Creates a batch with room for max_requested alleles, held by the caller and by all of them until released.
+ */
+static effect_batch_t *effect_batch_new(int id, vcf_batch_t *vcf_batch, array_list_t *passed_records, 
+                                        array_list_t *failed_records, array_list_t *alleles, 
+                                        int max_requested, int *num_pending_batches);
+
+static void effect_batch_free(effect_batch_t *batch);
+
+static effect_chunk_t *effect_chunk_new(effect_batch_t *batch, int start, int size);
+
+/**
+ * @brief Notifies that the response of a request for a chunk has been processed.
+ */
+static void release_effect_chunk(effect_chunk_t *chunk, FILE *non_processed_file);
+
+/**
+ * @brief Releases a request, waiting allele or the composition of the requests of a batch.
+ * 
+ * When all of them have been processed, the batch is freed. If any request failed, the records with 
+ * any allele of the failed requests are previously written to the errors file, including the ones 
+ * whose duplicated alleles were not requested, and the ones with an allele that waited for a failed one.
+ */
+static void release_effect_batch(effect_batch_t *batch, FILE *non_processed_file);
+
+/**
+ * @brief Writes the consequence type lines of the alleles that waited for a previous occurrence, 
+ * or marks them as failed in their batches, and releases them.
+ */
+static void release_allele_waiters(int tid, allele_waiter_t *waiters, effect_thread_output_t *output, FILE *non_processed_file);
+
+/**
+ * @brief Waits until all the batches read have been annotated and written, so a checkpoint can be taken.
+ */
+static void wait_for_pending_batches(int *num_pending_batches);
+
+
 /* **********************************************
  *              Response management             *
  * **********************************************/
@@ -90,14 +207,35 @@ int run_effect(char **urls, shared_options_data_t *global_options_data, effect_o
 /**
  * @brief Parses the response from the effect web service.
  * 
- * Reads the contents of the response from the effect web service
+ * Reads the contents of the response from the effect web service in a single pass, without 
+ * modifying or copying it. The gene, SO code and consequence type of each line are located by 
+ * the offsets of their columns, and the line is copied once to the output buffers of the thread.
  */
-static void parse_effect_response(int tid, char *output_directory, size_t output_directory_len, cp_hashtable *output_files, 
-                                  list_t *output_list, cp_hashtable *summary_count, cp_hashtable *gene_list);
+static void parse_effect_response(int tid, char *response, effect_thread_output_t *output);
+
+static void parse_snp_phenotype_response(int tid, char *response, effect_thread_output_t *output);
 
-static void parse_snp_phenotype_response(int tid, list_t *output_list);
+static void parse_mutation_phenotype_response(int tid, char *response, effect_thread_output_t *output);
+
+/**
+ * @brief Skips the whitespaces at both ends of a text, without modifying it.
+ * @param[out] len length of the trimmed text
+ * @return The first non-whitespace character of the text
+ */
+static const char *trim_view(const char *text, size_t *len);
 
-static void parse_mutation_phenotype_response(int tid, list_t *output_list);
+/**
+ * @brief Writes the annotations of the variants already stored in the cache.
+ * @param records the variants that passed the filters
+ * @param no_phenotypes whether the phenotypical information is not required
+ * @param cache cache of annotations retrieved in previous runs
+ * @return The list of variants whose annotations are not in the cache and must be requested to the web services
+ * 
+ * Looks up every variant in the cache and, when all its annotations are stored, processes them the 
+ * same way as a response from the web services.
+ */
+static array_list_t *retrieve_cached_annotations(array_list_t *records, int no_phenotypes, effect_cache_t *cache, 
+                                                 effect_thread_output_t *output);
 
 /**
  * Writes a summary file containing the number of entries for each of the consequence types processed.
@@ -113,24 +251,34 @@ void write_genes_with_variants_file(cp_hashtable *gene_list, char *output_direct
  * Writes an XML file containing the process input and output files, as well as some metadata about the 
  * process.
  */
-void write_result_file(shared_options_data_t *global_options_data, effect_options_data_t *options_data, cp_hashtable *summary_count, char *output_directory);
+void write_result_file(shared_options_data_t *global_options_data, effect_options_data_t *options_data, ws_scheduler_t *scheduler, 
+                       cp_hashtable *summary_count, char *output_directory);
 
 /**
  * @param output_directory directory Where the files will be stored
  * @param output_directory_len length of the path to the output directory
+ * @param compressed whether the annotations are written BGZF-compressed
+ * @param output_files map where the annotation files are stored (FILE, or bgzf_file_t if compressed)
+ * @param summary_file [out] plain text file where the summary will be written
  * @return Whether the output files descriptor where correctly initialized
  * 
  * Initialize the output files where the web service response will be written to.
  */
-static int initialize_output_files(char *output_directory, size_t output_directory_len, cp_hashtable **output_files);
+static int initialize_output_files(char *output_directory, size_t output_directory_len, int compressed, 
+                                   cp_hashtable **output_files, FILE **summary_file);
 
 /**
- * @param num_threads the number of threads that parse the response
- * @param output_directory the directory where the output files will be written
+ * Opens an annotation file for appending, BGZF-compressed and optionally indexed if so requested.
+ */
+static void *open_output_file(char *filename, int compressed, int indexed);
+
+/**
+ * @param summary_count counters of the consequence types found
+ * @param gene_list genes with any variant taking place in them
  * 
- * Initialize the structures for storing the web service response and writing it to the output files.
+ * Initialize the structures where the counters and genes found by all threads are merged.
  */
-static void initialize_output_data_structures(shared_options_data_t *shared_options, list_t **output_list, cp_hashtable **summary_count, cp_hashtable **gene_list);
+static void initialize_output_data_structures(cp_hashtable **summary_count, cp_hashtable **gene_list);
 
 /**
  * 
@@ -152,6 +300,13 @@ static void free_file_key1(int *key);
  */
 static void free_file_descriptor(FILE *fd);
 
+/**
+ * @param file the compressed file in a pair (id, file)
+ * 
+ * Writes the end-of-file marker and closes a compressed file stored in a map.
+ */
+static void free_compressed_file(bgzf_file_t *file);
+
 static void free_file_key2(char *key);
 
 /**
@@ -0,0 +1,671 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "local_annotation.h"
+
+enum consequence_type { INTERGENIC, UPSTREAM, DOWNSTREAM, INTRON, SPLICE_DONOR, SPLICE_ACCEPTOR, SPLICE_REGION,
+                        FIVE_PRIME_UTR, THREE_PRIME_UTR, NON_CODING_EXON, CODING_SEQUENCE, FRAMESHIFT,
+                        INFRAME_INSERTION, INFRAME_DELETION, INITIATOR_CODON, TERMINATOR_CODON, NUM_CONSEQUENCE_TYPES };
+
+typedef struct so_term {
+    const char *accession;
+    const char *name;
+    const char *description;
+} so_term_t;
+
+static const so_term_t so_terms[NUM_CONSEQUENCE_TYPES] = {
+    { "SO:0001628", "intergenic_variant", "A sequence variant located in the intergenic region, between genes" },
+    { "SO:0001631", "upstream_gene_variant", "A sequence variant located 5' of a gene" },
+    { "SO:0001632", "downstream_gene_variant", "A sequence variant located 3' of a gene" },
+    { "SO:0001627", "intron_variant", "A transcript variant occurring within an intron" },
+    { "SO:0001575", "splice_donor_variant", "A splice variant that changes the 2 base region at the 5' end of an intron" },
+    { "SO:0001574", "splice_acceptor_variant", "A splice variant that changes the 2 base region at the 3' end of an intron" },
+    { "SO:0001630", "splice_region_variant", "A sequence variant in which a change has occurred within the region of the splice site" },
+    { "SO:0001623", "5_prime_UTR_variant", "A UTR variant of the 5' UTR" },
+    { "SO:0001624", "3_prime_UTR_variant", "A UTR variant of the 3' UTR" },
+    { "SO:0001792", "non_coding_transcript_exon_variant", "A sequence variant that changes non-coding exon sequence" },
+    { "SO:0001580", "coding_sequence_variant", "A sequence variant that changes the coding sequence" },
+    { "SO:0001589", "frameshift_variant", "A sequence variant which causes a disruption of the translational reading frame" },
+    { "SO:0001821", "inframe_insertion", "An inframe non synonymous variant that inserts bases into the coding sequence" },
+    { "SO:0001822", "inframe_deletion", "An inframe non synonymous variant that deletes bases from the coding sequence" },
+    { "SO:0001582", "initiator_codon_variant", "A codon variant that changes at least one base of the first codon of a transcript" },
+    { "SO:0001590", "terminator_codon_variant", "A sequence variant whereby at least one of the bases in the terminator codon is changed" }
+};
+
+static char *get_gff_attribute(const char *attributes, const char *key);
+static const char *normalize_chromosome(const char *chromosome);
+static const char *display_id(const char *id);
+static transcript_t *get_or_create_transcript(char *id, const char *chromosome, khash_t(transcripts_by_id) *transcripts);
+static void add_transcript_exon(long start, long end, transcript_t *transcript);
+static void transcript_free(transcript_t *transcript);
+static void index_transcript(transcript_t *transcript, gene_model_t *model);
+static int compare_transcripts_by_start(const void *a, const void *b);
+
+static int compute_transcript_consequences(long variant_start, long variant_end, int length_change, int symbolic,
+                                           transcript_t *transcript, int *consequences);
+static void write_consequence_line(vcf_record_t *record, const char *allele, int allele_len, transcript_t *transcript,
+                                   int consequence, const char *excludes, FILE *output);
+static int is_excluded(const char *consequence_type, const char *excludes);
+
+
+/* **********************************************
+ *            Gene model construction           *
+ * **********************************************/
+
+gene_model_t *gene_model_load(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        LOG_ERROR_F("Can't open gene model file %s\n", filename);
+        return NULL;
+    }
+
+    gene_model_t *model = (gene_model_t*) calloc (1, sizeof(gene_model_t));
+    model->filename = strdup(filename);
+    model->chromosomes = kh_init(chromosome_transcripts);
+
+    // Gene names by identifier, and transcripts by identifier until they are indexed
+    khash_t(gene_names) *genes = kh_init(gene_names);
+    khash_t(transcripts_by_id) *transcripts = kh_init(transcripts_by_id);
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_len;
+    char *fields[9];
+
+    while ((line_len = getline(&line, &line_capacity, file)) > 0) {
+        if (line[0] == '#') {
+            if (!strncmp(line, "##FASTA", 7)) {
+                break;
+            }
+            continue;
+        }
+        if (line[line_len - 1] == '\n') {
+            line[--line_len] = '\0';
+        }
+
+        // Split the line in its 9 tab-separated columns
+        int num_fields = 0;
+        char *current = line;
+        while (num_fields < 9) {
+            fields[num_fields++] = current;
+            current = strchr(current, '\t');
+            if (!current) {
+                break;
+            }
+            *current++ = '\0';
+        }
+        if (num_fields < 9) {
+            continue;
+        }
+
+        char *feature = fields[2];
+        char *attributes = fields[8];
+        long start = atol(fields[3]);
+        long end = atol(fields[4]);
+        size_t feature_len = strlen(feature);
+
+        if (feature_len >= 4 && !strcmp(feature + feature_len - 4, "gene")) {
+            // Genes only provide the name shown in the output
+            char *id = get_gff_attribute(attributes, "ID");
+            if (!id) { id = get_gff_attribute(attributes, "gene_id"); }
+            if (!id) { continue; }
+
+            char *name = get_gff_attribute(attributes, "Name");
+            if (!name) { name = get_gff_attribute(attributes, "gene_name"); }
+
+            int ret;
+            khiter_t iter = kh_put(gene_names, genes, id, &ret);
+            if (ret) {
+                kh_value(genes, iter) = name ? name : strdup(display_id(id));
+                model->num_genes++;
+            } else {
+                free(id);
+                free(name);
+            }
+
+        } else if (!strcmp(feature, "exon") || !strcmp(feature, "CDS")) {
+            char *parents = get_gff_attribute(attributes, "Parent");
+            if (!parents) { parents = get_gff_attribute(attributes, "transcript_id"); }
+            if (!parents) { continue; }
+
+            // An exon may be shared by several transcripts
+            char *saveptr;
+            for (char *parent = strtok_r(parents, ",", &saveptr); parent; parent = strtok_r(NULL, ",", &saveptr)) {
+                transcript_t *transcript = get_or_create_transcript(parent, fields[0], transcripts);
+                if (transcript->strand == '.') {
+                    transcript->strand = fields[6][0];
+                }
+                if (start < transcript->start) { transcript->start = start; }
+                if (end > transcript->end) { transcript->end = end; }
+
+                if (feature[0] == 'e') {
+                    add_transcript_exon(start, end, transcript);
+                } else {
+                    if (!transcript->coding_start || start < transcript->coding_start) { transcript->coding_start = start; }
+                    if (end > transcript->coding_end) { transcript->coding_end = end; }
+                }
+
+                // GTF files don't define transcripts, so their exons carry the gene information
+                if (!transcript->gene_id) { transcript->gene_id = get_gff_attribute(attributes, "gene_id"); }
+                if (!transcript->gene_name) { transcript->gene_name = get_gff_attribute(attributes, "gene_name"); }
+                if (!transcript->biotype) { transcript->biotype = get_gff_attribute(attributes, "transcript_biotype"); }
+            }
+            free(parents);
+
+        } else if (!strcmp(feature, "mRNA") || strstr(feature, "transcript") ||
+                   (feature_len >= 3 && !strcmp(feature + feature_len - 3, "RNA"))) {
+            char *id = get_gff_attribute(attributes, "ID");
+            if (!id) { id = get_gff_attribute(attributes, "transcript_id"); }
+            if (!id) { continue; }
+
+            transcript_t *transcript = get_or_create_transcript(id, fields[0], transcripts);
+            free(id);
+            transcript->strand = fields[6][0];
+            if (start < transcript->start) { transcript->start = start; }
+            if (end > transcript->end) { transcript->end = end; }
+
+            if (!transcript->name) {
+                transcript->name = get_gff_attribute(attributes, "Name");
+                if (!transcript->name) { transcript->name = get_gff_attribute(attributes, "transcript_name"); }
+            }
+            if (!transcript->biotype) {
+                transcript->biotype = get_gff_attribute(attributes, "biotype");
+                if (!transcript->biotype) { transcript->biotype = get_gff_attribute(attributes, "transcript_biotype"); }
+                if (!transcript->biotype) { transcript->biotype = strdup(feature); }
+            }
+            if (!transcript->gene_id) {
+                transcript->gene_id = get_gff_attribute(attributes, "Parent");
+                if (!transcript->gene_id) { transcript->gene_id = get_gff_attribute(attributes, "gene_id"); }
+            }
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    // Resolve the names of the genes and index the transcripts by chromosome
+    for (khiter_t iter = kh_begin(transcripts); iter != kh_end(transcripts); ++iter) {
+        if (!kh_exist(transcripts, iter)) {
+            continue;
+        }
+        transcript_t *transcript = kh_value(transcripts, iter);
+        free((char*) kh_key(transcripts, iter));
+
+        if (!transcript->gene_name && transcript->gene_id) {
+            khiter_t gene_iter = kh_get(gene_names, genes, transcript->gene_id);
+            if (gene_iter != kh_end(genes)) {
+                transcript->gene_name = strdup(kh_value(genes, gene_iter));
+            } else {
+                transcript->gene_name = strdup(display_id(transcript->gene_id));
+            }
+        }
+        if (!transcript->name) { transcript->name = strdup(display_id(transcript->id)); }
+        if (!transcript->biotype) { transcript->biotype = strdup("transcript"); }
+
+        // Transcripts without exons are considered a single exon
+        if (!transcript->num_exons) {
+            add_transcript_exon(transcript->start, transcript->end, transcript);
+        }
+
+        // Exons are usually sorted, so insertion sort is enough
+        for (int i = 1; i < transcript->num_exons; i++) {
+            long start = transcript->exon_starts[i], end = transcript->exon_ends[i];
+            int j = i - 1;
+            for ( ; j >= 0 && transcript->exon_starts[j] > start; j--) {
+                transcript->exon_starts[j+1] = transcript->exon_starts[j];
+                transcript->exon_ends[j+1] = transcript->exon_ends[j];
+            }
+            transcript->exon_starts[j+1] = start;
+            transcript->exon_ends[j+1] = end;
+        }
+
+        index_transcript(transcript, model);
+    }
+    kh_destroy(transcripts_by_id, transcripts);
+
+    for (khiter_t iter = kh_begin(genes); iter != kh_end(genes); ++iter) {
+        if (kh_exist(genes, iter)) {
+            free((char*) kh_key(genes, iter));
+            free(kh_value(genes, iter));
+        }
+    }
+    kh_destroy(gene_names, genes);
+
+    // Sort the transcripts of each chromosome and calculate the maximum end reached up to each of them
+    for (khiter_t iter = kh_begin(model->chromosomes); iter != kh_end(model->chromosomes); ++iter) {
+        if (!kh_exist(model->chromosomes, iter)) {
+            continue;
+        }
+        chromosome_transcripts_t *chromosome = kh_value(model->chromosomes, iter);
+        qsort(chromosome->transcripts, chromosome->size, sizeof(transcript_t*), compare_transcripts_by_start);
+
+        chromosome->max_ends = (long*) malloc (chromosome->size * sizeof(long));
+        for (size_t i = 0; i < chromosome->size; i++) {
+            long end = chromosome->transcripts[i]->end;
+            chromosome->max_ends[i] = (i > 0 && chromosome->max_ends[i-1] > end) ? chromosome->max_ends[i-1] : end;
+        }
+    }
+
+    LOG_INFO_F("Gene model loaded from %s: %zu genes, %zu transcripts in %d chromosomes\n",
+               filename, model->num_genes, model->num_transcripts, kh_size(model->chromosomes));
+
+    return model;
+}
+
+void gene_model_free(gene_model_t *model) {
+    if (!model) {
+        return;
+    }
+
+    for (khiter_t iter = kh_begin(model->chromosomes); iter != kh_end(model->chromosomes); ++iter) {
+        if (!kh_exist(model->chromosomes, iter)) {
+            continue;
+        }
+        chromosome_transcripts_t *chromosome = kh_value(model->chromosomes, iter);
+        for (size_t i = 0; i < chromosome->size; i++) {
+            transcript_free(chromosome->transcripts[i]);
+        }
+        free(chromosome->transcripts);
+        free(chromosome->max_ends);
+        free(chromosome);
+        free((char*) kh_key(model->chromosomes, iter));
+    }
+    kh_destroy(chromosome_transcripts, model->chromosomes);
+
+    free(model->filename);
+    free(model);
+}
+
+/**
+ * Returns the value of an attribute in the 9th column of a GFF3 (key=value) or GTF (key "value")
+ * file, or NULL if it is not defined.
+ */
+static char *get_gff_attribute(const char *attributes, const char *key) {
+    size_t key_len = strlen(key);
+    const char *current = attributes;
+
+    while (*current) {
+        while (*current == ' ' || *current == ';') {
+            current++;
+        }
+        if (!strncmp(current, key, key_len) && (current[key_len] == '=' || current[key_len] == ' ')) {
+            const char *value = current + key_len + 1;
+            while (*value == ' ') {
+                value++;
+            }
+            if (*value == '"') {
+                value++;
+                return strndup(value, strcspn(value, "\""));
+            }
+            return strndup(value, strcspn(value, ";"));
+        }
+        current += strcspn(current, ";");
+    }
+
+    return NULL;
+}
+
+/**
+ * Chromosomes may be named with or without the 'chr' prefix, depending on the source of the files.
+ */
+static const char *normalize_chromosome(const char *chromosome) {
+    return strncasecmp(chromosome, "chr", 3) ? chromosome : chromosome + 3;
+}
+
+/**
+ * GFF3 files from Ensembl prefix the identifiers with the type of feature (gene:ENSG...).
+ */
+static const char *display_id(const char *id) {
+    if (!strncmp(id, "gene:", 5)) {
+        return id + 5;
+    }
+    if (!strncmp(id, "transcript:", 11)) {
+        return id + 11;
+    }
+    return id;
+}
+
+static transcript_t *get_or_create_transcript(char *id, const char *chromosome, khash_t(transcripts_by_id) *transcripts) {
+    khiter_t iter = kh_get(transcripts_by_id, transcripts, id);
+    if (iter != kh_end(transcripts)) {
+        return kh_value(transcripts, iter);
+    }
+
+    transcript_t *transcript = (transcript_t*) calloc (1, sizeof(transcript_t));
+    transcript->id = strdup(id);
+    transcript->chromosome = strdup(chromosome);
+    transcript->start = LONG_MAX;
+    transcript->end = 0;
+    transcript->strand = '.';
+
+    int ret;
+    iter = kh_put(transcripts_by_id, transcripts, strdup(id), &ret);
+    kh_value(transcripts, iter) = transcript;
+    return transcript;
+}
+
+static void add_transcript_exon(long start, long end, transcript_t *transcript) {
+    if (transcript->num_exons == transcript->exons_capacity) {
+        transcript->exons_capacity = transcript->exons_capacity ? 2 * transcript->exons_capacity : 8;
+        transcript->exon_starts = realloc(transcript->exon_starts, transcript->exons_capacity * sizeof(long));
+        transcript->exon_ends = realloc(transcript->exon_ends, transcript->exons_capacity * sizeof(long));
+    }
+    transcript->exon_starts[transcript->num_exons] = start;
+    transcript->exon_ends[transcript->num_exons] = end;
+    transcript->num_exons++;
+}
+
+static void transcript_free(transcript_t *transcript) {
+    free(transcript->id);
+    free(transcript->name);
+    free(transcript->biotype);
+    free(transcript->gene_id);
+    free(transcript->gene_name);
+    free(transcript->chromosome);
+    free(transcript->exon_starts);
+    free(transcript->exon_ends);
+    free(transcript);
+}
+
+static void index_transcript(transcript_t *transcript, gene_model_t *model) {
+    const char *name = normalize_chromosome(transcript->chromosome);
+    chromosome_transcripts_t *chromosome;
+
+    khiter_t iter = kh_get(chromosome_transcripts, model->chromosomes, name);
+    if (iter == kh_end(model->chromosomes)) {
+        int ret;
+        chromosome = (chromosome_transcripts_t*) calloc (1, sizeof(chromosome_transcripts_t));
+        iter = kh_put(chromosome_transcripts, model->chromosomes, strdup(name), &ret);
+        kh_value(model->chromosomes, iter) = chromosome;
+    } else {
+        chromosome = kh_value(model->chromosomes, iter);
+    }
+
+    if (chromosome->size == chromosome->capacity) {
+        chromosome->capacity = chromosome->capacity ? 2 * chromosome->capacity : 256;
+        chromosome->transcripts = realloc(chromosome->transcripts, chromosome->capacity * sizeof(transcript_t*));
+    }
+    chromosome->transcripts[chromosome->size++] = transcript;
+    model->num_transcripts++;
+}
+
+static int compare_transcripts_by_start(const void *a, const void *b) {
+    const transcript_t *t1 = *((const transcript_t**) a);
+    const transcript_t *t2 = *((const transcript_t**) b);
+    return (t1->start > t2->start) - (t1->start < t2->start);
+}
+
+
+/* **********************************************
+ *           Consequence types calculation      *
+ * **********************************************/
+
+char *annotate_variants_locally(vcf_record_t **records, int num_records, gene_model_t *model, const char *excludes) {
+    char *response = NULL;
+    size_t response_len = 0;
+    FILE *output = open_memstream(&response, &response_len);
+
+    for (int i = 0; i < num_records; i++) {
+        vcf_record_t *record = records[i];
+
+        char chromosome_name[record->chromosome_len + 1];
+        strncpy(chromosome_name, record->chromosome, record->chromosome_len);
+        chromosome_name[record->chromosome_len] = '\0';
+
+        chromosome_transcripts_t *chromosome = NULL;
+        khiter_t iter = kh_get(chromosome_transcripts, model->chromosomes, normalize_chromosome(chromosome_name));
+        if (iter != kh_end(model->chromosomes)) {
+            chromosome = kh_value(model->chromosomes, iter);
+        }
+
+        // Every alternate allele is annotated separately
+        const char *allele = record->alternate;
+        const char *alternate_end = record->alternate + record->alternate_len;
+        while (allele < alternate_end) {
+            const char *comma = memchr(allele, ',', alternate_end - allele);
+            int allele_len = (comma ? comma : alternate_end) - allele;
+
+            if (allele_len == 0 || (allele_len == 1 && (*allele == '.' || *allele == '*'))) {
+                allele += allele_len + 1;
+                continue;
+            }
+
+            // Skip the bases shared by both alleles, such as the padding base of indels
+            const char *ref = record->reference, *alt = allele;
+            int ref_len = record->reference_len, alt_len = allele_len;
+            long variant_start = record->position;
+            int symbolic = (*allele == '<');
+            if (!symbolic) {
+                while (ref_len > 0 && alt_len > 0 && *ref == *alt) {
+                    ref++; alt++;
+                    ref_len--; alt_len--;
+                    variant_start++;
+                }
+            }
+
+            // Insertions affect the bases at both sides of the insertion point
+            long variant_end = variant_start + ref_len - 1;
+            if (ref_len == 0) {
+                variant_end = variant_start;
+                variant_start--;
+            }
+
+            int num_annotations = 0;
+            if (chromosome && chromosome->size > 0) {
+                // Binary search of the first transcript starting after the range of interest
+                long range_start = variant_start - UPSTREAM_DOWNSTREAM_DISTANCE;
+                long range_end = variant_end + UPSTREAM_DOWNSTREAM_DISTANCE;
+                size_t low = 0, high = chromosome->size;
+                while (low < high) {
+                    size_t middle = (low + high) / 2;
+                    if (chromosome->transcripts[middle]->start <= range_end) {
+                        low = middle + 1;
+                    } else {
+                        high = middle;
+                    }
+                }
+
+                int consequences[NUM_CONSEQUENCE_TYPES];
+                for (size_t j = low; j > 0 && chromosome->max_ends[j-1] >= range_start; j--) {
+                    transcript_t *transcript = chromosome->transcripts[j-1];
+                    if (transcript->end < range_start) {
+                        continue;
+                    }
+
+                    int num_consequences = compute_transcript_consequences(variant_start, variant_end, alt_len - ref_len,
+                                                                           symbolic, transcript, consequences);
+                    for (int k = 0; k < num_consequences; k++) {
+                        write_consequence_line(record, allele, allele_len, transcript, consequences[k], excludes, output);
+                    }
+                    num_annotations += num_consequences;
+                }
+            }
+
+            if (!num_annotations) {
+                write_consequence_line(record, allele, allele_len, NULL, INTERGENIC, excludes, output);
+            }
+
+            allele += allele_len + 1;
+        }
+    }
+
+    fclose(output);
+    return response;
+}
+
+static inline int overlaps(long start1, long end1, long start2, long end2) {
+    return start1 <= end2 && start2 <= end1;
+}
+
+/**
+ * Fills the consequences a variant spanning [variant_start, variant_end] has over a transcript,
+ * and returns how many of them were found.
+ */
+static int compute_transcript_consequences(long variant_start, long variant_end, int length_change, int symbolic,
+                                           transcript_t *transcript, int *consequences) {
+    int num_consequences = 0;
+    int reverse = (transcript->strand == '-');
+
+    // Variants close to the transcript, but outside of it
+    if (variant_end < transcript->start) {
+        if (transcript->start - variant_end <= UPSTREAM_DOWNSTREAM_DISTANCE) {
+            consequences[num_consequences++] = reverse ? DOWNSTREAM : UPSTREAM;
+        }
+        return num_consequences;
+    }
+    if (variant_start > transcript->end) {
+        if (variant_start - transcript->end <= UPSTREAM_DOWNSTREAM_DISTANCE) {
+            consequences[num_consequences++] = reverse ? UPSTREAM : DOWNSTREAM;
+        }
+        return num_consequences;
+    }
+
+    int exonic = 0, intronic = 0, coding = 0, five_prime_utr = 0, three_prime_utr = 0;
+    int splice_donor = 0, splice_acceptor = 0, splice_region = 0;
+    long coding_start = transcript->coding_start, coding_end = transcript->coding_end;
+
+    for (int i = 0; i < transcript->num_exons; i++) {
+        long exon_start = transcript->exon_starts[i], exon_end = transcript->exon_ends[i];
+
+        if (overlaps(variant_start, variant_end, exon_start, exon_end)) {
+            exonic = 1;
+            if (coding_start) {
+                long overlap_start = (variant_start > exon_start) ? variant_start : exon_start;
+                long overlap_end = (variant_end < exon_end) ? variant_end : exon_end;
+                if (overlaps(overlap_start, overlap_end, coding_start, coding_end)) {
+                    coding = 1;
+                }
+                if (overlap_start < coding_start) {
+                    if (reverse) { three_prime_utr = 1; } else { five_prime_utr = 1; }
+                }
+                if (overlap_end > coding_end) {
+                    if (reverse) { five_prime_utr = 1; } else { three_prime_utr = 1; }
+                }
+            }
+        }
+
+        if (i == transcript->num_exons - 1) {
+            continue;
+        }
+
+        // Intron between this exon and the next one
+        long intron_start = exon_end + 1, intron_end = transcript->exon_starts[i+1] - 1;
+        if (intron_start > intron_end) {
+            continue;
+        }
+
+        if (overlaps(variant_start, variant_end, intron_start, intron_end)) {
+            intronic = 1;
+        }
+        if (overlaps(variant_start, variant_end, intron_start, intron_start + 1)) {
+            if (reverse) { splice_acceptor = 1; } else { splice_donor = 1; }
+        }
+        if (overlaps(variant_start, variant_end, intron_end - 1, intron_end)) {
+            if (reverse) { splice_donor = 1; } else { splice_acceptor = 1; }
+        }
+        if (overlaps(variant_start, variant_end, exon_end - SPLICE_REGION_EXON_BASES + 1, exon_end) ||
+            overlaps(variant_start, variant_end, intron_start + 2, intron_start + SPLICE_REGION_INTRON_BASES - 1) ||
+            overlaps(variant_start, variant_end, intron_end - SPLICE_REGION_INTRON_BASES + 1, intron_end - 2) ||
+            overlaps(variant_start, variant_end, intron_end + 1, intron_end + SPLICE_REGION_EXON_BASES)) {
+            splice_region = 1;
+        }
+    }
+
+    if (splice_donor) { consequences[num_consequences++] = SPLICE_DONOR; }
+    if (splice_acceptor) { consequences[num_consequences++] = SPLICE_ACCEPTOR; }
+    if (splice_region && !splice_donor && !splice_acceptor) { consequences[num_consequences++] = SPLICE_REGION; }
+
+    if (coding) {
+        if (!symbolic && length_change % 3) {
+            consequences[num_consequences++] = FRAMESHIFT;
+        } else if (!symbolic && length_change > 0) {
+            consequences[num_consequences++] = INFRAME_INSERTION;
+        } else if (!symbolic && length_change < 0) {
+            consequences[num_consequences++] = INFRAME_DELETION;
+        } else {
+            consequences[num_consequences++] = CODING_SEQUENCE;
+        }
+
+        if (overlaps(variant_start, variant_end, coding_start, coding_start + 2)) {
+            consequences[num_consequences++] = reverse ? TERMINATOR_CODON : INITIATOR_CODON;
+        }
+        if (overlaps(variant_start, variant_end, coding_end - 2, coding_end)) {
+            consequences[num_consequences++] = reverse ? INITIATOR_CODON : TERMINATOR_CODON;
+        }
+    }
+    if (five_prime_utr) { consequences[num_consequences++] = FIVE_PRIME_UTR; }
+    if (three_prime_utr) { consequences[num_consequences++] = THREE_PRIME_UTR; }
+    if (exonic && !coding_start) { consequences[num_consequences++] = NON_CODING_EXON; }
+    if (intronic && !exonic && !splice_donor && !splice_acceptor) { consequences[num_consequences++] = INTRON; }
+
+    return num_consequences;
+}
+
+/**
+ * Writes a line with the same 25 columns as the consequence type web service. The fields that
+ * can't be calculated without a reference sequence (aminoacid and codon changes) are set to '-'.
+ */
+static void write_consequence_line(vcf_record_t *record, const char *allele, int allele_len, transcript_t *transcript,
+                                   int consequence, const char *excludes, FILE *output) {
+    const so_term_t *term = &so_terms[consequence];
+    if (is_excluded(term->name, excludes)) {
+        return;
+    }
+
+    int has_id = record->id_len > 0 && strncmp(record->id, ".", record->id_len);
+
+    fprintf(output, "%.*s\t%ld\t%.*s\t%.*s\t", record->chromosome_len, record->chromosome, (long) record->position,
+            record->reference_len, record->reference, allele_len, allele);
+    if (transcript) {
+        fprintf(output, "%s\t%s\ttranscript\t%s\t%s\t%ld\t%ld\t%c\t",
+                display_id(transcript->id), transcript->name, transcript->biotype,
+                transcript->chromosome, transcript->start, transcript->end, transcript->strand);
+    } else {
+        fprintf(output, "-\t-\tintergenic\t-\t-\t-\t-\t-\t");
+    }
+    fprintf(output, "%.*s\t-\t-\t", has_id ? record->id_len : 1, has_id ? record->id : "-");
+    if (transcript) {
+        fprintf(output, "%s\t%s\t%s\t", transcript->gene_id ? display_id(transcript->gene_id) : "-",
+                display_id(transcript->id), transcript->gene_name ? transcript->gene_name : "-");
+    } else {
+        fprintf(output, "-\t-\t-\t");
+    }
+    fprintf(output, "%s\t%s\t%s\tconsequenceType\t-\t-\t-\n", term->accession, term->name, term->description);
+}
+
+static int is_excluded(const char *consequence_type, const char *excludes) {
+    if (!excludes || !*excludes) {
+        return 0;
+    }
+
+    size_t len = strlen(consequence_type);
+    const char *current = excludes;
+    while (*current) {
+        size_t token_len = strcspn(current, ",");
+        if (token_len == len && !strncmp(current, consequence_type, len)) {
+            return 1;
+        }
+        current += token_len;
+        if (*current == ',') {
+            current++;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOCAL_ANNOTATION_H
+#define LOCAL_ANNOTATION_H
+
+/**
+ * @file local_annotation.h
+ * @brief Annotation of consequence types without querying the web services
+ *
+ * This file declares a gene model loaded from a GFF3 (or GTF) file and indexed by chromosome and
+ * position, which allows to compute the consequence types of a variant in the same 25-column
+ * format returned by the consequence type web service.
+ *
+ * Without a reference sequence the changes in the aminoacids can't be predicted, so variants
+ * in a coding sequence are annotated as frameshift, inframe insertions/deletions, initiator or
+ * terminator codon variants, or coding sequence variants.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <commons/log.h>
+#include <containers/khash.h>
+
+/**
+ * Maximum distance between a variant and a transcript for annotating it as upstream/downstream.
+ */
+#define UPSTREAM_DOWNSTREAM_DISTANCE    5000
+
+/**
+ * Number of bases at the boundaries of an exon/intron considered part of a splicing region.
+ */
+#define SPLICE_REGION_EXON_BASES        3
+#define SPLICE_REGION_INTRON_BASES      8
+
+/**
+ * @brief A transcript of the gene model, with its exons and coding region.
+ *
+ * All coordinates are 1-based and inclusive, and the exons are sorted by position.
+ */
+typedef struct transcript {
+    char *id;
+    char *name;
+    char *biotype;
+    char *gene_id;              /**< Identifier of the gene, resolved to its name when the model is loaded. */
+    char *gene_name;
+    char *chromosome;
+
+    long start;
+    long end;
+    char strand;
+
+    long coding_start;          /**< Start of the coding region, 0 if the transcript is not coding. */
+    long coding_end;
+
+    long *exon_starts;
+    long *exon_ends;
+    int num_exons;
+    int exons_capacity;
+} transcript_t;
+
+/**
+ * @brief Transcripts of a chromosome, sorted by start position.
+ *
+ * Each position of max_ends stores the maximum end of the transcripts up to it, so the search of
+ * the transcripts overlapping a position can stop as soon as no previous transcript reaches it.
+ */
+typedef struct chromosome_transcripts {
+    transcript_t **transcripts;
+    long *max_ends;
+    size_t size;
+    size_t capacity;
+} chromosome_transcripts_t;
+
+KHASH_MAP_INIT_STR(chromosome_transcripts, chromosome_transcripts_t*);
+KHASH_MAP_INIT_STR(gene_names, char*);
+KHASH_MAP_INIT_STR(transcripts_by_id, transcript_t*);
+
+typedef struct gene_model {
+    char *filename;
+    khash_t(chromosome_transcripts) *chromosomes;
+    size_t num_genes;
+    size_t num_transcripts;
+} gene_model_t;
+
+
+/**
+ * @brief Loads the genes and transcripts described in a GFF3 or GTF file.
+ * @param filename path to the GFF/GTF file
+ * @return The gene model indexed by chromosome, or NULL if the file could not be read
+ *
+ * Genes, transcripts, exons and CDS are taken into account, linked by their ID/Parent attributes
+ * (GFF3) or gene_id/transcript_id attributes (GTF). The 'chr' prefix of chromosome names is ignored.
+ */
+gene_model_t *gene_model_load(const char *filename);
+
+void gene_model_free(gene_model_t *model);
+
+/**
+ * @brief Computes the consequence types of a group of variants.
+ * @param records variants to annotate
+ * @param num_records number of variants
+ * @param model gene model the variants are compared against
+ * @param excludes comma-separated consequence types that must not be reported, or NULL
+ * @return A newly allocated text with the same format as the response of the consequence type web service
+ *
+ * Every alternate allele of a variant is annotated against all the transcripts it overlaps or
+ * is close to. Variants far from any transcript are annotated as intergenic.
+ */
+char *annotate_variants_locally(vcf_record_t **records, int num_records, gene_model_t *model, const char *excludes);
+
+#endif
@@ -35,7 +35,7 @@ int main(int argc, char *argv[]) {
     if (argc == 1 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         argtable = merge_effect_options(effect_options, shared_options, arg_end(effect_options->num_options + shared_options->num_options));
         show_usage(argv[0], argtable, effect_options->num_options + shared_options->num_options);
-        arg_freetable(argtable, 30);
+        arg_freetable(argtable, 38);
         return 0;
     } else if (!strcmp(argv[1], "--version")) {
         show_version("Effect");
@@ -100,7 +100,7 @@ int main(int argc, char *argv[]) {
     
     free_effect_options_data(effect_options_data);
     free_shared_options_data(shared_options_data);
-    arg_freetable(argtable, 30);
+    arg_freetable(argtable, 38);
     array_list_free(config_search_paths, free);
     free(configuration_file);
 
@@ -114,6 +114,14 @@ effect_options_t *new_effect_cli_options(void) {
     options->num_options = NUM_EFFECT_OPTIONS;
     options->no_phenotypes = arg_lit0(NULL, "no-phenotypes", "Flag asking not to retrieve phenotypical information");
     options->excludes = arg_str0(NULL, "exclude", NULL, "Consequence types to exclude from the query (comma-separated)");
+    options->cache_directory = arg_str0(NULL, "cache-dir", NULL, "Directory where the annotations retrieved from the web services are cached");
+    options->no_cache = arg_lit0(NULL, "no-cache", "Flag asking not to use the annotations cache");
+    options->max_requests = arg_int0(NULL, "max-requests", NULL, "Maximum number of requests to the web services in flight at the same time");
+    options->annotation_backend = arg_str0(NULL, "annotation-backend", NULL, "Source of the consequence types: web services (ws, default) or a local gene model (local)");
+    options->gene_model_filename = arg_file0(NULL, "gene-model", NULL, "GFF file with the genes and transcripts used by the local annotation backend");
+    options->resume = arg_lit0(NULL, "resume", "Flag asking to resume an interrupted run from its last checkpoint");
+    options->redrive_errors = arg_lit0(NULL, "redrive-errors", "Flag asking to annotate only the variants that failed in a previous run, merging their results");
+    options->compress_output = arg_lit0(NULL, "compress-output", "Flag asking to write the annotations BGZF-compressed (.txt.gz), with an index by chromosome and position");
     return options;
 }
 
@@ -121,10 +129,20 @@ effect_options_data_t *new_effect_options_data(effect_options_t *options) {
     effect_options_data_t *options_data = (effect_options_data_t*) malloc (sizeof(effect_options_data_t));
     options_data->no_phenotypes = options->no_phenotypes->count;
     options_data->excludes = strdup(*(options->excludes->sval));
+    options_data->cache_directory = (!options->no_cache->count && strlen(*(options->cache_directory->sval)) > 0) ?
+                                    strdup(*(options->cache_directory->sval)) : NULL;
+    options_data->max_requests = *(options->max_requests->ival);
+    options_data->annotation_backend = strcmp(*(options->annotation_backend->sval), "local") ? WS_BACKEND : LOCAL_BACKEND;
+    options_data->gene_model_filename = options->gene_model_filename->count ? strdup(*(options->gene_model_filename->filename)) : NULL;
+    options_data->resume = options->resume->count;
+    options_data->redrive_errors = options->redrive_errors->count;
+    options_data->compress_output = options->compress_output->count;
     return options_data;
 }
 
 void free_effect_options_data(effect_options_data_t *options_data) {
     if (options_data->excludes) { free(options_data->excludes); }
+    if (options_data->cache_directory) { free(options_data->cache_directory); }
+    if (options_data->gene_model_filename) { free(options_data->gene_model_filename); }
     free(options_data);
 }
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ws_scheduler.h"
+
+static size_t save_ws_response(char *contents, size_t size, size_t nmemb, void *userdata);
+static void start_ready_requests(ws_scheduler_t *scheduler);
+static void collect_finished_requests(ws_scheduler_t *scheduler);
+static void adapt_ws_scheduler(double latency, size_t payload_len, int succeeded, ws_scheduler_t *scheduler);
+
+
+/* **********************************************
+ *                    Requests                  *
+ * **********************************************/
+
+ws_request_t *ws_request_new(char *url, char *body, int service, void *data) {
+    ws_request_t *request = (ws_request_t*) calloc (1, sizeof(ws_request_t));
+    request->url = url;
+    request->body = body;
+    request->service = service;
+    request->data = data;
+    request->response_capacity = 4096;
+    request->response = (char*) calloc (request->response_capacity, sizeof(char));
+    return request;
+}
+
+void ws_request_free(ws_request_t *request) {
+    if (request->handle) {
+        curl_easy_cleanup(request->handle);
+    }
+    free(request->body);
+    free(request->response);
+    free(request);
+}
+
+int ws_request_succeeded(ws_request_t *request) {
+    return request->error_code == CURLE_OK && request->http_status >= 200 && request->http_status < 300;
+}
+
+const char *ws_request_error(ws_request_t *request) {
+    if (request->error_code != CURLE_OK) {
+        return strlen(request->error_message) ? request->error_message : curl_easy_strerror(request->error_code);
+    }
+    if (request->http_status < 200 || request->http_status >= 300) {
+        snprintf(request->error_message, CURL_ERROR_SIZE, "HTTP status %ld", request->http_status);
+        return request->error_message;
+    }
+    return "No error";
+}
+
+static size_t save_ws_response(char *contents, size_t size, size_t nmemb, void *userdata) {
+    ws_request_t *request = userdata;
+    size_t data_len = size * nmemb;
+
+    if (request->response_len + data_len + 1 > request->response_capacity) {
+        size_t new_capacity = request->response_capacity * 2;
+        while (request->response_len + data_len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *aux = realloc(request->response, new_capacity);
+        if (!aux) {
+            LOG_ERROR("Can't allocate memory for the web service response\n");
+            return 0;   // Makes libcurl abort the transfer
+        }
+        request->response = aux;
+        request->response_capacity = new_capacity;
+    }
+
+    memcpy(request->response + request->response_len, contents, data_len);
+    request->response_len += data_len;
+    request->response[request->response_len] = '\0';
+
+    return data_len;
+}
+
+char *compose_ws_post_body(char **params, char **values, int num_params) {
+    size_t body_len = 1;
+    for (int i = 0; i < num_params; i++) {
+        if (values[i]) {
+            body_len += strlen(params[i]) + 3 * strlen(values[i]) + 2;
+        }
+    }
+
+    char *body = (char*) calloc (body_len, sizeof(char));
+    char *current = body;
+    for (int i = 0; i < num_params; i++) {
+        if (!values[i]) {
+            continue;
+        }
+        if (current != body) {
+            *current++ = '&';
+        }
+        current += sprintf(current, "%s=", params[i]);
+
+        // Percent-encode everything but unreserved characters
+        for (const unsigned char *c = (unsigned char*) values[i]; *c; c++) {
+            if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+                *c == '-' || *c == '_' || *c == '.' || *c == '~') {
+                *current++ = *c;
+            } else {
+                current += sprintf(current, "%%%02X", *c);
+            }
+        }
+    }
+
+    return body;
+}
+
+
+/* **********************************************
+ *                   Scheduler                  *
+ * **********************************************/
+
+ws_scheduler_t *ws_scheduler_new(int max_in_flight, int max_attempts, double retry_delay,
+                                 ws_request_callback callback, void *callback_data) {
+    ws_scheduler_t *scheduler = (ws_scheduler_t*) calloc (1, sizeof(ws_scheduler_t));
+    scheduler->max_in_flight = max_in_flight > 0 ? max_in_flight : 1;
+    scheduler->max_in_flight_limit = scheduler->max_in_flight;
+    scheduler->max_queued = 2 * scheduler->max_in_flight;
+    scheduler->max_attempts = max_attempts > 0 ? max_attempts : 1;
+    scheduler->retry_delay = retry_delay;
+    scheduler->callback = callback;
+    scheduler->callback_data = callback_data;
+    scheduler->multi_handle = curl_multi_init();
+    scheduler->jitter_seed[0] = (unsigned short) getpid();
+    scheduler->jitter_seed[1] = (unsigned short) time(NULL);
+    scheduler->jitter_seed[2] = 0x330E;
+    omp_init_lock(&(scheduler->lock));
+    return scheduler;
+}
+
+void ws_scheduler_adapt_chunk_size(int initial_size, int min_size, int max_size, double target_latency,
+                                   ws_scheduler_t *scheduler) {
+    omp_set_lock(&(scheduler->lock));
+    scheduler->min_chunk_size = min_size > 0 ? min_size : 1;
+    scheduler->max_chunk_size = max_size > scheduler->min_chunk_size ? max_size : scheduler->min_chunk_size;
+    scheduler->chunk_size = initial_size < scheduler->min_chunk_size ? scheduler->min_chunk_size :
+                            initial_size > scheduler->max_chunk_size ? scheduler->max_chunk_size : initial_size;
+    scheduler->target_latency = target_latency;
+    omp_unset_lock(&(scheduler->lock));
+}
+
+int ws_scheduler_chunk_size(ws_scheduler_t *scheduler) {
+    omp_set_lock(&(scheduler->lock));
+    int chunk_size = scheduler->chunk_size;
+    omp_unset_lock(&(scheduler->lock));
+    return chunk_size;
+}
+
+void ws_scheduler_free(ws_scheduler_t *scheduler) {
+    ws_request_t *request = scheduler->queue_head;
+    while (request) {
+        ws_request_t *next = request->next;
+        ws_request_free(request);
+        request = next;
+    }
+    curl_multi_cleanup(scheduler->multi_handle);
+    omp_destroy_lock(&(scheduler->lock));
+    free(scheduler);
+}
+
+void ws_scheduler_submit(ws_request_t *request, ws_scheduler_t *scheduler) {
+    request->next = NULL;
+
+    // Wait until there is room for another request
+    omp_set_lock(&(scheduler->lock));
+    while (scheduler->num_queued + scheduler->num_in_flight >= scheduler->max_queued) {
+        omp_unset_lock(&(scheduler->lock));
+        usleep(1000);
+        omp_set_lock(&(scheduler->lock));
+    }
+
+    if (scheduler->queue_tail) {
+        scheduler->queue_tail->next = request;
+    } else {
+        scheduler->queue_head = request;
+    }
+    scheduler->queue_tail = request;
+    scheduler->num_queued++;
+    omp_unset_lock(&(scheduler->lock));
+}
+
+void ws_scheduler_close(ws_scheduler_t *scheduler) {
+    omp_set_lock(&(scheduler->lock));
+    scheduler->closed = 1;
+    omp_unset_lock(&(scheduler->lock));
+}
+
+int ws_scheduler_run(ws_scheduler_t *scheduler) {
+    int running_handles;
+
+    while (1) {
+        start_ready_requests(scheduler);
+
+        omp_set_lock(&(scheduler->lock));
+        int num_in_flight = scheduler->num_in_flight;
+        int finished = scheduler->closed && !scheduler->num_queued && !num_in_flight;
+        omp_unset_lock(&(scheduler->lock));
+
+        if (finished) {
+            break;
+        }
+        if (!num_in_flight) {
+            // Nothing to transfer, wait for new submissions or retries
+            usleep(1000);
+            continue;
+        }
+
+        curl_multi_perform(scheduler->multi_handle, &running_handles);
+        collect_finished_requests(scheduler);
+        if (running_handles > 0) {
+            curl_multi_wait(scheduler->multi_handle, NULL, 0, 100, NULL);
+        }
+    }
+
+    LOG_DEBUG_F("Web service requests: %zu completed, %zu failed, %zu retries\n",
+                scheduler->num_completed, scheduler->num_failed, scheduler->num_retries);
+    LOG_DEBUG_F("Web service limits: %d requests in flight, %d variants per request (mean latency %.3f s, mean payload %.0f bytes, error rate %.3f)\n",
+                scheduler->max_in_flight, scheduler->chunk_size, scheduler->mean_latency, 
+                scheduler->mean_payload, scheduler->error_rate);
+
+    return scheduler->num_failed;
+}
+
+/**
+ * Moves the requests waiting in the queue to the multi handle, as long as the number of requests
+ * in flight is below the maximum and their retry delay (if any) has expired.
+ */
+static void start_ready_requests(ws_scheduler_t *scheduler) {
+    double now = omp_get_wtime();
+
+    omp_set_lock(&(scheduler->lock));
+    ws_request_t *previous = NULL, *request = scheduler->queue_head;
+    while (request && scheduler->num_in_flight < scheduler->max_in_flight) {
+        ws_request_t *next = request->next;
+        if (request->not_before > now) {
+            previous = request;
+            request = next;
+            continue;
+        }
+
+        // Unlink from the queue
+        if (previous) {
+            previous->next = next;
+        } else {
+            scheduler->queue_head = next;
+        }
+        if (scheduler->queue_tail == request) {
+            scheduler->queue_tail = previous;
+        }
+        request->next = NULL;
+        scheduler->num_queued--;
+
+        // Prepare the transfer
+        CURL *handle = curl_easy_init();
+        curl_easy_setopt(handle, CURLOPT_URL, request->url);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request->body);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, save_ws_response);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, request);
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, request);
+        curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, request->error_message);
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 30L);
+
+        request->handle = handle;
+        request->sent_at = now;
+        request->attempts++;
+        request->response_len = 0;
+        request->response[0] = '\0';
+        request->error_message[0] = '\0';
+        curl_multi_add_handle(scheduler->multi_handle, handle);
+        scheduler->num_in_flight++;
+
+        request = next;
+    }
+    omp_unset_lock(&(scheduler->lock));
+}
+
+/**
+ * Retrieves the requests whose transfer finished. Failed requests are queued again until they
+ * reach the maximum number of attempts, and the rest are delivered to the callback.
+ */
+static void collect_finished_requests(ws_scheduler_t *scheduler) {
+    CURLMsg *message;
+    int messages_left;
+
+    while ((message = curl_multi_info_read(scheduler->multi_handle, &messages_left))) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        ws_request_t *request;
+        CURL *handle = message->easy_handle;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**) &request);
+        request->error_code = message->data.result;
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &(request->http_status));
+        curl_multi_remove_handle(scheduler->multi_handle, handle);
+        curl_easy_cleanup(handle);
+        request->handle = NULL;
+
+        int succeeded = ws_request_succeeded(request);
+        int retry = !succeeded && request->attempts < scheduler->max_attempts;
+        double now = omp_get_wtime();
+
+        omp_set_lock(&(scheduler->lock));
+        scheduler->num_in_flight--;
+        adapt_ws_scheduler(now - request->sent_at, strlen(request->body), succeeded, scheduler);
+        if (retry) {
+            // Exponential backoff, with jitter so the retries of a burst of failures are spread
+            double delay = scheduler->retry_delay * pow(2, request->attempts - 1) * (0.5 + erand48(scheduler->jitter_seed));
+            LOG_WARN_F("Web service request failed (%s), retry #%d in %.1f s\n", ws_request_error(request), request->attempts, delay);
+            request->not_before = now + delay;
+            if (scheduler->queue_tail) {
+                scheduler->queue_tail->next = request;
+            } else {
+                scheduler->queue_head = request;
+            }
+            scheduler->queue_tail = request;
+            scheduler->num_queued++;
+            scheduler->num_retries++;
+        } else if (succeeded) {
+            scheduler->num_completed++;
+        } else {
+            scheduler->num_failed++;
+        }
+        omp_unset_lock(&(scheduler->lock));
+
+        if (!retry) {
+            scheduler->callback(request, scheduler->callback_data);
+        }
+    }
+}
+
+/**
+ * Updates the statistics of the web services with an attempt that just finished, and adapts the
+ * limits to them. The limits grow additively after a window of requests that succeeded on time
+ * (as many as requests may be in flight), and are halved when a request fails or takes longer than
+ * the target latency. Only one decrease is applied per mean latency, so a burst of failures of
+ * requests sent at the same time counts once. The lock of the scheduler must be held.
+ */
+static void adapt_ws_scheduler(double latency, size_t payload_len, int succeeded, ws_scheduler_t *scheduler) {
+    int first = scheduler->mean_latency == 0;
+    scheduler->mean_latency = first ? latency : (1 - WS_STATS_WEIGHT) * scheduler->mean_latency + WS_STATS_WEIGHT * latency;
+    scheduler->mean_payload = first ? payload_len : (1 - WS_STATS_WEIGHT) * scheduler->mean_payload + WS_STATS_WEIGHT * payload_len;
+    scheduler->error_rate = (1 - WS_STATS_WEIGHT) * scheduler->error_rate + WS_STATS_WEIGHT * !succeeded;
+
+    int too_slow = scheduler->chunk_size > 0 && scheduler->target_latency > 0 && latency > scheduler->target_latency;
+    double now = omp_get_wtime();
+
+    if (!succeeded || too_slow) {
+        scheduler->window_successes = 0;
+        if (now - scheduler->last_decrease < scheduler->mean_latency) {
+            return;
+        }
+        scheduler->last_decrease = now;
+
+        if (!succeeded && scheduler->max_in_flight > 1) {
+            scheduler->max_in_flight /= 2;
+            LOG_DEBUG_F("Web service requests in flight reduced to %d\n", scheduler->max_in_flight);
+        }
+        if (scheduler->chunk_size > scheduler->min_chunk_size) {
+            scheduler->chunk_size = MAX(scheduler->chunk_size / 2, scheduler->min_chunk_size);
+            LOG_DEBUG_F("Variants per web service request reduced to %d\n", scheduler->chunk_size);
+        }
+        return;
+    }
+
+    if (++scheduler->window_successes < scheduler->max_in_flight) {
+        return;
+    }
+    scheduler->window_successes = 0;
+
+    if (scheduler->max_in_flight < scheduler->max_in_flight_limit) {
+        scheduler->max_in_flight++;
+    }
+    if (scheduler->chunk_size > 0 && scheduler->chunk_size < scheduler->max_chunk_size) {
+        int step = MAX(scheduler->max_chunk_size / 20, 1);
+        scheduler->chunk_size = MIN(scheduler->chunk_size + step, scheduler->max_chunk_size);
+    }
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WS_SCHEDULER_H
+#define WS_SCHEDULER_H
+
+/**
+ * @file ws_scheduler.h
+ * @brief Asynchronous invocation of web services
+ *
+ * This file declares an event-driven scheduler that keeps a configurable number of HTTP POST
+ * requests in flight using a libcurl multi handle. Requests are submitted from any thread, run by
+ * a single thread that drives the network I/O, and delivered through a callback as soon as their
+ * response is complete, so they can be parsed while other requests are still being transferred.
+ *
+ * The number of requests in flight and the number of variants per request are adapted to the
+ * latency and errors of the web services, the same way as TCP congestion control: they grow
+ * additively while requests succeed on time, and are halved when requests fail or take too long.
+ * Failed requests are retried with exponential backoff and random jitter.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+#include <omp.h>
+
+#include <commons/log.h>
+
+/**
+ * Weight of the last request in the exponentially weighted means of latency, payload and errors.
+ */
+#define WS_STATS_WEIGHT     0.125
+
+#ifndef MIN
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+#endif
+#ifndef MAX
+#define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
+#endif
+
+typedef struct ws_request ws_request_t;
+
+/**
+ * Function called when a request has finished, successfully or not. It receives the ownership of
+ * the request, which must be freed with ws_request_free.
+ */
+typedef void (*ws_request_callback)(ws_request_t *request, void *callback_data);
+
+/**
+ * @brief A POST request to a web service and its response.
+ */
+struct ws_request {
+    char *url;                  /**< URL of the web service (not owned by the request). */
+    char *body;                 /**< Body of the POST request, URL-encoded. */
+    int service;                /**< Identifier of the web service, free to use by the caller. */
+    void *data;                 /**< Data associated to the request, free to use by the caller. */
+
+    char *response;             /**< Response of the web service, always null-terminated. */
+    size_t response_len;        /**< Length of the response. */
+    size_t response_capacity;   /**< Size of the buffer allocated for the response. */
+    long http_status;           /**< HTTP status code of the response. */
+    int error_code;             /**< libcurl error code, CURLE_OK if the transfer succeeded. */
+    char error_message[CURL_ERROR_SIZE];
+
+    int attempts;               /**< Times the request has been sent. */
+    double not_before;          /**< Time (as in omp_get_wtime) before which the request can't be sent. */
+    double sent_at;             /**< Time (as in omp_get_wtime) the last attempt was sent. */
+
+    CURL *handle;
+    struct ws_request *next;
+};
+
+/**
+ * @brief Scheduler of web service requests.
+ */
+typedef struct ws_scheduler {
+    int max_in_flight;          /**< Maximum number of requests being transferred at the same time, adapted to the errors. */
+    int max_in_flight_limit;    /**< Upper bound of max_in_flight. */
+    int max_queued;             /**< Maximum number of requests waiting or in flight before submissions block. */
+    int max_attempts;           /**< Times a request is sent before considering it failed. */
+    double retry_delay;         /**< Seconds to wait before sending again a failed request, doubled in each attempt. */
+
+    int chunk_size;             /**< Variants recommended per request, adapted to the latency (zero if not adapted). */
+    int min_chunk_size;
+    int max_chunk_size;
+    double target_latency;      /**< Seconds a request should take at most. */
+
+    int window_successes;       /**< Requests that succeeded on time since the limits were last increased. */
+    double last_decrease;       /**< Time (as in omp_get_wtime) the limits were last decreased. */
+    double mean_latency;        /**< Exponentially weighted mean of the seconds taken by each attempt. */
+    double mean_payload;        /**< Exponentially weighted mean of the size of the request bodies. */
+    double error_rate;          /**< Exponentially weighted fraction of failed attempts. */
+    unsigned short jitter_seed[3];
+
+    ws_request_callback callback;
+    void *callback_data;
+
+    ws_request_t *queue_head;   /**< Requests waiting to be sent. */
+    ws_request_t *queue_tail;
+    int num_queued;
+    int num_in_flight;
+    int closed;                 /**< Whether no more requests will be submitted. */
+
+    size_t num_completed;       /**< Requests that finished successfully. */
+    size_t num_failed;          /**< Requests that failed after all their attempts. */
+    size_t num_retries;         /**< Times a request was sent again after failing. */
+
+    CURLM *multi_handle;
+    omp_lock_t lock;
+} ws_scheduler_t;
+
+
+/**
+ * @brief Creates a new request.
+ * @param url URL of the web service, must outlive the request
+ * @param body URL-encoded body of the POST request, owned by the request from now on
+ * @param service identifier of the web service
+ * @param data data associated to the request
+ */
+ws_request_t *ws_request_new(char *url, char *body, int service, void *data);
+
+void ws_request_free(ws_request_t *request);
+
+/**
+ * @brief Whether a request finished with a valid response from the web service.
+ */
+int ws_request_succeeded(ws_request_t *request);
+
+/**
+ * @brief Returns a description of the error that made a request fail.
+ */
+const char *ws_request_error(ws_request_t *request);
+
+
+/**
+ * @brief Creates a new scheduler.
+ * @param max_in_flight maximum number of requests being transferred at the same time
+ * @param max_attempts times a request is sent before considering it failed
+ * @param retry_delay seconds to wait before sending again a failed request
+ * @param callback function called when a request finishes
+ * @param callback_data data passed to the callback
+ */
+ws_scheduler_t *ws_scheduler_new(int max_in_flight, int max_attempts, double retry_delay,
+                                 ws_request_callback callback, void *callback_data);
+
+void ws_scheduler_free(ws_scheduler_t *scheduler);
+
+/**
+ * @brief Enables the adaptation of the number of variants per request.
+ * @param initial_size variants per request recommended initially
+ * @param min_size minimum variants per request
+ * @param max_size maximum variants per request
+ * @param target_latency seconds a request should take at most, slower ones reduce the size
+ */
+void ws_scheduler_adapt_chunk_size(int initial_size, int min_size, int max_size, double target_latency,
+                                   ws_scheduler_t *scheduler);
+
+/**
+ * @brief Returns the number of variants that should be sent in the next requests.
+ */
+int ws_scheduler_chunk_size(ws_scheduler_t *scheduler);
+
+/**
+ * @brief Submits a request to be sent by the scheduler.
+ *
+ * Blocks while the number of requests waiting to be sent or in flight is at its maximum, so the
+ * threads producing the requests can't get too far ahead of the network.
+ */
+void ws_scheduler_submit(ws_request_t *request, ws_scheduler_t *scheduler);
+
+/**
+ * @brief Notifies the scheduler that no more requests will be submitted.
+ */
+void ws_scheduler_close(ws_scheduler_t *scheduler);
+
+/**
+ * @brief Runs the event loop that sends the requests and receives their responses.
+ * @return Zero if all requests were successful, the number of failed requests otherwise
+ *
+ * Returns once the scheduler has been closed and all the submitted requests have finished.
+ * Only one thread may run the event loop of a scheduler.
+ */
+int ws_scheduler_run(ws_scheduler_t *scheduler);
+
+
+/**
+ * @brief Composes a URL-encoded body for a POST request.
+ * @param params names of the parameters
+ * @param values values of the parameters, NULL values are skipped
+ * @param num_params number of parameters
+ */
+char *compose_ws_post_body(char **params, char **values, int num_params);
+
+#endif
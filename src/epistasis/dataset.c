@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dataset.h"
+
+static void epistasis_dataset_reserve(size_t num_variants, epistasis_dataset_t *dataset);
+
+
+epistasis_dataset_t *epistasis_dataset_new(int num_affected, int num_unaffected) {
+    epistasis_dataset_t *dataset = (epistasis_dataset_t*) calloc (1, sizeof(epistasis_dataset_t));
+    dataset->num_affected = num_affected;
+    dataset->num_unaffected = num_unaffected;
+    dataset->affected_words = (num_affected + 63) / 64;
+    dataset->unaffected_words = (num_unaffected + 63) / 64;
+    dataset->words_per_variant = EPISTASIS_NUM_GENOTYPES * (dataset->affected_words + dataset->unaffected_words);
+    return dataset;
+}
+
+void epistasis_dataset_free(epistasis_dataset_t *dataset) {
+    for (size_t i = 0; i < dataset->num_variants; i++) {
+        free(dataset->chromosomes[i]);
+        free(dataset->ids[i]);
+    }
+    free(dataset->chromosomes);
+    free(dataset->ids);
+    free(dataset->positions);
+    free(dataset->planes);
+    free(dataset);
+}
+
+void epistasis_dataset_add_records(vcf_record_t **records, size_t num_records, uint8_t *genotypes, epistasis_dataset_t *dataset) {
+    int num_samples = dataset->num_affected + dataset->num_unaffected;
+    epistasis_dataset_reserve(dataset->num_variants + num_records, dataset);
+    
+    for (size_t i = 0; i < num_records; i++) {
+        size_t variant = dataset->num_variants + i;
+        uint8_t *row = genotypes + i * num_samples;
+        uint64_t *planes = dataset->planes + variant * dataset->words_per_variant;
+        memset(planes, 0, dataset->words_per_variant * sizeof(uint64_t));
+        
+        for (int j = 0; j < num_samples; j++) {
+            if (row[j] >= EPISTASIS_NUM_GENOTYPES) {
+                continue;
+            }
+            // Unaffected samples start at a new word
+            int bit = (j < dataset->num_affected) ? j : (dataset->affected_words * 64 + j - dataset->num_affected);
+            epistasis_dataset_plane(variant, row[j], dataset)[bit / 64] |= 1ULL << (bit % 64);
+        }
+        
+        dataset->chromosomes[variant] = strndup(records[i]->chromosome, records[i]->chromosome_len);
+        dataset->ids[variant] = strndup(records[i]->id, records[i]->id_len);
+        dataset->positions[variant] = records[i]->position;
+    }
+    
+    dataset->num_variants += num_records;
+}
+
+void epistasis_dataset_append(epistasis_dataset_t *source, epistasis_dataset_t *dataset) {
+    assert(source->words_per_variant == dataset->words_per_variant);
+    epistasis_dataset_reserve(dataset->num_variants + source->num_variants, dataset);
+    
+    memcpy(dataset->planes + dataset->num_variants * dataset->words_per_variant, source->planes, 
+           source->num_variants * source->words_per_variant * sizeof(uint64_t));
+    memcpy(dataset->chromosomes + dataset->num_variants, source->chromosomes, source->num_variants * sizeof(char*));
+    memcpy(dataset->ids + dataset->num_variants, source->ids, source->num_variants * sizeof(char*));
+    memcpy(dataset->positions + dataset->num_variants, source->positions, source->num_variants * sizeof(unsigned long));
+    dataset->num_variants += source->num_variants;
+    
+    // The strings now belong to the destination dataset
+    source->num_variants = 0;
+}
+
+
+static void epistasis_dataset_reserve(size_t num_variants, epistasis_dataset_t *dataset) {
+    if (num_variants <= dataset->capacity) {
+        return;
+    }
+    
+    size_t capacity = (num_variants > 2 * dataset->capacity) ? num_variants : 2 * dataset->capacity;
+    dataset->planes = realloc(dataset->planes, capacity * dataset->words_per_variant * sizeof(uint64_t));
+    dataset->chromosomes = realloc(dataset->chromosomes, capacity * sizeof(char*));
+    dataset->ids = realloc(dataset->ids, capacity * sizeof(char*));
+    dataset->positions = realloc(dataset->positions, capacity * sizeof(unsigned long));
+    dataset->capacity = capacity;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EPISTASIS_DATASET_H
+#define EPISTASIS_DATASET_H
+
+/**
+ * @file dataset.h
+ * @brief Genotypes of the variants tested for epistasis, packed as bit planes
+ *
+ * Samples are grouped by phenotype, first the affected and then the unaffected ones. Each variant 
+ * stores a plane per genotype (homozygous reference, heterozygous, homozygous alternate), and each 
+ * plane holds the bits of the affected samples followed by the bits of the unaffected ones, both 
+ * padded to a whole number of words. The cases and controls of any genotype combination of two 
+ * variants are then counted with an AND and a popcount per word. Missing genotypes have no bit set.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_util.h>
+#include <commons/log.h>
+
+/**
+ * Code of a missing genotype in the unpacked genotypes of a variant.
+ */
+#define EPISTASIS_MISSING_GENOTYPE  255
+
+/**
+ * Genotypes with a plane: homozygous reference, heterozygous and homozygous alternate.
+ */
+#define EPISTASIS_NUM_GENOTYPES     3
+
+/**
+ * Phenotype of the samples not tested, because their condition is unknown.
+ */
+#define EPISTASIS_UNKNOWN_PHENOTYPE 255
+
+
+typedef struct epistasis_dataset {
+    int num_affected;
+    int num_unaffected;
+    int affected_words;         /**< Words with the bits of the affected samples of a plane. */
+    int unaffected_words;       /**< Words with the bits of the unaffected samples of a plane. */
+    int words_per_variant;      /**< Words of the planes of all the genotypes of a variant. */
+    
+    size_t num_variants;
+    size_t capacity;
+    uint64_t *planes;           /**< words_per_variant words per variant. */
+    
+    char **chromosomes;
+    char **ids;
+    unsigned long *positions;
+} epistasis_dataset_t;
+
+
+/* **********************************************
+ *              Dataset creation                *
+ * **********************************************/
+
+/**
+ * @brief Assigns the affected samples the first positions and the unaffected ones the following.
+ * @param phenotypes 1 for affected samples and 0 for unaffected ones
+ * @param num_affected number of affected samples
+ * @param num_unaffected number of unaffected samples
+ * @return The position of each sample, keeping the order inside each group
+ */
+int *group_individuals_by_phenotype(uint8_t *phenotypes, int num_affected, int num_unaffected);
+
+/**
+ * @brief Assigns the affected samples the first positions and the unaffected ones the following.
+ * @param phenotypes 1 for affected samples, 0 for unaffected, EPISTASIS_UNKNOWN_PHENOTYPE for those not tested
+ * @param num_samples number of samples
+ * @param[out] num_affected number of affected samples
+ * @param[out] num_unaffected number of unaffected samples
+ * @return The position of each sample, keeping the order inside each group, or -1 if not tested
+ */
+int *group_samples_by_phenotype(uint8_t *phenotypes, int num_samples, int *num_affected, int *num_unaffected);
+
+/**
+ * @brief Decodes the genotypes of a list of variants, with their samples grouped by phenotype.
+ * @param records variants to decode
+ * @param num_records number of variants
+ * @param destination position of each sample of the variants, or -1 if not tested
+ * @param num_samples number of samples tested
+ * @return The number of alternate alleles of each variant and sample, or EPISTASIS_MISSING_GENOTYPE
+ */
+uint8_t *epistasis_dataset_process_records(vcf_record_t **records, size_t num_records, int *destination, int num_samples);
+
+
+/* **********************************************
+ *                Packed dataset                *
+ * **********************************************/
+
+epistasis_dataset_t *epistasis_dataset_new(int num_affected, int num_unaffected);
+
+void epistasis_dataset_free(epistasis_dataset_t *dataset);
+
+/**
+ * @brief Packs the genotypes of a list of variants at the end of a dataset.
+ * @param records variants whose position and ID are stored
+ * @param num_records number of variants
+ * @param genotypes genotypes of the variants, as returned by epistasis_dataset_process_records
+ * @param dataset dataset the variants are added to
+ */
+void epistasis_dataset_add_records(vcf_record_t **records, size_t num_records, uint8_t *genotypes, epistasis_dataset_t *dataset);
+
+/**
+ * @brief Moves the variants of a dataset to the end of another one with the same samples.
+ */
+void epistasis_dataset_append(epistasis_dataset_t *source, epistasis_dataset_t *dataset);
+
+/**
+ * @brief Returns the plane of a genotype of a variant, whose unaffected samples start at affected_words.
+ */
+static inline uint64_t *epistasis_dataset_plane(size_t variant, int genotype, epistasis_dataset_t *dataset) {
+    return dataset->planes + variant * dataset->words_per_variant + 
+           genotype * (dataset->affected_words + dataset->unaffected_words);
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dataset.h"
+
+int *group_individuals_by_phenotype(uint8_t *phenotypes, int num_affected, int num_unaffected) {
+    int affected, unaffected;
+    return group_samples_by_phenotype(phenotypes, num_affected + num_unaffected, &affected, &unaffected);
+}
+
+int *group_samples_by_phenotype(uint8_t *phenotypes, int num_samples, int *num_affected, int *num_unaffected) {
+    int *destination = (int*) malloc ((num_samples + 1) * sizeof(int));
+    
+    *num_affected = 0;
+    for (int i = 0; i < num_samples; i++) {
+        if (phenotypes[i] == 1) {
+            (*num_affected)++;
+        }
+    }
+    
+    int next_affected = 0, next_unaffected = *num_affected;
+    for (int i = 0; i < num_samples; i++) {
+        if (phenotypes[i] == 1) {
+            destination[i] = next_affected++;
+        } else if (phenotypes[i] == 0) {
+            destination[i] = next_unaffected++;
+        } else {
+            destination[i] = -1;
+        }
+    }
+    *num_unaffected = next_unaffected - *num_affected;
+    
+    return destination;
+}
+
+uint8_t *epistasis_dataset_process_records(vcf_record_t **records, size_t num_records, int *destination, int num_samples) {
+    uint8_t *genotypes = (uint8_t*) malloc (num_records * num_samples * sizeof(uint8_t));
+    int allele1, allele2;
+    
+    for (size_t i = 0; i < num_records; i++) {
+        vcf_record_t *record = records[i];
+        uint8_t *row = genotypes + i * num_samples;
+        memset(row, EPISTASIS_MISSING_GENOTYPE, num_samples * sizeof(uint8_t));
+        
+        char *format = strndup(record->format, record->format_len);
+        int gt_position = get_field_position_in_format("GT", format);
+        free(format);
+        if (gt_position < 0) {
+            continue;
+        }
+        
+        char **samples = (char**) record->samples->items;
+        for (int j = 0; j < record->samples->size; j++) {
+            if (destination[j] < 0) {
+                continue;
+            }
+            
+            char *sample = strdup(samples[j]);
+            if (!get_alleles(sample, gt_position, &allele1, &allele2)) {
+                row[destination[j]] = (allele1 > 0) + (allele2 > 0);
+            }
+            free(sample);
+        }
+    }
+    
+    return genotypes;
+}
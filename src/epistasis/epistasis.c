@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "epistasis.h"
+
+static int is_better_interaction(epistasis_interaction_t a, epistasis_interaction_t b);
+
+static void heap_sift_down(int position, epistasis_heap_t *heap);
+
+
+/* **********************************************
+ *                 Pairs search                 *
+ * **********************************************/
+
+epistasis_heap_t *epistasis_scan(epistasis_dataset_t *dataset, int top, int num_threads) {
+    long num_variants = dataset->num_variants;
+    long block_size = EPISTASIS_TILE_BYTES / (2 * dataset->words_per_variant * sizeof(uint64_t));
+    if (block_size < 1) {
+        block_size = 1;
+    }
+    long num_blocks = (num_variants + block_size - 1) / block_size;
+    long num_tiles = num_blocks * (num_blocks + 1) / 2;
+    LOG_DEBUG_F("%ld variants in blocks of %ld, %ld tiles\n", num_variants, block_size, num_tiles);
+    
+    epistasis_heap_t *best = epistasis_heap_new(top);
+    
+#pragma omp parallel num_threads(num_threads)
+    {
+        epistasis_heap_t *heap = epistasis_heap_new(top);
+        int cases[EPISTASIS_NUM_COMBINATIONS], controls[EPISTASIS_NUM_COMBINATIONS];
+        
+#pragma omp for schedule(dynamic)
+        for (long t = 0; t < num_tiles; t++) {
+            // Tiles are numbered by rows of the upper triangle of the blocks matrix
+            long first_block = 0, tile = t;
+            while (tile >= num_blocks - first_block) {
+                tile -= num_blocks - first_block;
+                first_block++;
+            }
+            long second_block = first_block + tile;
+            
+            long first_end = (first_block + 1) * block_size;
+            long second_end = (second_block + 1) * block_size;
+            if (first_end > num_variants) { first_end = num_variants; }
+            if (second_end > num_variants) { second_end = num_variants; }
+            
+            for (long i = first_block * block_size; i < first_end; i++) {
+                long second_start = (first_block == second_block) ? i + 1 : second_block * block_size;
+                for (long j = second_start; j < second_end; j++) {
+                    epistasis_contingency_table(i, j, dataset, cases, controls);
+                    epistasis_interaction_t interaction = { epistasis_balanced_accuracy(cases, controls), i, j };
+                    epistasis_heap_push(interaction, heap);
+                }
+            }
+        }
+        
+#pragma omp critical
+        {
+            for (int k = 0; k < heap->size; k++) {
+                epistasis_heap_push(heap->interactions[k], best);
+            }
+        }
+        
+        epistasis_heap_free(heap);
+    }
+    
+    epistasis_heap_sort(best);
+    return best;
+}
+
+void epistasis_contingency_table(size_t first, size_t second, epistasis_dataset_t *dataset, 
+                                 int cases[EPISTASIS_NUM_COMBINATIONS], int controls[EPISTASIS_NUM_COMBINATIONS]) {
+    int affected_words = dataset->affected_words;
+    int plane_words = dataset->affected_words + dataset->unaffected_words;
+    
+    for (int g1 = 0; g1 < EPISTASIS_NUM_GENOTYPES; g1++) {
+        uint64_t *plane1 = epistasis_dataset_plane(first, g1, dataset);
+        for (int g2 = 0; g2 < EPISTASIS_NUM_GENOTYPES; g2++) {
+            uint64_t *plane2 = epistasis_dataset_plane(second, g2, dataset);
+            int num_cases = 0, num_controls = 0;
+            for (int w = 0; w < affected_words; w++) {
+                num_cases += __builtin_popcountll(plane1[w] & plane2[w]);
+            }
+            for (int w = affected_words; w < plane_words; w++) {
+                num_controls += __builtin_popcountll(plane1[w] & plane2[w]);
+            }
+            cases[g1 * EPISTASIS_NUM_GENOTYPES + g2] = num_cases;
+            controls[g1 * EPISTASIS_NUM_GENOTYPES + g2] = num_controls;
+        }
+    }
+}
+
+double epistasis_balanced_accuracy(int cases[EPISTASIS_NUM_COMBINATIONS], int controls[EPISTASIS_NUM_COMBINATIONS]) {
+    long total_cases = 0, total_controls = 0;
+    for (int k = 0; k < EPISTASIS_NUM_COMBINATIONS; k++) {
+        total_cases += cases[k];
+        total_controls += controls[k];
+    }
+    if (total_cases == 0 || total_controls == 0) {
+        return 0.5;
+    }
+    
+    // A combination is high-risk if its ratio of cases to controls is higher than the one of all samples
+    long true_positives = 0, true_negatives = 0;
+    for (int k = 0; k < EPISTASIS_NUM_COMBINATIONS; k++) {
+        if (cases[k] * total_controls > controls[k] * total_cases) {
+            true_positives += cases[k];
+        } else {
+            true_negatives += controls[k];
+        }
+    }
+    
+    return 0.5 * ((double) true_positives / total_cases + (double) true_negatives / total_controls);
+}
+
+
+/* **********************************************
+ *              Best interactions               *
+ * **********************************************/
+
+epistasis_heap_t *epistasis_heap_new(int capacity) {
+    epistasis_heap_t *heap = (epistasis_heap_t*) malloc (sizeof(epistasis_heap_t));
+    heap->interactions = (epistasis_interaction_t*) malloc ((capacity + 1) * sizeof(epistasis_interaction_t));
+    heap->size = 0;
+    heap->capacity = capacity;
+    return heap;
+}
+
+void epistasis_heap_free(epistasis_heap_t *heap) {
+    free(heap->interactions);
+    free(heap);
+}
+
+void epistasis_heap_push(epistasis_interaction_t interaction, epistasis_heap_t *heap) {
+    epistasis_interaction_t *interactions = heap->interactions;
+    
+    if (heap->size < heap->capacity) {
+        // Sift up from the new leaf
+        int position = heap->size++;
+        while (position > 0 && is_better_interaction(interactions[(position - 1) / 2], interaction)) {
+            interactions[position] = interactions[(position - 1) / 2];
+            position = (position - 1) / 2;
+        }
+        interactions[position] = interaction;
+    } else if (heap->capacity > 0 && is_better_interaction(interaction, interactions[0])) {
+        // Replace the worst interaction
+        interactions[0] = interaction;
+        heap_sift_down(0, heap);
+    }
+}
+
+void epistasis_heap_sort(epistasis_heap_t *heap) {
+    // Move the worst interaction to the end while the heap shrinks
+    int size = heap->size;
+    while (heap->size > 1) {
+        epistasis_interaction_t worst = heap->interactions[0];
+        heap->interactions[0] = heap->interactions[--heap->size];
+        heap_sift_down(0, heap);
+        heap->interactions[heap->size] = worst;
+    }
+    heap->size = size;
+}
+
+
+static int is_better_interaction(epistasis_interaction_t a, epistasis_interaction_t b) {
+    if (a.accuracy != b.accuracy) {
+        return a.accuracy > b.accuracy;
+    }
+    // Ties are broken by position, so the result doesn't depend on the number of threads
+    return (a.first != b.first) ? a.first < b.first : a.second < b.second;
+}
+
+static void heap_sift_down(int position, epistasis_heap_t *heap) {
+    epistasis_interaction_t *interactions = heap->interactions;
+    epistasis_interaction_t interaction = interactions[position];
+    
+    while (2 * position + 1 < heap->size) {
+        int child = 2 * position + 1;
+        if (child + 1 < heap->size && is_better_interaction(interactions[child], interactions[child + 1])) {
+            child++;
+        }
+        if (!is_better_interaction(interaction, interactions[child])) {
+            break;
+        }
+        interactions[position] = interactions[child];
+        position = child;
+    }
+    interactions[position] = interaction;
+}
+
+
+/* **********************************************
+ *                   Results                    *
+ * **********************************************/
+
+epistasis_result_t *epistasis_result_new(epistasis_interaction_t interaction, epistasis_dataset_t *dataset) {
+    epistasis_result_t *result = (epistasis_result_t*) malloc (sizeof(epistasis_result_t));
+    result->chromosome1 = strdup(dataset->chromosomes[interaction.first]);
+    result->id1 = strdup(dataset->ids[interaction.first]);
+    result->position1 = dataset->positions[interaction.first];
+    result->chromosome2 = strdup(dataset->chromosomes[interaction.second]);
+    result->id2 = strdup(dataset->ids[interaction.second]);
+    result->position2 = dataset->positions[interaction.second];
+    result->accuracy = interaction.accuracy;
+    
+    // Chi-square test of independence between the phenotype and the observed genotype combinations
+    int cases[EPISTASIS_NUM_COMBINATIONS], controls[EPISTASIS_NUM_COMBINATIONS];
+    epistasis_contingency_table(interaction.first, interaction.second, dataset, cases, controls);
+    
+    double total_cases = 0, total_controls = 0;
+    for (int k = 0; k < EPISTASIS_NUM_COMBINATIONS; k++) {
+        total_cases += cases[k];
+        total_controls += controls[k];
+    }
+    
+    result->chi_square = 0;
+    result->degrees_of_freedom = -1;
+    if (total_cases > 0 && total_controls > 0) {
+        double total = total_cases + total_controls;
+        for (int k = 0; k < EPISTASIS_NUM_COMBINATIONS; k++) {
+            int samples = cases[k] + controls[k];
+            if (samples == 0) {
+                continue;
+            }
+            double expected_cases = samples * total_cases / total;
+            double expected_controls = samples * total_controls / total;
+            result->chi_square += (cases[k] - expected_cases) * (cases[k] - expected_cases) / expected_cases + 
+                                  (controls[k] - expected_controls) * (controls[k] - expected_controls) / expected_controls;
+            result->degrees_of_freedom++;
+        }
+    }
+    result->p_value = (result->degrees_of_freedom > 0) ? 1 - gsl_cdf_chisq_P(result->chi_square, result->degrees_of_freedom) : 1.0;
+    if (result->degrees_of_freedom < 0) {
+        result->degrees_of_freedom = 0;
+    }
+    
+    return result;
+}
+
+void epistasis_result_free(epistasis_result_t *result) {
+    free(result->chromosome1);
+    free(result->id1);
+    free(result->chromosome2);
+    free(result->id2);
+    free(result);
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EPISTASIS_H
+#define EPISTASIS_H
+
+/**
+ * @file epistasis.h
+ * @brief Exhaustive search of interactions between pairs of variants
+ *
+ * Every pair of variants is scored as in multifactor dimensionality reduction (MDR): each of the 
+ * 9 combinations of their genotypes is labelled high-risk if its ratio of cases to controls is higher 
+ * than the one of the whole dataset, and the pair is scored with the balanced accuracy of classifying 
+ * the samples with those labels.
+ *
+ * The pairs are enumerated in tiles of two blocks of variants, small enough for the planes of both 
+ * blocks to stay in cache while all their pairs are counted. Tiles are distributed among the threads, 
+ * and each thread keeps only its best pairs in a bounded heap.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gsl/gsl_cdf.h>
+#include <omp.h>
+
+#include <bioformats/family/family.h>
+#include <bioformats/ped/ped_file.h>
+#include <bioformats/ped/ped_file_structure.h>
+#include <bioformats/vcf/vcf_file.h>
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_util.h>
+#include <commons/log.h>
+#include <commons/argtable/argtable2.h>
+#include <commons/config/libconfig.h>
+#include <containers/list.h>
+#include <containers/khash.h>
+#include <containers/cprops/hashtable.h>
+
+#include "error.h"
+#include "epistasis/dataset.h"
+#include "hpg_variant_utils.h"
+#include "shared_options.h"
+
+/**
+ * Number of options applicable to the epistasis tool.
+ */
+#define NUM_EPISTASIS_OPTIONS  1
+
+/**
+ * Interactions reported if not specified.
+ */
+#define EPISTASIS_DEFAULT_TOP  100
+
+/**
+ * Bytes of the planes of both blocks of a tile, which should fit in the L2 cache.
+ */
+#define EPISTASIS_TILE_BYTES   (128 * 1024)
+
+/**
+ * Combinations of the genotypes of two variants.
+ */
+#define EPISTASIS_NUM_COMBINATIONS  (EPISTASIS_NUM_GENOTYPES * EPISTASIS_NUM_GENOTYPES)
+
+
+typedef struct epistasis_options {
+    int num_options;
+    
+    struct arg_int *top;
+} epistasis_options_t;
+
+/**
+ * @brief Values for the options of the epistasis tool.
+ */
+typedef struct epistasis_options_data {
+    int top; /**< Number of interactions reported */
+} epistasis_options_data_t;
+
+static epistasis_options_t *new_epistasis_cli_options(void);
+
+/**
+ * @brief Initializes an epistasis_options_data_t structure from the values of the command-line options.
+ */
+static epistasis_options_data_t *new_epistasis_options_data(epistasis_options_t *options);
+
+/**
+ * @brief Free memory associated to an epistasis_options_data_t structure.
+ */
+static void free_epistasis_options_data(epistasis_options_data_t *options_data);
+
+
+/* **********************************************
+ *                Options parsing               *
+ * **********************************************/
+
+/**
+ * @brief Reads the configuration parameters of the epistasis tool.
+ * @param filename file the options data are read from
+ * @param options_data local options values (host URL, species, num-threads...)
+ * @return Zero if the configuration has been successfully read, non-zero otherwise
+ * 
+ * Reads the basic configuration parameters of the tool. If the configuration
+ * file can't be read, these parameters should be provided via the command-line
+ * interface.
+ */
+int read_epistasis_configuration(const char *filename, epistasis_options_t *epistasis_options, shared_options_t *shared_options);
+
+/**
+ * @brief Parses the tool options from the command-line.
+ * @param argc Number of arguments from the command-line
+ * @param argv List of arguments from the command line
+ * @param[out] options_data Struct where the tool-specific options are stored in
+ * @param[out] global_options_data Struct where the application options are stored in
+ * 
+ * Reads the arguments from the command-line, checking they correspond to an option for the 
+ * epistasis tool, and stores them in the local or global structure, depending on their scope.
+ */
+void **parse_epistasis_options(int argc, char *argv[], epistasis_options_t *epistasis_options, shared_options_t *shared_options);
+
+void **merge_epistasis_options(epistasis_options_t *epistasis_options, shared_options_t *shared_options, struct arg_end *arg_end);
+
+/**
+ * @brief Checks semantic dependencies among the tool options.
+ * @param global_options_data Application-wide options to check
+ * @param options_data Tool-wide options to check
+ * @return Zero (0) if the options are correct, non-zero otherwise
+ * 
+ * Checks that all dependencies among options are satisfied, i.e.: option A is mandatory, 
+ * option B can't be provided at the same time as option C, and so on.
+ */
+int verify_epistasis_options(epistasis_options_t *epistasis_options, shared_options_t *shared_options);
+
+
+/* **********************************************
+ *                Test execution                *
+ * **********************************************/
+
+typedef struct epistasis_interaction {
+    double accuracy;    /**< Balanced accuracy of the high-risk genotype combinations. */
+    size_t first;       /**< Index of the first variant in the dataset. */
+    size_t second;      /**< Index of the second variant, always greater than the first. */
+} epistasis_interaction_t;
+
+/**
+ * @brief Min-heap with the best interactions found so far.
+ */
+typedef struct epistasis_heap {
+    epistasis_interaction_t *interactions;
+    int size;
+    int capacity;
+} epistasis_heap_t;
+
+typedef struct {
+    char *chromosome1;
+    char *id1;
+    unsigned long int position1;
+    char *chromosome2;
+    char *id2;
+    unsigned long int position2;
+    
+    double accuracy;
+    double chi_square;
+    int degrees_of_freedom;
+    double p_value;
+} epistasis_result_t;
+
+
+epistasis_heap_t *epistasis_heap_new(int capacity);
+
+void epistasis_heap_free(epistasis_heap_t *heap);
+
+/**
+ * @brief Adds an interaction if the heap is not full or it is better than the worst one stored.
+ */
+void epistasis_heap_push(epistasis_interaction_t interaction, epistasis_heap_t *heap);
+
+/**
+ * @brief Sorts the interactions of a heap from the best to the worst, which is no longer a heap.
+ */
+void epistasis_heap_sort(epistasis_heap_t *heap);
+
+/**
+ * @brief Counts the cases and controls of each combination of the genotypes of two variants.
+ * @param first index of the first variant
+ * @param second index of the second variant
+ * @param dataset packed genotypes
+ * @param[out] cases cases of each combination, as first genotype * 3 + second genotype
+ * @param[out] controls controls of each combination
+ */
+void epistasis_contingency_table(size_t first, size_t second, epistasis_dataset_t *dataset, 
+                                 int cases[EPISTASIS_NUM_COMBINATIONS], int controls[EPISTASIS_NUM_COMBINATIONS]);
+
+/**
+ * @brief Returns the balanced accuracy of labelling as high-risk the combinations with more cases than expected.
+ */
+double epistasis_balanced_accuracy(int cases[EPISTASIS_NUM_COMBINATIONS], int controls[EPISTASIS_NUM_COMBINATIONS]);
+
+/**
+ * @brief Scores all the pairs of variants of a dataset.
+ * @param dataset packed genotypes
+ * @param top number of interactions kept
+ * @param num_threads number of threads that score the pairs
+ * @return The best interactions, sorted from the best to the worst
+ */
+epistasis_heap_t *epistasis_scan(epistasis_dataset_t *dataset, int top, int num_threads);
+
+/**
+ * @brief Creates the result of an interaction, with the chi-square test of its contingency table.
+ */
+epistasis_result_t *epistasis_result_new(epistasis_interaction_t interaction, epistasis_dataset_t *dataset);
+
+void epistasis_result_free(epistasis_result_t *result);
+
+#endif
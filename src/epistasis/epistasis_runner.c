@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "epistasis_runner.h"
+
+int run_epistasis(shared_options_data_t* shared_options_data, epistasis_options_data_t *options_data) {
+    list_t *output_list = (list_t*) malloc (sizeof(list_t));
+    list_init("output", shared_options_data->num_threads, INT_MAX, output_list);
+
+    int ret_code = 0;
+    vcf_file_t *vcf_file = vcf_open(shared_options_data->vcf_filename, shared_options_data->max_batches);
+    if (!vcf_file) {
+        LOG_FATAL("VCF file does not exist!\n");
+    }
+    
+    ped_file_t *ped_file = ped_open(shared_options_data->ped_filename);
+    if (!ped_file) {
+        LOG_FATAL("PED file does not exist!\n");
+    }
+    
+    LOG_INFO("About to read PED file...\n");
+    // Read PED file before doing any processing
+    ret_code = ped_read(ped_file);
+    if (ret_code != 0) {
+        LOG_FATAL_F("Can't read PED file: %s\n", ped_file->filename);
+    }
+    
+    // Try to create the directory where the output files will be stored
+    ret_code = create_directory(shared_options_data->output_directory);
+    if (ret_code != 0 && errno != EEXIST) {
+        LOG_FATAL_F("Can't create output directory: %s\n", shared_options_data->output_directory);
+    }
+    
+    LOG_INFO("About to load the genotypes for the epistasis search...\n");
+
+    // Variants are added to the dataset in the same order the batches were read
+    reorder_buffer_t *reorder_buffer = reorder_buffer_new(shared_options_data->num_threads * REORDER_BUFFER_BATCHES_PER_THREAD);
+    
+    // Genotypes of all the variants that passed the filters, packed when the samples are known
+    epistasis_dataset_t *dataset = NULL;
+
+#pragma omp parallel sections private(ret_code)
+    {
+#pragma omp section
+        {
+            LOG_DEBUG_F("Level %d: number of threads in the team - %d\n", 0, omp_get_num_threads());
+            
+            double start = omp_get_wtime();
+
+            ret_code = vcf_read(vcf_file, 0,
+                                (shared_options_data->batch_bytes > 0) ? shared_options_data->batch_bytes : shared_options_data->batch_lines,
+                                shared_options_data->batch_bytes <= 0);
+
+            double stop = omp_get_wtime();
+
+            if (ret_code) {
+                LOG_FATAL_F("Error %d while reading the file %s\n", ret_code, vcf_file->filename);
+            }
+
+            LOG_INFO_F("[%dR] Time elapsed = %f s\n", omp_get_thread_num(), stop - start);
+            LOG_INFO_F("[%dR] Time elapsed = %e ms\n", omp_get_thread_num(), (stop - start) * 1000);
+
+            notify_end_reading(vcf_file);
+        }
+
+#pragma omp section
+        {
+            LOG_DEBUG_F("Level %d: number of threads in the team - %d\n", 10, omp_get_num_threads());
+            
+            // Enable nested parallelism
+            omp_set_nested(1);
+            
+            volatile int initialization_done = 0;
+            // Pedigree information
+            individual_t **individuals = NULL;
+            khash_t(ids) *sample_ids = NULL;
+            int *destination = NULL;
+            int num_affected = 0, num_unaffected = 0;
+            
+            // Create chain of filters for the VCF file
+            filter_t **filters = NULL;
+            int num_filters = 0;
+            if (shared_options_data->chain != NULL) {
+                filters = sort_filter_chain(shared_options_data->chain, &num_filters);
+            }
+            FILE *passed_file = NULL, *failed_file = NULL;
+            get_filtering_output_files(shared_options_data, &passed_file, &failed_file);
+    
+            double start = omp_get_wtime();
+            
+            int i = 0;
+//#pragma omp parallel num_threads(shared_options_data->num_threads) shared(initialization_done, families, sample_ids, filters)
+#pragma omp parallel num_threads(shared_options_data->num_threads)
+            {
+            LOG_DEBUG_F("Level %d: number of threads in the team - %d\n", 11, omp_get_num_threads());
+            
+            char *text_begin, *text_end;
+            vcf_reader_status *status;
+            long text_sequence;
+            int text_records;
+            while (1) {
+                // Texts must be given their sequence numbers in the same order they are fetched
+#pragma omp critical 
+                {
+                    text_begin = fetch_vcf_text_batch(vcf_file);
+                    if (text_begin) {
+                        text_end = text_begin + strlen(text_begin);
+                        text_records = count_vcf_text_records(text_begin, text_end);
+                        text_sequence = reorder_buffer_register_text(text_begin, text_end, text_records, reorder_buffer);
+                        status = vcf_reader_status_new(shared_options_data->batch_lines, i);
+                        i++;
+                    }
+                }
+                
+                if (!text_begin) {
+                    break;
+                }
+                if (text_begin == text_end) { // EOF
+                    reorder_buffer_skip_text(text_sequence, reorder_buffer);
+                    vcf_reader_status_free(status);
+                    free(text_begin);
+                    break;
+                }
+                if (text_records == 0) {
+                    reorder_buffer_skip_text(text_sequence, reorder_buffer);
+                }
+                
+                if (shared_options_data->batch_bytes > 0) {
+                    ret_code = run_vcf_parser(text_begin, text_end, 0, vcf_file, status);
+                } else if (shared_options_data->batch_lines > 0) {
+                    ret_code = run_vcf_parser(text_begin, text_end, shared_options_data->batch_lines, vcf_file, status);
+                }
+                
+                if (ret_code > 0) {
+                    LOG_FATAL_F("Error %d while parsing the file %s\n", ret_code, vcf_file->filename);
+                }
+                
+                // Initialize structures needed for packing the genotypes and write headers of output files
+                if (!initialization_done && vcf_file->samples_names->size > 0) {
+#pragma omp critical
+                {
+                    // Guarantee that just one thread performs this operation
+                    if (!initialization_done) {
+                        // Create map to associate the position of individuals in the list of samples defined in the VCF file
+                        sample_ids = associate_samples_and_positions(vcf_file);
+                        // Sort individuals in PED as defined in the VCF file
+                        individuals = sort_individuals(vcf_file, ped_file);
+                        // Group samples by phenotype, leaving out those whose condition is unknown
+                        int num_vcf_samples = get_num_vcf_samples(vcf_file);
+                        uint8_t *phenotypes = (uint8_t*) malloc ((num_vcf_samples + 1) * sizeof(uint8_t));
+                        for (int j = 0; j < num_vcf_samples; j++) {
+                            if (individuals[j] && individuals[j]->condition == AFFECTED) {
+                                phenotypes[j] = 1;
+                            } else if (individuals[j] && individuals[j]->condition == UNAFFECTED) {
+                                phenotypes[j] = 0;
+                            } else {
+                                phenotypes[j] = EPISTASIS_UNKNOWN_PHENOTYPE;
+                            }
+                        }
+                        destination = group_samples_by_phenotype(phenotypes, num_vcf_samples, &num_affected, &num_unaffected);
+                        dataset = epistasis_dataset_new(num_affected, num_unaffected);
+                        LOG_INFO_F("%d affected and %d unaffected samples will be tested\n", num_affected, num_unaffected);
+                        free(phenotypes);
+                        
+                        // Add headers associated to the defined filters
+                        vcf_header_entry_t **filter_headers = get_filters_as_vcf_headers(filters, num_filters);
+                        for (int j = 0; j < num_filters; j++) {
+                            add_vcf_header_entry(filter_headers[j], vcf_file);
+                        }
+                        
+                        // Write file format, header entries and delimiter
+                        if (passed_file != NULL) { write_vcf_header(vcf_file, passed_file); }
+                        if (failed_file != NULL) { write_vcf_header(vcf_file, failed_file); }
+                        
+                        LOG_DEBUG("VCF header written\n");
+                        
+                        initialization_done = 1;
+                    }
+                }
+                }
+                
+                // If it has not been initialized it means that header is not fully read
+                if (!initialization_done) {
+                    continue;
+                }
+                
+                vcf_batch_t *batch = fetch_vcf_batch(vcf_file);
+
+                if (i % 100 == 0) {
+                    LOG_INFO_F("Batch %d reached by thread %d - %zu/%zu records \n", 
+                            i, omp_get_thread_num(),
+                            batch->records->size, batch->records->capacity);
+                }
+
+                // Pack the genotypes of the records that passed the filters
+                array_list_t *failed_records = NULL;
+                assert(batch);
+                assert(batch->records);
+                
+                // The batch may have been parsed from the text of another thread
+                int batch_offset = 0;
+                long batch_sequence = claim_vcf_batch_sequence(batch, &batch_offset, reorder_buffer);
+                if (batch_sequence >= 0) {
+                    reorder_buffer_wait(batch_sequence, reorder_buffer);
+                }
+                
+                int num_variables = ped_file? get_num_variables(ped_file): 0;
+                array_list_t *passed_records = filter_records(filters, num_filters, individuals, sample_ids,num_variables, batch->records, &failed_records);
+                if (batch_sequence >= 0) {
+                    epistasis_dataset_t *batch_dataset = epistasis_dataset_new(num_affected, num_unaffected);
+                    if (passed_records->size > 0) {
+                        uint8_t *genotypes = epistasis_dataset_process_records((vcf_record_t**) passed_records->items, passed_records->size, 
+                                                                               destination, num_affected + num_unaffected);
+                        epistasis_dataset_add_records((vcf_record_t**) passed_records->items, passed_records->size, genotypes, batch_dataset);
+                        free(genotypes);
+                    }
+                    list_insert_item(list_item_new(batch_sequence, batch_offset, batch_dataset), output_list);
+                }
+                
+                // Write records that passed and failed filters to separate files, and free them
+                write_filtering_output_files(passed_records, failed_records, passed_file, failed_file);
+                free_filtered_records(passed_records, failed_records, batch->records);
+                
+                // Free batch and its contents
+                vcf_reader_status_free(status);
+                vcf_batch_free(batch);
+            }
+            
+            notify_end_parsing(vcf_file);
+            }
+
+            double stop = omp_get_wtime();
+            
+            LOG_INFO_F("[%d] Time elapsed = %f s\n", omp_get_thread_num(), stop - start);
+            LOG_INFO_F("[%d] Time elapsed = %e ms\n", omp_get_thread_num(), (stop - start) * 1000);
+
+            // Free resources
+            if (filters) {
+                for (int i = 0; i < num_filters; i++) {
+                    filter_t *filter = filters[i];
+                    filter->free_func(filter);
+                }
+                free(filters);
+            }
+            
+            if (sample_ids) { kh_destroy(ids, sample_ids); }
+            if (destination) { free(destination); }
+            if (individuals) { free(individuals); }
+            
+            // Decrease list writers count
+            for (int i = 0; i < shared_options_data->num_threads; i++) {
+                list_decr_writers(output_list);
+            }
+        }
+
+#pragma omp section
+        {
+            // Thread which adds the genotypes of each batch to the dataset
+            LOG_DEBUG_F("Level %d: number of threads in the team - %d\n", 20, omp_get_num_threads());
+            
+            double start = omp_get_wtime();
+            
+            list_item_t *item = NULL;
+            epistasis_dataset_t *batch_dataset = NULL;
+            while (item = list_remove_item(output_list)) {
+                reorder_buffer_put(item->id, item->type, item->data_p, reorder_buffer);
+                list_item_free(item);
+                
+                while (reorder_buffer_pop((void**) &batch_dataset, reorder_buffer)) {
+                    if (batch_dataset) {
+                        epistasis_dataset_append(batch_dataset, dataset);
+                        epistasis_dataset_free(batch_dataset);
+                    }
+                }
+            }
+            
+            // Results of every batch must have been written in order
+            reorder_buffer_finish(reorder_buffer);
+            
+            double stop = omp_get_wtime();
+
+            LOG_INFO_F("[%dW] Time elapsed = %f s\n", omp_get_thread_num(), stop - start);
+            LOG_INFO_F("[%dW] Time elapsed = %e ms\n", omp_get_thread_num(), (stop - start) * 1000);
+
+        }
+    }
+    
+    // Score all pairs of variants once their genotypes are loaded
+    if (dataset) {
+        LOG_INFO_F("About to search interactions among %zu variants...\n", dataset->num_variants);
+        double start = omp_get_wtime();
+        
+        epistasis_heap_t *best = epistasis_scan(dataset, options_data->top, shared_options_data->num_threads);
+        
+        double stop = omp_get_wtime();
+        LOG_INFO_F("[S] Time elapsed = %f s\n", stop - start);
+        
+        char *path;
+        FILE *fd = get_output_file(shared_options_data, "hpg-variant.epistasis", &path);
+        LOG_INFO_F("Epistasis output filename = %s\n", path);
+        write_output_header(fd);
+        write_output_body(best, dataset, fd);
+        fclose(fd);
+        free(path);
+        
+        epistasis_heap_free(best);
+        epistasis_dataset_free(dataset);
+    }
+    
+    free(output_list);
+    reorder_buffer_free(reorder_buffer);
+    vcf_close(vcf_file);
+    ped_close(ped_file, 1, 1);
+    
+    return ret_code;
+}
+
+
+/* *******************
+ * Output generation *
+ * *******************/
+
+void write_output_header(FILE *fd) {
+    assert(fd);
+    fprintf(fd, "#CHR1        POS1              ID1     CHR2        POS2              ID2     ACCURACY        CHISQ   DF        P-VALUE\n");
+}
+
+void write_output_body(epistasis_heap_t *interactions, epistasis_dataset_t *dataset, FILE *fd) {
+    assert(fd);
+    for (int k = 0; k < interactions->size; k++) {
+        epistasis_result_t *result = epistasis_result_new(interactions->interactions[k], dataset);
+        
+        fprintf(fd, "%s\t%8ld\t%s\t%s\t%8ld\t%s\t%6f\t%6f\t%d\t%e\n",
+                result->chromosome1, result->position1, result->id1, result->chromosome2, result->position2, result->id2, 
+                result->accuracy, result->chi_square, result->degrees_of_freedom, result->p_value);
+        
+        epistasis_result_free(result);
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "epistasis.h"
+#include "epistasis_runner.h"
+
+int epistasis(int argc, char *argv[], const char *configuration_file) {
+    
+    /* ******************************
+     *       Modifiable options     *
+     * ******************************/
+
+    shared_options_t *shared_options = new_shared_cli_options(1);
+    epistasis_options_t *epistasis_options = new_epistasis_cli_options();
+
+    // If no arguments or only --help are provided, show usage
+    void **argtable;
+    if (argc == 1 || !strcmp(argv[1], "--help")) {
+        argtable = merge_epistasis_options(epistasis_options, shared_options, arg_end(epistasis_options->num_options + shared_options->num_options));
+        show_usage("hpg-var-gwas epistasis", argtable, epistasis_options->num_options + shared_options->num_options);
+        arg_freetable(argtable, 29);
+        return 0;
+    }
+
+    /* ******************************
+     *       Execution steps        *
+     * ******************************/
+
+    // Step 1: read options from configuration file
+    int config_errors = read_shared_configuration(configuration_file, shared_options);
+    config_errors &= read_epistasis_configuration(configuration_file, epistasis_options, shared_options);
+    
+    if (config_errors) {
+        LOG_FATAL("Configuration file read with errors\n");
+        return CANT_READ_CONFIG_FILE;
+    }
+    
+    // Step 2: parse command-line options
+    argtable = parse_epistasis_options(argc, argv, epistasis_options, shared_options);
+
+    // Step 3: check that all options are set with valid values
+    // Mandatory options that couldn't be read from the config file must be set via command-line
+    // If not, return error code!
+    int check_epistasis_opts = verify_epistasis_options(epistasis_options, shared_options);
+    if (check_epistasis_opts > 0) {
+        return check_epistasis_opts;
+    }
+    
+    // Step 4: Create XXX_options_data_t structures from valid XXX_options_t
+    shared_options_data_t *shared_options_data = new_shared_options_data(shared_options);
+    epistasis_options_data_t *options_data = new_epistasis_options_data(epistasis_options);
+
+    init_log_custom(shared_options_data->log_level, 1, "hpg-var-gwas.log", "w");
+    
+    // Step 5: Perform the operations related to the selected GWAS sub-tool
+    int ret_code = run_epistasis(shared_options_data, options_data);
+    
+    free_epistasis_options_data(options_data);
+    free_shared_options_data(shared_options_data);
+    arg_freetable(argtable, 29);
+    free(configuration_file);
+
+    return ret_code;
+}
+
+epistasis_options_t *new_epistasis_cli_options(void) {
+    epistasis_options_t *options = (epistasis_options_t*) malloc (sizeof(epistasis_options_t));
+    options->num_options = NUM_EPISTASIS_OPTIONS;
+    options->top = arg_int0(NULL, "top", NULL, "Number of interactions reported (default 100)");
+    return options;
+}
+
+epistasis_options_data_t *new_epistasis_options_data(epistasis_options_t *options) {
+    epistasis_options_data_t *options_data = (epistasis_options_data_t*) calloc (1, sizeof(epistasis_options_data_t));
+    options_data->top = (options->top->count > 0) ? *(options->top->ival) : EPISTASIS_DEFAULT_TOP;
+    return options_data;
+}
+
+void free_epistasis_options_data(epistasis_options_data_t *options_data) {
+    free(options_data);
+}
@@ -36,10 +36,17 @@
 
 // Effect tool errors
 #define EFFECT_REGIONS_NOT_SPECIFIED            50
+#define EFFECT_BACKEND_NOT_VALID                51
+#define EFFECT_GENE_MODEL_NOT_SPECIFIED         52
+#define EFFECT_RESUME_AND_REDRIVE_SPECIFIED     53
 
 // GWAS tool errors
 #define GWAS_TASK_NOT_SPECIFIED                 150
 #define GWAS_MANY_TASKS_SPECIFIED               151
+#define GWAS_INVALID_PERMUTATIONS               152
+#define GWAS_INVALID_MENDEL_ERRORS              153
+#define GWAS_INVALID_NUM_INTERACTIONS           154
+#define GWAS_INVALID_FISHER_OPTIONS             155
 
 
 // VCF tools errors
@@ -52,6 +59,7 @@
 #define DISCORDANT_CHROMOSOME                   212
 #define DISCORDANT_POSITION                     213
 #define DISCORDANT_REFERENCE                    214
+#define MERGE_INVALID_FAN_IN                    215
 
 // -- Split tool errors
 #define CRITERION_NOT_SPECIFIED                 220
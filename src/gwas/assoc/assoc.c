@@ -20,41 +20,61 @@
 
 #include "assoc.h"
 
+static void assoc_permutation_test(enum ASSOC_task test_type, genotype_matrix_t *genotypes, int *haploid, 
+                                   uint64_t *affected, uint64_t *unaffected, const void *opt_input, 
+                                   permutation_set_t *permutations, int *exceeded);
+
+static void assoc_regression_batch(vcf_record_t **variants, genotype_matrix_t *genotypes, regression_model_t *model, 
+                                   list_t *output_list);
+
+
 void assoc_test(enum ASSOC_task test_type, vcf_record_t **variants, int num_variants, individual_t **samples, int num_samples,
-                const void *opt_input, list_t *output_list) {
+                const void *opt_input, permutation_set_t *permutations, list_t *output_list) {
     int tid = omp_get_thread_num();
 
     vcf_record_t *record;
-    individual_t *individual;
-    char *sample_data, *format;
     
-    int gt_position;
-    int allele1, allele2;
-
     // Affection counts
     int A1 = 0, A2 = 0, U1 = 0, U2 = 0;
     
-    // Perform analysis for each variant
-    for (int i = 0; i < num_variants; i++) {
-        record = variants[i];
+    // Decode the genotypes of the whole batch once, with a row per alternate allele, and count the alleles 
+    // of cases and controls from them
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *genotypes = genotype_matrix_new_split(variants, num_variants, num_samples, gt_positions);
+    genotype_row_t *rows = genotypes->rows;
+    int num_rows = genotypes->num_variants;
+    
+    // Regressions use the genotypes of each sample instead of allele counts
+    if (test_type == LOGISTIC || test_type == LINEAR) {
+        assoc_regression_batch(variants, genotypes, (regression_model_t*) opt_input, output_list);
+        genotype_matrix_free(genotypes);
+        gt_positions_free(gt_positions);
+        return;
+    }
+    
+    uint64_t *affected = genotype_mask_new(samples, num_samples, AFFECTED);
+    uint64_t *unaffected = genotype_mask_new(samples, num_samples, UNAFFECTED);
+    
+    int *haploid = (int*) malloc (num_rows * sizeof(int));
+    for (int i = 0; i < num_rows; i++) {
+        record = variants[rows[i].variant];
+        haploid[i] = !strncmp("X", record->chromosome, record->chromosome_len);
+    }
+    
+    // Permutations are run over the whole batch before the results are created
+    int *exceeded = NULL;
+    if (permutations) {
+        exceeded = (int*) calloc (num_rows, sizeof(int));
+        assoc_permutation_test(test_type, genotypes, haploid, affected, unaffected, opt_input, permutations, exceeded);
+    }
+    
+    // Perform analysis for each alternate allele of each variant
+    for (int i = 0; i < num_rows; i++) {
+        record = variants[rows[i].variant];
 //         LOG_DEBUG_F("[%d] Checking variant %.*s:%ld\n", tid, record->chromosome_len, record->chromosome, record->position);
         
-        A1 = 0; A2 = 0;
-        U1 = 0; U2 = 0;
-
-        format = strndup(record->format, record->format_len);
-        gt_position = get_field_position_in_format("GT", format);
-        free(format);
-    
-        // Count over individuals
-        for (int j = 0; j < num_samples; j++) {
-        	individual = samples[j];
-        	sample_data = strdup(array_list_get(j, record->samples));
-        	if (!get_alleles(sample_data, gt_position, &allele1, &allele2)) {
-                    assoc_count_individual(individual, record, allele1, allele2, &A1, &A2, &U1, &U2);
-                }
-        	free(sample_data);
-        }
+        genotype_matrix_count_alleles(genotypes, i, affected, haploid[i], &A1, &A2);
+        genotype_matrix_count_alleles(genotypes, i, unaffected, haploid[i], &U1, &U2);
         
         // Finished counting: now compute the statistics
         if (test_type == CHI_SQUARE) {
@@ -62,17 +82,19 @@ void assoc_test(enum ASSOC_task test_type, vcf_record_t **variants, int num_vari
             assoc_basic_result_t *result = assoc_basic_result_new(record->chromosome, record->chromosome_len, 
                                                                   record->position, record->id, record->id_len, 
                                                                   record->reference, record->reference_len,
-                                                                  record->alternate, record->alternate_len,
+                                                                  rows[i].alternate, rows[i].alternate_len,
                                                                   A1, A2, U1, U2, assoc_basic_chisq);
+            result->permutations_exceeded = exceeded ? exceeded[i] : 0;
             list_item_t *output_item = list_item_new(tid, 0, result);
             list_insert_item(output_item, output_list);
         } else if (test_type == FISHER) {
-            double p_value = assoc_fisher_test(A1, A2, U1, U2, (double*) opt_input);
+            double p_value = assoc_fisher_test(A1, A2, U1, U2, (assoc_fisher_input_t*) opt_input);
             assoc_fisher_result_t *result = assoc_fisher_result_new(record->chromosome, record->chromosome_len, 
                                                                     record->position, record->id, record->id_len, 
                                                                     record->reference, record->reference_len,
-                                                                    record->alternate, record->alternate_len,
+                                                                    rows[i].alternate, rows[i].alternate_len,
                                                                     A1, A2, U1, U2, p_value);
+            result->permutations_exceeded = exceeded ? exceeded[i] : 0;
             list_item_t *output_item = list_item_new(tid, 0, result);
             list_insert_item(output_item, output_list);
         }
@@ -81,6 +103,130 @@ void assoc_test(enum ASSOC_task test_type, vcf_record_t **variants, int num_vari
         
     } // next variant
 
+    free(exceeded);
+    free(haploid);
+    free(affected);
+    free(unaffected);
+    genotype_matrix_free(genotypes);
+    gt_positions_free(gt_positions);
+}
+
+double assoc_permutation_statistic(enum ASSOC_task test_type, int affected1, int affected2, int unaffected1, int unaffected2,
+                                   const void *opt_input) {
+    if (test_type == CHI_SQUARE) {
+        return assoc_basic_test(affected1, unaffected1, affected2, unaffected2);
+    } else if (test_type == FISHER) {
+        return assoc_fisher_permutation_statistic(assoc_fisher_test(affected1, affected2, unaffected1, unaffected2, 
+                                                                    (assoc_fisher_input_t*) opt_input));
+    }
+    return NAN;
+}
+
+double assoc_fisher_permutation_statistic(double p_value) {
+    // Very significant p-values may underflow, and they are tied at the smallest one
+    return -log10(fmax(p_value, DBL_MIN));
+}
+
+/**
+ * Counts how many permutations of the condition of the samples reach the statistic observed in each variant, 
+ * and updates the maximum statistic of each permutation.
+ * 
+ * Permutations are evaluated in blocks, expanded into masks of the genotype rows, so a block is checked 
+ * against every variant while it stays in cache. The samples with a known condition are the same in every 
+ * permutation, so only the cases need to be counted: the controls are the rest of them. The blocks are 
+ * shared among the threads of the permutations, each one with its own cache of Fisher's p-values.
+ */
+static void assoc_permutation_test(enum ASSOC_task test_type, genotype_matrix_t *genotypes, int *haploid, 
+                                   uint64_t *affected, uint64_t *unaffected, const void *opt_input, 
+                                   permutation_set_t *permutations, int *exceeded) {
+    int num_variants = genotypes->num_variants;
+    int num_words = genotypes->words_per_variant;
+    int num_permutations = permutations->num_permutations;
+    int num_blocks = (num_permutations + PERMUTATIONS_PER_BLOCK - 1) / PERMUTATIONS_PER_BLOCK;
+    
+    uint64_t *phenotyped = (uint64_t*) malloc (num_words * sizeof(uint64_t));
+    for (int w = 0; w < num_words; w++) {
+        phenotyped[w] = affected[w] | unaffected[w];
+    }
+    
+    // Genotypes of all the samples with a known condition, and observed statistics
+    int *totals = (int*) malloc (num_variants * 3 * sizeof(int));
+    double *observed = (double*) malloc (num_variants * sizeof(double));
+    for (int i = 0; i < num_variants; i++) {
+        int A1, A2, U1, U2;
+        uint64_t *row = genotypes->genotypes + (size_t) i * num_words;
+        genotypes->count_genotypes(row, phenotyped, num_words, totals + 3 * i);
+        genotype_matrix_count_alleles(genotypes, i, affected, haploid[i], &A1, &A2);
+        genotype_matrix_count_alleles(genotypes, i, unaffected, haploid[i], &U1, &U2);
+        observed[i] = assoc_permutation_statistic(test_type, A1, A2, U1, U2, opt_input) - PERMUTATION_EPSILON;
+    }
+    
+    double *max_statistics = (double*) calloc (num_permutations, sizeof(double));
+    
+    #pragma omp parallel num_threads(permutations->num_threads)
+    {
+        const void *input = opt_input;
+        if (test_type == FISHER) {
+            assoc_fisher_input_t *fisher_input = (assoc_fisher_input_t*) opt_input;
+            input = assoc_fisher_input_new(fisher_input->factorial_logarithms, fisher_input->mid_p, fisher_input->early_exit);
+        }
+        uint64_t *masks = (uint64_t*) malloc ((size_t) PERMUTATIONS_PER_BLOCK * num_words * sizeof(uint64_t));
+        int *thread_exceeded = (int*) calloc (num_variants, sizeof(int));
+        
+        // Blocks write the maximum statistics of different permutations
+        #pragma omp for schedule(dynamic, 1)
+        for (int block = 0; block < num_blocks; block++) {
+            int first = block * PERMUTATIONS_PER_BLOCK;
+            int block_size = (num_permutations - first < PERMUTATIONS_PER_BLOCK) ? num_permutations - first : PERMUTATIONS_PER_BLOCK;
+            permutation_set_expand(first, block_size, num_words, masks, permutations);
+            
+            for (int i = 0; i < num_variants; i++) {
+                if (isnan(observed[i])) {
+                    continue;
+                }
+                
+                uint64_t *row = genotypes->genotypes + (size_t) i * num_words;
+                int cases[3], controls[3];
+                int A1, A2, U1, U2;
+                for (int p = 0; p < block_size; p++) {
+                    genotypes->count_genotypes(row, masks + (size_t) p * num_words, num_words, cases);
+                    for (int k = 0; k < 3; k++) {
+                        controls[k] = totals[3 * i + k] - cases[k];
+                    }
+                    genotype_counts_to_alleles(cases, haploid[i], &A1, &A2);
+                    genotype_counts_to_alleles(controls, haploid[i], &U1, &U2);
+                    
+                    double statistic = assoc_permutation_statistic(test_type, A1, A2, U1, U2, input);
+                    if (statistic >= observed[i]) {
+                        thread_exceeded[i]++;
+                    }
+                    if (statistic > max_statistics[first + p]) {
+                        max_statistics[first + p] = statistic;
+                    }
+                }
+            }
+        }
+        
+        for (int i = 0; i < num_variants; i++) {
+            if (thread_exceeded[i]) {
+                #pragma omp atomic
+                exceeded[i] += thread_exceeded[i];
+            }
+        }
+        
+        free(thread_exceeded);
+        free(masks);
+        if (test_type == FISHER) {
+            assoc_fisher_input_free((assoc_fisher_input_t*) input);
+        }
+    }
+    
+    permutation_set_update_max(max_statistics, permutations);
+    
+    free(max_statistics);
+    free(observed);
+    free(totals);
+    free(phenotyped);
 }
 
 
@@ -132,3 +278,25 @@ void assoc_count_individual(individual_t *individual, vcf_record_t *record, int
     *unaffected1 += U1;
     *unaffected2 += U2;
 }
+
+static void assoc_regression_batch(vcf_record_t **variants, genotype_matrix_t *genotypes, regression_model_t *model, 
+                                   list_t *output_list) {
+    int tid = omp_get_thread_num();
+    
+    regression_fit_t *fits = (regression_fit_t*) malloc (genotypes->num_variants * sizeof(regression_fit_t));
+    assoc_regression_test(genotypes, model, fits);
+    
+    for (int i = 0; i < genotypes->num_variants; i++) {
+        genotype_row_t *row = genotypes->rows + i;
+        vcf_record_t *record = variants[row->variant];
+        assoc_regression_result_t *result = assoc_regression_result_new(record->chromosome, record->chromosome_len, 
+                                                                        record->position, record->id, record->id_len, 
+                                                                        record->reference, record->reference_len,
+                                                                        row->alternate, row->alternate_len,
+                                                                        &fits[i]);
+        list_item_t *output_item = list_item_new(tid, 0, result);
+        list_insert_item(output_item, output_list);
+    }
+    
+    free(fits);
+}
@@ -21,6 +21,9 @@
 #ifndef ASSOC_H
 #define ASSOC_H
 
+#include <float.h>
+#include <math.h>
+
 #include <gsl/gsl_cdf.h>
 #include <omp.h>
 
@@ -37,7 +40,13 @@
 
 #include "assoc_basic_test.h"
 #include "assoc_fisher_test.h"
+#include "assoc_regression_test.h"
+#include "covariates.h"
 #include "error.h"
+#include "genotype_matrix.h"
+#include "gwas/mendel_errors.h"
+#include "gwas/permutation.h"
+#include "gwas/trio_table.h"
 #include "hpg_variant_utils.h"
 #include "shared_options.h"
 
@@ -45,16 +54,22 @@
 /**
  * Number of options applicable to the assoc tool.
  */
-#define NUM_ASSOC_OPTIONS  2
+#define NUM_ASSOC_OPTIONS  8
 
 typedef struct assoc_options {
     int num_options;
     
     struct arg_lit *chisq;
     struct arg_lit *fisher;
+    struct arg_lit *mid_p;
+    struct arg_dbl *fisher_early_exit;
+    struct arg_lit *logistic;
+    struct arg_lit *linear;
+    struct arg_int *permutations;
+    struct arg_int *max_mendel_errors;
 } assoc_options_t;
 
-enum ASSOC_task { NONE, CHI_SQUARE, FISHER };
+enum ASSOC_task { NONE, CHI_SQUARE, FISHER, LOGISTIC, LINEAR };
 
 /**
  * @brief Values for the options of the assoc tool.
@@ -65,6 +80,10 @@ enum ASSOC_task { NONE, CHI_SQUARE, FISHER };
  */
 typedef struct assoc_options_data {
     enum ASSOC_task task; /**< Task to perform */
+    int num_permutations; /**< Permutations for the empirical p-values, 0 if disabled */
+    int max_mendel_errors; /**< Mendelian errors allowed in a variant, -1 if not filtered */
+    int mid_p; /**< Whether Fisher's test returns mid-p values */
+    double fisher_early_exit; /**< Chi-square p-value above which Fisher's test is skipped, 0 if disabled */
 } assoc_options_data_t;
 
 
@@ -136,8 +155,34 @@ int verify_assoc_options(assoc_options_t *assoc_options, shared_options_t *share
 
 //void assoc_test(enum ASSOC_task test_type, vcf_record_t **variants, int num_variants, family_t **families, int num_families,
 //                cp_hashtable *sample_ids, const void *opt_input, list_t *output_list);
+/**
+ * @brief Performs an association test over a batch of variants.
+ * @param test_type chi-square, Fisher's test, logistic or linear regression
+ * @param variants variants to test
+ * @param num_variants number of variants
+ * @param samples samples sorted as in the VCF file
+ * @param num_samples number of samples
+ * @param opt_input assoc_fisher_input_t of the calling thread for Fisher's test, regression_model_t for the regressions
+ * @param permutations permutations of the condition of the samples, or NULL if disabled
+ * @param output_list list where a result per alternate allele of each variant is inserted
+ */
 void assoc_test(enum ASSOC_task test_type, vcf_record_t **variants, int num_variants, individual_t **samples, int num_samples,
-                const void *opt_input, list_t *output_list);
+                const void *opt_input, permutation_set_t *permutations, list_t *output_list);
+
+/**
+ * @brief Returns the statistic compared among permutations, which increases with the significance of the test.
+ * 
+ * It is the chi-square value for the chi-square test, and -log10(p-value) for Fisher's test.
+ */
+double assoc_permutation_statistic(enum ASSOC_task test_type, int affected1, int affected2, int unaffected1, int unaffected2,
+                                   const void *opt_input);
+
+/**
+ * @brief Returns the statistic of Fisher's test compared among permutations, -log10(p-value).
+ * 
+ * Unlike 1 - p-value, it keeps apart the most significant p-values, which an absolute tolerance would tie.
+ */
+double assoc_fisher_permutation_statistic(double p_value);
 
 void assoc_count_individual(individual_t *individual, vcf_record_t *record, int allele1, int allele2, 
                            int *affected1, int *affected2, int *unaffected1, int *unaffected2);
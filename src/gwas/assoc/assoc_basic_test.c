@@ -59,6 +59,7 @@ assoc_basic_result_t* assoc_basic_result_new(char *chromosome, int chromosome_le
                          ((double) affected1 / affected2) * ((double) unaffected2 / unaffected1);
     result->chi_square = chi_square;
     result->p_value = 1 - gsl_cdf_chisq_P(chi_square, 1);
+    result->permutations_exceeded = 0;
     
     return result;
 }
@@ -43,6 +43,8 @@ typedef struct {
     double odds_ratio;
     double chi_square;
     double p_value;
+    
+    int permutations_exceeded;
 } assoc_basic_result_t;
 
 double assoc_basic_test(int a, int b, int c, int d);
@@ -21,8 +21,174 @@
 #include "assoc_fisher_test.h"
 
 
-double assoc_fisher_test(int a, int b, int c, int d, double *factorial_logarithms) {
-    return fisher_test(a, b, c, d, TWO_SIDED, factorial_logarithms);
+static void add_tail_probabilities(int start, int direction, double probability, int row1, int row2, int column1, 
+                                   int first, int last, double *less_likely, double *as_likely);
+
+static double chi_square_p_value(int a, int b, int c, int d);
+
+static inline size_t cache_slot(int a, int b, int c, int d);
+
+
+double *assoc_fisher_factorial_logarithms(int max_value) {
+    double *factorial_logarithms = (double*) malloc ((max_value + 1) * sizeof(double));
+    factorial_logarithms[0] = 0;
+    for (int i = 1; i <= max_value; i++) {
+        factorial_logarithms[i] = factorial_logarithms[i-1] + log(i);
+    }
+    return factorial_logarithms;
+}
+
+assoc_fisher_input_t *assoc_fisher_input_new(double *factorial_logarithms, int mid_p, double early_exit) {
+    assoc_fisher_input_t *input = (assoc_fisher_input_t*) malloc (sizeof(assoc_fisher_input_t));
+    input->factorial_logarithms = factorial_logarithms;
+    input->mid_p = mid_p;
+    input->early_exit = early_exit;
+    input->cache = (fisher_cache_entry_t*) malloc (FISHER_CACHE_SIZE * sizeof(fisher_cache_entry_t));
+    for (int i = 0; i < FISHER_CACHE_SIZE; i++) {
+        input->cache[i].a = -1;
+    }
+    input->hits = 0;
+    input->misses = 0;
+    return input;
+}
+
+void assoc_fisher_input_free(assoc_fisher_input_t *input) {
+    free(input->cache);
+    free(input);
+}
+
+double assoc_fisher_test(int a, int b, int c, int d, assoc_fisher_input_t *input) {
+    fisher_cache_entry_t *entry = input->cache + cache_slot(a, b, c, d);
+    if (entry->a == a && entry->b == b && entry->c == c && entry->d == d) {
+        input->hits++;
+        return entry->p_value;
+    }
+    input->misses++;
+    
+    double p_value = NAN;
+    if (input->early_exit > 0) {
+        p_value = chi_square_p_value(a, b, c, d);
+    }
+    // Tables far from significance keep the approximate p-value
+    if (isnan(p_value) || p_value <= input->early_exit) {
+        p_value = assoc_fisher_p_value(a, b, c, d, input->mid_p, input->factorial_logarithms);
+    }
+    
+    entry->a = a;
+    entry->b = b;
+    entry->c = c;
+    entry->d = d;
+    entry->p_value = p_value;
+    return p_value;
+}
+
+double assoc_fisher_p_value(int a, int b, int c, int d, int mid_p, double *factorial_logarithms) {
+    int row1 = a + b, row2 = c + d, column1 = a + c, column2 = b + d, n = a + b + c + d;
+    double *lf = factorial_logarithms;
+    double margins = lf[row1] + lf[row2] + lf[column1] + lf[column2] - lf[n];
+    
+    // Tables are identified by their top-left cell, which ranges from first to last
+    int first = (column1 - row2 > 0) ? column1 - row2 : 0;
+    int last = (row1 < column1) ? row1 : column1;
+    if (first == last) {
+        return 1;
+    }
+#define TABLE_LOG_PROBABILITY(x)    (margins - lf[(x)] - lf[row1 - (x)] - lf[column1 - (x)] - lf[row2 - column1 + (x)])
+    
+    int mode = (int) (((long) row1 + 1) * ((long) column1 + 1) / ((long) n + 2));
+    double observed = TABLE_LOG_PROBABILITY(a);
+    double bound = observed + log1p(FISHER_RELATIVE_ERROR);
+    
+    // Probabilities are summed relative to the observed table, from the start of each tail outwards
+    double less_likely = 0, as_likely = 0;
+    if (a <= mode) {
+        add_tail_probabilities(a, -1, 1, row1, row2, column1, first, last, &less_likely, &as_likely);
+        
+        // The other tail starts at the first table past the mode that is not more likely than the observed one
+        int low = (mode > a) ? mode : a + 1, high = last + 1;
+        while (low < high) {
+            int middle = low + (high - low) / 2;
+            if (TABLE_LOG_PROBABILITY(middle) <= bound) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        if (low <= last) {
+            add_tail_probabilities(low, 1, exp(TABLE_LOG_PROBABILITY(low) - observed), row1, row2, column1, first, last, 
+                                   &less_likely, &as_likely);
+        }
+    } else {
+        add_tail_probabilities(a, 1, 1, row1, row2, column1, first, last, &less_likely, &as_likely);
+        
+        // The other tail starts at the last table before the mode that is not more likely than the observed one
+        int low = first - 1, high = mode;
+        while (low < high) {
+            int middle = high - (high - low) / 2;
+            if (TABLE_LOG_PROBABILITY(middle) <= bound) {
+                low = middle;
+            } else {
+                high = middle - 1;
+            }
+        }
+        if (low >= first) {
+            add_tail_probabilities(low, -1, exp(TABLE_LOG_PROBABILITY(low) - observed), row1, row2, column1, first, last, 
+                                   &less_likely, &as_likely);
+        }
+    }
+#undef TABLE_LOG_PROBABILITY
+    
+    double p_value = exp(observed) * (mid_p ? less_likely + 0.5 * as_likely : less_likely + as_likely);
+    return (p_value < 1) ? p_value : 1;
+}
+
+
+/**
+ * Adds the probabilities of the tables from start to the end of the distribution in the given direction, 
+ * relative to the probability of the observed table. Each one is obtained from the previous one, and the 
+ * walk stops when the rest of them can't change the sum.
+ */
+static void add_tail_probabilities(int start, int direction, double probability, int row1, int row2, int column1, 
+                                   int first, int last, double *less_likely, double *as_likely) {
+    double sum = 0;
+    for (int x = start; x >= first && x <= last; x += direction) {
+        if (probability < 1 - FISHER_RELATIVE_ERROR) {
+            *less_likely += probability;
+        } else {
+            *as_likely += probability;
+        }
+        sum += probability;
+        if (probability < FISHER_NEGLIGIBLE_PROBABILITY * sum) {
+            break;
+        }
+        
+        if (direction > 0) {
+            probability *= ((double) (row1 - x) * (column1 - x)) / ((double) (x + 1) * (row2 - column1 + x + 1));
+        } else {
+            probability *= ((double) x * (row2 - column1 + x)) / ((double) (row1 - x + 1) * (column1 - x + 1));
+        }
+    }
+}
+
+/**
+ * Pearson's chi-square test without continuity correction, or NAN if any margin is empty.
+ */
+static double chi_square_p_value(int a, int b, int c, int d) {
+    double row1 = a + b, row2 = c + d, column1 = a + c, column2 = b + d;
+    if (row1 == 0 || row2 == 0 || column1 == 0 || column2 == 0) {
+        return NAN;
+    }
+    double difference = (double) a * d - (double) b * c;
+    double chi_square = (row1 + row2) * difference * difference / (row1 * row2 * column1 * column2);
+    return 1 - gsl_cdf_chisq_P(chi_square, 1);
+}
+
+static inline size_t cache_slot(int a, int b, int c, int d) {
+    uint32_t hash = (uint32_t) a * 2654435761u;
+    hash = (hash ^ (uint32_t) b) * 2246822519u;
+    hash = (hash ^ (uint32_t) c) * 3266489917u;
+    hash = (hash ^ (uint32_t) d) * 668265263u;
+    return (hash ^ (hash >> 15)) & (FISHER_CACHE_SIZE - 1);
 }
 
 
@@ -44,6 +210,7 @@ assoc_fisher_result_t* assoc_fisher_result_new(char *chromosome, int chromosome_
     result->odds_ratio = (affected2 == 0 || unaffected1 == 0) ? NAN : 
                          ((double) affected1 / affected2) * ((double) unaffected2 / unaffected1);
     result->p_value = p_value;
+    result->permutations_exceeded = 0;
     
     return result;
 }
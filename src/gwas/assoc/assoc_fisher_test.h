@@ -21,10 +21,51 @@
 #ifndef ASSOCIATION_FISHER_TEST_H
 #define ASSOCIATION_FISHER_TEST_H
 
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <stats/fisher.h>
+#include <gsl/gsl_cdf.h>
+
+/**
+ * Entries of the cache of p-values of each thread, which must be a power of 2.
+ */
+#define FISHER_CACHE_SIZE       16384
+
+/**
+ * Relative tolerance when comparing the probabilities of two tables, as in R's fisher.test.
+ */
+#define FISHER_RELATIVE_ERROR   1e-7
+
+/**
+ * Probability, relative to the sum of a tail, below which the rest of the tail is not added.
+ */
+#define FISHER_NEGLIGIBLE_PROBABILITY   1e-17
+
+/**
+ * @brief P-value of a contingency table, stored in a cache slot.
+ */
+typedef struct {
+    int a, b, c, d;
+    double p_value;
+} fisher_cache_entry_t;
+
+/**
+ * @brief Input for Fisher's test used by a single thread.
+ * 
+ * The table of logarithms of factorials is shared by all threads, while the cache of p-values 
+ * of the tables already tested belongs to just one of them.
+ */
+typedef struct {
+    double *factorial_logarithms;   /**< log(n!) for n from 0 to the number of alleles */
+    int mid_p;                      /**< Whether to return the mid-p value instead of the exact one */
+    double early_exit;              /**< Chi-square p-value above which it is returned instead of the exact one, 0 if disabled */
+    
+    fisher_cache_entry_t *cache;    /**< Direct-mapped cache of p-values, indexed by the hash of the table */
+    size_t hits;
+    size_t misses;
+} assoc_fisher_input_t;
 
 typedef struct {
     char *chromosome;
@@ -41,9 +82,36 @@ typedef struct {
     
     double odds_ratio;
     double p_value;
+    
+    int permutations_exceeded;
 } assoc_fisher_result_t;
 
-double assoc_fisher_test(int a, int b, int c, int d, double *factorial_logarithms);
+/**
+ * @brief Returns a table with the logarithms of the factorials from 0 to max_value, both included.
+ */
+double *assoc_fisher_factorial_logarithms(int max_value);
+
+assoc_fisher_input_t *assoc_fisher_input_new(double *factorial_logarithms, int mid_p, double early_exit);
+
+void assoc_fisher_input_free(assoc_fisher_input_t *input);
+
+/**
+ * @brief Two-sided Fisher's exact test of the table { { a, b }, { c, d } }.
+ * @param input logarithms of factorials, test options and cache of the calling thread
+ * @return The p-value of the table, taken from the cache if it was already tested
+ */
+double assoc_fisher_test(int a, int b, int c, int d, assoc_fisher_input_t *input);
+
+/**
+ * @brief Sums the probabilities of the tables with the same margins that are not more likely than { { a, b }, { c, d } }.
+ * @param mid_p whether the tables as likely as the observed one are counted just by half
+ * @param factorial_logarithms log(n!) for n from 0 to a + b + c + d
+ * 
+ * The hypergeometric distribution is unimodal, so these tables form two tails: one starts at the observed 
+ * table and the other is found by binary search. Each tail is walked outwards only until its probabilities 
+ * become negligible, instead of enumerating all the tables.
+ */
+double assoc_fisher_p_value(int a, int b, int c, int d, int mid_p, double *factorial_logarithms);
 
 assoc_fisher_result_t *assoc_fisher_result_new(char *chromosome, int chromosome_len, unsigned long int position,  char *id, int id_len,
                                                char *reference, int reference_len, char *alternate, int alternate_len, 
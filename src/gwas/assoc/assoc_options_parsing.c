@@ -75,7 +75,7 @@ void **parse_assoc_options(int argc, char *argv[], assoc_options_t *assoc_option
 }
 
 void **merge_assoc_options(assoc_options_t *assoc_options, shared_options_t *shared_options, struct arg_end *arg_end) {
-    void **tool_options = malloc (30 * sizeof(void*));
+    void **tool_options = malloc (36 * sizeof(void*));
     
     // Input/output files
     tool_options[0] = shared_options->vcf_filename;
@@ -89,36 +89,42 @@ void **merge_assoc_options(assoc_options_t *assoc_options, shared_options_t *sha
     // Association test arguments
     tool_options[5] = assoc_options->chisq;
     tool_options[6] = assoc_options->fisher;
+    tool_options[7] = assoc_options->mid_p;
+    tool_options[8] = assoc_options->fisher_early_exit;
+    tool_options[9] = assoc_options->logistic;
+    tool_options[10] = assoc_options->linear;
+    tool_options[11] = assoc_options->permutations;
+    tool_options[12] = assoc_options->max_mendel_errors;
 
     // Filter arguments
-    tool_options[7] = shared_options->num_alleles;
-    tool_options[8] = shared_options->coverage;
-    tool_options[9] = shared_options->quality;
-    tool_options[10] = shared_options->maf;
-    tool_options[11] = shared_options->missing;
-    tool_options[12] = shared_options->gene;
-    tool_options[13] = shared_options->region;
-    tool_options[14] = shared_options->region_file;
-    tool_options[15] = shared_options->region_type;
-    tool_options[16] = shared_options->snp;
-    tool_options[17] = shared_options->indel;
-    tool_options[18] = shared_options->dominant;
-    tool_options[19] = shared_options->recessive;
+    tool_options[13] = shared_options->num_alleles;
+    tool_options[14] = shared_options->coverage;
+    tool_options[15] = shared_options->quality;
+    tool_options[16] = shared_options->maf;
+    tool_options[17] = shared_options->missing;
+    tool_options[18] = shared_options->gene;
+    tool_options[19] = shared_options->region;
+    tool_options[20] = shared_options->region_file;
+    tool_options[21] = shared_options->region_type;
+    tool_options[22] = shared_options->snp;
+    tool_options[23] = shared_options->indel;
+    tool_options[24] = shared_options->dominant;
+    tool_options[25] = shared_options->recessive;
     
     // Configuration file
-    tool_options[20] = shared_options->log_level;
-    tool_options[21] = shared_options->config_file;
+    tool_options[26] = shared_options->log_level;
+    tool_options[27] = shared_options->config_file;
     
     // Advanced configuration
-    tool_options[22] = shared_options->host_url;
-    tool_options[23] = shared_options->version;
-    tool_options[24] = shared_options->max_batches;
-    tool_options[25] = shared_options->batch_lines;
-    tool_options[26] = shared_options->batch_bytes;
-    tool_options[27] = shared_options->num_threads;
-    tool_options[28] = shared_options->mmap_vcf_files;
+    tool_options[28] = shared_options->host_url;
+    tool_options[29] = shared_options->version;
+    tool_options[30] = shared_options->max_batches;
+    tool_options[31] = shared_options->batch_lines;
+    tool_options[32] = shared_options->batch_bytes;
+    tool_options[33] = shared_options->num_threads;
+    tool_options[34] = shared_options->mmap_vcf_files;
     
-    tool_options[29] = arg_end;
+    tool_options[35] = arg_end;
     
     return tool_options;
 }
@@ -132,17 +138,50 @@ int verify_assoc_options(assoc_options_t *assoc_options, shared_options_t *share
     }
     
     // Check whether the task to perform is defined
-    if (assoc_options->chisq->count + assoc_options->fisher->count == 0) {
+    int num_tasks = assoc_options->chisq->count + assoc_options->fisher->count + 
+                    assoc_options->logistic->count + assoc_options->linear->count;
+    if (num_tasks == 0) {
         LOG_ERROR("Please specify the task to perform.\n");
         return GWAS_TASK_NOT_SPECIFIED;
     }
 
     // Check whether more than one task is specified
-    if (assoc_options->chisq->count + assoc_options->fisher->count > 1) {
+    if (num_tasks > 1) {
         LOG_ERROR("Please specify only one task to perform.\n");
         return GWAS_MANY_TASKS_SPECIFIED;
     }
     
+    // Check whether the number of permutations is valid
+    if (assoc_options->permutations->count > 0 && *(assoc_options->permutations->ival) <= 0) {
+        LOG_ERROR("Please specify a positive number of permutations.\n");
+        return GWAS_INVALID_PERMUTATIONS;
+    }
+    
+    // Check whether permutations are requested for a regression
+    if (assoc_options->permutations->count > 0 && assoc_options->logistic->count + assoc_options->linear->count > 0) {
+        LOG_ERROR("Permutations are only available for the chi-square and Fisher's tests.\n");
+        return GWAS_INVALID_PERMUTATIONS;
+    }
+    
+    // Check whether the options of Fisher's test are used without it
+    if (assoc_options->mid_p->count + assoc_options->fisher_early_exit->count > 0 && assoc_options->fisher->count == 0) {
+        LOG_ERROR("Mid-p values and early exit are only available for Fisher's test.\n");
+        return GWAS_INVALID_FISHER_OPTIONS;
+    }
+    
+    // Check whether the early exit threshold is a valid p-value
+    if (assoc_options->fisher_early_exit->count > 0 && 
+        (*(assoc_options->fisher_early_exit->dval) <= 0 || *(assoc_options->fisher_early_exit->dval) >= 1)) {
+        LOG_ERROR("Please specify an early exit threshold between 0 and 1.\n");
+        return GWAS_INVALID_FISHER_OPTIONS;
+    }
+    
+    // Check whether the number of mendelian errors allowed is valid
+    if (assoc_options->max_mendel_errors->count > 0 && *(assoc_options->max_mendel_errors->ival) < 0) {
+        LOG_ERROR("Please specify a non-negative number of mendelian errors.\n");
+        return GWAS_INVALID_MENDEL_ERRORS;
+    }
+    
     // Check whether the input PED file is defined
     if (shared_options->ped_filename->filename == NULL || strlen(*(shared_options->ped_filename->filename)) == 0) {
         LOG_ERROR("Please specify the input PED file.\n");
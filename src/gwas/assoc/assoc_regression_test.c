@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assoc_regression_test.h"
+
+static void fit_linear_block(gsl_matrix *dosages, int num_variants, regression_model_t *model, regression_fit_t *fits);
+
+static void fit_logistic_block(gsl_matrix *dosages, int num_variants, regression_model_t *model, regression_fit_t *fits);
+
+static gsl_vector *fit_logistic_null(regression_model_t *model);
+
+static void set_missing_fit(regression_fit_t *fit);
+
+
+regression_model_t *regression_model_new(individual_t **samples, int num_samples, covariate_table_t *covariates, int logistic) {
+    // Singular systems are reported as missing fits instead of aborting
+    gsl_set_error_handler_off();
+
+    int num_covariates = covariates ? covariates->num_covariates : 0;
+    int *positions = (int*) malloc (num_samples * sizeof(int));
+    double *phenotypes = (double*) malloc (num_samples * sizeof(double));
+    double **values = (double**) malloc (num_samples * sizeof(double*));
+    int n = 0;
+
+    // Only samples with a known phenotype and all covariates are used
+    for (int j = 0; j < num_samples; j++) {
+        individual_t *individual = samples[j];
+        if (!individual) {
+            continue;
+        }
+
+        double phenotype;
+        if (logistic) {
+            if (individual->condition == AFFECTED) {
+                phenotype = 1;
+            } else if (individual->condition == UNAFFECTED) {
+                phenotype = 0;
+            } else {
+                continue;
+            }
+        } else {
+            if (isnan(individual->phenotype) || individual->phenotype == MISSING_PHENOTYPE) {
+                continue;
+            }
+            phenotype = individual->phenotype;
+        }
+
+        double *individual_values = NULL;
+        if (num_covariates > 0) {
+            individual_values = covariate_table_get(individual->id, covariates);
+            if (!individual_values) {
+                continue;
+            }
+            int missing = 0;
+            for (int c = 0; c < num_covariates && !missing; c++) {
+                missing = isnan(individual_values[c]);
+            }
+            if (missing) {
+                continue;
+            }
+        }
+
+        positions[n] = j;
+        phenotypes[n] = phenotype;
+        values[n] = individual_values;
+        n++;
+    }
+
+    int k = num_covariates + 1;
+    if (n <= k + 1) {
+        free(positions);
+        free(phenotypes);
+        free(values);
+        return NULL;
+    }
+
+    regression_model_t *model = (regression_model_t*) calloc (1, sizeof(regression_model_t));
+    model->logistic = logistic;
+    model->num_samples = n;
+    model->sample_positions = positions;
+    model->num_covariates = k;
+    model->design = gsl_matrix_alloc(n, k);
+    model->phenotype = gsl_vector_alloc(n);
+    for (int i = 0; i < n; i++) {
+        gsl_matrix_set(model->design, i, 0, 1.0);
+        for (int c = 1; c < k; c++) {
+            gsl_matrix_set(model->design, i, c, values[i][c-1]);
+        }
+        gsl_vector_set(model->phenotype, i, phenotypes[i]);
+    }
+    free(phenotypes);
+    free(values);
+
+    // Orthonormal basis of the design, the first k columns of Q
+    gsl_matrix *qr = gsl_matrix_alloc(n, k);
+    gsl_matrix_memcpy(qr, model->design);
+    gsl_vector *tau = gsl_vector_alloc(k);
+    gsl_linalg_QR_decomp(qr, tau);
+
+    model->basis = gsl_matrix_alloc(n, k);
+    gsl_vector *column = gsl_vector_alloc(n);
+    for (int c = 0; c < k; c++) {
+        gsl_vector_set_basis(column, c);
+        gsl_linalg_QR_Qvec(qr, tau, column);
+        gsl_matrix_set_col(model->basis, c, column);
+    }
+    gsl_vector_free(column);
+    gsl_vector_free(tau);
+    gsl_matrix_free(qr);
+
+    // Residuals of the phenotype once the covariates are projected out
+    gsl_vector *projection = gsl_vector_alloc(k);
+    model->residual_phenotype = gsl_vector_alloc(n);
+    gsl_vector_memcpy(model->residual_phenotype, model->phenotype);
+    gsl_blas_dgemv(CblasTrans, 1.0, model->basis, model->phenotype, 0.0, projection);
+    gsl_blas_dgemv(CblasNoTrans, -1.0, model->basis, projection, 1.0, model->residual_phenotype);
+    gsl_blas_ddot(model->residual_phenotype, model->residual_phenotype, &(model->residual_sum_squares));
+    gsl_vector_free(projection);
+
+    if (logistic) {
+        model->null_coefficients = fit_logistic_null(model);
+    }
+
+    return model;
+}
+
+void regression_model_free(regression_model_t *model) {
+    free(model->sample_positions);
+    gsl_matrix_free(model->design);
+    gsl_vector_free(model->phenotype);
+    gsl_matrix_free(model->basis);
+    gsl_vector_free(model->residual_phenotype);
+    if (model->null_coefficients) {
+        gsl_vector_free(model->null_coefficients);
+    }
+    free(model);
+}
+
+void assoc_regression_test(genotype_matrix_t *genotypes, regression_model_t *model, regression_fit_t *fits) {
+    int n = model->num_samples;
+    gsl_matrix *dosages = gsl_matrix_alloc(n, REGRESSION_VARIANTS_PER_BLOCK);
+
+    for (int first = 0; first < genotypes->num_variants; first += REGRESSION_VARIANTS_PER_BLOCK) {
+        int num_variants = genotypes->num_variants - first;
+        if (num_variants > REGRESSION_VARIANTS_PER_BLOCK) {
+            num_variants = REGRESSION_VARIANTS_PER_BLOCK;
+        }
+
+        // Alternate allele counts, a column per variant
+        for (int v = 0; v < REGRESSION_VARIANTS_PER_BLOCK; v++) {
+            if (v >= num_variants) {
+                // Columns past the last variant of the batch don't take part in the fits
+                for (int i = 0; i < n; i++) {
+                    gsl_matrix_set(dosages, i, v, 0.0);
+                }
+                continue;
+            }
+
+            int count = 0;
+            double sum = 0;
+            for (int i = 0; i < n; i++) {
+                int genotype = genotype_matrix_get(genotypes, first + v, model->sample_positions[i]);
+                if (genotype != GENOTYPE_MISSING) {
+                    sum += genotype;
+                    count++;
+                }
+            }
+
+            double mean = (count > 0) ? sum / count : 0.0;
+            for (int i = 0; i < n; i++) {
+                int genotype = genotype_matrix_get(genotypes, first + v, model->sample_positions[i]);
+                gsl_matrix_set(dosages, i, v, (genotype != GENOTYPE_MISSING) ? genotype : mean);
+            }
+            fits[first + v].num_samples = count;
+        }
+
+        if (model->logistic) {
+            fit_logistic_block(dosages, num_variants, model, fits + first);
+        } else {
+            fit_linear_block(dosages, num_variants, model, fits + first);
+        }
+    }
+
+    gsl_matrix_free(dosages);
+}
+
+
+assoc_regression_result_t *assoc_regression_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len,
+                                                       char *reference, int reference_len, char *alternate, int alternate_len,
+                                                       regression_fit_t *fit) {
+    assoc_regression_result_t *result = (assoc_regression_result_t*) malloc (sizeof(assoc_regression_result_t));
+
+    result->chromosome = strndup(chromosome, chromosome_len);
+    result->position = position;
+    result->id = strndup(id, id_len);
+    result->reference = strndup(reference, reference_len);
+    result->alternate = strndup(alternate, alternate_len);
+    result->num_samples = fit->num_samples;
+    result->coefficient = fit->coefficient;
+    result->standard_error = fit->standard_error;
+    result->statistic = fit->statistic;
+    result->p_value = fit->p_value;
+
+    return result;
+}
+
+void assoc_regression_result_free(assoc_regression_result_t *result) {
+    free(result->chromosome);
+    free(result->id);
+    free(result->reference);
+    free(result->alternate);
+    free(result);
+}
+
+
+/* ***********************
+ *     Model fitting     *
+ * ***********************/
+
+/**
+ * After projecting the covariates out of the allele counts, the coefficient of each variant is the one of
+ * a simple regression of the residual phenotype on the residual counts. The projections of a block are
+ * obtained with a single matrix product against the basis of the design.
+ */
+static void fit_linear_block(gsl_matrix *dosages, int num_variants, regression_model_t *model, regression_fit_t *fits) {
+    int n = model->num_samples;
+    int k = model->num_covariates;
+    double degrees_freedom = n - k - 1;
+
+    gsl_vector *products = gsl_vector_alloc(dosages->size2);
+    gsl_matrix *projections = gsl_matrix_alloc(k, dosages->size2);
+    gsl_blas_dgemv(CblasTrans, 1.0, dosages, model->residual_phenotype, 0.0, products);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, model->basis, dosages, 0.0, projections);
+
+    for (int v = 0; v < num_variants; v++) {
+        double sum_squares = 0, projected_squares = 0;
+        for (int i = 0; i < n; i++) {
+            double dosage = gsl_matrix_get(dosages, i, v);
+            sum_squares += dosage * dosage;
+        }
+        for (int c = 0; c < k; c++) {
+            double projection = gsl_matrix_get(projections, c, v);
+            projected_squares += projection * projection;
+        }
+
+        // Monomorphic variants, or explained by the covariates
+        double residual_squares = sum_squares - projected_squares;
+        if (fits[v].num_samples == 0 || residual_squares <= 1e-10 * sum_squares) {
+            set_missing_fit(&fits[v]);
+            continue;
+        }
+
+        double product = gsl_vector_get(products, v);
+        double coefficient = product / residual_squares;
+        double residual_sum_squares = model->residual_sum_squares - coefficient * product;
+        double standard_error = sqrt(residual_sum_squares / degrees_freedom / residual_squares);
+
+        fits[v].coefficient = coefficient;
+        fits[v].standard_error = standard_error;
+        fits[v].statistic = coefficient / standard_error;
+        fits[v].p_value = 2 * gsl_cdf_tdist_Q(fabs(fits[v].statistic), degrees_freedom);
+    }
+
+    gsl_matrix_free(projections);
+    gsl_vector_free(products);
+}
+
+/**
+ * Newton-Raphson iterations of all the variants of a block advance together: the linear predictors of the
+ * covariates are computed for the whole block with a single matrix product, and then each variant still
+ * being fitted accumulates and solves its own weighted system.
+ */
+static void fit_logistic_block(gsl_matrix *dosages, int num_variants, regression_model_t *model, regression_fit_t *fits) {
+    int n = model->num_samples;
+    int k = model->num_covariates;
+    int p = k + 1;
+
+    if (!model->null_coefficients) {
+        for (int v = 0; v < num_variants; v++) {
+            set_missing_fit(&fits[v]);
+        }
+        return;
+    }
+
+    // Coefficients of the covariates (a column per variant) and of the allele count
+    gsl_matrix *coefficients = gsl_matrix_alloc(k, dosages->size2);
+    double *allele_coefficients = (double*) calloc (dosages->size2, sizeof(double));
+    int *fitting = (int*) calloc (dosages->size2, sizeof(int));
+    for (int v = 0; v < (int) dosages->size2; v++) {
+        gsl_matrix_set_col(coefficients, v, model->null_coefficients);
+    }
+    int num_fitting = 0;
+    for (int v = 0; v < num_variants; v++) {
+        if (fits[v].num_samples > 0) {
+            fitting[v] = 1;
+            num_fitting++;
+        } else {
+            set_missing_fit(&fits[v]);
+        }
+    }
+
+    gsl_matrix *predictors = gsl_matrix_alloc(n, dosages->size2);
+    gsl_matrix *information = gsl_matrix_alloc(p, p);
+    gsl_vector *score = gsl_vector_alloc(p);
+    gsl_vector *step = gsl_vector_alloc(p);
+    gsl_vector *variance = gsl_vector_alloc(p);
+    gsl_vector *unit = gsl_vector_alloc(p);
+    gsl_vector_set_basis(unit, k);
+    double *row = (double*) malloc (p * sizeof(double));
+
+    for (int iteration = 0; iteration < LOGISTIC_MAX_ITERATIONS && num_fitting > 0; iteration++) {
+        gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, model->design, coefficients, 0.0, predictors);
+
+        for (int v = 0; v < num_variants; v++) {
+            if (!fitting[v]) {
+                continue;
+            }
+
+            gsl_matrix_set_zero(information);
+            gsl_vector_set_zero(score);
+            for (int i = 0; i < n; i++) {
+                double dosage = gsl_matrix_get(dosages, i, v);
+                double predictor = gsl_matrix_get(predictors, i, v) + dosage * allele_coefficients[v];
+                double mean = 1.0 / (1.0 + exp(-predictor));
+                double weight = mean * (1.0 - mean);
+                double residual = gsl_vector_get(model->phenotype, i) - mean;
+
+                for (int a = 0; a < k; a++) {
+                    row[a] = gsl_matrix_get(model->design, i, a);
+                }
+                row[k] = dosage;
+
+                for (int a = 0; a < p; a++) {
+                    *gsl_vector_ptr(score, a) += residual * row[a];
+                    for (int b = 0; b <= a; b++) {
+                        *gsl_matrix_ptr(information, a, b) += weight * row[a] * row[b];
+                    }
+                }
+            }
+            for (int a = 0; a < p; a++) {
+                for (int b = a + 1; b < p; b++) {
+                    gsl_matrix_set(information, a, b, gsl_matrix_get(information, b, a));
+                }
+            }
+
+            if (gsl_linalg_cholesky_decomp(information) != GSL_SUCCESS) {
+                set_missing_fit(&fits[v]);
+                fitting[v] = 0;
+                num_fitting--;
+                continue;
+            }
+            gsl_linalg_cholesky_solve(information, score, step);
+
+            double max_step = 0;
+            for (int a = 0; a < p; a++) {
+                double change = gsl_vector_get(step, a);
+                if (a < k) {
+                    *gsl_matrix_ptr(coefficients, a, v) += change;
+                } else {
+                    allele_coefficients[v] += change;
+                }
+                max_step = (fabs(change) > max_step) ? fabs(change) : max_step;
+            }
+
+            if (!isfinite(max_step)) {
+                set_missing_fit(&fits[v]);
+                fitting[v] = 0;
+                num_fitting--;
+            } else if (max_step < LOGISTIC_TOLERANCE) {
+                // The variance of the coefficient is in the inverse of the information matrix
+                gsl_linalg_cholesky_solve(information, unit, variance);
+                fits[v].coefficient = allele_coefficients[v];
+                fits[v].standard_error = sqrt(gsl_vector_get(variance, k));
+                fits[v].statistic = fits[v].coefficient / fits[v].standard_error;
+                fits[v].p_value = 2 * gsl_cdf_ugaussian_Q(fabs(fits[v].statistic));
+                fitting[v] = 0;
+                num_fitting--;
+            }
+        }
+    }
+
+    // Variants that did not converge, usually because of complete separation
+    for (int v = 0; v < num_variants; v++) {
+        if (fitting[v]) {
+            set_missing_fit(&fits[v]);
+        }
+    }
+
+    free(row);
+    gsl_vector_free(unit);
+    gsl_vector_free(variance);
+    gsl_vector_free(step);
+    gsl_vector_free(score);
+    gsl_matrix_free(information);
+    gsl_matrix_free(predictors);
+    free(fitting);
+    free(allele_coefficients);
+    gsl_matrix_free(coefficients);
+}
+
+static gsl_vector *fit_logistic_null(regression_model_t *model) {
+    int n = model->num_samples;
+    int k = model->num_covariates;
+
+    // Start from the proportion of cases in the intercept
+    double cases = 0;
+    for (int i = 0; i < n; i++) {
+        cases += gsl_vector_get(model->phenotype, i);
+    }
+    if (cases == 0 || cases == n) {
+        return NULL;
+    }
+
+    gsl_vector *coefficients = gsl_vector_calloc(k);
+    gsl_vector_set(coefficients, 0, log(cases / (n - cases)));
+
+    gsl_vector *predictors = gsl_vector_alloc(n);
+    gsl_matrix *information = gsl_matrix_alloc(k, k);
+    gsl_vector *score = gsl_vector_alloc(k);
+    gsl_vector *step = gsl_vector_alloc(k);
+    int converged = 0;
+
+    for (int iteration = 0; iteration < LOGISTIC_MAX_ITERATIONS && !converged; iteration++) {
+        gsl_blas_dgemv(CblasNoTrans, 1.0, model->design, coefficients, 0.0, predictors);
+        gsl_matrix_set_zero(information);
+        gsl_vector_set_zero(score);
+
+        for (int i = 0; i < n; i++) {
+            double mean = 1.0 / (1.0 + exp(-gsl_vector_get(predictors, i)));
+            double weight = mean * (1.0 - mean);
+            double residual = gsl_vector_get(model->phenotype, i) - mean;
+            for (int a = 0; a < k; a++) {
+                double xa = gsl_matrix_get(model->design, i, a);
+                *gsl_vector_ptr(score, a) += residual * xa;
+                for (int b = 0; b < k; b++) {
+                    *gsl_matrix_ptr(information, a, b) += weight * xa * gsl_matrix_get(model->design, i, b);
+                }
+            }
+        }
+
+        if (gsl_linalg_cholesky_decomp(information) != GSL_SUCCESS) {
+            break;
+        }
+        gsl_linalg_cholesky_solve(information, score, step);
+        gsl_vector_add(coefficients, step);
+
+        converged = 1;
+        for (int a = 0; a < k; a++) {
+            converged &= fabs(gsl_vector_get(step, a)) < LOGISTIC_TOLERANCE;
+        }
+    }
+
+    gsl_vector_free(step);
+    gsl_vector_free(score);
+    gsl_matrix_free(information);
+    gsl_vector_free(predictors);
+
+    if (!converged) {
+        gsl_vector_free(coefficients);
+        return NULL;
+    }
+    return coefficients;
+}
+
+static void set_missing_fit(regression_fit_t *fit) {
+    fit->coefficient = NAN;
+    fit->standard_error = NAN;
+    fit->statistic = NAN;
+    fit->p_value = NAN;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASSOCIATION_REGRESSION_TEST_H
+#define ASSOCIATION_REGRESSION_TEST_H
+
+/**
+ * @file assoc_regression_test.h
+ * @brief Linear and logistic regression of the phenotype on the alternate allele count, adjusted by covariates
+ *
+ * The model of every variant is phenotype ~ intercept + covariates + allele count. Everything that
+ * does not depend on the variant is computed once: the QR decomposition of the covariates for the
+ * linear model, and the fit of the covariates alone for the logistic one.
+ *
+ * Variants are fitted in blocks of REGRESSION_VARIANTS_PER_BLOCK with BLAS level 2 and 3 operations.
+ * The linear model has a closed form after projecting out the covariates. The logistic model is fitted
+ * by iteratively reweighted least squares, advancing all the variants of a block at every iteration
+ * and starting from the fit of the covariates alone.
+ *
+ * Missing genotypes are replaced by the mean allele count of the variant.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gsl/gsl_blas.h>
+#include <gsl/gsl_cdf.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_linalg.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_vector.h>
+
+#include <bioformats/family/family.h>
+
+#include "covariates.h"
+#include "genotype_matrix.h"
+
+/**
+ * Variants fitted together, which bounds the memory used by their allele counts.
+ */
+#define REGRESSION_VARIANTS_PER_BLOCK   128
+
+#define LOGISTIC_MAX_ITERATIONS         25
+#define LOGISTIC_TOLERANCE              1e-6
+
+/**
+ * Phenotype values considered missing in quantitative traits.
+ */
+#define MISSING_PHENOTYPE               -9
+
+typedef struct regression_model {
+    int logistic;                   /**< Whether the phenotype is the condition (logistic) or quantitative (linear). */
+
+    int num_samples;                /**< Samples with a known phenotype and all covariates. */
+    int *sample_positions;          /**< Position of each of those samples in the VCF file. */
+    int num_covariates;             /**< Columns of the design, including the intercept. */
+
+    gsl_matrix *design;             /**< Intercept and covariates, a row per sample. */
+    gsl_vector *phenotype;
+
+    gsl_matrix *basis;              /**< Orthonormal basis of the design, from its QR decomposition. */
+    gsl_vector *residual_phenotype; /**< Phenotype minus its projection onto the design. */
+    double residual_sum_squares;
+
+    gsl_vector *null_coefficients;  /**< Logistic fit of the design alone, or NULL if it did not converge. */
+} regression_model_t;
+
+/**
+ * @brief Fit of the allele count in the model of a variant.
+ */
+typedef struct regression_fit {
+    int num_samples;                /**< Samples whose genotype is not missing. */
+    double coefficient;             /**< NAN if the model could not be fitted. */
+    double standard_error;
+    double statistic;               /**< t statistic (linear) or Wald z statistic (logistic). */
+    double p_value;
+} regression_fit_t;
+
+typedef struct {
+    char *chromosome;
+    char *id;
+    char *reference;
+    char *alternate;
+
+    unsigned long int position;
+
+    int num_samples;
+    double coefficient;
+    double standard_error;
+    double statistic;
+    double p_value;
+} assoc_regression_result_t;
+
+
+/**
+ * @brief Prepares the parts of the regression models that don't depend on the variants.
+ * @param samples samples sorted as in the VCF file, may contain NULL
+ * @param num_samples number of samples
+ * @param covariates covariates of the individuals
+ * @param logistic whether to fit logistic models of the condition or linear models of the phenotype
+ * @return The model, or NULL if there are not enough samples to fit it
+ */
+regression_model_t *regression_model_new(individual_t **samples, int num_samples, covariate_table_t *covariates, int logistic);
+
+void regression_model_free(regression_model_t *model);
+
+/**
+ * @brief Fits the model of each variant of a matrix of genotypes.
+ * @param[out] fits a fit per variant
+ */
+void assoc_regression_test(genotype_matrix_t *genotypes, regression_model_t *model, regression_fit_t *fits);
+
+assoc_regression_result_t *assoc_regression_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len,
+                                                       char *reference, int reference_len, char *alternate, int alternate_len,
+                                                       regression_fit_t *fit);
+
+void assoc_regression_result_free(assoc_regression_result_t *result);
+
+#endif
@@ -42,6 +42,17 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
         LOG_FATAL_F("Can't read PED file: %s\n", ped_file->filename);
     }
 
+    // Covariates of the regressions are the columns of the PED file after the phenotype
+    int regression = options_data->task == LOGISTIC || options_data->task == LINEAR;
+    covariate_table_t *covariates = NULL;
+    if (regression) {
+        covariates = covariate_table_read(shared_options_data->ped_filename);
+        if (!covariates) {
+            LOG_FATAL_F("Can't read covariates from PED file: %s\n", shared_options_data->ped_filename);
+        }
+        LOG_INFO_F("%d covariates read from PED file\n", covariates->num_covariates);
+    }
+
     // Try to create the directory where the output files will be stored
     ret_code = create_directory(shared_options_data->output_directory);
     if (ret_code != 0 && errno != EEXIST) {
@@ -50,6 +61,15 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
     
     LOG_INFO("About to perform basic association test...\n");
 
+    // Results are written in the same order the batches were read
+    reorder_buffer_t *reorder_buffer = reorder_buffer_new(shared_options_data->num_threads * REORDER_BUFFER_BATCHES_PER_THREAD);
+    
+    // Permutations of the condition of the samples, created once the samples are known
+    permutation_set_t *permutations = NULL;
+    
+    // Parts of the regression models shared by all variants, created once the samples are known
+    regression_model_t *regression_model = NULL;
+
 #pragma omp parallel sections private(ret_code)
     {
 #pragma omp section
@@ -85,6 +105,7 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
             // Pedigree information
             individual_t **individuals = NULL;
             khash_t(ids) *sample_ids = NULL;
+            trio_table_t *mendel_trios = NULL;
             
             // Create chain of filters for the VCF file
             filter_t **filters = NULL;
@@ -100,23 +121,45 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
             double *factorial_logarithms = NULL;
             
             int i = 0;
-#pragma omp parallel num_threads(shared_options_data->num_threads) shared(initialization_done, factorial_logarithms, filters, individuals)
+            // The threads that evaluate the permutations of each batch are not available to process other batches
+            int permutation_threads = permutation_threads_per_batch(options_data->num_permutations, shared_options_data->num_threads);
+            int batch_threads = shared_options_data->num_threads / permutation_threads;
+#pragma omp parallel num_threads(batch_threads) shared(initialization_done, factorial_logarithms, filters, individuals, permutations, regression_model)
             {
             LOG_DEBUG_F("Level %d: number of threads in the team - %d\n", 11, omp_get_num_threads()); 
 
+            // Fisher's test p-values are cached by each thread
+            assoc_fisher_input_t *fisher_input = NULL;
+            
             char *text_begin, *text_end;
             vcf_reader_status *status;
-            while(text_begin = fetch_vcf_text_batch(vcf_file)) {
-                text_end = text_begin + strlen(text_begin);
+            long text_sequence;
+            int text_records;
+            while (1) {
+                // Texts must be given their sequence numbers in the same order they are fetched
+# pragma omp critical
+                {
+                    text_begin = fetch_vcf_text_batch(vcf_file);
+                    if (text_begin) {
+                        text_end = text_begin + strlen(text_begin);
+                        text_records = count_vcf_text_records(text_begin, text_end);
+                        text_sequence = reorder_buffer_register_text(text_begin, text_end, text_records, reorder_buffer);
+                        status = vcf_reader_status_new(shared_options_data->batch_lines, i);
+                        i++;
+                    }
+                }
+                
+                if (!text_begin) {
+                    break;
+                }
                 if (text_begin == text_end) { // EOF
+                    reorder_buffer_skip_text(text_sequence, reorder_buffer);
+                    vcf_reader_status_free(status);
                     free(text_begin);
                     break;
                 }
-                
-# pragma omp critical
-                {
-                    status = vcf_reader_status_new(shared_options_data->batch_lines, i);
-                    i++;
+                if (text_records == 0) {
+                    reorder_buffer_skip_text(text_sequence, reorder_buffer);
                 }
                 
                 if (shared_options_data->batch_bytes > 0) {
@@ -135,6 +178,12 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
                         sample_ids = associate_samples_and_positions(vcf_file);
                         // Sort individuals in PED as defined in the VCF file
                         individuals = sort_individuals(vcf_file, ped_file);
+                        // Trios whose mendelian errors are counted to filter variants
+                        if (options_data->max_mendel_errors >= 0) {
+                            family_t **families = (family_t**) cp_hashtable_get_values(ped_file->families);
+                            mendel_trios = trio_table_new(families, get_num_families(ped_file), sample_ids, 0);
+                            free(families);
+                        }
                         
 /*
                         printf("num samples = %zu\n", get_num_vcf_samples(file));
@@ -159,7 +208,22 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
                         LOG_DEBUG("VCF header written\n");
                         
                         if (options_data->task == FISHER) {
-                            factorial_logarithms = init_logarithm_array(get_num_vcf_samples(vcf_file) * 10);
+                            // A table never has more alleles than twice the number of samples
+                            factorial_logarithms = assoc_fisher_factorial_logarithms(2 * get_num_vcf_samples(vcf_file));
+                        }
+                        
+                        if (regression) {
+                            regression_model = regression_model_new(individuals, get_num_vcf_samples(vcf_file), covariates, 
+                                                                    options_data->task == LOGISTIC);
+                            if (!regression_model) {
+                                LOG_FATAL("Not enough samples with phenotype and covariates to fit the regression models\n");
+                            }
+                        }
+                        
+                        if (options_data->num_permutations > 0) {
+                            LOG_INFO_F("Generating %d permutations of the samples condition...\n", options_data->num_permutations);
+                            permutations = permutation_set_new_conditions(individuals, get_num_vcf_samples(vcf_file), 
+                                                                          options_data->num_permutations, permutation_threads);
                         }
                         
                         initialization_done = 1;
@@ -172,6 +236,10 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
                     continue;
                 }
                 
+                if (options_data->task == FISHER && !fisher_input) {
+                    fisher_input = assoc_fisher_input_new(factorial_logarithms, options_data->mid_p, options_data->fisher_early_exit);
+                }
+                
                 vcf_batch_t *batch = fetch_vcf_batch(vcf_file);
                 
                 if (i % 100 == 0) {
@@ -182,13 +250,32 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
 
                 assert(batch);
                 
+                // The batch may have been parsed from the text of another thread
+                int batch_offset = 0;
+                long batch_sequence = claim_vcf_batch_sequence(batch, &batch_offset, reorder_buffer);
+                if (batch_sequence >= 0) {
+                    reorder_buffer_wait(batch_sequence, reorder_buffer);
+                }
+                
                 // Launch association test over records that passed the filters
                 array_list_t *failed_records = NULL;
                 int num_variables = ped_file? get_num_variables(ped_file): 0;
                 array_list_t *passed_records = filter_records(filters, num_filters, individuals, sample_ids, num_variables, batch->records, &failed_records);
-                if (passed_records->size > 0) {
-                    assoc_test(options_data->task, (vcf_record_t**) passed_records->items, passed_records->size, 
-                                individuals, get_num_vcf_samples(vcf_file), factorial_logarithms, output_list);
+                if (mendel_trios) {
+                    passed_records = filter_mendel_errors(passed_records, batch->records, &failed_records, 
+                                                          mendel_trios, options_data->max_mendel_errors);
+                }
+                if (batch_sequence >= 0) {
+                    list_t *batch_results = (list_t*) malloc (sizeof(list_t));
+                    list_init("batch", 1, INT_MAX, batch_results);
+                    if (passed_records->size > 0) {
+                        assoc_test(options_data->task, (vcf_record_t**) passed_records->items, passed_records->size, 
+                                    individuals, get_num_vcf_samples(vcf_file), 
+                                    regression ? (void*) regression_model : (void*) fisher_input, 
+                                    permutations, batch_results);
+                    }
+                    list_decr_writers(batch_results);
+                    list_insert_item(list_item_new(batch_sequence, batch_offset, batch_results), output_list);
                 }
                 
                 // Write records that passed and failed filters to separate files, and free them
@@ -201,6 +288,11 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
             }  
             
             notify_end_parsing(vcf_file);
+            
+            if (fisher_input) {
+                LOG_DEBUG_F("[%d] Fisher's test cache: %zu hits, %zu misses\n", omp_get_thread_num(), fisher_input->hits, fisher_input->misses);
+                assoc_fisher_input_free(fisher_input);
+            }
             }
 
             double stop = omp_get_wtime();
@@ -217,7 +309,9 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
             free(filters);
             
             if (sample_ids) { kh_destroy(ids, sample_ids); }
+            if (mendel_trios) { trio_table_free(mendel_trios); }
             if (individuals) { free(individuals); }
+            if (factorial_logarithms) { free(factorial_logarithms); }
 
             // Decrease list writers count
             for (int i = 0; i < shared_options_data->num_threads; i++) {
@@ -237,20 +331,37 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
             FILE *fd = get_assoc_output_file(options_data->task, shared_options_data, &path);
             LOG_INFO_F("Association test output filename = %s\n", path);
             
-            // Write data: header + one line per variant
+            // Write data: header + one line per variant, in the same order as the input file
             write_output_header(options_data->task, fd);
-            write_output_body(options_data->task, output_list, fd);
             
-            fclose(fd);
+            permutation_report_t *report = (options_data->num_permutations > 0) ? permutation_report_new() : NULL;
+            list_item_t *item = NULL;
+            list_t *batch_results = NULL;
+            while (item = list_remove_item(output_list)) {
+                reorder_buffer_put(item->id, item->type, item->data_p, reorder_buffer);
+                list_item_free(item);
+                
+                while (reorder_buffer_pop((void**) &batch_results, reorder_buffer)) {
+                    if (batch_results) {
+                        write_output_body(options_data->task, batch_results, report, fd);
+                        free(batch_results);
+                    }
+                }
+            }
+            
+            // Results of every batch must have been written in order
+            reorder_buffer_finish(reorder_buffer);
             
-            // Sort resulting file
-            char *cmd = calloc (40 + strlen(path) * 4, sizeof(char));
-            sprintf(cmd, "sort -k1,1h -k2,2n %s > %s.tmp && mv %s.tmp %s", path, path, path, path);
+            fclose(fd);
             
-            int sort_ret = system(cmd);
-            if (sort_ret) {
-                LOG_WARN("Association results could not be sorted by chromosome and position, will be shown unsorted\n");
+            // All variants have been tested, so the maximum statistics of the permutations are final
+            if (report) {
+                if (permutations) {
+                    write_permutation_output(path, report, permutations);
+                }
+                permutation_report_free(report);
             }
+            free(path);
             
             double stop = omp_get_wtime();
             double total = stop - start;
@@ -261,6 +372,10 @@ int run_association_test(shared_options_data_t* shared_options_data, assoc_optio
     }
    
     free(output_list);
+    reorder_buffer_free(reorder_buffer);
+    if (permutations) { permutation_set_free(permutations); }
+    if (regression_model) { regression_model_free(regression_model); }
+    if (covariates) { covariate_table_free(covariates); }
     vcf_close(vcf_file);
     ped_close(ped_file, 1,1);
         
@@ -276,6 +391,10 @@ static FILE *get_assoc_output_file(enum ASSOC_task task, shared_options_data_t *
         return get_output_file(global_options_data, "hpg-variant.chisq", path);
     } else if (task == FISHER) {
         return get_output_file(global_options_data, "hpg-variant.fisher", path);
+    } else if (task == LOGISTIC) {
+        return get_output_file(global_options_data, "hpg-variant.logistic", path);
+    } else if (task == LINEAR) {
+        return get_output_file(global_options_data, "hpg-variant.linear", path);
     } else {
         LOG_FATAL("Requested association test is not recognized as a valid test.\n");
     }
@@ -287,10 +406,14 @@ void write_output_header(enum ASSOC_task task, FILE *fd) {
         fprintf(fd, "#CHR         POS               ID      A1      C_A1    C_U1         F_A1            F_U1       A2      C_A2    C_U2         F_A2            F_U2              OR           CHISQ         P-VALUE\n");
     } else if (task == FISHER) {
         fprintf(fd, "#CHR         POS               ID      A1      C_A1    C_U1         F_A1            F_U1       A2      C_A2    C_U2         F_A2            F_U2              OR         P-VALUE\n");
+    } else if (task == LOGISTIC) {
+        fprintf(fd, "#CHR         POS               ID      A1      A2     NMISS              OR              SE            STAT         P-VALUE\n");
+    } else if (task == LINEAR) {
+        fprintf(fd, "#CHR         POS               ID      A1      A2     NMISS            BETA              SE            STAT         P-VALUE\n");
     }
 }
 
-void write_output_body(enum ASSOC_task task, list_t* output_list, FILE *fd) {
+void write_output_body(enum ASSOC_task task, list_t* output_list, permutation_report_t *report, FILE *fd) {
     assert(fd);
     list_item_t* item = NULL;
     
@@ -309,6 +432,11 @@ void write_output_body(enum ASSOC_task task, list_t* output_list, FILE *fd) {
                     result->alternate, result->affected2, result->unaffected2, freq_a2, freq_u2,
                     result->odds_ratio, result->chi_square, result->p_value);
             
+            if (report) {
+                permutation_report_add(result->chromosome, result->position, result->id, result->chi_square, 
+                                       result->permutations_exceeded, report);
+            }
+            
             assoc_basic_result_free(result);
             list_item_free(item);
         }
@@ -327,13 +455,49 @@ void write_output_body(enum ASSOC_task task, list_t* output_list, FILE *fd) {
                     result->alternate, result->affected2, result->unaffected2, freq_a2, freq_u2,
                     result->odds_ratio, result->p_value);
             
+            if (report) {
+                permutation_report_add(result->chromosome, result->position, result->id, 
+                                       assoc_fisher_permutation_statistic(result->p_value), result->permutations_exceeded, report);
+            }
+            
             assoc_fisher_result_free(result);
             list_item_free(item);
         }
+    } else if (task == LOGISTIC || task == LINEAR) {
+        while (item = list_remove_item(output_list)) {
+            assoc_regression_result_t *result = item->data_p;
+            
+            // The effect of the logistic regression is reported as an odds ratio
+            double effect = (task == LOGISTIC) ? exp(result->coefficient) : result->coefficient;
+            
+            fprintf(fd, "%s\t%8ld\t%s\t%s\t%s\t%6d\t%6f\t%6f\t%6f\t%6f\n",
+                    result->chromosome, result->position, result->id, result->reference, result->alternate,
+                    result->num_samples, effect, result->standard_error, result->statistic, result->p_value);
+            
+            assoc_regression_result_free(result);
+            list_item_free(item);
+        }
     }
 }
 
 
+void write_permutation_output(char *path, permutation_report_t *report, permutation_set_t *permutations) {
+    char *mperm_path = (char*) malloc ((strlen(path) + 7) * sizeof(char));
+    sprintf(mperm_path, "%s.mperm", path);
+    
+    FILE *fd = fopen(mperm_path, "w");
+    if (!fd) {
+        LOG_ERROR_F("Can't write permutation results to %s\n", mperm_path);
+    } else {
+        LOG_INFO_F("Permutation test output filename = %s\n", mperm_path);
+        permutation_set_finish(permutations);
+        write_permutation_report(fd, report, permutations);
+        fclose(fd);
+    }
+    
+    free(mperm_path);
+}
+
 /* *******************
  *      Sorting      *
  * *******************/
@@ -56,7 +56,9 @@ static FILE *get_assoc_output_file(enum ASSOC_task task, shared_options_data_t *
 
 static void write_output_header(enum ASSOC_task task, FILE *fd);
 
-static void write_output_body(enum ASSOC_task task, list_t* output_list, FILE *fd);
+static void write_output_body(enum ASSOC_task task, list_t* output_list, permutation_report_t *report, FILE *fd);
+
+static void write_permutation_output(char *path, permutation_report_t *report, permutation_set_t *permutations);
 
 
 //static individual_t **sort_individuals(vcf_file_t *vcf, ped_file_t *ped);
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "covariates.h"
+
+static double parse_covariate(const char *token);
+
+
+covariate_table_t *covariate_table_read(const char *filename) {
+    FILE *fd = fopen(filename, "r");
+    if (!fd) {
+        return NULL;
+    }
+
+    covariate_table_t *table = (covariate_table_t*) calloc (1, sizeof(covariate_table_t));
+    table->num_covariates = -1;
+    table->rows = kh_init(covariate_rows);
+
+    char line[8192];
+    char *fields[1024];
+    while (fgets(line, sizeof(line), fd)) {
+        int num_fields = 0;
+        char *save, *token = strtok_r(line, " \t\r\n", &save);
+        while (token && num_fields < 1024) {
+            fields[num_fields++] = token;
+            token = strtok_r(NULL, " \t\r\n", &save);
+        }
+        if (num_fields == 0) {
+            continue;
+        }
+
+        // The header, if any, names the covariates
+        if (fields[0][0] == '#') {
+            if (table->num_covariates < 0 && num_fields > PED_MANDATORY_COLUMNS) {
+                table->num_covariates = num_fields - PED_MANDATORY_COLUMNS;
+                table->names = (char**) malloc (table->num_covariates * sizeof(char*));
+                for (int c = 0; c < table->num_covariates; c++) {
+                    table->names[c] = strdup(fields[PED_MANDATORY_COLUMNS + c]);
+                }
+            }
+            continue;
+        }
+
+        // Without header, the first individual defines the number of covariates
+        if (table->num_covariates < 0) {
+            table->num_covariates = (num_fields > PED_MANDATORY_COLUMNS) ? num_fields - PED_MANDATORY_COLUMNS : 0;
+            table->names = (char**) malloc ((table->num_covariates + 1) * sizeof(char*));
+            for (int c = 0; c < table->num_covariates; c++) {
+                table->names[c] = (char*) malloc (16 * sizeof(char));
+                sprintf(table->names[c], "COV%d", c + 1);
+            }
+        }
+
+        if (num_fields < 2) {
+            continue;
+        }
+
+        double *values = (double*) malloc ((table->num_covariates + 1) * sizeof(double));
+        for (int c = 0; c < table->num_covariates; c++) {
+            int field = PED_MANDATORY_COLUMNS + c;
+            values[c] = (field < num_fields) ? parse_covariate(fields[field]) : NAN;
+        }
+
+        int ret;
+        khiter_t iter = kh_put(covariate_rows, table->rows, strdup(fields[1]), &ret);
+        if (ret) {
+            kh_value(table->rows, iter) = values;
+        } else {
+            LOG_WARN_F("Individual %s is defined more than once, its first covariates will be used\n", fields[1]);
+            free(values);
+        }
+    }
+
+    if (table->num_covariates < 0) {
+        table->num_covariates = 0;
+    }
+
+    fclose(fd);
+    return table;
+}
+
+void covariate_table_free(covariate_table_t *table) {
+    for (khiter_t iter = kh_begin(table->rows); iter != kh_end(table->rows); iter++) {
+        if (kh_exist(table->rows, iter)) {
+            free((char*) kh_key(table->rows, iter));
+            free(kh_value(table->rows, iter));
+        }
+    }
+    kh_destroy(covariate_rows, table->rows);
+
+    for (int c = 0; c < table->num_covariates; c++) {
+        free(table->names[c]);
+    }
+    free(table->names);
+    free(table);
+}
+
+double *covariate_table_get(const char *individual_id, covariate_table_t *table) {
+    khiter_t iter = kh_get(covariate_rows, table->rows, individual_id);
+    return (iter != kh_end(table->rows)) ? kh_value(table->rows, iter) : NULL;
+}
+
+
+static double parse_covariate(const char *token) {
+    if (!strcmp(token, "NA") || !strcmp(token, ".") || !strcmp(token, "-9")) {
+        return NAN;
+    }
+
+    char *end;
+    double value = strtod(token, &end);
+    return (*end == '\0') ? value : NAN;
+}
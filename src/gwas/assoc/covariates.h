@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COVARIATES_H
+#define COVARIATES_H
+
+/**
+ * @file covariates.h
+ * @brief Numeric covariates of the individuals, read from the columns of a PED file after the phenotype
+ *
+ * A header line starting with '#' gives the names of the covariates. Values "NA", "." and "-9" are
+ * considered missing.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <commons/log.h>
+#include <containers/khash.h>
+
+/**
+ * Columns of a PED file before the covariates: family, individual, father, mother, sex and phenotype.
+ */
+#define PED_MANDATORY_COLUMNS   6
+
+/**
+ * Covariates of each individual, by its ID.
+ */
+KHASH_MAP_INIT_STR(covariate_rows, double*);
+
+typedef struct covariate_table {
+    int num_covariates;
+    char **names;
+    khash_t(covariate_rows) *rows;  /**< num_covariates values per individual, NAN if missing. */
+} covariate_table_t;
+
+
+/**
+ * @brief Reads the covariates of a PED file.
+ * @param filename path to the PED file
+ * @return The covariates of every individual, or NULL if the file can't be read
+ */
+covariate_table_t *covariate_table_read(const char *filename);
+
+void covariate_table_free(covariate_table_t *table);
+
+/**
+ * @brief Returns the covariates of an individual, or NULL if it is not in the table.
+ */
+double *covariate_table_get(const char *individual_id, covariate_table_t *table);
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "genotype_matrix.h"
+
+/**
+ * Low bit of every genotype in a word.
+ */
+#define GENOTYPE_LOW_BITS   0x5555555555555555ULL
+
+/**
+ * The vectorised kernels are compiled with target attributes, so no special flags are needed.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GENOTYPE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static int decode_allele(const char **allele);
+static void count_genotypes_scalar(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]);
+#ifdef GENOTYPE_KERNELS_X86
+static void count_genotypes_avx2(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]);
+static void count_genotypes_avx512(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]);
+#endif
+
+
+genotype_matrix_t *genotype_matrix_new(vcf_record_t **variants, int num_variants, int num_samples, khash_t(gt_positions) *gt_positions) {
+    genotype_matrix_t *matrix = (genotype_matrix_t*) malloc (sizeof(genotype_matrix_t));
+    matrix->num_variants = num_variants;
+    matrix->num_samples = num_samples;
+    matrix->words_per_variant = (num_samples + GENOTYPES_PER_WORD - 1) / GENOTYPES_PER_WORD;
+    matrix->genotypes = (uint64_t*) calloc ((size_t) num_variants * matrix->words_per_variant, sizeof(uint64_t));
+    matrix->rows = NULL;
+    matrix->count_genotypes = genotype_kernel_get(genotype_kernel_best());
+
+    for (int i = 0; i < num_variants; i++) {
+        vcf_record_t *variant = variants[i];
+        int gt_position = get_gt_position(variant, gt_positions);
+        uint64_t *row = matrix->genotypes + (size_t) i * matrix->words_per_variant;
+
+        for (int j = 0; j < num_samples; j++) {
+            uint64_t genotype = (gt_position < 0) ? GENOTYPE_MISSING :
+                                decode_genotype(array_list_get(j, variant->samples), gt_position);
+            row[j / GENOTYPES_PER_WORD] |= genotype << (2 * (j % GENOTYPES_PER_WORD));
+        }
+    }
+
+    return matrix;
+}
+
+genotype_matrix_t *genotype_matrix_new_split(vcf_record_t **variants, int num_variants, int num_samples, 
+                                             khash_t(gt_positions) *gt_positions) {
+    // One row per alternate allele, separated by commas in the ALT column
+    int num_rows = 0;
+    for (int i = 0; i < num_variants; i++) {
+        num_rows++;
+        for (int k = 0; k < variants[i]->alternate_len; k++) {
+            num_rows += (variants[i]->alternate[k] == ',');
+        }
+    }
+    
+    genotype_matrix_t *matrix = (genotype_matrix_t*) malloc (sizeof(genotype_matrix_t));
+    matrix->num_variants = num_rows;
+    matrix->num_samples = num_samples;
+    matrix->words_per_variant = (num_samples + GENOTYPES_PER_WORD - 1) / GENOTYPES_PER_WORD;
+    matrix->genotypes = (uint64_t*) calloc ((size_t) num_rows * matrix->words_per_variant, sizeof(uint64_t));
+    matrix->rows = (genotype_row_t*) malloc (num_rows * sizeof(genotype_row_t));
+    matrix->count_genotypes = genotype_kernel_get(genotype_kernel_best());
+    
+    int first_row = 0;
+    for (int i = 0; i < num_variants; i++) {
+        vcf_record_t *variant = variants[i];
+        
+        // Rows of the variant, whose genotypes are HOM_REF unless one of its alleles is found
+        int num_alternates = 0;
+        const char *alternate = variant->alternate, *end = variant->alternate + variant->alternate_len;
+        while (1) {
+            const char *comma = memchr(alternate, ',', end - alternate);
+            genotype_row_t *row = matrix->rows + first_row + num_alternates;
+            row->variant = i;
+            row->allele = ++num_alternates;
+            row->alternate = alternate;
+            row->alternate_len = (comma ? comma : end) - alternate;
+            if (!comma) {
+                break;
+            }
+            alternate = comma + 1;
+        }
+        
+        int gt_position = get_gt_position(variant, gt_positions);
+        uint64_t *rows = matrix->genotypes + (size_t) first_row * matrix->words_per_variant;
+        
+        for (int j = 0; j < num_samples; j++) {
+            int allele1 = -1, allele2 = -1;
+            if (gt_position >= 0) {
+                decode_genotype_alleles(array_list_get(j, variant->samples), gt_position, &allele1, &allele2);
+            }
+            
+            int word = j / GENOTYPES_PER_WORD, shift = 2 * (j % GENOTYPES_PER_WORD);
+            if (allele1 < 0 || allele2 < 0 || allele1 > num_alternates || allele2 > num_alternates) {
+                for (int a = 0; a < num_alternates; a++) {
+                    rows[(size_t) a * matrix->words_per_variant + word] |= (uint64_t) GENOTYPE_MISSING << shift;
+                }
+            } else if (allele1 == allele2) {
+                if (allele1 > 0) {
+                    rows[(size_t) (allele1 - 1) * matrix->words_per_variant + word] |= (uint64_t) GENOTYPE_HOM_ALT << shift;
+                }
+            } else {
+                if (allele1 > 0) {
+                    rows[(size_t) (allele1 - 1) * matrix->words_per_variant + word] |= (uint64_t) GENOTYPE_HET << shift;
+                }
+                if (allele2 > 0) {
+                    rows[(size_t) (allele2 - 1) * matrix->words_per_variant + word] |= (uint64_t) GENOTYPE_HET << shift;
+                }
+            }
+        }
+        
+        first_row += num_alternates;
+    }
+    
+    return matrix;
+}
+
+void genotype_matrix_free(genotype_matrix_t *matrix) {
+    free(matrix->genotypes);
+    free(matrix->rows);
+    free(matrix);
+}
+
+khash_t(gt_positions) *gt_positions_new(void) {
+    return kh_init(gt_positions);
+}
+
+void gt_positions_free(khash_t(gt_positions) *gt_positions) {
+    for (khiter_t iter = kh_begin(gt_positions); iter != kh_end(gt_positions); ++iter) {
+        if (kh_exist(gt_positions, iter)) {
+            free((char*) kh_key(gt_positions, iter));
+        }
+    }
+    kh_destroy(gt_positions, gt_positions);
+}
+
+int get_gt_position(vcf_record_t *variant, khash_t(gt_positions) *gt_positions) {
+    char format[variant->format_len + 1];
+    memcpy(format, variant->format, variant->format_len);
+    format[variant->format_len] = '\0';
+
+    khiter_t iter = kh_get(gt_positions, gt_positions, format);
+    if (iter != kh_end(gt_positions)) {
+        return kh_value(gt_positions, iter);
+    }
+
+    // get_field_position_in_format tokenizes its argument, so it receives a copy
+    char *format_key = strdup(format);
+    int gt_position = get_field_position_in_format("GT", format);
+    int ret;
+    iter = kh_put(gt_positions, gt_positions, format_key, &ret);
+    kh_value(gt_positions, iter) = gt_position;
+    return gt_position;
+}
+
+int decode_genotype(const char *sample, int gt_position) {
+    int allele1, allele2;
+    if (decode_genotype_alleles(sample, gt_position, &allele1, &allele2) || allele1 < 0 || allele2 < 0) {
+        return GENOTYPE_MISSING;
+    } else if (!allele1 && !allele2) {
+        return GENOTYPE_HOM_REF;
+    } else if (allele1 && allele2) {
+        return GENOTYPE_HOM_ALT;
+    } else {
+        return GENOTYPE_HET;
+    }
+}
+
+int decode_genotype_alleles(const char *sample, int gt_position, int *allele1, int *allele2) {
+    *allele1 = *allele2 = -1;
+    for (int field = 0; field < gt_position; field++) {
+        sample = strchr(sample, ':');
+        if (!sample) {
+            return 1;
+        }
+        sample++;
+    }
+
+    *allele1 = decode_allele(&sample);
+    if (*sample != '/' && *sample != '|') {
+        *allele1 = -1;
+        return 1;
+    }
+    sample++;
+    *allele2 = decode_allele(&sample);
+    return 0;
+}
+
+uint64_t *genotype_mask_new(individual_t **samples, int num_samples, enum Condition condition) {
+    int num_words = (num_samples + GENOTYPES_PER_WORD - 1) / GENOTYPES_PER_WORD;
+    uint64_t *mask = (uint64_t*) calloc (num_words > 0 ? num_words : 1, sizeof(uint64_t));
+    for (int j = 0; j < num_samples; j++) {
+        if (samples[j] && samples[j]->condition == condition) {
+            mask[j / GENOTYPES_PER_WORD] |= 1ULL << (2 * (j % GENOTYPES_PER_WORD));
+        }
+    }
+    return mask;
+}
+
+void genotype_matrix_count_alleles(genotype_matrix_t *matrix, int variant, uint64_t *mask, int haploid,
+                                   int *reference_count, int *alternate_count) {
+    uint64_t *row = matrix->genotypes + (size_t) variant * matrix->words_per_variant;
+    int counts[3];
+    matrix->count_genotypes(row, mask, matrix->words_per_variant, counts);
+    genotype_counts_to_alleles(counts, haploid, reference_count, alternate_count);
+}
+
+void genotype_counts_to_alleles(const int counts[3], int haploid, int *reference_count, int *alternate_count) {
+    int hom_ref = counts[0], het = counts[1], hom_alt = counts[2];
+
+    if (haploid) {
+        *reference_count = hom_ref;
+        *alternate_count = hom_alt;
+    } else {
+        *reference_count = 2 * hom_ref + het;
+        *alternate_count = 2 * hom_alt + het;
+    }
+}
+
+enum genotype_kernel genotype_kernel_best(void) {
+    for (int kernel = NUM_GENOTYPE_KERNELS - 1; kernel > GENOTYPE_KERNEL_SCALAR; kernel--) {
+        if (genotype_kernel_get(kernel)) {
+            return kernel;
+        }
+    }
+    return GENOTYPE_KERNEL_SCALAR;
+}
+
+genotype_count_fn genotype_kernel_get(enum genotype_kernel kernel) {
+    switch (kernel) {
+        case GENOTYPE_KERNEL_SCALAR:
+            return count_genotypes_scalar;
+#ifdef GENOTYPE_KERNELS_X86
+        case GENOTYPE_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") ? count_genotypes_avx2 : NULL;
+        case GENOTYPE_KERNEL_AVX512:
+            return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) ?
+                   count_genotypes_avx512 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+const char *genotype_kernel_name(enum genotype_kernel kernel) {
+    switch (kernel) {
+        case GENOTYPE_KERNEL_SCALAR:    return "scalar";
+        case GENOTYPE_KERNEL_AVX2:      return "avx2";
+        case GENOTYPE_KERNEL_AVX512:    return "avx512";
+        default:                        return "unknown";
+    }
+}
+
+
+/* **********************************************
+ *               Counting kernels               *
+ * **********************************************/
+
+/*
+ * All kernels split each word in the bitplanes of the low and high bits of the genotypes, so
+ * 00 (hom-ref) = ~(low | high), 01 (het) = low & ~high and 10 (hom-alt) = high & ~low. Missing
+ * genotypes (11) and samples not in the mask are never counted.
+ */
+
+static void count_genotypes_scalar(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]) {
+    counts[0] = counts[1] = counts[2] = 0;
+    for (int w = 0; w < num_words; w++) {
+        uint64_t low = row[w] & GENOTYPE_LOW_BITS;
+        uint64_t high = (row[w] >> 1) & GENOTYPE_LOW_BITS;
+        counts[0] += __builtin_popcountll(~(low | high) & mask[w]);
+        counts[1] += __builtin_popcountll(low & ~high & mask[w]);
+        counts[2] += __builtin_popcountll(high & ~low & mask[w]);
+    }
+}
+
+#ifdef GENOTYPE_KERNELS_X86
+
+/**
+ * Population count of each 64-bit lane, using a lookup table of the nibbles (there is no
+ * popcount instruction for vectors in AVX2).
+ */
+__attribute__((target("avx2")))
+static inline __m256i popcount_avx2(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    __m256i low_nibbles = _mm256_and_si256(v, nibble_mask);
+    __m256i high_nibbles = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble_mask);
+    __m256i byte_counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low_nibbles), _mm256_shuffle_epi8(lookup, high_nibbles));
+    return _mm256_sad_epu8(byte_counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline int sum_lanes_avx2(__m256i v) {
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1);
+}
+
+__attribute__((target("avx2")))
+static void count_genotypes_avx2(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]) {
+    const __m256i low_bits = _mm256_set1_epi64x(GENOTYPE_LOW_BITS);
+    __m256i hom_ref = _mm256_setzero_si256(), het = _mm256_setzero_si256(), hom_alt = _mm256_setzero_si256();
+
+    int w = 0;
+    for (; w + 4 <= num_words; w += 4) {
+        __m256i genotypes = _mm256_loadu_si256((const __m256i*) (row + w));
+        __m256i samples = _mm256_loadu_si256((const __m256i*) (mask + w));
+        __m256i low = _mm256_and_si256(genotypes, low_bits);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi64(genotypes, 1), low_bits);
+        hom_ref = _mm256_add_epi64(hom_ref, popcount_avx2(_mm256_andnot_si256(_mm256_or_si256(low, high), samples)));
+        het = _mm256_add_epi64(het, popcount_avx2(_mm256_and_si256(_mm256_andnot_si256(high, low), samples)));
+        hom_alt = _mm256_add_epi64(hom_alt, popcount_avx2(_mm256_and_si256(_mm256_andnot_si256(low, high), samples)));
+    }
+
+    count_genotypes_scalar(row + w, mask + w, num_words - w, counts);
+    counts[0] += sum_lanes_avx2(hom_ref);
+    counts[1] += sum_lanes_avx2(het);
+    counts[2] += sum_lanes_avx2(hom_alt);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void count_genotypes_avx512(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]) {
+    const __m512i low_bits = _mm512_set1_epi64(GENOTYPE_LOW_BITS);
+    __m512i hom_ref = _mm512_setzero_si512(), het = _mm512_setzero_si512(), hom_alt = _mm512_setzero_si512();
+
+    for (int w = 0; w < num_words; w += 8) {
+        // The last words are loaded with a mask, so the samples beyond the row are not counted
+        __mmask8 lanes = (num_words - w >= 8) ? 0xff : (__mmask8) ((1u << (num_words - w)) - 1);
+        __m512i genotypes = _mm512_maskz_loadu_epi64(lanes, row + w);
+        __m512i samples = _mm512_maskz_loadu_epi64(lanes, mask + w);
+        __m512i low = _mm512_and_si512(genotypes, low_bits);
+        __m512i high = _mm512_and_si512(_mm512_srli_epi64(genotypes, 1), low_bits);
+        hom_ref = _mm512_add_epi64(hom_ref, _mm512_popcnt_epi64(_mm512_andnot_si512(_mm512_or_si512(low, high), samples)));
+        het = _mm512_add_epi64(het, _mm512_popcnt_epi64(_mm512_and_si512(_mm512_andnot_si512(high, low), samples)));
+        hom_alt = _mm512_add_epi64(hom_alt, _mm512_popcnt_epi64(_mm512_and_si512(_mm512_andnot_si512(low, high), samples)));
+    }
+
+    counts[0] = _mm512_reduce_add_epi64(hom_ref);
+    counts[1] = _mm512_reduce_add_epi64(het);
+    counts[2] = _mm512_reduce_add_epi64(hom_alt);
+}
+
+#endif
+
+
+/**
+ * Reads an allele index, advancing the pointer past it. Returns -1 if the allele is missing.
+ */
+static int decode_allele(const char **allele) {
+    const char *p = *allele;
+    if (*p < '0' || *p > '9') {
+        if (*p == '.') {
+            (*allele)++;
+        }
+        return -1;
+    }
+
+    int value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    *allele = p;
+    return value;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENOTYPE_MATRIX_H
+#define GENOTYPE_MATRIX_H
+
+/**
+ * @file genotype_matrix.h
+ * @brief Genotypes of a batch of variants packed in 2 bits per sample
+ *
+ * The samples of each variant are decoded once, straight from the VCF text and without allocating
+ * memory, into a row of 64-bit words that hold 32 genotypes each. Groups of samples (such as cases
+ * and controls) are represented with masks of the same layout, so the alleles of a group are
+ * counted with a few bitwise operations and popcounts per word.
+ *
+ * Multi-allelic variants can be split into a row per alternate allele, where the genotype codes
+ * count the copies of that allele and any other one is taken as reference. All the rows of a
+ * variant are filled in the same pass over its samples.
+ *
+ * The counting kernel is vectorised with AVX2 and AVX-512 when the processor supports them, which
+ * is checked at runtime, so the same binary runs on any x86-64 machine.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bioformats/family/family.h>
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_util.h>
+#include <containers/khash.h>
+
+/**
+ * Genotype codes. Both alleles are alternate in HOM_ALT, and only one of them in HET. Haploid
+ * genotypes and those with any allele missing are MISSING.
+ */
+#define GENOTYPE_HOM_REF    0
+#define GENOTYPE_HET        1
+#define GENOTYPE_HOM_ALT    2
+#define GENOTYPE_MISSING    3
+
+#define GENOTYPES_PER_WORD  32
+
+/**
+ * Position of the GT field for each distinct FORMAT column.
+ */
+KHASH_MAP_INIT_STR(gt_positions, int);
+
+/**
+ * Implementations of the kernel that counts genotypes, from the slowest to the fastest.
+ */
+enum genotype_kernel { GENOTYPE_KERNEL_SCALAR, GENOTYPE_KERNEL_AVX2, GENOTYPE_KERNEL_AVX512, NUM_GENOTYPE_KERNELS };
+
+/**
+ * Counts the homozygous reference (counts[0]), heterozygous (counts[1]) and homozygous alternate
+ * (counts[2]) genotypes of a row that are set in a mask.
+ */
+typedef void (*genotype_count_fn)(const uint64_t *row, const uint64_t *mask, int num_words, int counts[3]);
+
+/**
+ * @brief Origin of a row of a matrix whose alternate alleles are split.
+ */
+typedef struct genotype_row {
+    int variant;                /**< Index of the variant the row was decoded from. */
+    int allele;                 /**< Alternate allele counted in the row, from 1. */
+    const char *alternate;      /**< Text of the alternate allele, inside the ALT column of the variant. */
+    int alternate_len;
+} genotype_row_t;
+
+typedef struct genotype_matrix {
+    uint64_t *genotypes;        /**< A row of words_per_variant words per variant. */
+    int num_variants;           /**< Rows of the matrix, which are more than the variants if they are split. */
+    int num_samples;
+    int words_per_variant;
+    genotype_row_t *rows;       /**< Origin of each row if alternate alleles are split, NULL otherwise. */
+    genotype_count_fn count_genotypes;  /**< Fastest kernel supported by the processor. */
+} genotype_matrix_t;
+
+
+/**
+ * @brief Decodes the genotypes of a list of variants.
+ * @param variants variants to decode
+ * @param num_variants number of variants
+ * @param num_samples number of samples of each variant
+ * @param gt_positions cache of GT positions by FORMAT, where new FORMAT columns are added
+ * @return The packed genotypes of the variants
+ */
+genotype_matrix_t *genotype_matrix_new(vcf_record_t **variants, int num_variants, int num_samples, khash_t(gt_positions) *gt_positions);
+
+/**
+ * @brief Decodes the genotypes of a list of variants, with a row per alternate allele.
+ * 
+ * The genotype of a sample in the row of an allele is HOM_ALT if both its alleles are that one, HET if 
+ * only one of them is, and HOM_REF otherwise. Biallelic variants get the same row as in genotype_matrix_new.
+ * @see genotype_matrix_new
+ */
+genotype_matrix_t *genotype_matrix_new_split(vcf_record_t **variants, int num_variants, int num_samples, 
+                                             khash_t(gt_positions) *gt_positions);
+
+void genotype_matrix_free(genotype_matrix_t *matrix);
+
+/**
+ * @brief Creates an empty cache of GT positions.
+ */
+khash_t(gt_positions) *gt_positions_new(void);
+
+void gt_positions_free(khash_t(gt_positions) *gt_positions);
+
+/**
+ * @brief Returns the position of the GT field in the FORMAT column of a variant, or -1 if missing.
+ */
+int get_gt_position(vcf_record_t *variant, khash_t(gt_positions) *gt_positions);
+
+/**
+ * @brief Decodes the genotype of a sample without modifying or copying it.
+ * @param sample data of the sample, as in the VCF file
+ * @param gt_position position of the GT field in the sample
+ * @return One of the GENOTYPE_* codes
+ */
+int decode_genotype(const char *sample, int gt_position);
+
+/**
+ * @brief Decodes the alleles of the genotype of a sample without modifying or copying it.
+ * @param sample data of the sample, as in the VCF file
+ * @param gt_position position of the GT field in the sample
+ * @param[out] allele1 index of the first allele, -1 if missing
+ * @param[out] allele2 index of the second allele, -1 if missing
+ * @return Zero if the genotype is diploid, non-zero otherwise
+ */
+int decode_genotype_alleles(const char *sample, int gt_position, int *allele1, int *allele2);
+
+/**
+ * @brief Creates a mask with the samples whose condition is the given one.
+ * @return An array of words with the same layout as a row of a matrix of num_samples samples
+ */
+uint64_t *genotype_mask_new(individual_t **samples, int num_samples, enum Condition condition);
+
+/**
+ * @brief Converts the genotype counts of a kernel into reference and alternate allele counts.
+ * @see genotype_matrix_count_alleles
+ */
+void genotype_counts_to_alleles(const int counts[3], int haploid, int *reference_count, int *alternate_count);
+
+/**
+ * @brief Counts the reference and alternate alleles of a variant in the samples of a mask.
+ * @param matrix packed genotypes
+ * @param variant index of the variant in the matrix
+ * @param mask samples to count
+ * @param haploid whether each genotype counts as one allele (as in chromosome X), so heterozygous
+ * genotypes are ignored
+ * @param[out] reference_count reference alleles found
+ * @param[out] alternate_count alternate alleles found
+ */
+void genotype_matrix_count_alleles(genotype_matrix_t *matrix, int variant, uint64_t *mask, int haploid,
+                                   int *reference_count, int *alternate_count);
+
+/**
+ * @brief Returns the fastest counting kernel supported by the processor.
+ */
+enum genotype_kernel genotype_kernel_best(void);
+
+/**
+ * @brief Returns the function of a counting kernel, or NULL if the processor doesn't support it.
+ */
+genotype_count_fn genotype_kernel_get(enum genotype_kernel kernel);
+
+const char *genotype_kernel_name(enum genotype_kernel kernel);
+
+/**
+ * @brief Returns the genotype of a sample in a variant.
+ */
+static inline int genotype_matrix_get(genotype_matrix_t *matrix, int variant, int sample) {
+    uint64_t word = matrix->genotypes[(size_t) variant * matrix->words_per_variant + sample / GENOTYPES_PER_WORD];
+    return (word >> (2 * (sample % GENOTYPES_PER_WORD))) & 3;
+}
+
+#endif
@@ -35,7 +35,7 @@ int association(int argc, char *argv[], const char *configuration_file) {
     if (argc == 1 || !strcmp(argv[1], "--help")) {
         argtable = merge_assoc_options(assoc_options, shared_options, arg_end(assoc_options->num_options + shared_options->num_options));
         show_usage("hpg-var-gwas assoc", argtable, assoc_options->num_options + shared_options->num_options);
-        arg_freetable(argtable, 30);
+        arg_freetable(argtable, 36);
         return 0;
     }
 
@@ -74,7 +74,7 @@ int association(int argc, char *argv[], const char *configuration_file) {
     
     free_assoc_options_data(options_data);
     free_shared_options_data(shared_options_data);
-    arg_freetable(argtable, 30);
+    arg_freetable(argtable, 36);
     free(configuration_file);
 
     return 0;
@@ -85,6 +85,12 @@ assoc_options_t *new_assoc_cli_options(void) {
     options->num_options = NUM_ASSOC_OPTIONS;
     options->chisq = arg_lit0(NULL, "chisq", "Chi-square association test");
     options->fisher = arg_lit0(NULL, "fisher", "Fisher's exact test");
+    options->mid_p = arg_lit0(NULL, "mid-p", "Report mid-p values in Fisher's test");
+    options->fisher_early_exit = arg_dbl0(NULL, "fisher-early-exit", NULL, "Report the chi-square p-value instead of Fisher's test when it is above this threshold (decimal like 0.5)");
+    options->logistic = arg_lit0(NULL, "logistic", "Logistic regression of the condition, adjusted by the covariates of the PED file");
+    options->linear = arg_lit0(NULL, "linear", "Linear regression of the phenotype, adjusted by the covariates of the PED file");
+    options->permutations = arg_int0(NULL, "perm", NULL, "Number of permutations for empirical and max(T) corrected p-values");
+    options->max_mendel_errors = arg_int0(NULL, "max-mendel-errors", NULL, "Maximum number of mendelian errors allowed in a variant");
     return options;
 }
 
@@ -94,9 +100,17 @@ assoc_options_data_t *new_assoc_options_data(assoc_options_t *options) {
         options_data->task = CHI_SQUARE;
     } else if (options->fisher->count > 0) {
         options_data->task = FISHER;
+    } else if (options->logistic->count > 0) {
+        options_data->task = LOGISTIC;
+    } else if (options->linear->count > 0) {
+        options_data->task = LINEAR;
     } else {
         options_data->task = NONE;
     }
+    options_data->num_permutations = (options->permutations->count > 0) ? *(options->permutations->ival) : 0;
+    options_data->max_mendel_errors = (options->max_mendel_errors->count > 0) ? *(options->max_mendel_errors->ival) : -1;
+    options_data->mid_p = options->mid_p->count > 0;
+    options_data->fisher_early_exit = (options->fisher_early_exit->count > 0) ? *(options->fisher_early_exit->dval) : 0;
     return options_data;
 }
 
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
  * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
  *
  * This file is part of hpg-variant.
@@ -20,339 +20,248 @@
 
 #include "hardy_weinberg.h"
 
-// TODO individuals must be founders
-int hardy_weinberg_test(vcf_record_t **variants, int num_variants, individual_t **individuals, int num_individuals, cp_hashtable *sample_ids, list_t *output_list) {
-    int ret_code = 0;
-    int tid = omp_get_thread_num();
-    int num_samples = cp_hashtable_count(sample_ids);
-    
-    char **sample_data;
-    
-    int gt_position;
-    int father_allele1, father_allele2;
-//     int mother_allele1, mother_allele2;
-//     int child_allele1, child_allele2;
+static void hardy_weinberg_buffer_reserve(int num_probabilities, int num_genotypes, hardy_weinberg_buffer_t *buffer);
+
+static int hardy_weinberg_split_alternates(vcf_record_t *record, hardy_weinberg_buffer_t *buffer);
 
-    ///////////////////////////////////
-    // Perform analysis for each variant
 
-    vcf_record_t *record;
+int hardy_weinberg_test(vcf_record_t **variants, int num_variants, int *samples, int num_samples, 
+                        hardy_weinberg_buffer_t *buffer, list_t *output_list) {
+    int tid = omp_get_thread_num();
+    int allele1, allele2;
+
     for (int i = 0; i < num_variants; i++) {
-        record = variants[i];
+        vcf_record_t *record = variants[i];
         LOG_DEBUG_F("[%d] Checking variant %.*s:%ld\n", tid, record->chromosome_len, record->chromosome, record->position);
         
         // Consider only diploid genotypes
-        if (!strncmp("X", record->chromosome, record->chromosome_len)) {
+        if (!strncmp("X", record->chromosome, record->chromosome_len) ||
+            !strncmp("Y", record->chromosome, record->chromosome_len) ||
+            !strncmp("MT", record->chromosome, record->chromosome_len)) {
             continue;
         }
         
-        sample_data = (char**) record->samples->items;
-        gt_position = get_field_position_in_format("GT", strndup(record->format, record->format_len));
-    
-        // Transmission counts
-        int t1 = 0;
-        int t2 = 0;
-        
-        ///////////// Get record information
-        
-        // Create list of alternates
-        int num_alternates;
-        char *copy_buf = strndup(record->alternate, record->alternate_len);
-        char **alternates = split(copy_buf, ",", &num_alternates);
-        if (copy_buf) {
-            free(copy_buf);
+        char **sample_data = (char**) record->samples->items;
+        int gt_position = get_gt_position(record, buffer->gt_positions);
+        if (gt_position < 0) {
+            continue;
         }
         
+        // Alternates are referenced inside the ALT column, without copying it
+        int num_alternates = hardy_weinberg_split_alternates(record, buffer);
+        int *alternate_starts = buffer->alternate_starts;
+        
+        // Count genotypes, with the lowest allele first
         int num_alleles = num_alternates + 1;
-        int *genotypes_count = (int*) calloc (num_alleles * num_alleles, sizeof(int));
-        int *genotypes_count_affected = (int*) calloc (num_alleles * num_alleles, sizeof(int));
-        int *genotypes_count_unaffected = (int*) calloc (num_alleles * num_alleles, sizeof(int));
+        hardy_weinberg_buffer_reserve(0, num_alleles * num_alleles, buffer);
+        int *genotypes_count = buffer->genotypes_count;
+        memset(genotypes_count, 0, num_alleles * num_alleles * sizeof(int));
         
-        // Count over individuals
-        for (int j = 0; j < num_individuals; j++) {
-            int *father_pos = cp_hashtable_get(sample_ids, individuals[j]->id);
-            char *father_sample = strdup(sample_data[*father_pos]);
-            
-            // If alleles can't be read or is missing, go to next individual
-            if (get_alleles(father_sample, gt_position, &father_allele1, &father_allele2)) {
-                free(father_sample);
-                continue;
-            }
-            
-            int cur_pos = father_allele1 * num_alleles + father_allele2;
-            genotypes_count[cur_pos] += 1;
-            if (individuals[j]->condition == AFFECTED) {
-                genotypes_count_affected[cur_pos] += 1;
-            } else {
-                genotypes_count_unaffected[cur_pos] += 1;
+        for (int j = 0; j < num_samples; j++) {
+            // If alleles can't be read or are missing, go to next sample
+            if (!decode_genotype_alleles(sample_data[samples[j]], gt_position, &allele1, &allele2) &&
+                allele1 >= 0 && allele1 < num_alleles && allele2 >= 0 && allele2 < num_alleles) {
+                int cur_pos = (allele1 < allele2) ? allele1 * num_alleles + allele2 : allele2 * num_alleles + allele1;
+                genotypes_count[cur_pos] += 1;
             }
         }
         
-//         // Count over families
-//         family_t *family;
-//         for (int f = 0; f < num_families; f++) {
-//             family = families[f];
-//             individual_t *father = family->father;
-//             individual_t *mother = family->mother;
-//             cp_list *children = family->children;
-// 
-// //           LOG_DEBUG_F("[%d] Checking suitability of family %s\n", tid, family->id);
-//             
-//             if (father == NULL || mother == NULL) {
-//                 continue;
-//             }
-// 
-//             int *father_pos = cp_hashtable_get(sample_ids, father->id);
-//             if (father_pos != NULL) {
-//     //           LOG_DEBUG_F("[%d] Father %s is in position %d\n", tid, father->id, *father_pos);
-//             } else {
-//     //           LOG_DEBUG_F("[%d] Father %s is not positioned\n", tid, father->id);
-//                 continue;
-//             }
-//             
-//             int *mother_pos = cp_hashtable_get(sample_ids, mother->id);
-//             if (mother_pos != NULL) {
-//     //           LOG_DEBUG_F("[%d] Mother %s is in position %d\n", tid, mother->id, *mother_pos);
-//             } else {
-//     //           LOG_DEBUG_F("[%d] Mother %s is not positioned\n", tid, mother->id);
-//                 continue;
-//             }
-//             
-//             char *father_sample = strdup(sample_data[*father_pos]);
-//             char *mother_sample = strdup(sample_data[*mother_pos]);
-//             
-// //           LOG_DEBUG_F("[%d] Samples: Father = %s\tMother = %s\n", tid, father_sample, mother_sample);
-//             
-//             // If any parent's alleles can't be read or is missing, go to next family
-//             if (get_alleles(father_sample, gt_position, &father_allele1, &father_allele2) ||
-//                 get_alleles(mother_sample, gt_position, &mother_allele1, &mother_allele2)) {
-//                 free(father_sample);
-//                 free(mother_sample);
-//                 continue;
-//             }
-//             
-// //           LOG_DEBUG_F("[%d] Alleles: Father = %d/%d\tMother = %d/%d\n", tid, father_allele1, father_allele2, mother_allele1, mother_allele2);
-//             
-//             // We need two genotyped parents, with at least one het
-//             if (father_allele1 == father_allele2 && mother_allele1 == mother_allele2) {
-//                 free(father_sample);
-//                 free(mother_sample);
-//                 continue;
-//             }
-//             
-//             if ((father_allele1 && !father_allele2) || (mother_allele1 && !mother_allele2)) {
-//                 free(father_sample);
-//                 free(mother_sample);
-//                 continue;
-//             }
-// 
-// //           LOG_DEBUG_F("[%d] Proceeding to analyse family %s...\n", tid, family->id);
-// 
-//             
-//             int trA = 0;  // transmitted allele from first het parent
-//             int unA = 0;  // untransmitted allele from first het parent
-//             
-//             int trB = 0;  // transmitted allele from second het parent
-//             int unB = 0;  // untransmitted allele from second het parent
-//             
-//             // Consider all offspring in nuclear family
-//             cp_list_iterator *children_iterator = cp_list_create_iterator(family->children, COLLECTION_LOCK_READ);
-//             individual_t *child = NULL;
-//             while ((child = cp_list_iterator_next(children_iterator)) != NULL) {
-//                 // Only consider affected children
-//                 if (child->condition != AFFECTED) { continue; }
-//                 
-//                 int *child_pos = cp_hashtable_get(sample_ids, child->id);
-//                 if (child_pos != NULL) {
-//         //           LOG_DEBUG_F("[%d] Child %s is in position %d\n", tid, child->id, *child_pos);
-//                 } else {
-//         //           LOG_DEBUG_F("[%d] Child %s is not positioned\n", tid, child->id);
-//                     continue;
-//                 }
-//                 
-//                 char *child_sample = strdup(sample_data[*child_pos]);
-//     //           LOG_DEBUG_F("[%d] Samples: Child = %s\n", tid, child_sample);
-//                 
-//                 // Skip if offspring has missing genotype
-//                 if (get_alleles(child_sample, gt_position, &child_allele1, &child_allele2)) {
-//                     free(child_sample);
-//                     continue;
-//                 }
-//                 
-//                 // Exclude mendelian errors
-//                 char *aux_chromosome = strndup(record->chromosome, record->chromosome_len);
-//                 if (check_mendel(aux_chromosome, father_allele1, father_allele2, mother_allele1, mother_allele2, 
-//                     child_allele1, child_allele2, child->sex)) {
-//                     free(child_sample);
-//                     free(aux_chromosome);
-//                     continue;
-//                 }
-//                 free(aux_chromosome);
-//                 
-//                 
-//                 // We've now established: no missing genotypes
-//                 // and at least one heterozygous parent
-// 
-//                 // Kid is 00
-// 
-//                 if (!child_allele1 && !child_allele2) {
-//                     if ( ( (!father_allele1) && father_allele2 ) && 
-//                         ( (!mother_allele1) && mother_allele2 ) )
-//                     { trA=1; unA=2; trB=1; unB=2; }
-//                     else 
-//                     { trA=1; unA=2; } 
-//                 }
-//                 else if ( (!child_allele1) && child_allele2 )  // Kid is 01
-//                 {
-//                     // het dad
-//                     if (father_allele1 != father_allele2 )
-//                     {
-//                         // het mum
-//                         if ( mother_allele1 != mother_allele2 )
-//                     { trA=1; trB=2; unA=2; unB=1; }
-//                         else if ( !mother_allele1 ) 
-//                     { trA=2; unA=1; }
-//                         else { trA=1; unA=2; }
-//                     }
-//                     else if ( !father_allele1 ) 
-//                     {
-//                         trA=2; unA=1; 
-//                     }           
-//                     else
-//                     {
-//                         trA=1; unA=2;
-//                     }
-//                 }
-//                 else // kid is 1/1
-//                 {
-//                     
-//                     if ( ( (!father_allele1) && father_allele2 ) && 
-//                         ( (!mother_allele1) && mother_allele2 ) )
-//                     { trA=2; unA=1; trB=2; unB=1; }
-//                     else 
-//                     { 
-//                         trA=2; unA=1;
-//                     }
-//                 }
-//                 
-//                 // We have now populated trA (first transmission) 
-//                 // and possibly trB also 
-//                 
-//                 ////////////////////////////////////////
-//                 // Permutation? 50:50 flip (precomputed)
-//                 
-// //                 if (permute) {
-// //                     if (flipA[f])
-// //                     {
-// //                     int t = trA;
-// //                     trA = unA;
-// //                     unA = t;
-// //                     
-// //                     t = trB;
-// //                     trB = unB;
-// //                     unB = t;
-// //                     }
-// //                 }
-//                 
-//                 // Increment transmission counts
-// //                 if (trA==1) { t1++; }
-// //                 if (trB==1) { t1++; }
-// //                 if (trA==2) { t2++; }
-// //                 if (trB==2) { t2++; }
-//                 if (trA==1) { t1++; }
-//                 else if (trA==2) { t2++; }
-//                 
-//                 if (trB==1) { t1++; }
-//                 else if (trB==2) { t2++; }
-//                 
-// //     //           LOG_DEBUG_F("TDT\t%.*s %s : %d %d - %d %d - %d %d - F %d/%d - M %d/%d - C %d/%d\n", 
-// //                             record->id_len, record->id, family->id, trA, unA, trB, unB, t1, t2, 
-// //                             father_allele1, father_allele2, mother_allele1, mother_allele2, child_allele1, child_allele2);
-//                 free(child_sample);
-//                 
-//             } // next offspring in family
-//             
-//             cp_list_iterator_destroy(children_iterator);
-//             free(father_sample);
-//             free(mother_sample);
-//         }  // next nuclear family
-// 
-//         /////////////////////////////
-//         // Finished counting: now compute
-//         // the statistics
-//         
-//         double tdt_chisq = -1;
-//         
-//         // Basic TDT test
-//         if (t1+t2 > 0) {
-//             tdt_chisq = ((double) ((t1-t2) * (t1-t2))) / (t1+t2);
-//         }
-//         
-// //         LOG_DEBUG_F("[%d] before adding %s:%ld\n", tid, record->chromosome, record->position);
-//         result = tdt_result_new(record->chromosome, record->chromosome_len, 
-//                                 record->position, 
-//                                 record->reference, record->reference_len, 
-//                                 record->alternate, record->alternate_len,
-//                                 t1, t2, tdt_chisq);
-//         list_item_t *output_item = list_item_new(tid, 0, result);
-//         list_insert_item(output_item, output_list);
-//         LOG_DEBUG_F("[%d] after adding %.*s:%ld\n", tid, record->chromosome_len, record->chromosome, record->position);
+        int num_genotypes = 0;
+        for (int a = 0; a < num_alleles * num_alleles; a++) {
+            num_genotypes += genotypes_count[a];
+        }
         
-    } // next variant
+        // Test each alternate allele against the rest
+        for (int a = 1; a < num_alleles; a++) {
+            int homozygous = genotypes_count[a * num_alleles + a];
+            int heterozygous = 0;
+            for (int b = 0; b < num_alleles; b++) {
+                if (b != a) {
+                    heterozygous += genotypes_count[(a < b) ? a * num_alleles + b : b * num_alleles + a];
+                }
+            }
+            int homozygous_other = num_genotypes - homozygous - heterozygous;
+            
+            double p_value = hardy_weinberg_exact_test(heterozygous, homozygous, homozygous_other, buffer);
+            hardy_weinberg_result_t *result = hardy_weinberg_result_new(record->chromosome, record->chromosome_len, 
+                                                                        record->position, 
+                                                                        record->id, record->id_len, 
+                                                                        record->reference, record->reference_len, 
+                                                                        record->alternate + alternate_starts[a-1], 
+                                                                        alternate_starts[a] - alternate_starts[a-1] - 1,
+                                                                        homozygous, heterozygous, homozygous_other, p_value);
+            list_item_t *output_item = list_item_new(i, 0, result);
+            list_insert_item(output_item, output_list);
+        }
+    }
 
-    return ret_code;
+    return 0;
 }
 
+double hardy_weinberg_exact_test(int heterozygous, int homozygous1, int homozygous2, hardy_weinberg_buffer_t *buffer) {
+    int homozygous_rare = (homozygous1 < homozygous2) ? homozygous1 : homozygous2;
+    int homozygous_common = (homozygous1 < homozygous2) ? homozygous2 : homozygous1;
+    int rare_copies = 2 * homozygous_rare + heterozygous;
+    int genotypes = heterozygous + homozygous_common + homozygous_rare;
+    if (genotypes == 0) {
+        return 1.0;
+    }
+    
+    hardy_weinberg_buffer_reserve(rare_copies + 1, 0, buffer);
+    double *probabilities = buffer->probabilities;
+    memset(probabilities, 0, (rare_copies + 1) * sizeof(double));
+    
+    // Start at the most likely number of heterozygotes, which has the same parity as the rare allele copies
+    int mid = (int) ((double) rare_copies * (2 * genotypes - rare_copies) / (2 * genotypes));
+    if ((rare_copies & 1) ^ (mid & 1)) {
+        mid++;
+    }
+    
+    probabilities[mid] = 1.0;
+    double sum = 1.0;
+    
+    // Fewer heterozygotes, each pair of them replaced by a homozygote of each allele
+    int curr_homozygous_rare = (rare_copies - mid) / 2;
+    int curr_homozygous_common = genotypes - mid - curr_homozygous_rare;
+    for (int curr_heterozygous = mid; curr_heterozygous > 1; curr_heterozygous -= 2) {
+        probabilities[curr_heterozygous - 2] = probabilities[curr_heterozygous] * curr_heterozygous * (curr_heterozygous - 1.0) /
+                                               (4.0 * (curr_homozygous_rare + 1.0) * (curr_homozygous_common + 1.0));
+        sum += probabilities[curr_heterozygous - 2];
+        curr_homozygous_rare++;
+        curr_homozygous_common++;
+    }
+    
+    // More heterozygotes
+    curr_homozygous_rare = (rare_copies - mid) / 2;
+    curr_homozygous_common = genotypes - mid - curr_homozygous_rare;
+    for (int curr_heterozygous = mid; curr_heterozygous <= rare_copies - 2; curr_heterozygous += 2) {
+        probabilities[curr_heterozygous + 2] = probabilities[curr_heterozygous] * 4.0 * curr_homozygous_rare * curr_homozygous_common /
+                                               ((curr_heterozygous + 2.0) * (curr_heterozygous + 1.0));
+        sum += probabilities[curr_heterozygous + 2];
+        curr_homozygous_rare--;
+        curr_homozygous_common--;
+    }
+    
+    // Add the probabilities of the samples as or less likely than the observed one
+    double p_value = 0.0;
+    for (int h = rare_copies & 1; h <= rare_copies; h += 2) {
+        if (probabilities[h] <= probabilities[heterozygous]) {
+            p_value += probabilities[h];
+        }
+    }
+    p_value /= sum;
+    
+    return (p_value > 1.0) ? 1.0 : p_value;
+}
 
-// tdt_result_t* tdt_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *reference, int reference_len, 
-//                              char *alternate, int alternate_len, double t1, double t2, double chi_square) {
-//     tdt_result_t *result = (tdt_result_t*) malloc (sizeof(tdt_result_t));
-//     
-//     result->chromosome = strndup(chromosome, chromosome_len);
-//     result->position = position;
-//     result->reference = strndup(reference, reference_len);
-//     result->alternate = strndup(alternate, alternate_len);
-//     result->t1 = t1;
-//     result->t2 = t2;
-//     result->odds_ratio = (t2 == 0.0) ? NAN : ((double) t1/t2);
-//     result->chi_square = chi_square;
-//     result->p_value = 1 - gsl_cdf_chisq_P(chi_square, 1);
-//     
-//     return result;
-// }
-// 
-// void tdt_result_free(tdt_result_t* result) {
-//     free(result->chromosome);
-//     free(result->reference);
-//     free(result->alternate);
-//     free(result);
-// }
-
-individual_t **get_founders_from_families(family_t **families, int num_families, int *num_individuals) {
-    individual_t **individuals = (individual_t**) calloc (num_families * 2, sizeof(individual_t*));
-    family_t *family;
-    int cur_ind = 0;
+int *hardy_weinberg_select_samples(individual_t **individuals, int num_samples, int controls_only, int *num_selected) {
+    int *samples = (int*) malloc ((num_samples + 1) * sizeof(int));
+    *num_selected = 0;
     
-    for (int i = 0; i < num_families; i++) {
-        family = families[i];
-        if (family->father) {
-            individuals[cur_ind] = family->father;
-            cur_ind++;
+    for (int i = 0; i < num_samples; i++) {
+        individual_t *individual = individuals[i];
+        if (individual == NULL || individual->father || individual->mother) {
+            continue;
         }
-        if (family->mother) {
-            individuals[cur_ind] = family->mother;
-            cur_ind++;
+        if (controls_only && individual->condition != UNAFFECTED) {
+            continue;
         }
+        samples[*num_selected] = i;
+        (*num_selected)++;
     }
     
-    if (cur_ind < num_families * 2) {
-        individual_t **aux = realloc(individuals, cur_ind * sizeof(individual_t*));
-        if (aux) {
-            individuals = aux;
-        } else {
-            LOG_FATAL("Could not allocate memory for storing individuals to analyze\n");
+    return samples;
+}
+
+
+hardy_weinberg_buffer_t *hardy_weinberg_buffer_new(void) {
+    hardy_weinberg_buffer_t *buffer = (hardy_weinberg_buffer_t*) calloc (1, sizeof(hardy_weinberg_buffer_t));
+    buffer->gt_positions = gt_positions_new();
+    return buffer;
+}
+
+void hardy_weinberg_buffer_free(hardy_weinberg_buffer_t *buffer) {
+    free(buffer->probabilities);
+    free(buffer->genotypes_count);
+    free(buffer->alternate_starts);
+    gt_positions_free(buffer->gt_positions);
+    free(buffer);
+}
+
+static void hardy_weinberg_buffer_reserve(int num_probabilities, int num_genotypes, hardy_weinberg_buffer_t *buffer) {
+    if (num_probabilities > buffer->probabilities_capacity) {
+        buffer->probabilities_capacity = (num_probabilities > 2 * buffer->probabilities_capacity) ? 
+                                         num_probabilities : 2 * buffer->probabilities_capacity;
+        buffer->probabilities = realloc(buffer->probabilities, buffer->probabilities_capacity * sizeof(double));
+    }
+    if (num_genotypes > buffer->genotypes_count_capacity) {
+        buffer->genotypes_count_capacity = num_genotypes;
+        buffer->genotypes_count = realloc(buffer->genotypes_count, buffer->genotypes_count_capacity * sizeof(int));
+    }
+}
+
+/**
+ * Stores where each alternate allele of a variant starts in its ALT column, followed by the end of 
+ * the column plus 1, so the i-th one is as long as alternate_starts[i+1] - alternate_starts[i] - 1.
+ */
+static int hardy_weinberg_split_alternates(vcf_record_t *record, hardy_weinberg_buffer_t *buffer) {
+    int num_alternates = 1;
+    for (int k = 0; k < record->alternate_len; k++) {
+        if (record->alternate[k] == ',') {
+            num_alternates++;
+        }
+    }
+    
+    if (num_alternates + 1 > buffer->alternate_starts_capacity) {
+        buffer->alternate_starts_capacity = 2 * (num_alternates + 1);
+        buffer->alternate_starts = realloc(buffer->alternate_starts, buffer->alternate_starts_capacity * sizeof(int));
+    }
+    
+    int a = 0;
+    buffer->alternate_starts[a++] = 0;
+    for (int k = 0; k < record->alternate_len; k++) {
+        if (record->alternate[k] == ',') {
+            buffer->alternate_starts[a++] = k + 1;
         }
     }
+    buffer->alternate_starts[a] = record->alternate_len + 1;
     
-    return individuals;
+    return num_alternates;
+}
+
+
+hardy_weinberg_result_t* hardy_weinberg_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len, 
+                                                   char *reference, int reference_len, char *alternate, int alternate_len, 
+                                                   int homozygous_alternate, int heterozygous, int homozygous_other, double p_value) {
+    hardy_weinberg_result_t *result = (hardy_weinberg_result_t*) malloc (sizeof(hardy_weinberg_result_t));
+    
+    result->chromosome = strndup(chromosome, chromosome_len);
+    result->position = position;
+    result->id = strndup(id, id_len);
+    result->reference = strndup(reference, reference_len);
+    result->alternate = strndup(alternate, alternate_len);
+    result->homozygous_alternate = homozygous_alternate;
+    result->heterozygous = heterozygous;
+    result->homozygous_other = homozygous_other;
+    
+    int num_genotypes = homozygous_alternate + heterozygous + homozygous_other;
+    if (num_genotypes > 0) {
+        double frequency = (2.0 * homozygous_alternate + heterozygous) / (2.0 * num_genotypes);
+        result->observed_heterozygosity = (double) heterozygous / num_genotypes;
+        result->expected_heterozygosity = 2 * frequency * (1 - frequency);
+    } else {
+        result->observed_heterozygosity = NAN;
+        result->expected_heterozygosity = NAN;
+    }
+    result->p_value = p_value;
+    
+    return result;
+}
+
+void hardy_weinberg_result_free(hardy_weinberg_result_t* result) {
+    free(result->chromosome);
+    free(result->id);
+    free(result->reference);
+    free(result->alternate);
+    free(result);
 }
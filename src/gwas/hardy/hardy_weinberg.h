@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
  * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
  *
  * This file is part of hpg-variant.
@@ -18,30 +18,186 @@
  * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef TRANSMISSION_DISEQUILIBRIUM_TEST_H
-#define TRANSMISSION_DISEQUILIBRIUM_TEST_H
+#ifndef HARDY_WEINBERG_H
+#define HARDY_WEINBERG_H
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <cprops/hashtable.h>
-#include <cprops/linked_list.h>
-#include <gsl/gsl_cdf.h>
 #include <omp.h>
 
+#include <bioformats/family/family.h>
 #include <bioformats/ped/ped_file.h>
 #include <bioformats/ped/ped_file_structure.h>
 #include <bioformats/vcf/vcf_file.h>
 #include <bioformats/vcf/vcf_file_structure.h>
 #include <bioformats/vcf/vcf_util.h>
 #include <commons/log.h>
+#include <commons/string_utils.h>
+#include <commons/argtable/argtable2.h>
+#include <commons/config/libconfig.h>
 #include <containers/list.h>
+#include <containers/khash.h>
+#include <containers/cprops/hashtable.h>
 
-#include "checks_family.h"
+#include "error.h"
+#include "gwas/assoc/genotype_matrix.h"
+#include "hpg_variant_utils.h"
+#include "shared_options.h"
 
-int hardy_weinberg_test(vcf_record_t **variants, int num_variants, individual_t **individuals, int num_individuals, 
-                        cp_hashtable *sample_ids, list_t *output_list);
+/**
+ * Number of options applicable to the Hardy-Weinberg tool.
+ */
+#define NUM_HARDY_OPTIONS  1
+
+
+typedef struct hardy_options {
+    int num_options;
+    
+    struct arg_lit *controls_only;
+} hardy_options_t;
+
+/**
+ * @brief Values for the options of the Hardy-Weinberg tool.
+ */
+typedef struct hardy_options_data {
+    int controls_only; /**< Whether only unaffected founders are tested, instead of all founders */
+} hardy_options_data_t;
+
+static hardy_options_t *new_hardy_cli_options(void);
+
+/**
+ * @brief Initializes a hardy_options_data_t structure from the values of the command-line options.
+ */
+static hardy_options_data_t *new_hardy_options_data(hardy_options_t *options);
+
+/**
+ * @brief Free memory associated to a hardy_options_data_t structure.
+ */
+static void free_hardy_options_data(hardy_options_data_t *options_data);
+
+
+/* **********************************************
+ *                Options parsing               *
+ * **********************************************/
+
+/**
+ * @brief Reads the configuration parameters of the hardy tool.
+ * @param filename file the options data are read from
+ * @param options_data local options values (host URL, species, num-threads...)
+ * @return Zero if the configuration has been successfully read, non-zero otherwise
+ * 
+ * Reads the basic configuration parameters of the tool. If the configuration
+ * file can't be read, these parameters should be provided via the command-line
+ * interface.
+ */
+int read_hardy_configuration(const char *filename, hardy_options_t *hardy_options, shared_options_t *shared_options);
+
+/**
+ * @brief Parses the tool options from the command-line.
+ * @param argc Number of arguments from the command-line
+ * @param argv List of arguments from the command line
+ * @param[out] options_data Struct where the tool-specific options are stored in
+ * @param[out] global_options_data Struct where the application options are stored in
+ * 
+ * Reads the arguments from the command-line, checking they correspond to an option for the 
+ * hardy tool, and stores them in the local or global structure, depending on their scope.
+ */
+void **parse_hardy_options(int argc, char *argv[], hardy_options_t *hardy_options, shared_options_t *shared_options);
+
+void **merge_hardy_options(hardy_options_t *hardy_options, shared_options_t *shared_options, struct arg_end *arg_end);
+
+/**
+ * @brief Checks semantic dependencies among the tool options.
+ * @param global_options_data Application-wide options to check
+ * @param options_data Tool-wide options to check
+ * @return Zero (0) if the options are correct, non-zero otherwise
+ * 
+ * Checks that all dependencies among options are satisfied, i.e.: option A is mandatory, 
+ * option B can't be provided at the same time as option C, and so on.
+ */
+int verify_hardy_options(hardy_options_t *hardy_options, shared_options_t *shared_options);
+
+
+/* **********************************************
+ *                Test execution                *
+ * **********************************************/
+
+/**
+ * @brief Memory reused by a thread between the tests of different variants.
+ */
+typedef struct hardy_weinberg_buffer {
+    double *probabilities;      /**< Probability of each number of heterozygotes. */
+    int probabilities_capacity;
+    int *genotypes_count;       /**< Genotype counts, num_alleles x num_alleles. */
+    int genotypes_count_capacity;
+    int *alternate_starts;      /**< Offset of each alternate allele in the ALT column, and of the end of the column plus 1. */
+    int alternate_starts_capacity;
+    khash_t(gt_positions) *gt_positions;    /**< Position of the GT field in each FORMAT column found. */
+} hardy_weinberg_buffer_t;
+
+typedef struct {
+    char *chromosome;
+    char *id;
+    char *reference;
+    char *alternate;
+    
+    unsigned long int position;
+    
+    int homozygous_alternate;   /**< Samples homozygous for the tested allele. */
+    int heterozygous;           /**< Samples with a single copy of the tested allele. */
+    int homozygous_other;       /**< Samples without the tested allele. */
+    double observed_heterozygosity;
+    double expected_heterozygosity;
+    double p_value;
+} hardy_weinberg_result_t;
+
+hardy_weinberg_buffer_t *hardy_weinberg_buffer_new(void);
+
+void hardy_weinberg_buffer_free(hardy_weinberg_buffer_t *buffer);
+
+/**
+ * @brief Selects the samples whose genotypes are counted: founders, and only unaffected ones if requested.
+ * @param individuals individuals of the PED file, in the same order as the samples of the VCF file
+ * @param num_samples number of samples of the VCF file
+ * @param controls_only whether only unaffected founders are selected
+ * @param[out] num_selected number of samples selected
+ * @return Positions of the selected samples
+ */
+int *hardy_weinberg_select_samples(individual_t **individuals, int num_samples, int controls_only, int *num_selected);
+
+/**
+ * @brief Performs the exact test of Hardy-Weinberg equilibrium of a biallelic site (Wigginton et al, 2005).
+ * @param heterozygous number of heterozygotes
+ * @param homozygous1 number of homozygotes for one allele
+ * @param homozygous2 number of homozygotes for the other allele
+ * @param buffer memory where the probabilities of each number of heterozygotes are stored
+ * @return The probability of a sample as or less likely than the observed one, or 1 without genotypes
+ */
+double hardy_weinberg_exact_test(int heterozygous, int homozygous1, int homozygous2, hardy_weinberg_buffer_t *buffer);
+
+/**
+ * @brief Tests the Hardy-Weinberg equilibrium of a batch of variants.
+ * 
+ * Each alternate allele of a variant is tested against the rest of alleles, so multi-allelic 
+ * variants produce a result per alternate allele. Chromosomes X, Y and MT are not tested.
+ * 
+ * @param variants variants to test
+ * @param num_variants number of variants
+ * @param samples positions of the samples whose genotypes are counted
+ * @param num_samples number of samples
+ * @param buffer memory reused between variants, owned by the calling thread
+ * @param output_list list where the results are inserted
+ * @return Zero if the test was successfully performed, non-zero otherwise
+ */
+int hardy_weinberg_test(vcf_record_t **variants, int num_variants, int *samples, int num_samples, 
+                        hardy_weinberg_buffer_t *buffer, list_t *output_list);
+
+hardy_weinberg_result_t* hardy_weinberg_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len, 
+                                                   char *reference, int reference_len, char *alternate, int alternate_len, 
+                                                   int homozygous_alternate, int heterozygous, int homozygous_other, double p_value);
 
-individual_t **get_founders_from_families(family_t **families, int num_families, int *num_individuals);
+void hardy_weinberg_result_free(hardy_weinberg_result_t *result);
 
-#endif
\ No newline at end of file
+#endif
@@ -22,7 +22,7 @@
 
 int main(int argc, char *argv[]) {
     if (argc == 1 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
-        printf("Usage: %s < assoc | tdt > < tool-options >\nFor more information about a certain tool, type %s tool-name --help\n", argv[0], argv[0]);
+        printf("Usage: %s < assoc | epistasis | hardy | mendel | tdt > < tool-options >\nFor more information about a certain tool, type %s tool-name --help\n", argv[0], argv[0]);
         return 0;
     } else if (!strcmp(argv[1], "--version")) {
         show_version("GWAS");
@@ -45,6 +45,15 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(tool, "tdt") == 0) {
         exit_code = tdt(argc - 1, argv + 1, config);
  
+    } else if (strcmp(tool, "hardy") == 0) {
+        exit_code = hardy(argc - 1, argv + 1, config);
+ 
+    } else if (strcmp(tool, "mendel") == 0) {
+        exit_code = mendel(argc - 1, argv + 1, config);
+ 
+    } else if (strcmp(tool, "epistasis") == 0) {
+        exit_code = epistasis(argc - 1, argv + 1, config);
+ 
     } else {
         fprintf(stderr, "The requested genome-wide analysis tool does not exist! (%s)\n", tool);
         exit_code = NOT_IMPLEMENTED_TOOL;
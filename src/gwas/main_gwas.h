@@ -34,12 +34,21 @@
 
 #include "error.h"
 #include "hpg_variant_utils.h"
+#include "epistasis/epistasis.h"
 #include "gwas/assoc/assoc.h"
+#include "gwas/hardy/hardy_weinberg.h"
+#include "gwas/mendel/mendel.h"
 #include "gwas/tdt/tdt.h"
 
 int association(int argc, char *argv[], const char *configuration_file);
 
 int tdt(int argc, char *argv[], const char *configuration_file);
 
+int hardy(int argc, char *argv[], const char *configuration_file);
+
+int mendel(int argc, char *argv[], const char *configuration_file);
+
+int epistasis(int argc, char *argv[], const char *configuration_file);
+
 
 #endif
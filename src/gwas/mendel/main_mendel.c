@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mendel.h"
+#include "mendel_runner.h"
+
+int mendel(int argc, char *argv[], const char *configuration_file) {
+    
+    /* ******************************
+     *       Modifiable options     *
+     * ******************************/
+
+    shared_options_t *shared_options = new_shared_cli_options(1);
+    mendel_options_t *mendel_options = new_mendel_cli_options();
+
+    // If no arguments or only --help are provided, show usage
+    void **argtable;
+    if (argc == 1 || !strcmp(argv[1], "--help")) {
+        argtable = merge_mendel_options(mendel_options, shared_options, arg_end(mendel_options->num_options + shared_options->num_options));
+        show_usage("hpg-var-gwas mendel", argtable, mendel_options->num_options + shared_options->num_options);
+        arg_freetable(argtable, 28);
+        return 0;
+    }
+
+    /* ******************************
+     *       Execution steps        *
+     * ******************************/
+
+    // Step 1: read options from configuration file
+    int config_errors = read_shared_configuration(configuration_file, shared_options);
+    config_errors &= read_mendel_configuration(configuration_file, mendel_options, shared_options);
+    
+    if (config_errors) {
+        LOG_FATAL("Configuration file read with errors\n");
+        return CANT_READ_CONFIG_FILE;
+    }
+    
+    // Step 2: parse command-line options
+    argtable = parse_mendel_options(argc, argv, mendel_options, shared_options);
+
+    // Step 3: check that all options are set with valid values
+    // Mandatory options that couldn't be read from the config file must be set via command-line
+    // If not, return error code!
+    int check_mendel_opts = verify_mendel_options(mendel_options, shared_options);
+    if (check_mendel_opts > 0) {
+        return check_mendel_opts;
+    }
+    
+    // Step 4: Create XXX_options_data_t structures from valid XXX_options_t
+    shared_options_data_t *shared_options_data = new_shared_options_data(shared_options);
+    mendel_options_data_t *options_data = new_mendel_options_data(mendel_options);
+
+    init_log_custom(shared_options_data->log_level, 1, "hpg-var-gwas.log", "w");
+    
+    // Step 5: Perform the operations related to the selected GWAS sub-tool
+    run_mendel_errors(shared_options_data, options_data);
+    
+    free_mendel_options_data(options_data);
+    free_shared_options_data(shared_options_data);
+    arg_freetable(argtable, 28);
+    free(configuration_file);
+
+    return 0;
+}
+
+mendel_options_t *new_mendel_cli_options(void) {
+    mendel_options_t *options = (mendel_options_t*) malloc (sizeof(mendel_options_t));
+    options->num_options = NUM_MENDEL_OPTIONS;
+    return options;
+}
+
+mendel_options_data_t *new_mendel_options_data(mendel_options_t *options) {
+    mendel_options_data_t *options_data = (mendel_options_data_t*) calloc (1, sizeof(mendel_options_data_t));
+    return options_data;
+}
+
+void free_mendel_options_data(mendel_options_data_t *options_data) {
+    free(options_data);
+}
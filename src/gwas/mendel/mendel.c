@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mendel.h"
+
+
+int mendel_test(vcf_record_t **variants, int num_variants, trio_table_t *trios, int *trio_errors, list_t *output_list) {
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *genotypes = genotype_matrix_new(variants, num_variants, variants[0]->samples->size, gt_positions);
+    int *variant_errors = (int*) malloc (num_variants * sizeof(int));
+    
+    mendel_count_errors(genotypes, variants, trios, variant_errors, trio_errors);
+    
+    for (int i = 0; i < num_variants; i++) {
+        vcf_record_t *record = variants[i];
+        mendel_result_t *result = mendel_result_new(record->chromosome, record->chromosome_len, 
+                                                    record->position, 
+                                                    record->id, record->id_len, 
+                                                    record->reference, record->reference_len, 
+                                                    record->alternate, record->alternate_len,
+                                                    variant_errors[i]);
+        list_item_t *output_item = list_item_new(i, 0, result);
+        list_insert_item(output_item, output_list);
+    }
+    
+    free(variant_errors);
+    genotype_matrix_free(genotypes);
+    gt_positions_free(gt_positions);
+    
+    return 0;
+}
+
+mendel_result_t* mendel_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len, 
+                                   char *reference, int reference_len, char *alternate, int alternate_len, int num_errors) {
+    mendel_result_t *result = (mendel_result_t*) malloc (sizeof(mendel_result_t));
+    
+    result->chromosome = strndup(chromosome, chromosome_len);
+    result->position = position;
+    result->id = strndup(id, id_len);
+    result->reference = strndup(reference, reference_len);
+    result->alternate = strndup(alternate, alternate_len);
+    result->num_errors = num_errors;
+    
+    return result;
+}
+
+void mendel_result_free(mendel_result_t* result) {
+    free(result->chromosome);
+    free(result->id);
+    free(result->reference);
+    free(result->alternate);
+    free(result);
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MENDEL_H
+#define MENDEL_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include <bioformats/family/family.h>
+#include <bioformats/ped/ped_file.h>
+#include <bioformats/ped/ped_file_structure.h>
+#include <bioformats/vcf/vcf_file.h>
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_util.h>
+#include <commons/log.h>
+#include <commons/argtable/argtable2.h>
+#include <commons/config/libconfig.h>
+#include <containers/list.h>
+#include <containers/khash.h>
+#include <containers/cprops/hashtable.h>
+
+#include "error.h"
+#include "gwas/assoc/genotype_matrix.h"
+#include "gwas/mendel_errors.h"
+#include "gwas/trio_table.h"
+#include "hpg_variant_utils.h"
+#include "shared_options.h"
+
+/**
+ * Number of options applicable to the mendel tool.
+ */
+#define NUM_MENDEL_OPTIONS  0
+
+
+typedef struct mendel_options {
+    int num_options;
+} mendel_options_t;
+
+/**
+ * @brief Values for the options of the mendel tool.
+ */
+typedef struct mendel_options_data {
+    int unused;
+} mendel_options_data_t;
+
+static mendel_options_t *new_mendel_cli_options(void);
+
+/**
+ * @brief Initializes a mendel_options_data_t structure from the values of the command-line options.
+ */
+static mendel_options_data_t *new_mendel_options_data(mendel_options_t *options);
+
+/**
+ * @brief Free memory associated to a mendel_options_data_t structure.
+ */
+static void free_mendel_options_data(mendel_options_data_t *options_data);
+
+
+/* **********************************************
+ *                Options parsing               *
+ * **********************************************/
+
+/**
+ * @brief Reads the configuration parameters of the mendel tool.
+ * @param filename file the options data are read from
+ * @param options_data local options values (host URL, species, num-threads...)
+ * @return Zero if the configuration has been successfully read, non-zero otherwise
+ * 
+ * Reads the basic configuration parameters of the tool. If the configuration
+ * file can't be read, these parameters should be provided via the command-line
+ * interface.
+ */
+int read_mendel_configuration(const char *filename, mendel_options_t *mendel_options, shared_options_t *shared_options);
+
+/**
+ * @brief Parses the tool options from the command-line.
+ * @param argc Number of arguments from the command-line
+ * @param argv List of arguments from the command line
+ * @param[out] options_data Struct where the tool-specific options are stored in
+ * @param[out] global_options_data Struct where the application options are stored in
+ * 
+ * Reads the arguments from the command-line, checking they correspond to an option for the 
+ * mendel tool, and stores them in the local or global structure, depending on their scope.
+ */
+void **parse_mendel_options(int argc, char *argv[], mendel_options_t *mendel_options, shared_options_t *shared_options);
+
+void **merge_mendel_options(mendel_options_t *mendel_options, shared_options_t *shared_options, struct arg_end *arg_end);
+
+/**
+ * @brief Checks semantic dependencies among the tool options.
+ * @param global_options_data Application-wide options to check
+ * @param options_data Tool-wide options to check
+ * @return Zero (0) if the options are correct, non-zero otherwise
+ * 
+ * Checks that all dependencies among options are satisfied, i.e.: option A is mandatory, 
+ * option B can't be provided at the same time as option C, and so on.
+ */
+int verify_mendel_options(mendel_options_t *mendel_options, shared_options_t *shared_options);
+
+
+/* **********************************************
+ *                Test execution                *
+ * **********************************************/
+
+typedef struct {
+    char *chromosome;
+    char *id;
+    char *reference;
+    char *alternate;
+    
+    unsigned long int position;
+    
+    int num_errors;
+} mendel_result_t;
+
+/**
+ * @brief Counts the mendelian errors of a batch of variants.
+ * @param variants variants to check
+ * @param num_variants number of variants
+ * @param trios trios the errors are searched in
+ * @param[out] trio_errors errors of each trio, added to the previous value
+ * @param output_list list where a result per variant is inserted
+ * @return Zero if the errors were successfully counted, non-zero otherwise
+ */
+int mendel_test(vcf_record_t **variants, int num_variants, trio_table_t *trios, int *trio_errors, list_t *output_list);
+
+mendel_result_t* mendel_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len, 
+                                   char *reference, int reference_len, char *alternate, int alternate_len, int num_errors);
+
+void mendel_result_free(mendel_result_t *result);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MENDEL_RUNNER_H
+#define MENDEL_RUNNER_H
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include <bioformats/family/family.h>
+#include <bioformats/ped/ped_file.h>
+#include <bioformats/ped/ped_file_structure.h>
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_file.h>
+#include <bioformats/vcf/vcf_filters.h>
+#include <bioformats/vcf/vcf_reader.h>
+#include <bioformats/vcf/vcf_util.h>
+#include <commons/log.h>
+#include <commons/string_utils.h>
+#include <containers/list.h>
+#include <containers/khash.h>
+#include <containers/cprops/hashtable.h>
+
+#include "shared_options.h"
+#include "hpg_variant_utils.h"
+#include "mendel.h"
+
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+
+int run_mendel_errors(shared_options_data_t *global_options_data, mendel_options_data_t *options_data);
+
+
+static void write_output_header(FILE *fd);
+
+static void write_output_body(list_t* output_list, FILE *fd);
+
+static void write_family_output(char *path, trio_table_t *trios, int *trio_errors);
+
+
+#endif
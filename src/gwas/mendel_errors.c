@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mendel_errors.h"
+
+enum inheritance { INHERITANCE_NONE, INHERITANCE_AUTOSOMAL, INHERITANCE_X };
+
+static enum inheritance get_inheritance(vcf_record_t *variant);
+
+static void transpose_genotypes(genotype_matrix_t *genotypes, int num_blocks, uint64_t *low_planes, uint64_t *high_planes);
+
+static uint64_t even_bits(uint64_t word);
+
+static void transpose_bits(uint64_t rows[64]);
+
+static uint64_t mendel_error_mask(uint64_t father_low, uint64_t father_high, uint64_t mother_low, uint64_t mother_high,
+                                  uint64_t child_low, uint64_t child_high, uint64_t haploid);
+
+
+void mendel_count_errors(genotype_matrix_t *genotypes, vcf_record_t **variants, trio_table_t *trios,
+                         int *variant_errors, int *trio_errors) {
+    int num_variants = genotypes->num_variants;
+    int num_blocks = (num_variants + VARIANTS_PER_WORD - 1) / VARIANTS_PER_WORD;
+    if (num_blocks == 0) {
+        return;
+    }
+
+    // Variants whose trios are checked, and those in chromosome X, where male children are haploid
+    uint64_t *checked = (uint64_t*) calloc (num_blocks, sizeof(uint64_t));
+    uint64_t *chromosome_x = (uint64_t*) calloc (num_blocks, sizeof(uint64_t));
+    for (int i = 0; i < num_variants; i++) {
+        variant_errors[i] = 0;
+        enum inheritance inheritance = get_inheritance(variants[i]);
+        if (inheritance != INHERITANCE_NONE) {
+            checked[i / VARIANTS_PER_WORD] |= 1ULL << (i % VARIANTS_PER_WORD);
+        }
+        if (inheritance == INHERITANCE_X) {
+            chromosome_x[i / VARIANTS_PER_WORD] |= 1ULL << (i % VARIANTS_PER_WORD);
+        }
+    }
+
+    // Bit planes of the genotypes of each sample, a word per block of variants
+    uint64_t *low_planes = (uint64_t*) malloc ((size_t) genotypes->num_samples * num_blocks * sizeof(uint64_t));
+    uint64_t *high_planes = (uint64_t*) malloc ((size_t) genotypes->num_samples * num_blocks * sizeof(uint64_t));
+    transpose_genotypes(genotypes, num_blocks, low_planes, high_planes);
+
+    for (int t = 0; t < trios->num_trios; t++) {
+        size_t father = (size_t) trios->fathers[t] * num_blocks;
+        size_t mother = (size_t) trios->mothers[t] * num_blocks;
+        size_t child = (size_t) trios->children[t] * num_blocks;
+        int male = trios->children_sex[t] == MALE;
+
+        for (int b = 0; b < num_blocks; b++) {
+            uint64_t errors = mendel_error_mask(low_planes[father + b], high_planes[father + b],
+                                                low_planes[mother + b], high_planes[mother + b],
+                                                low_planes[child + b], high_planes[child + b],
+                                                male ? chromosome_x[b] : 0) & checked[b];
+            if (trio_errors) {
+                trio_errors[t] += __builtin_popcountll(errors);
+            }
+            while (errors) {
+                variant_errors[b * VARIANTS_PER_WORD + __builtin_ctzll(errors)]++;
+                errors &= errors - 1;
+            }
+        }
+    }
+
+    free(low_planes);
+    free(high_planes);
+    free(checked);
+    free(chromosome_x);
+}
+
+array_list_t *filter_mendel_errors(array_list_t *passed_records, array_list_t *input_records, array_list_t **failed_records,
+                                   trio_table_t *trios, int max_errors) {
+    array_list_t *mendel_passed = array_list_new(passed_records->size + 1, 1, COLLECTION_MODE_ASYNCHRONIZED);
+    if (*failed_records == NULL) {
+        *failed_records = array_list_new(input_records->size + 1, 1, COLLECTION_MODE_ASYNCHRONIZED);
+    }
+
+    if (passed_records->size > 0) {
+        vcf_record_t **records = (vcf_record_t**) passed_records->items;
+        khash_t(gt_positions) *gt_positions = gt_positions_new();
+        genotype_matrix_t *genotypes = genotype_matrix_new(records, passed_records->size, records[0]->samples->size, gt_positions);
+        int *variant_errors = (int*) malloc (passed_records->size * sizeof(int));
+        mendel_count_errors(genotypes, records, trios, variant_errors, NULL);
+
+        for (int i = 0; i < passed_records->size; i++) {
+            array_list_insert(records[i], (variant_errors[i] > max_errors) ? *failed_records : mendel_passed);
+        }
+
+        free(variant_errors);
+        genotype_matrix_free(genotypes);
+        gt_positions_free(gt_positions);
+    }
+
+    // The list of records that passed the previous filters is replaced
+    if (passed_records != input_records) {
+        array_list_free(passed_records, NULL);
+    }
+
+    return mendel_passed;
+}
+
+
+static enum inheritance get_inheritance(vcf_record_t *variant) {
+    if (!strncmp("X", variant->chromosome, variant->chromosome_len)) {
+        return INHERITANCE_X;
+    } else if (!strncmp("Y", variant->chromosome, variant->chromosome_len) ||
+               !strncmp("MT", variant->chromosome, variant->chromosome_len)) {
+        return INHERITANCE_NONE;
+    }
+    return INHERITANCE_AUTOSOMAL;
+}
+
+/**
+ * Transposes the genotypes of each block of VARIANTS_PER_WORD variants, 64 samples at a time: the
+ * genotypes of a variant are split into their low and high bits, and the resulting 64 x 64 bit matrices
+ * are transposed, so each plane holds a bit per variant. Variants past the end of the matrix are
+ * homozygous reference.
+ */
+static void transpose_genotypes(genotype_matrix_t *genotypes, int num_blocks, uint64_t *low_planes, uint64_t *high_planes) {
+    uint64_t low[64], high[64];
+    int words_per_variant = genotypes->words_per_variant;
+
+    for (int b = 0; b < num_blocks; b++) {
+        for (int first_sample = 0; first_sample < genotypes->num_samples; first_sample += 64) {
+            int w = first_sample / GENOTYPES_PER_WORD;
+
+            for (int v = 0; v < 64; v++) {
+                int variant = b * VARIANTS_PER_WORD + v;
+                if (variant >= genotypes->num_variants) {
+                    low[v] = high[v] = 0;
+                    continue;
+                }
+
+                const uint64_t *row = genotypes->genotypes + (size_t) variant * words_per_variant;
+                uint64_t first = row[w];
+                uint64_t second = (w + 1 < words_per_variant) ? row[w + 1] : 0;
+                low[v] = even_bits(first) | (even_bits(second) << 32);
+                high[v] = even_bits(first >> 1) | (even_bits(second >> 1) << 32);
+            }
+
+            transpose_bits(low);
+            transpose_bits(high);
+
+            int num_samples = (genotypes->num_samples - first_sample < 64) ? genotypes->num_samples - first_sample : 64;
+            for (int s = 0; s < num_samples; s++) {
+                low_planes[(size_t) (first_sample + s) * num_blocks + b] = low[s];
+                high_planes[(size_t) (first_sample + s) * num_blocks + b] = high[s];
+            }
+        }
+    }
+}
+
+/**
+ * Packs the even bits of a word into its lower 32 bits.
+ */
+static uint64_t even_bits(uint64_t word) {
+    word &= 0x5555555555555555ULL;
+    word = (word | (word >> 1)) & 0x3333333333333333ULL;
+    word = (word | (word >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    word = (word | (word >> 4)) & 0x00FF00FF00FF00FFULL;
+    word = (word | (word >> 8)) & 0x0000FFFF0000FFFFULL;
+    word = (word | (word >> 16)) & 0x00000000FFFFFFFFULL;
+    return word;
+}
+
+/**
+ * Transposes a 64 x 64 bit matrix, whose row i holds column j in bit j, swapping blocks of halving size.
+ */
+static void transpose_bits(uint64_t rows[64]) {
+    uint64_t mask = 0x00000000FFFFFFFFULL;
+    for (int width = 32; width > 0; width >>= 1, mask ^= mask << width) {
+        for (int i = 0; i < 64; i = (i + width + 1) & ~width) {
+            uint64_t swap = ((rows[i] >> width) ^ rows[i + width]) & mask;
+            rows[i] ^= swap << width;
+            rows[i + width] ^= swap;
+        }
+    }
+}
+
+/**
+ * Genotype codes are homozygous reference (00), heterozygous (01), homozygous alternate (10) and
+ * missing (11), written as high and low bit. A parent can transmit the reference allele unless it is
+ * homozygous alternate, and the alternate allele if it is heterozygous or homozygous alternate.
+ */
+static uint64_t mendel_error_mask(uint64_t father_low, uint64_t father_high, uint64_t mother_low, uint64_t mother_high,
+                                  uint64_t child_low, uint64_t child_high, uint64_t haploid) {
+    uint64_t father_reference = ~father_high;
+    uint64_t father_alternate = father_low ^ father_high;
+    uint64_t mother_reference = ~mother_high;
+    uint64_t mother_alternate = mother_low ^ mother_high;
+
+    uint64_t child_reference = ~child_low & ~child_high;
+    uint64_t child_heterozygous = child_low & ~child_high;
+    uint64_t child_alternate = ~child_low & child_high;
+
+    uint64_t diploid = (child_reference & father_reference & mother_reference) |
+                       (child_alternate & father_alternate & mother_alternate) |
+                       (child_heterozygous & ((father_reference & mother_alternate) | (father_alternate & mother_reference)));
+    uint64_t monoploid = (child_reference & mother_reference) | (child_alternate & mother_alternate);
+    uint64_t consistent = (diploid & ~haploid) | (monoploid & haploid);
+
+    uint64_t missing = (father_low & father_high) | (mother_low & mother_high) | (child_low & child_high) |
+                       (child_heterozygous & haploid);
+
+    return ~missing & ~consistent;
+}
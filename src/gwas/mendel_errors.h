@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GWAS_MENDEL_ERRORS_H
+#define GWAS_MENDEL_ERRORS_H
+
+/**
+ * @file mendel_errors.h
+ * @brief Detection of mendelian inconsistencies in the trios of a pedigree
+ *
+ * The packed genotypes of each sample are transposed, with word-level shifts and masks, into bit planes
+ * (the low and high bit of each genotype code) of VARIANTS_PER_WORD variants, so a single sequence of
+ * bitwise operations checks a trio in all of them at once.
+ *
+ * Autosomes are checked as diploid. In chromosome X, male children receive their only copy from the
+ * mother, and their heterozygous genotypes are considered missing. Chromosomes Y and MT are not checked.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <containers/array_list.h>
+
+#include "gwas/assoc/genotype_matrix.h"
+#include "gwas/trio_table.h"
+
+/**
+ * Variants checked together, one per bit of a word.
+ */
+#define VARIANTS_PER_WORD   64
+
+
+/**
+ * @brief Counts the mendelian errors in the trios of each variant of a matrix of genotypes.
+ * @param genotypes genotypes of the variants
+ * @param variants variants, whose chromosomes define how alleles are inherited
+ * @param trios trios to check
+ * @param[out] variant_errors errors found in each variant
+ * @param[out] trio_errors errors of each trio, added to the previous value, or NULL if not needed
+ */
+void mendel_count_errors(genotype_matrix_t *genotypes, vcf_record_t **variants, trio_table_t *trios,
+                         int *variant_errors, int *trio_errors);
+
+/**
+ * @brief Moves the records with too many mendelian errors to the list of failed records.
+ * @param passed_records records that passed the previous filters
+ * @param input_records all the records of the batch
+ * @param[in,out] failed_records records that failed the previous filters, created if NULL
+ * @param trios trios to check
+ * @param max_errors maximum errors allowed in a variant
+ * @return The records with at most max_errors errors
+ */
+array_list_t *filter_mendel_errors(array_list_t *passed_records, array_list_t *input_records, array_list_t **failed_records,
+                                   trio_table_t *trios, int max_errors);
+
+#endif
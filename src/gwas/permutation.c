@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "permutation.h"
+
+static permutation_set_t *permutation_set_new(int num_units, int num_permutations, int num_threads);
+
+static uint64_t block_seed(int first);
+
+static uint64_t next_random(uint64_t *state);
+
+static uint64_t spread_bits(uint64_t bits);
+
+static int compare_doubles(const void *a, const void *b);
+
+
+permutation_set_t *permutation_set_new_conditions(individual_t **samples, int num_samples, int num_permutations, int num_threads) {
+    permutation_set_t *permutations = permutation_set_new(num_samples, num_permutations, num_threads);
+
+    // Only samples with a known condition are permuted
+    permutations->phenotyped = (int*) malloc ((num_samples > 0 ? num_samples : 1) * sizeof(int));
+    for (int j = 0; j < num_samples; j++) {
+        if (samples[j] && (samples[j]->condition == AFFECTED || samples[j]->condition == UNAFFECTED)) {
+            permutations->phenotyped[permutations->num_phenotyped++] = j;
+            if (samples[j]->condition == AFFECTED) {
+                permutations->num_cases++;
+            }
+        }
+    }
+
+    return permutations;
+}
+
+permutation_set_t *permutation_set_new_flips(int num_families, int num_permutations, int num_threads) {
+    return permutation_set_new(num_families, num_permutations, num_threads);
+}
+
+void permutation_set_free(permutation_set_t *permutations) {
+    free(permutations->phenotyped);
+    free(permutations->max_statistics);
+    omp_destroy_lock(&(permutations->lock));
+    free(permutations);
+}
+
+int permutation_threads_per_batch(int num_permutations, int num_threads) {
+    int num_blocks = (num_permutations + PERMUTATIONS_PER_BLOCK - 1) / PERMUTATIONS_PER_BLOCK;
+    int threads = (num_blocks < num_threads) ? num_blocks : num_threads;
+    return (threads > 0) ? threads : 1;
+}
+
+void permutation_set_generate(int first, int count, uint64_t *rows, permutation_set_t *permutations) {
+    assert(first % PERMUTATIONS_PER_BLOCK == 0);
+    int num_words = permutations->words_per_permutation;
+    uint64_t state = block_seed(first);
+    memset(rows, 0, (size_t) count * num_words * sizeof(uint64_t));
+
+    if (!permutations->phenotyped) {
+        uint64_t tail = (permutations->num_units % 64) ? (1ULL << (permutations->num_units % 64)) - 1 : ~0ULL;
+        for (int p = 0; p < count; p++) {
+            uint64_t *row = rows + (size_t) p * num_words;
+            for (int w = 0; w < num_words; w++) {
+                row[w] = next_random(&state);
+            }
+            if (num_words > 0) {
+                row[num_words - 1] &= tail;
+            }
+        }
+        return;
+    }
+
+    // Choose the cases of each permutation with a partial Fisher-Yates shuffle, which goes on from the 
+    // previous permutation of the block
+    int num_phenotyped = permutations->num_phenotyped;
+    int *phenotyped = (int*) malloc ((num_phenotyped > 0 ? num_phenotyped : 1) * sizeof(int));
+    memcpy(phenotyped, permutations->phenotyped, num_phenotyped * sizeof(int));
+    for (int p = 0; p < count; p++) {
+        uint64_t *row = rows + (size_t) p * num_words;
+        for (int k = 0; k < permutations->num_cases; k++) {
+            int chosen = k + (int) (((next_random(&state) >> 32) * (num_phenotyped - k)) >> 32);
+            int sample = phenotyped[chosen];
+            phenotyped[chosen] = phenotyped[k];
+            phenotyped[k] = sample;
+            row[sample / 64] |= 1ULL << (sample % 64);
+        }
+    }
+    free(phenotyped);
+}
+
+void permutation_set_expand(int first, int count, int words_per_mask, uint64_t *masks, permutation_set_t *permutations) {
+    int num_words = permutations->words_per_permutation;
+    uint64_t *rows = (uint64_t*) malloc (((size_t) count * num_words + 1) * sizeof(uint64_t));
+    permutation_set_generate(first, count, rows, permutations);
+
+    for (int p = 0; p < count; p++) {
+        uint64_t *row = rows + (size_t) p * num_words;
+        uint64_t *mask = masks + (size_t) p * words_per_mask;
+        for (int w = 0; w < words_per_mask; w++) {
+            // Each word of the mask holds 32 units, half a word of the row
+            int source = w / 2;
+            uint64_t bits = (source < num_words) ? row[source] : 0;
+            mask[w] = spread_bits((w % 2) ? bits >> 32 : bits & 0xFFFFFFFFULL);
+        }
+    }
+    free(rows);
+}
+
+void permutation_set_update_max(const double *max_statistics, permutation_set_t *permutations) {
+    omp_set_lock(&(permutations->lock));
+    for (int p = 0; p < permutations->num_permutations; p++) {
+        if (max_statistics[p] > permutations->max_statistics[p]) {
+            permutations->max_statistics[p] = max_statistics[p];
+        }
+    }
+    omp_unset_lock(&(permutations->lock));
+}
+
+void permutation_set_finish(permutation_set_t *permutations) {
+    qsort(permutations->max_statistics, permutations->num_permutations, sizeof(double), compare_doubles);
+}
+
+double permutation_empirical_p_value(int exceeded, permutation_set_t *permutations) {
+    return (exceeded + 1.0) / (permutations->num_permutations + 1.0);
+}
+
+double permutation_corrected_p_value(double statistic, permutation_set_t *permutations) {
+    if (isnan(statistic)) {
+        return NAN;
+    }
+
+    // Binary search of the first maximum that reaches the statistic
+    double threshold = statistic - PERMUTATION_EPSILON;
+    int low = 0, high = permutations->num_permutations;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (permutations->max_statistics[middle] < threshold) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return (permutations->num_permutations - low + 1.0) / (permutations->num_permutations + 1.0);
+}
+
+
+/* ***********************
+ *  Permutation reports  *
+ * ***********************/
+
+permutation_report_t *permutation_report_new(void) {
+    permutation_report_t *report = (permutation_report_t*) malloc (sizeof(permutation_report_t));
+    report->size = 0;
+    report->capacity = 1024;
+    report->records = (permutation_record_t*) malloc (report->capacity * sizeof(permutation_record_t));
+    return report;
+}
+
+void permutation_report_free(permutation_report_t *report) {
+    for (size_t i = 0; i < report->size; i++) {
+        free(report->records[i].chromosome);
+        free(report->records[i].id);
+    }
+    free(report->records);
+    free(report);
+}
+
+void permutation_report_add(char *chromosome, unsigned long int position, char *id, double statistic, int exceeded,
+                            permutation_report_t *report) {
+    if (report->size == report->capacity) {
+        report->capacity *= 2;
+        report->records = realloc(report->records, report->capacity * sizeof(permutation_record_t));
+    }
+
+    permutation_record_t *record = &(report->records[report->size++]);
+    record->chromosome = strdup(chromosome);
+    record->position = position;
+    record->id = strdup(id);
+    record->statistic = statistic;
+    record->exceeded = exceeded;
+}
+
+void write_permutation_report(FILE *fd, permutation_report_t *report, permutation_set_t *permutations) {
+    fprintf(fd, "#CHR         POS               ID            EMP1            EMP2\n");
+    for (size_t i = 0; i < report->size; i++) {
+        permutation_record_t *record = &(report->records[i]);
+        double emp1 = isnan(record->statistic) ? NAN : permutation_empirical_p_value(record->exceeded, permutations);
+        double emp2 = permutation_corrected_p_value(record->statistic, permutations);
+        fprintf(fd, "%s\t%8ld\t%s\t%6f\t%6f\n", record->chromosome, record->position, record->id, emp1, emp2);
+    }
+}
+
+
+/* ***********************
+ *       Auxiliary       *
+ * ***********************/
+
+static permutation_set_t *permutation_set_new(int num_units, int num_permutations, int num_threads) {
+    permutation_set_t *permutations = (permutation_set_t*) calloc (1, sizeof(permutation_set_t));
+    permutations->num_permutations = num_permutations;
+    permutations->num_units = num_units;
+    permutations->words_per_permutation = (num_units + 63) / 64;
+    permutations->num_threads = (num_threads > 0) ? num_threads : 1;
+    permutations->max_statistics = (double*) calloc (num_permutations > 0 ? num_permutations : 1, sizeof(double));
+    omp_init_lock(&(permutations->lock));
+    return permutations;
+}
+
+/**
+ * Seed of the block of permutations starting at a given one, mixed with splitmix64 so the 
+ * sequences of consecutive blocks are not correlated.
+ */
+static uint64_t block_seed(int first) {
+    uint64_t z = PERMUTATION_SEED + (uint64_t) (first / PERMUTATIONS_PER_BLOCK + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z ? z : PERMUTATION_SEED;
+}
+
+/**
+ * xorshift64* generator, good enough to draw permutations and much faster than rand().
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Moves bit i of the lower 32 bits to bit 2i.
+ */
+static uint64_t spread_bits(uint64_t bits) {
+    bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFULL;
+    bits = (bits | (bits << 8))  & 0x00FF00FF00FF00FFULL;
+    bits = (bits | (bits << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+    bits = (bits | (bits << 2))  & 0x3333333333333333ULL;
+    bits = (bits | (bits << 1))  & 0x5555555555555555ULL;
+    return bits;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *((const double*) a), y = *((const double*) b);
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GWAS_PERMUTATION_H
+#define GWAS_PERMUTATION_H
+
+/**
+ * @file permutation.h
+ * @brief Max(T) permutation testing shared by the association and TDT tests
+ *
+ * Every permutation is a row of bits, one per permuted unit: whether each sample is a case in the
+ * association test, or whether the transmissions of each family are flipped in the TDT. The same
+ * permutations are applied to all variants, so the maximum statistic of each permutation over
+ * the whole file gives family-wise corrected p-values (EMP2), besides the empirical ones (EMP1).
+ *
+ * Permutations are evaluated in blocks of PERMUTATIONS_PER_BLOCK for all the variants of a batch,
+ * so the genotypes of a variant are read once per block and the block stays in cache. Blocks are not
+ * stored but generated again from their own seed whenever they are evaluated, so memory doesn't grow
+ * with the number of permutations, and the blocks of a batch are shared among several threads.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include <bioformats/family/family.h>
+
+/**
+ * Permutations evaluated together over the variants of a batch.
+ */
+#define PERMUTATIONS_PER_BLOCK  64
+
+/**
+ * Seed of the permutations, so that runs with the same input are reproducible.
+ */
+#define PERMUTATION_SEED        20130101ULL
+
+/**
+ * Tolerance when comparing a permuted statistic against the observed one. Statistics based on p-values 
+ * are -log10(p), so it is a relative tolerance of those p-values.
+ */
+#define PERMUTATION_EPSILON     1e-8
+
+typedef struct permutation_set {
+    int num_permutations;
+    int num_units;                  /**< Samples or families permuted. */
+    int words_per_permutation;      /**< Words of a row, with one bit per unit. */
+    int num_threads;                /**< Threads sharing the blocks of permutations of every batch. */
+
+    int *phenotyped;                /**< Units whose condition is permuted, NULL if the units are flipped instead. */
+    int num_phenotyped;
+    int num_cases;                  /**< Units that are cases in every permutation of the conditions. */
+
+    double *max_statistics;         /**< Maximum statistic of each permutation over the variants tested. */
+    omp_lock_t lock;
+} permutation_set_t;
+
+/**
+ * @brief Permutation results of a variant, needed to write its empirical p-values.
+ */
+typedef struct permutation_record {
+    char *chromosome;
+    char *id;
+    unsigned long int position;
+    double statistic;               /**< Observed statistic, NAN if it could not be computed. */
+    int exceeded;                   /**< Permutations whose statistic reached the observed one. */
+} permutation_record_t;
+
+/**
+ * @brief Permutation results of all the variants of a file, in the order they were written.
+ */
+typedef struct permutation_report {
+    permutation_record_t *records;
+    size_t size;
+    size_t capacity;
+} permutation_report_t;
+
+
+/**
+ * @brief Creates permutations of the condition of the samples.
+ *
+ * Conditions are shuffled among the samples that are either affected or unaffected, so each
+ * permutation has as many cases as the original data. A bit is set for every permuted case.
+ *
+ * @param samples samples sorted as in the VCF file, may contain NULL
+ * @param num_samples number of samples
+ * @param num_permutations number of permutations
+ * @param num_threads threads sharing the blocks of permutations of every batch
+ */
+permutation_set_t *permutation_set_new_conditions(individual_t **samples, int num_samples, int num_permutations, int num_threads);
+
+/**
+ * @brief Creates permutations that flip the transmissions of each family with probability 1/2.
+ */
+permutation_set_t *permutation_set_new_flips(int num_families, int num_permutations, int num_threads);
+
+void permutation_set_free(permutation_set_t *permutations);
+
+/**
+ * @brief Returns how many of the threads of a run evaluate the permutations of every batch.
+ * 
+ * There must be at least one block of permutations for each of those threads. The rest of threads 
+ * are used to process several batches at the same time.
+ */
+int permutation_threads_per_batch(int num_permutations, int num_threads);
+
+/**
+ * @brief Generates the rows of bits of a block of permutations, which are the same every time.
+ * @param first first permutation of the block, a multiple of PERMUTATIONS_PER_BLOCK
+ * @param count permutations in the block
+ * @param[out] rows count rows of words_per_permutation words
+ */
+void permutation_set_generate(int first, int count, uint64_t *rows, permutation_set_t *permutations);
+
+/**
+ * @brief Expands a block of permutations into masks with 2 bits per unit, the layout of a genotype row.
+ * @param first first permutation of the block, a multiple of PERMUTATIONS_PER_BLOCK
+ * @param count permutations in the block
+ * @param words_per_mask words of each mask
+ * @param[out] masks count masks of words_per_mask words
+ */
+void permutation_set_expand(int first, int count, int words_per_mask, uint64_t *masks, permutation_set_t *permutations);
+
+/**
+ * @brief Updates the maximum statistic of each permutation with those of a batch of variants.
+ * @param max_statistics maximum statistic of each permutation in the batch
+ */
+void permutation_set_update_max(const double *max_statistics, permutation_set_t *permutations);
+
+/**
+ * @brief Sorts the maximum statistics, once all variants have been tested, so corrected p-values can be computed.
+ */
+void permutation_set_finish(permutation_set_t *permutations);
+
+/**
+ * @brief Returns the proportion of permutations whose statistic reached the observed one in a variant (EMP1).
+ */
+double permutation_empirical_p_value(int exceeded, permutation_set_t *permutations);
+
+/**
+ * @brief Returns the proportion of permutations whose maximum statistic reached a given one (EMP2).
+ * @pre permutation_set_finish must have been called
+ */
+double permutation_corrected_p_value(double statistic, permutation_set_t *permutations);
+
+
+/**
+ * @brief Creates an empty permutation report.
+ */
+permutation_report_t *permutation_report_new(void);
+
+void permutation_report_free(permutation_report_t *report);
+
+/**
+ * @brief Appends the permutation results of a variant.
+ */
+void permutation_report_add(char *chromosome, unsigned long int position, char *id, double statistic, int exceeded,
+                            permutation_report_t *report);
+
+/**
+ * @brief Writes the empirical and corrected p-values of each variant of a report.
+ * @pre permutation_set_finish must have been called
+ */
+void write_permutation_report(FILE *fd, permutation_report_t *report, permutation_set_t *permutations);
+
+#endif
@@ -35,7 +35,7 @@ int tdt(int argc, char *argv[], const char *configuration_file) {
     if (argc == 1 || !strcmp(argv[1], "--help")) {
         argtable = merge_tdt_options(tdt_options, shared_options, arg_end(tdt_options->num_options + shared_options->num_options));
         show_usage("hpg-var-gwas tdt", argtable, tdt_options->num_options + shared_options->num_options);
-        arg_freetable(argtable, 28);
+        arg_freetable(argtable, 30);
         return 0;
     }
 
@@ -66,17 +66,16 @@ int tdt(int argc, char *argv[], const char *configuration_file) {
     
     // Step 4: Create XXX_options_data_t structures from valid XXX_options_t
     shared_options_data_t *shared_options_data = new_shared_options_data(shared_options);
-//     tdt_options_data_t *options_data = new_tdt_options_data(tdt_options);
+    tdt_options_data_t *options_data = new_tdt_options_data(tdt_options);
 
     init_log_custom(shared_options_data->log_level, 1, "hpg-var-gwas.log", "w");
     
     // Step 5: Perform the operations related to the selected GWAS sub-tool
-//     run_tdt_test(shared_options_data, options_data);
-    run_tdt_test(shared_options_data);
+    run_tdt_test(shared_options_data, options_data);
     
-//     free_tdt_options_data(options_data);
+    free_tdt_options_data(options_data);
     free_shared_options_data(shared_options_data);
-    arg_freetable(argtable, 28);
+    arg_freetable(argtable, 30);
     free(configuration_file);
 
     return 0;
@@ -85,5 +84,18 @@ int tdt(int argc, char *argv[], const char *configuration_file) {
 tdt_options_t *new_tdt_cli_options(void) {
     tdt_options_t *options = (tdt_options_t*) malloc (sizeof(tdt_options_t));
     options->num_options = NUM_TDT_OPTIONS;
+    options->permutations = arg_int0(NULL, "perm", NULL, "Number of permutations for empirical and max(T) corrected p-values");
+    options->max_mendel_errors = arg_int0(NULL, "max-mendel-errors", NULL, "Maximum number of mendelian errors allowed in a variant");
     return options;
 }
+
+tdt_options_data_t *new_tdt_options_data(tdt_options_t *options) {
+    tdt_options_data_t *options_data = (tdt_options_data_t*) calloc (1, sizeof(tdt_options_data_t));
+    options_data->num_permutations = (options->permutations->count > 0) ? *(options->permutations->ival) : 0;
+    options_data->max_mendel_errors = (options->max_mendel_errors->count > 0) ? *(options->max_mendel_errors->ival) : -1;
+    return options_data;
+}
+
+void free_tdt_options_data(tdt_options_data_t *options_data) {
+    free(options_data);
+}
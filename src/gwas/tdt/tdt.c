@@ -20,253 +20,281 @@
 
 #include "tdt.h"
 
-int tdt_test(vcf_record_t **variants, int num_variants, family_t **families, int num_families, khash_t(ids) *sample_ids, list_t *output_list) {
+/**
+ * Genotype combinations of a trio: the codes of the father, mother and child, 2 bits each.
+ */
+#define TDT_GENOTYPE_COMBINATIONS   64
+
+/**
+ * Transmissions of the first and second allele counted for a trio.
+ */
+typedef struct {
+    unsigned char t1;
+    unsigned char t2;
+} tdt_transmissions_t;
+
+static void tdt_transmissions_init(char *chromosome, tdt_transmissions_t table[][TDT_GENOTYPE_COMBINATIONS]);
+
+static void tdt_permutation_test(tdt_result_t **results, int *balances, int num_variants, int num_families, 
+                                 permutation_set_t *permutations);
+
+
+int tdt_test(vcf_record_t **variants, int num_variants, trio_table_t *trios, permutation_set_t *permutations, list_t *output_list) {
     double start = omp_get_wtime();
     
     int ret_code = 0;
     int tid = omp_get_thread_num();
+    int num_families = trios->num_families;
+    
+    // Decode the genotypes of the whole batch once, with a row per alternate allele
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *genotypes = genotype_matrix_new_split(variants, num_variants, variants[0]->samples->size, gt_positions);
+    int num_rows = genotypes->num_variants;
     
-    tdt_result_t *result;
-    char **sample_data;
+    // Transmissions of every trio genotype, by sex of the child, for the chromosome of the current variant
+    tdt_transmissions_t transmissions[UNKNOWN_SEX + 1][TDT_GENOTYPE_COMBINATIONS];
+    char *chromosome = NULL;
     
-    int gt_position;
-    int father_allele1, father_allele2;
-    int mother_allele1, mother_allele2;
-    int child_allele1, child_allele2;
+    // Results are inserted once the permutations of the whole batch have been evaluated
+    tdt_result_t **results = (tdt_result_t**) malloc (num_rows * sizeof(tdt_result_t*));
+    
+    // Difference between the transmissions of the first and second allele in each family and variant
+    int *balances = permutations ? (int*) calloc ((size_t) num_rows * num_families, sizeof(int)) : NULL;
 
     ///////////////////////////////////
     // Perform analysis for each variant
 
     vcf_record_t *record;
-    for (int i = 0; i < num_variants; i++) {
-        record = variants[i];
+    for (int i = 0; i < num_rows; i++) {
+        genotype_row_t *row = genotypes->rows + i;
+        record = variants[row->variant];
         LOG_DEBUG_F("[%d] Checking variant %.*s:%ld\n", tid, record->chromosome_len, record->chromosome, record->position);
         
-        sample_data = (char**) record->samples->items;
-        char *format_dup = strndup(record->format, record->format_len);
-        gt_position = get_field_position_in_format("GT", format_dup);
-        free(format_dup);
+        // Mendelian errors depend on the chromosome, which rarely changes inside a batch
+        if (!chromosome || strlen(chromosome) != record->chromosome_len || 
+            strncmp(chromosome, record->chromosome, record->chromosome_len)) {
+            free(chromosome);
+            chromosome = strndup(record->chromosome, record->chromosome_len);
+            tdt_transmissions_init(chromosome, transmissions);
+        }
         
         // Transmission counts
         int t1 = 0;
         int t2 = 0;
         
-        
-        // Count over families
-        family_t *family;
+        // Count over families, whose transmissions are flipped together by the permutations
         for (int f = 0; f < num_families; f++) {
-            family = families[f];
-            individual_t *father = family->father;
-            individual_t *mother = family->mother;
-
-//           LOG_DEBUG_F("[%d] Checking suitability of family %s\n", tid, family->id);
+            int family_t1 = 0, family_t2 = 0;
             
-            if (father == NULL || mother == NULL) {
-                continue;
+            for (int t = trios->family_starts[f]; t < trios->family_starts[f+1]; t++) {
+                int combination = (genotype_matrix_get(genotypes, i, trios->fathers[t]) << 4) |
+                                  (genotype_matrix_get(genotypes, i, trios->mothers[t]) << 2) |
+                                   genotype_matrix_get(genotypes, i, trios->children[t]);
+                tdt_transmissions_t trio = transmissions[trios->children_sex[t]][combination];
+                family_t1 += trio.t1;
+                family_t2 += trio.t2;
             }
             
-            int father_pos = -1, mother_pos = -1, child_pos = -1;
-            
-            khiter_t iter = kh_get(ids, sample_ids, father->id);
-            if (iter != kh_end(sample_ids)) {
-                father_pos = kh_value(sample_ids, iter);
-            } else {
-                continue;
+            t1 += family_t1;
+            t2 += family_t2;
+            if (balances) {
+                balances[(size_t) i * num_families + f] = family_t1 - family_t2;
             }
-            
-            iter = kh_get(ids, sample_ids, mother->id);
-            if (iter != kh_end(sample_ids)) {
-                mother_pos = kh_value(sample_ids, iter);
-            } else {
+        }  // next nuclear family
+
+        /////////////////////////////
+        // Finished counting: now compute
+        // the statistics
+        
+        double tdt_chisq = -1;
+        
+        // Basic TDT test
+        if (t1+t2 > 0) {
+            tdt_chisq = ((double) ((t1-t2) * (t1-t2))) / (t1+t2);
+        }
+        
+        results[i] = tdt_result_new(record->chromosome, record->chromosome_len, 
+                                    record->position, record->id, record->id_len,
+                                    record->reference, record->reference_len, 
+                                    row->alternate, row->alternate_len,
+                                    t1, t2, tdt_chisq);
+        
+    } // next variant
+    
+    if (permutations) {
+        tdt_permutation_test(results, balances, num_rows, num_families, permutations);
+    }
+    
+    for (int i = 0; i < num_rows; i++) {
+        list_item_t *output_item = list_item_new(tid, 0, results[i]);
+        list_insert_item(output_item, output_list);
+    }
+    
+    free(chromosome);
+    free(balances);
+    free(results);
+    genotype_matrix_free(genotypes);
+    gt_positions_free(gt_positions);
+
+    double end = omp_get_wtime();
+    
+    return ret_code;
+}
+
+/**
+ * Fills the transmissions counted for each combination of genotypes of a trio and sex of the child.
+ * 
+ * Trios need both parents genotyped and at least one of them heterozygous, a genotyped child and 
+ * no mendelian errors; otherwise nothing is transmitted. When both parents are heterozygous, each 
+ * of them transmits an allele.
+ */
+static void tdt_transmissions_init(char *chromosome, tdt_transmissions_t table[][TDT_GENOTYPE_COMBINATIONS]) {
+    memset(table, 0, (UNKNOWN_SEX + 1) * TDT_GENOTYPE_COMBINATIONS * sizeof(tdt_transmissions_t));
+    
+    for (int father = GENOTYPE_HOM_REF; father <= GENOTYPE_HOM_ALT; father++) {
+        for (int mother = GENOTYPE_HOM_REF; mother <= GENOTYPE_HOM_ALT; mother++) {
+            if (father != GENOTYPE_HET && mother != GENOTYPE_HET) {
                 continue;
             }
             
-            char *father_sample = strdup(sample_data[father_pos]);
-            char *mother_sample = strdup(sample_data[mother_pos]);
-            
-//           LOG_DEBUG_F("[%d] Samples: Father = %s\tMother = %s\n", tid, father_sample, mother_sample);
-            
-            // If any parent's alleles can't be read or is missing, go to next family
-            if (get_alleles(father_sample, gt_position, &father_allele1, &father_allele2) ||
-                get_alleles(mother_sample, gt_position, &mother_allele1, &mother_allele2)) {
-                free(father_sample);
-                free(mother_sample);
-                continue;
+            for (int child = GENOTYPE_HOM_REF; child <= GENOTYPE_HOM_ALT; child++) {
+                int t1 = 0, t2 = 0;
+                if (child == GENOTYPE_HOM_REF) {
+                    t1 = (father == GENOTYPE_HET && mother == GENOTYPE_HET) ? 2 : 1;
+                } else if (child == GENOTYPE_HOM_ALT) {
+                    t2 = (father == GENOTYPE_HET && mother == GENOTYPE_HET) ? 2 : 1;
+                } else if (father == GENOTYPE_HET && mother == GENOTYPE_HET) {
+                    t1 = t2 = 1;
+                } else {
+                    // The heterozygous parent transmitted the allele the homozygous one did not
+                    int homozygous = (father == GENOTYPE_HET) ? mother : father;
+                    t1 = (homozygous == GENOTYPE_HOM_ALT);
+                    t2 = (homozygous == GENOTYPE_HOM_REF);
+                }
+                
+                int combination = (father << 4) | (mother << 2) | child;
+                for (int sex = 0; sex <= UNKNOWN_SEX; sex++) {
+                    if (!check_mendel(chromosome, father == GENOTYPE_HOM_ALT, father != GENOTYPE_HOM_REF,
+                                      mother == GENOTYPE_HOM_ALT, mother != GENOTYPE_HOM_REF,
+                                      child == GENOTYPE_HOM_ALT, child != GENOTYPE_HOM_REF, sex)) {
+                        table[sex][combination].t1 = t1;
+                        table[sex][combination].t2 = t2;
+                    }
+                }
             }
-            
-//           LOG_DEBUG_F("[%d] Alleles: Father = %d/%d\tMother = %d/%d\n", tid, father_allele1, father_allele2, mother_allele1, mother_allele2);
-            
-            // We need two genotyped parents, with at least one het
-            if (father_allele1 == father_allele2 && mother_allele1 == mother_allele2) {
-                free(father_sample);
-                free(mother_sample);
+        }
+    }
+}
+
+/**
+ * Counts how many permutations of the transmissions reach the chi-square observed in each variant, and 
+ * updates the maximum chi-square of each permutation.
+ * 
+ * Flipping a family swaps its transmissions of both alleles, so it just changes the sign of its balance. The 
+ * families of a variant are grouped by balance in bit-masks with the layout of the flips, and the difference 
+ * between transmissions in a permutation is obtained from the popcounts of the flipped families of each group.
+ */
+static void tdt_permutation_test(tdt_result_t **results, int *balances, int num_variants, int num_families, 
+                                 permutation_set_t *permutations) {
+    int num_words = permutations->words_per_permutation;
+    int num_permutations = permutations->num_permutations;
+    
+    // Groups of families with the same non-zero balance, from group_start[i] to group_start[i+1] for variant i
+    int *group_start = (int*) malloc ((num_variants + 1) * sizeof(int));
+    int groups_capacity = 16, num_groups = 0;
+    int *group_values = (int*) malloc (groups_capacity * sizeof(int));
+    uint64_t *group_sets = (uint64_t*) malloc ((size_t) groups_capacity * num_words * sizeof(uint64_t));
+    
+    for (int i = 0; i < num_variants; i++) {
+        group_start[i] = num_groups;
+        for (int f = 0; f < num_families; f++) {
+            int balance = balances[(size_t) i * num_families + f];
+            if (!balance) {
                 continue;
             }
             
-            if ((father_allele1 && !father_allele2) || (mother_allele1 && !mother_allele2)) {
-                free(father_sample);
-                free(mother_sample);
-                continue;
+            int g = group_start[i];
+            while (g < num_groups && group_values[g] != balance) {
+                g++;
             }
-
-//           LOG_DEBUG_F("[%d] Proceeding to analyse family %s...\n", tid, family->id);
-
-            
-            int trA = 0;  // transmitted allele from first het parent
-            int unA = 0;  // untransmitted allele from first het parent
-            
-            int trB = 0;  // transmitted allele from second het parent
-            int unB = 0;  // untransmitted allele from second het parent
-            
-            // Consider all offspring in nuclear family
-            linked_list_iterator_t *children_iterator = linked_list_iterator_new(family->children);
-            individual_t *child = NULL;
-            
-            while (child = linked_list_iterator_curr(children_iterator)) {
-                // Only consider affected children
-                if (child->condition != AFFECTED) { 
-                    linked_list_iterator_next(children_iterator);
-                    continue;
-                }
-                
-                iter = kh_get(ids, sample_ids, child->id);
-                if (iter != kh_end(sample_ids)) {
-                    child_pos = kh_value(sample_ids, iter);
-                } else {
-                    linked_list_iterator_next(children_iterator);
-                    continue;
+            if (g == num_groups) {
+                if (num_groups == groups_capacity) {
+                    groups_capacity *= 2;
+                    group_values = realloc(group_values, groups_capacity * sizeof(int));
+                    group_sets = realloc(group_sets, (size_t) groups_capacity * num_words * sizeof(uint64_t));
                 }
-                char *child_sample = strdup(sample_data[child_pos]);
-    //           LOG_DEBUG_F("[%d] Samples: Child = %s\n", tid, child_sample);
-                
-                // Skip if offspring has missing genotype
-                if (get_alleles(child_sample, gt_position, &child_allele1, &child_allele2)) {
-                    free(child_sample);
-                    linked_list_iterator_next(children_iterator);
-                    continue;
-                }
-                
-                // Exclude mendelian errors
-                char *aux_chromosome = strndup(record->chromosome, record->chromosome_len);
-                if (check_mendel(aux_chromosome, father_allele1, father_allele2, mother_allele1, mother_allele2, 
-                    child_allele1, child_allele2, child->sex)) {
-                    free(child_sample);
-                    free(aux_chromosome);
-                    linked_list_iterator_next(children_iterator);
+                group_values[g] = balance;
+                memset(group_sets + (size_t) g * num_words, 0, num_words * sizeof(uint64_t));
+                num_groups++;
+            }
+            group_sets[(size_t) g * num_words + f / 64] |= 1ULL << (f % 64);
+        }
+    }
+    group_start[num_variants] = num_groups;
+    
+    double *max_statistics = (double*) calloc (num_permutations, sizeof(double));
+    int num_blocks = (num_permutations + PERMUTATIONS_PER_BLOCK - 1) / PERMUTATIONS_PER_BLOCK;
+    
+    #pragma omp parallel num_threads(permutations->num_threads)
+    {
+        uint64_t *block_flips = (uint64_t*) malloc (((size_t) PERMUTATIONS_PER_BLOCK * num_words + 1) * sizeof(uint64_t));
+        int *exceeded = (int*) calloc (num_variants, sizeof(int));
+        
+        // Blocks write the maximum statistics of different permutations
+        #pragma omp for schedule(dynamic, 1)
+        for (int block = 0; block < num_blocks; block++) {
+            int first = block * PERMUTATIONS_PER_BLOCK;
+            int block_size = (num_permutations - first < PERMUTATIONS_PER_BLOCK) ? num_permutations - first : PERMUTATIONS_PER_BLOCK;
+            permutation_set_generate(first, block_size, block_flips, permutations);
+            
+            for (int i = 0; i < num_variants; i++) {
+                tdt_result_t *result = results[i];
+                int total = result->t1 + result->t2;
+                if (total == 0) {
                     continue;
                 }
-                free(aux_chromosome);
                 
-                
-                // We've now established: no missing genotypes
-                // and at least one heterozygous parent
-
-                // Kid is 00
-
-                if (!child_allele1 && !child_allele2) {
-                    if ( ( (!father_allele1) && father_allele2 ) && 
-                        ( (!mother_allele1) && mother_allele2 ) )
-                    { trA=1; unA=2; trB=1; unB=2; }
-                    else 
-                    { trA=1; unA=2; } 
-                }
-                else if ( (!child_allele1) && child_allele2 )  // Kid is 01
-                {
-                    // het dad
-                    if (father_allele1 != father_allele2 )
-                    {
-                        // het mum
-                        if ( mother_allele1 != mother_allele2 )
-                    { trA=1; trB=2; unA=2; unB=1; }
-                        else if ( !mother_allele1 ) 
-                    { trA=2; unA=1; }
-                        else { trA=1; unA=2; }
-                    }
-                    else if ( !father_allele1 ) 
-                    {
-                        trA=2; unA=1; 
-                    }           
-                    else
-                    {
-                        trA=1; unA=2;
+                double observed = result->chi_square - PERMUTATION_EPSILON;
+                for (int p = 0; p < block_size; p++) {
+                    uint64_t *flips = block_flips + (size_t) p * num_words;
+                    int difference = result->t1 - result->t2;
+                    for (int g = group_start[i]; g < group_start[i+1]; g++) {
+                        uint64_t *set = group_sets + (size_t) g * num_words;
+                        int flipped = 0;
+                        for (int w = 0; w < num_words; w++) {
+                            flipped += __builtin_popcountll(set[w] & flips[w]);
+                        }
+                        difference -= 2 * group_values[g] * flipped;
                     }
-                }
-                else // kid is 1/1
-                {
                     
-                    if ( ( (!father_allele1) && father_allele2 ) && 
-                        ( (!mother_allele1) && mother_allele2 ) )
-                    { trA=2; unA=1; trB=2; unB=1; }
-                    else 
-                    { 
-                        trA=2; unA=1;
+                    double statistic = ((double) difference * difference) / total;
+                    if (statistic >= observed) {
+                        exceeded[i]++;
+                    }
+                    if (statistic > max_statistics[first + p]) {
+                        max_statistics[first + p] = statistic;
                     }
                 }
-                
-                // We have now populated trA (first transmission) 
-                // and possibly trB also 
-                
-                ////////////////////////////////////////
-                // Permutation? 50:50 flip (precomputed)
-                
-//                 if (permute) {
-//                     if (flipA[f])
-//                     {
-//                     int t = trA;
-//                     trA = unA;
-//                     unA = t;
-//                     
-//                     t = trB;
-//                     trB = unB;
-//                     unB = t;
-//                     }
-//                 }
-                
-                // Increment transmission counts
-                if (trA==1) { t1++; }
-                else if (trA==2) { t2++; }
-                
-                if (trB==1) { t1++; }
-                else if (trB==2) { t2++; }
-                
-//     //           LOG_DEBUG_F("TDT\t%.*s %s : %d %d - %d %d - %d %d - F %d/%d - M %d/%d - C %d/%d\n", 
-//                             record->id_len, record->id, family->id, trA, unA, trB, unB, t1, t2, 
-//                             father_allele1, father_allele2, mother_allele1, mother_allele2, child_allele1, child_allele2);
-                free(child_sample);
-                linked_list_iterator_next(children_iterator);
-            } // next offspring in family
-            
-            linked_list_iterator_free(children_iterator);
-            free(father_sample);
-            free(mother_sample);
-        }  // next nuclear family
-
-        /////////////////////////////
-        // Finished counting: now compute
-        // the statistics
-        
-        double tdt_chisq = -1;
-        
-        // Basic TDT test
-        if (t1+t2 > 0) {
-            tdt_chisq = ((double) ((t1-t2) * (t1-t2))) / (t1+t2);
+            }
         }
         
-//         LOG_DEBUG_F("[%d] before adding %s:%ld\n", tid, record->chromosome, record->position);
-        result = tdt_result_new(record->chromosome, record->chromosome_len, 
-                                record->position, record->id, record->id_len,
-                                record->reference, record->reference_len, 
-                                record->alternate, record->alternate_len,
-                                t1, t2, tdt_chisq);
-        list_item_t *output_item = list_item_new(tid, 0, result);
-        list_insert_item(output_item, output_list);
-//         LOG_DEBUG_F("[%d] after adding %.*s:%ld\n", tid, record->chromosome_len, record->chromosome, record->position);
+        for (int i = 0; i < num_variants; i++) {
+            if (exceeded[i]) {
+                #pragma omp atomic
+                results[i]->permutations_exceeded += exceeded[i];
+            }
+        }
         
-    } // next variant
-
-    double end = omp_get_wtime();
+        free(exceeded);
+        free(block_flips);
+    }
     
-    return ret_code;
+    permutation_set_update_max(max_statistics, permutations);
+    
+    free(max_statistics);
+    free(group_sets);
+    free(group_values);
+    free(group_start);
 }
 
 
@@ -284,6 +312,7 @@ tdt_result_t* tdt_result_new(char *chromosome, int chromosome_len, unsigned long
     result->odds_ratio = (t2 == 0.0) ? NAN : ((double) t1/t2);
     result->chi_square = chi_square;
     result->p_value = 1 - gsl_cdf_chisq_P(chi_square, 1);
+    result->permutations_exceeded = 0;
     
     return result;
 }
@@ -41,21 +41,46 @@
 #include <containers/cprops/hashtable.h>
 
 #include "error.h"
+#include "gwas/assoc/genotype_matrix.h"
+#include "gwas/mendel_errors.h"
+#include "gwas/permutation.h"
+#include "gwas/trio_table.h"
 #include "hpg_variant_utils.h"
 #include "shared_options.h"
 
 /**
  * Number of options applicable to the TDT tool.
  */
-#define NUM_TDT_OPTIONS  0
+#define NUM_TDT_OPTIONS  2
 
 
 typedef struct tdt_options {
     int num_options;
+    
+    struct arg_int *permutations;
+    struct arg_int *max_mendel_errors;
 } tdt_options_t;
 
+/**
+ * @brief Values for the options of the TDT tool.
+ */
+typedef struct tdt_options_data {
+    int num_permutations; /**< Permutations for the empirical p-values, 0 if disabled */
+    int max_mendel_errors; /**< Mendelian errors allowed in a variant, -1 if not filtered */
+} tdt_options_data_t;
+
 static tdt_options_t *new_tdt_cli_options(void);
 
+/**
+ * @brief Initializes a tdt_options_data_t structure from the values of the command-line options.
+ */
+static tdt_options_data_t *new_tdt_options_data(tdt_options_t *options);
+
+/**
+ * @brief Free memory associated to a tdt_options_data_t structure.
+ */
+static void free_tdt_options_data(tdt_options_data_t *options_data);
+
 
 /* **********************************************
  *                Options parsing               *
@@ -116,9 +141,20 @@ typedef struct {
     double odds_ratio;
     double chi_square;
     double p_value;
+    
+    int permutations_exceeded;
 } tdt_result_t;
 
-int tdt_test(vcf_record_t **variants, int num_variants, family_t **families, int num_families, khash_t(ids) *sample_ids, list_t *output_list);
+/**
+ * @brief Performs the transmission disequilibrium test over a batch of variants.
+ * @param variants variants to test
+ * @param num_variants number of variants
+ * @param trios trios with an affected child the transmissions are counted in
+ * @param permutations flips of the transmissions of each family, or NULL if disabled
+ * @param output_list list where a result per alternate allele of each variant is inserted
+ * @return Zero if the test was successfully performed, non-zero otherwise
+ */
+int tdt_test(vcf_record_t **variants, int num_variants, trio_table_t *trios, permutation_set_t *permutations, list_t *output_list);
 
 tdt_result_t* tdt_result_new(char *chromosome, int chromosome_len, unsigned long int position, char *id, int id_len, 
                              char *reference, int reference_len, char *alternate, int alternate_len, double t1, double t2, double chi_square);
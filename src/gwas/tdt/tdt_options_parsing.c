@@ -65,7 +65,7 @@ int read_tdt_configuration(const char *filename, tdt_options_t *tdt_options, sha
 }
 
 void **parse_tdt_options(int argc, char *argv[], tdt_options_t *tdt_options, shared_options_t *shared_options) {
-    struct arg_end *end = arg_end(shared_options->num_options);
+    struct arg_end *end = arg_end(tdt_options->num_options + shared_options->num_options);
     void **argtable = merge_tdt_options(tdt_options, shared_options, end);
     
     int num_errors = arg_parse(argc, argv, argtable);
@@ -77,7 +77,7 @@ void **parse_tdt_options(int argc, char *argv[], tdt_options_t *tdt_options, sha
 }
 
 void **merge_tdt_options(tdt_options_t *tdt_options, shared_options_t *shared_options, struct arg_end *arg_end) {
-    void **tool_options = malloc (28 * sizeof(void*));
+    void **tool_options = malloc (30 * sizeof(void*));
     
     // Input/output files
     tool_options[0] = shared_options->vcf_filename;
@@ -88,35 +88,39 @@ void **merge_tdt_options(tdt_options_t *tdt_options, shared_options_t *shared_op
     // Species
     tool_options[4] = shared_options->species;
     
+    // TDT arguments
+    tool_options[5] = tdt_options->permutations;
+    tool_options[6] = tdt_options->max_mendel_errors;
+    
     // Filter arguments
-    tool_options[5] = shared_options->num_alleles;
-    tool_options[6] = shared_options->coverage;
-    tool_options[7] = shared_options->quality;
-    tool_options[8] = shared_options->maf;
-    tool_options[9] = shared_options->missing;
-    tool_options[10] = shared_options->gene;
-    tool_options[11] = shared_options->region;
-    tool_options[12] = shared_options->region_file;
-    tool_options[13] = shared_options->region_type;
-    tool_options[14] = shared_options->snp;
-    tool_options[15] = shared_options->indel;
-    tool_options[16] = shared_options->dominant;
-    tool_options[17] = shared_options->recessive;
+    tool_options[7] = shared_options->num_alleles;
+    tool_options[8] = shared_options->coverage;
+    tool_options[9] = shared_options->quality;
+    tool_options[10] = shared_options->maf;
+    tool_options[11] = shared_options->missing;
+    tool_options[12] = shared_options->gene;
+    tool_options[13] = shared_options->region;
+    tool_options[14] = shared_options->region_file;
+    tool_options[15] = shared_options->region_type;
+    tool_options[16] = shared_options->snp;
+    tool_options[17] = shared_options->indel;
+    tool_options[18] = shared_options->dominant;
+    tool_options[19] = shared_options->recessive;
     
     // Configuration file
-    tool_options[18] = shared_options->log_level;
-    tool_options[19] = shared_options->config_file;
+    tool_options[20] = shared_options->log_level;
+    tool_options[21] = shared_options->config_file;
     
     // Advanced configuration
-    tool_options[20] = shared_options->host_url;
-    tool_options[21] = shared_options->version;
-    tool_options[22] = shared_options->max_batches;
-    tool_options[23] = shared_options->batch_lines;
-    tool_options[24] = shared_options->batch_bytes;
-    tool_options[25] = shared_options->num_threads;
-    tool_options[26] = shared_options->mmap_vcf_files;
+    tool_options[22] = shared_options->host_url;
+    tool_options[23] = shared_options->version;
+    tool_options[24] = shared_options->max_batches;
+    tool_options[25] = shared_options->batch_lines;
+    tool_options[26] = shared_options->batch_bytes;
+    tool_options[27] = shared_options->num_threads;
+    tool_options[28] = shared_options->mmap_vcf_files;
     
-    tool_options[27] = arg_end;
+    tool_options[29] = arg_end;
     
     return tool_options;
 }
@@ -129,6 +133,18 @@ int verify_tdt_options(tdt_options_t *tdt_options, shared_options_t *shared_opti
         return VCF_FILE_NOT_SPECIFIED;
     }
     
+    // Check whether the number of permutations is valid
+    if (tdt_options->permutations->count > 0 && *(tdt_options->permutations->ival) <= 0) {
+        LOG_ERROR("Please specify a positive number of permutations.\n");
+        return GWAS_INVALID_PERMUTATIONS;
+    }
+    
+    // Check whether the number of mendelian errors allowed is valid
+    if (tdt_options->max_mendel_errors->count > 0 && *(tdt_options->max_mendel_errors->ival) < 0) {
+        LOG_ERROR("Please specify a non-negative number of mendelian errors.\n");
+        return GWAS_INVALID_MENDEL_ERRORS;
+    }
+    
     // Check whether the input PED file is defined
     if (shared_options->ped_filename->filename == NULL || strlen(*(shared_options->ped_filename->filename)) == 0) {
         LOG_ERROR("Please specify the input PED file.\n");
@@ -20,7 +20,7 @@
 
 #include "tdt_runner.h"
 
-int run_tdt_test(shared_options_data_t* shared_options_data) {
+int run_tdt_test(shared_options_data_t* shared_options_data, tdt_options_data_t *options_data) {
     list_t *output_list = (list_t*) malloc (sizeof(list_t));
     list_init("output", shared_options_data->num_threads, INT_MAX, output_list);
 
@@ -50,6 +50,18 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
     
     LOG_INFO("About to perform TDT test...\n");
 
+    // Results are written in the same order the batches were read
+    reorder_buffer_t *reorder_buffer = reorder_buffer_new(shared_options_data->num_threads * REORDER_BUFFER_BATCHES_PER_THREAD);
+    
+    // Permutations of the transmissions of each family
+    permutation_set_t *permutations = NULL;
+    if (options_data->num_permutations > 0) {
+        LOG_INFO_F("Generating %d permutations of the families transmissions...\n", options_data->num_permutations);
+        permutations = permutation_set_new_flips(get_num_families(ped_file), options_data->num_permutations,
+                                                 permutation_threads_per_batch(options_data->num_permutations, 
+                                                                               shared_options_data->num_threads));
+    }
+
 #pragma omp parallel sections private(ret_code)
     {
 #pragma omp section
@@ -87,6 +99,8 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
             int num_families = get_num_families(ped_file);
             individual_t **individuals = NULL;
             khash_t(ids) *sample_ids = NULL;
+            trio_table_t *trios = NULL;
+            trio_table_t *mendel_trios = NULL;
             
             // Create chain of filters for the VCF file
             filter_t **filters = NULL;
@@ -100,24 +114,43 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
             double start = omp_get_wtime();
             
             int i = 0;
+            // The threads that evaluate the permutations of each batch are not available to process other batches
+            int batch_threads = shared_options_data->num_threads / 
+                                permutation_threads_per_batch(options_data->num_permutations, shared_options_data->num_threads);
 //#pragma omp parallel num_threads(shared_options_data->num_threads) shared(initialization_done, families, sample_ids, filters)
-#pragma omp parallel num_threads(shared_options_data->num_threads)
+#pragma omp parallel num_threads(batch_threads)
             {
             LOG_DEBUG_F("Level %d: number of threads in the team - %d\n", 11, omp_get_num_threads());
             
             char *text_begin, *text_end;
             vcf_reader_status *status;
-            while(text_begin = fetch_vcf_text_batch(vcf_file)) {
-                text_end = text_begin + strlen(text_begin);
+            long text_sequence;
+            int text_records;
+            while (1) {
+                // Texts must be given their sequence numbers in the same order they are fetched
+#pragma omp critical 
+                {
+                    text_begin = fetch_vcf_text_batch(vcf_file);
+                    if (text_begin) {
+                        text_end = text_begin + strlen(text_begin);
+                        text_records = count_vcf_text_records(text_begin, text_end);
+                        text_sequence = reorder_buffer_register_text(text_begin, text_end, text_records, reorder_buffer);
+                        status = vcf_reader_status_new(shared_options_data->batch_lines, i);
+                        i++;
+                    }
+                }
+                
+                if (!text_begin) {
+                    break;
+                }
                 if (text_begin == text_end) { // EOF
+                    reorder_buffer_skip_text(text_sequence, reorder_buffer);
+                    vcf_reader_status_free(status);
                     free(text_begin);
                     break;
                 }
-                
-#pragma omp critical 
-                {
-                    status = vcf_reader_status_new(shared_options_data->batch_lines, i);
-                    i++;
+                if (text_records == 0) {
+                    reorder_buffer_skip_text(text_sequence, reorder_buffer);
                 }
                 
                 if (shared_options_data->batch_bytes > 0) {
@@ -140,6 +173,13 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
                         sample_ids = associate_samples_and_positions(vcf_file);
                         // Sort individuals in PED as defined in the VCF file
                         individuals = sort_individuals(vcf_file, ped_file);
+                        // Trios with an affected child, so their samples are not looked up for every variant
+                        trios = trio_table_new(families, num_families, sample_ids, 1);
+                        LOG_INFO_F("%d trios in %d families will be tested\n", trios->num_trios, trios->num_families);
+                        // Mendelian errors are searched in all trios, regardless of the condition of the child
+                        if (options_data->max_mendel_errors >= 0) {
+                            mendel_trios = trio_table_new(families, num_families, sample_ids, 0);
+                        }
                         
                         // Add headers associated to the defined filters
                         vcf_header_entry_t **filter_headers = get_filters_as_vcf_headers(filters, num_filters);
@@ -175,13 +215,31 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
                 array_list_t *failed_records = NULL;
                 assert(batch);
                 assert(batch->records);
+                
+                // The batch may have been parsed from the text of another thread
+                int batch_offset = 0;
+                long batch_sequence = claim_vcf_batch_sequence(batch, &batch_offset, reorder_buffer);
+                if (batch_sequence >= 0) {
+                    reorder_buffer_wait(batch_sequence, reorder_buffer);
+                }
+                
                 int num_variables = ped_file? get_num_variables(ped_file): 0;
                 array_list_t *passed_records = filter_records(filters, num_filters, individuals, sample_ids,num_variables, batch->records, &failed_records);
-                if (passed_records->size > 0) {
-                    ret_code = tdt_test((vcf_record_t**) passed_records->items, passed_records->size, families, num_families, sample_ids, output_list);
-                    if (ret_code) {
-                        LOG_FATAL_F("[%d] Error in execution #%d of TDT\n", omp_get_thread_num(), i);
+                if (mendel_trios) {
+                    passed_records = filter_mendel_errors(passed_records, batch->records, &failed_records, 
+                                                          mendel_trios, options_data->max_mendel_errors);
+                }
+                if (batch_sequence >= 0) {
+                    list_t *batch_results = (list_t*) malloc (sizeof(list_t));
+                    list_init("batch", 1, INT_MAX, batch_results);
+                    if (passed_records->size > 0) {
+                        ret_code = tdt_test((vcf_record_t**) passed_records->items, passed_records->size, trios, permutations, batch_results);
+                        if (ret_code) {
+                            LOG_FATAL_F("[%d] Error in execution #%d of TDT\n", omp_get_thread_num(), i);
+                        }
                     }
+                    list_decr_writers(batch_results);
+                    list_insert_item(list_item_new(batch_sequence, batch_offset, batch_results), output_list);
                 }
                 
                 // Write records that passed and failed filters to separate files, and free them
@@ -211,6 +269,8 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
             }
             
             if (sample_ids) { kh_destroy(ids, sample_ids); }
+            if (trios) { trio_table_free(trios); }
+            if (mendel_trios) { trio_table_free(mendel_trios); }
             if (individuals) { free(individuals); }
             free(families);
             
@@ -232,22 +292,34 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
             
             double start = omp_get_wtime();
             
-            // Write data: header + one line per variant
+            // Write data: header + one line per variant, in the same order as the input file
             write_output_header(fd);
-            write_output_body(output_list, fd);
             
-            fclose(fd);
+            permutation_report_t *report = permutations ? permutation_report_new() : NULL;
+            list_item_t *item = NULL;
+            list_t *batch_results = NULL;
+            while (item = list_remove_item(output_list)) {
+                reorder_buffer_put(item->id, item->type, item->data_p, reorder_buffer);
+                list_item_free(item);
+                
+                while (reorder_buffer_pop((void**) &batch_results, reorder_buffer)) {
+                    if (batch_results) {
+                        write_output_body(batch_results, report, fd);
+                        free(batch_results);
+                    }
+                }
+            }
             
-            // Sort resulting file
-            char *cmd = calloc (40 + strlen(path) * 4, sizeof(char));
-            sprintf(cmd, "sort -k1,1h -k2,2n %s > %s.tmp && mv %s.tmp %s", path, path, path, path);
+            // Results of every batch must have been written in order
+            reorder_buffer_finish(reorder_buffer);
             
-            int sort_ret = system(cmd);
-            if (sort_ret) {
-                LOG_WARN("TDT results could not be sorted by chromosome and position, will be shown unsorted\n");
-            }
+            fclose(fd);
             
-            free(cmd);
+            // All variants have been tested, so the maximum statistics of the permutations are final
+            if (report) {
+                write_permutation_output(path, report, permutations);
+                permutation_report_free(report);
+            }
             free(path);
             
             double stop = omp_get_wtime();
@@ -259,6 +331,8 @@ int run_tdt_test(shared_options_data_t* shared_options_data) {
     }
     
     free(output_list);
+    reorder_buffer_free(reorder_buffer);
+    if (permutations) { permutation_set_free(permutations); }
     vcf_close(vcf_file);
     ped_close(ped_file, 1, 1);
     
@@ -275,7 +349,7 @@ void write_output_header(FILE *fd) {
     fprintf(fd, "#CHR         POS               ID      A1      A2         T       U           OR           CHISQ         P-VALUE\n");
 }
 
-void write_output_body(list_t* output_list, FILE *fd) {
+void write_output_body(list_t* output_list, permutation_report_t *report, FILE *fd) {
     assert(fd);
     list_item_t* item = NULL;
     while (item = list_remove_item(output_list)) {
@@ -285,8 +359,31 @@ void write_output_body(list_t* output_list, FILE *fd) {
                 result->chromosome, result->position, result->id, result->reference, result->alternate, 
                 result->t1, result->t2, result->odds_ratio, result->chi_square, result->p_value);
         
+        if (report) {
+            // Variants without transmissions have no statistic
+            permutation_report_add(result->chromosome, result->position, result->id, 
+                                   (result->chi_square < 0) ? NAN : result->chi_square, 
+                                   result->permutations_exceeded, report);
+        }
+        
         tdt_result_free(result);
         list_item_free(item);
     }
 }
 
+void write_permutation_output(char *path, permutation_report_t *report, permutation_set_t *permutations) {
+    char *mperm_path = (char*) malloc ((strlen(path) + 7) * sizeof(char));
+    sprintf(mperm_path, "%s.mperm", path);
+    
+    FILE *fd = fopen(mperm_path, "w");
+    if (!fd) {
+        LOG_ERROR_F("Can't write permutation results to %s\n", mperm_path);
+    } else {
+        LOG_INFO_F("Permutation test output filename = %s\n", mperm_path);
+        permutation_set_finish(permutations);
+        write_permutation_report(fd, report, permutations);
+        fclose(fd);
+    }
+    
+    free(mperm_path);
+}
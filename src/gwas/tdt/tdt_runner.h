@@ -51,12 +51,14 @@
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
 
 
-int run_tdt_test(shared_options_data_t *global_options_data);
+int run_tdt_test(shared_options_data_t *global_options_data, tdt_options_data_t *options_data);
 
 
 static void write_output_header(FILE *fd);
 
-static void write_output_body(list_t* output_list, FILE *fd);
+static void write_output_body(list_t* output_list, permutation_report_t *report, FILE *fd);
+
+static void write_permutation_output(char *path, permutation_report_t *report, permutation_set_t *permutations);
 
 
 #endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trio_table.h"
+
+static int get_sample_position(individual_t *individual, khash_t(ids) *sample_ids);
+
+static void trio_table_add(int father, int mother, int child, enum Sex sex, int *capacity, trio_table_t *trios);
+
+
+trio_table_t *trio_table_new(family_t **families, int num_families, khash_t(ids) *sample_ids, int affected_only) {
+    trio_table_t *trios = (trio_table_t*) calloc (1, sizeof(trio_table_t));
+    int capacity = 64;
+    trios->fathers = (int*) malloc (capacity * sizeof(int));
+    trios->mothers = (int*) malloc (capacity * sizeof(int));
+    trios->children = (int*) malloc (capacity * sizeof(int));
+    trios->children_sex = (enum Sex*) malloc (capacity * sizeof(enum Sex));
+    trios->families = (family_t**) malloc ((num_families + 1) * sizeof(family_t*));
+    trios->family_starts = (int*) malloc ((num_families + 1) * sizeof(int));
+
+    for (int f = 0; f < num_families; f++) {
+        family_t *family = families[f];
+        int father = get_sample_position(family->father, sample_ids);
+        int mother = get_sample_position(family->mother, sample_ids);
+        if (father < 0 || mother < 0) {
+            continue;
+        }
+
+        int first_trio = trios->num_trios;
+        linked_list_iterator_t *children_iterator = linked_list_iterator_new(family->children);
+        individual_t *child = NULL;
+        while (child = linked_list_iterator_curr(children_iterator)) {
+            int position = get_sample_position(child, sample_ids);
+            if (position >= 0 && (!affected_only || child->condition == AFFECTED)) {
+                trio_table_add(father, mother, position, child->sex, &capacity, trios);
+            }
+            linked_list_iterator_next(children_iterator);
+        }
+        linked_list_iterator_free(children_iterator);
+
+        if (trios->num_trios > first_trio) {
+            trios->families[trios->num_families] = family;
+            trios->family_starts[trios->num_families] = first_trio;
+            trios->num_families++;
+        }
+    }
+    trios->family_starts[trios->num_families] = trios->num_trios;
+
+    return trios;
+}
+
+void trio_table_free(trio_table_t *trios) {
+    free(trios->fathers);
+    free(trios->mothers);
+    free(trios->children);
+    free(trios->children_sex);
+    free(trios->families);
+    free(trios->family_starts);
+    free(trios);
+}
+
+
+static int get_sample_position(individual_t *individual, khash_t(ids) *sample_ids) {
+    if (individual == NULL) {
+        return -1;
+    }
+    khiter_t iter = kh_get(ids, sample_ids, individual->id);
+    return (iter != kh_end(sample_ids)) ? kh_value(sample_ids, iter) : -1;
+}
+
+static void trio_table_add(int father, int mother, int child, enum Sex sex, int *capacity, trio_table_t *trios) {
+    if (trios->num_trios == *capacity) {
+        *capacity *= 2;
+        trios->fathers = realloc(trios->fathers, *capacity * sizeof(int));
+        trios->mothers = realloc(trios->mothers, *capacity * sizeof(int));
+        trios->children = realloc(trios->children, *capacity * sizeof(int));
+        trios->children_sex = realloc(trios->children_sex, *capacity * sizeof(enum Sex));
+    }
+
+    int t = trios->num_trios;
+    trios->fathers[t] = father;
+    trios->mothers[t] = mother;
+    trios->children[t] = child;
+    trios->children_sex[t] = sex;
+    trios->num_trios++;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GWAS_TRIO_TABLE_H
+#define GWAS_TRIO_TABLE_H
+
+/**
+ * @file trio_table.h
+ * @brief Father, mother and child of every trio, as positions of samples in the VCF file
+ *
+ * The table is built once, when the samples of the VCF file are known, so the tests that scan
+ * the trios of each variant don't need to look up the samples of the families by their IDs.
+ * The trios of a family are contiguous, and families without any trio are left out.
+ */
+
+#include <stdlib.h>
+
+#include <bioformats/family/family.h>
+#include <bioformats/ped/ped_file_structure.h>
+#include <containers/khash.h>
+#include <containers/linked_list.h>
+
+typedef struct trio_table {
+    int num_trios;
+    int *fathers;           /**< Position of the father of each trio. */
+    int *mothers;           /**< Position of the mother of each trio. */
+    int *children;          /**< Position of the child of each trio. */
+    enum Sex *children_sex;
+
+    int num_families;       /**< Families with at least one trio. */
+    family_t **families;
+    int *family_starts;     /**< First trio of each family, plus the total number of trios at the end. */
+} trio_table_t;
+
+
+/**
+ * @brief Creates the table of trios of a list of families.
+ * @param families families whose trios are added
+ * @param num_families number of families
+ * @param sample_ids position of each sample in the VCF file
+ * @param affected_only whether only affected children are added
+ * @return The trios whose samples are all in the VCF file
+ */
+trio_table_t *trio_table_new(family_t **families, int num_families, khash_t(ids) *sample_ids, int affected_only);
+
+void trio_table_free(trio_table_t *trios);
+
+#endif
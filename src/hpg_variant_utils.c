@@ -209,7 +209,17 @@ void close_job_status_file(FILE* file) {
  *        Filtering      *
  * ***********************/
 
+static int open_filtering_output_files(shared_options_data_t *shared_options, const char *mode, FILE** passed_file, FILE** failed_file);
+
 int get_filtering_output_files(shared_options_data_t *shared_options, FILE** passed_file, FILE** failed_file) {
+    return open_filtering_output_files(shared_options, "w", passed_file, failed_file);
+}
+
+int append_filtering_output_files(shared_options_data_t *shared_options, FILE** passed_file, FILE** failed_file) {
+    return open_filtering_output_files(shared_options, "a", passed_file, failed_file);
+}
+
+static int open_filtering_output_files(shared_options_data_t *shared_options, const char *mode, FILE** passed_file, FILE** failed_file) {
     assert(shared_options);
     
     int filename_len = 0;
@@ -232,8 +242,8 @@ int get_filtering_output_files(shared_options_data_t *shared_options, FILE** pas
     sprintf(passed_filename, "%s/%s.filtered", shared_options->output_directory, prefix_filename);
     sprintf(failed_filename, "%s/%s.rejected", shared_options->output_directory, prefix_filename);
     
-    *passed_file = fopen(passed_filename, "w");
-    *failed_file = fopen(failed_filename, "w");
+    *passed_file = fopen(passed_filename, mode);
+    *failed_file = fopen(failed_filename, mode);
     
     LOG_DEBUG_F("passed filename = %s\nfailed filename = %s\n", passed_filename, failed_filename);
     
@@ -310,6 +320,37 @@ FILE *get_output_file(shared_options_data_t *shared_options_data, char *default_
 }
 
 
+int count_vcf_text_records(const char *text_begin, const char *text_end) {
+    int num_records = 0;
+    const char *line = text_begin;
+    while (line < text_end) {
+        if (*line != '#' && *line != '\n') {
+            num_records++;
+        }
+        line = memchr(line, '\n', text_end - line);
+        if (!line) {
+            break;
+        }
+        line++;
+    }
+    return num_records;
+}
+
+long claim_vcf_batch_sequence(vcf_batch_t *batch, int *offset, reorder_buffer_t *reorder_buffer) {
+    if (batch->records->size == 0) {
+        return -1;
+    }
+    // Records point to the text they were parsed from
+    vcf_record_t *first = batch->records->items[0];
+    long sequence = reorder_buffer_claim_text(first->chromosome, batch->records->size, offset, reorder_buffer);
+    if (sequence < 0) {
+        LOG_FATAL_F("The text of the batch starting at %.*s:%ld is unknown, its results can't be written in order\n",
+                    first->chromosome_len, first->chromosome, first->position);
+    }
+    return sequence;
+}
+
+
 /* ***********************
  *      Miscellaneous    *
  * ***********************/
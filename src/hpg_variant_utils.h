@@ -33,6 +33,7 @@
 #include <containers/khash.h>
 #include <containers/list.h>
 
+#include "reorder_buffer.h"
 #include "shared_options.h"
 
 #define HPG_VARIANT_VERSION     "0.99.3"
@@ -80,6 +81,12 @@ void close_job_status_file(FILE *file);
  */
 int get_filtering_output_files(shared_options_data_t *shared_options, FILE **passed_file, FILE **failed_file);
 
+/**
+ * @brief Opens the files that contain the output of filtering tools, appending to their current contents.
+ * @see get_filtering_output_files
+ */
+int append_filtering_output_files(shared_options_data_t *shared_options, FILE **passed_file, FILE **failed_file);
+
 int write_filtering_output_files(array_list_t *passed_records, array_list_t *failed_records, FILE* passed_file, FILE* failed_file);
 
 array_list_t *filter_records(filter_t** filters, int num_filters, individual_t **individuals, khash_t(ids) *sample_ids, int num_variables,
@@ -94,6 +101,22 @@ void free_filtered_records(array_list_t *passed_records, array_list_t *failed_re
 
 FILE *get_output_file(shared_options_data_t *shared_options_data, char *default_name, char **path);
 
+/**
+ * @brief Returns the number of records of a text batch of a VCF file, not counting header lines.
+ */
+int count_vcf_text_records(const char *text_begin, const char *text_end);
+
+/**
+ * @brief Returns the sequence number of the text a batch of records was parsed from.
+ * 
+ * A batch whose text is unknown would shift the results of the following ones, so it is a fatal error.
+ * 
+ * @param[out] offset position of the batch in its text
+ * @return The sequence number, or -1 if the batch is empty
+ * @see reorder_buffer_claim_text
+ */
+long claim_vcf_batch_sequence(vcf_batch_t *batch, int *offset, reorder_buffer_t *reorder_buffer);
+
 
 /* ***********************
  *      Miscellaneous    *
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reorder_buffer.h"
+
+static int find_text(long sequence, reorder_buffer_t *buffer);
+static void remove_text(int index, reorder_buffer_t *buffer);
+static void insert_part(int offset, void *item, reorder_slot_t *slot);
+
+
+reorder_buffer_t *reorder_buffer_new(size_t capacity) {
+    reorder_buffer_t *buffer = (reorder_buffer_t*) calloc (1, sizeof(reorder_buffer_t));
+    buffer->capacity = capacity > 0 ? capacity : 1;
+    buffer->slots = (reorder_slot_t*) calloc (buffer->capacity, sizeof(reorder_slot_t));
+    buffer->texts_capacity = 16;
+    buffer->texts = (reorder_text_t*) malloc (buffer->texts_capacity * sizeof(reorder_text_t));
+    omp_init_lock(&(buffer->lock));
+    return buffer;
+}
+
+void reorder_buffer_free(reorder_buffer_t *buffer) {
+    for (size_t i = 0; i < buffer->capacity; i++) {
+        free(buffer->slots[i].parts);
+    }
+    free(buffer->slots);
+    free(buffer->texts);
+    omp_destroy_lock(&(buffer->lock));
+    free(buffer);
+}
+
+long reorder_buffer_register_text(const char *begin, const char *end, int num_records, reorder_buffer_t *buffer) {
+    omp_set_lock(&(buffer->lock));
+    if (buffer->num_texts == buffer->texts_capacity) {
+        buffer->texts_capacity *= 2;
+        buffer->texts = realloc(buffer->texts, buffer->texts_capacity * sizeof(reorder_text_t));
+    }
+    reorder_text_t *text = &(buffer->texts[buffer->num_texts++]);
+    text->begin = begin;
+    text->end = end;
+    text->sequence = buffer->num_sequences++;
+    text->num_records = num_records;
+    text->num_parts = 0;
+    text->num_received = 0;
+    long sequence = text->sequence;
+    omp_unset_lock(&(buffer->lock));
+    return sequence;
+}
+
+long reorder_buffer_claim_text(const char *pointer, int num_records, int *offset, reorder_buffer_t *buffer) {
+    long sequence = -1;
+
+    omp_set_lock(&(buffer->lock));
+    // The memory of a text whose records have all been claimed may be reused by a newer one, so it can't match
+    for (int i = 0; pointer && i < buffer->num_texts; i++) {
+        reorder_text_t *text = &(buffer->texts[i]);
+        if (text->num_records > 0 && pointer >= text->begin && pointer < text->end) {
+            sequence = text->sequence;
+            *offset = pointer - text->begin;
+            text->num_records -= num_records;
+            text->num_parts++;
+            if (text->num_records < 0) {
+                LOG_ERROR_F("Text of sequence %ld was parsed into more records than expected\n", sequence);
+                text->num_records = 0;
+            }
+            break;
+        }
+    }
+    omp_unset_lock(&(buffer->lock));
+
+    return sequence;
+}
+
+void reorder_buffer_skip_text(long sequence, reorder_buffer_t *buffer) {
+    omp_set_lock(&(buffer->lock));
+    int index = find_text(sequence, buffer);
+    if (index >= 0) {
+        remove_text(index, buffer);
+    }
+    omp_unset_lock(&(buffer->lock));
+
+    reorder_buffer_wait(sequence, buffer);
+    reorder_buffer_put(sequence, 0, NULL, buffer);
+}
+
+void reorder_buffer_wait(long sequence, reorder_buffer_t *buffer) {
+    while (1) {
+        omp_set_lock(&(buffer->lock));
+        int fits = sequence < buffer->next + (long) buffer->capacity;
+        omp_unset_lock(&(buffer->lock));
+        if (fits) {
+            break;
+        }
+        usleep(1000);
+    }
+}
+
+void reorder_buffer_put(long sequence, int offset, void *item, reorder_buffer_t *buffer) {
+    omp_set_lock(&(buffer->lock));
+    assert(sequence >= buffer->next && sequence < buffer->next + (long) buffer->capacity);
+    reorder_slot_t *slot = &(buffer->slots[sequence % buffer->capacity]);
+    insert_part(offset, item, slot);
+    
+    // The sequence is complete when all the records of its text have been claimed, and all the batches put
+    int index = find_text(sequence, buffer);
+    if (index < 0) {
+        slot->complete = 1;
+    } else {
+        reorder_text_t *text = &(buffer->texts[index]);
+        text->num_received++;
+        if (text->num_records == 0 && text->num_received == text->num_parts) {
+            slot->complete = 1;
+            remove_text(index, buffer);
+        }
+    }
+    omp_unset_lock(&(buffer->lock));
+}
+
+int reorder_buffer_pop(void **item, reorder_buffer_t *buffer) {
+    int popped = 0;
+
+    omp_set_lock(&(buffer->lock));
+    reorder_slot_t *slot = &(buffer->slots[buffer->next % buffer->capacity]);
+    if (slot->complete) {
+        *item = slot->parts[slot->num_popped++].item;
+        if (slot->num_popped == slot->num_parts) {
+            slot->num_parts = 0;
+            slot->num_popped = 0;
+            slot->complete = 0;
+            buffer->next++;
+        }
+        popped = 1;
+    }
+    omp_unset_lock(&(buffer->lock));
+
+    return popped;
+}
+
+void reorder_buffer_finish(reorder_buffer_t *buffer) {
+    omp_set_lock(&(buffer->lock));
+    size_t num_pending = 0;
+    for (size_t i = 0; i < buffer->capacity; i++) {
+        if (buffer->slots[i].num_parts > 0) {
+            num_pending++;
+        }
+    }
+    int num_texts = buffer->num_texts;
+    omp_unset_lock(&(buffer->lock));
+    
+    if (num_texts > 0 || num_pending > 0) {
+        LOG_FATAL_F("Results of %d batches were never completely received, and %zu more could not be written in order\n", 
+                    num_texts, num_pending);
+    }
+}
+
+
+static int find_text(long sequence, reorder_buffer_t *buffer) {
+    for (int i = 0; i < buffer->num_texts; i++) {
+        if (buffer->texts[i].sequence == sequence) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void remove_text(int index, reorder_buffer_t *buffer) {
+    memmove(buffer->texts + index, buffer->texts + index + 1, (buffer->num_texts - index - 1) * sizeof(reorder_text_t));
+    buffer->num_texts--;
+}
+
+static void insert_part(int offset, void *item, reorder_slot_t *slot) {
+    if (slot->num_parts == slot->parts_capacity) {
+        slot->parts_capacity = slot->parts_capacity ? 2 * slot->parts_capacity : 2;
+        slot->parts = realloc(slot->parts, slot->parts_capacity * sizeof(reorder_part_t));
+    }
+    // Batches of the same text are usually put in order
+    int i = slot->num_parts;
+    while (i > 0 && slot->parts[i-1].offset > offset) {
+        slot->parts[i] = slot->parts[i-1];
+        i--;
+    }
+    slot->parts[i].offset = offset;
+    slot->parts[i].item = item;
+    slot->num_parts++;
+}
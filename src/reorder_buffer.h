@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+/**
+ * @file reorder_buffer.h
+ * @brief Emission of the results of a batch in the same order the batches were read
+ *
+ * Every text batch read from the input file is given a sequence number, and the threads that process
+ * the batches put their results in the buffer tagged with that number. The thread that writes the
+ * output pops them in sequence order, so the output follows the order of the input file in a single
+ * streaming pass.
+ *
+ * Memory is bounded by a window of sequence numbers: the threads wait before processing a batch that
+ * is too far ahead of the next one to be written.
+ *
+ * Batches are parsed in parallel and fetched in the order parsing finished, so a thread doesn't
+ * necessarily get the batch of the text it parsed. The sequence number of a batch is recovered from
+ * the text its records point to. A text may be parsed into several batches, so it is kept registered
+ * until all its records have been claimed, and its sequence is not popped until the results of all
+ * its batches have been put. The results of every batch are popped in the order of the text.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include <commons/log.h>
+
+/**
+ * Batches a thread may be ahead of the next to be written, in a window of num_threads times this value.
+ */
+#define REORDER_BUFFER_BATCHES_PER_THREAD   4
+
+/**
+ * @brief Text batch whose results have not been completely put yet.
+ */
+typedef struct reorder_text {
+    const char *begin;
+    const char *end;
+    long sequence;
+    int num_records;            /**< Records not claimed yet. */
+    int num_parts;              /**< Batches claimed so far. */
+    int num_received;           /**< Batches whose results have been put. */
+} reorder_text_t;
+
+/**
+ * @brief Results of a batch of a text, sorted by the position of the batch in the text.
+ */
+typedef struct reorder_part {
+    int offset;
+    void *item;
+} reorder_part_t;
+
+/**
+ * @brief Results of all the batches of a sequence.
+ */
+typedef struct reorder_slot {
+    reorder_part_t *parts;
+    int num_parts;
+    int parts_capacity;
+    int num_popped;
+    char complete;              /**< Whether the results of all the batches of the sequence have been put. */
+} reorder_slot_t;
+
+typedef struct reorder_buffer {
+    reorder_slot_t *slots;      /**< Slots of the window, indexed by their sequence modulo the capacity. */
+    size_t capacity;
+    long next;                  /**< Sequence of the next item to pop. */
+    long num_sequences;         /**< Sequence numbers assigned so far. */
+
+    reorder_text_t *texts;
+    int num_texts;
+    int texts_capacity;
+
+    omp_lock_t lock;
+} reorder_buffer_t;
+
+
+/**
+ * @brief Creates a reorder buffer.
+ * @param capacity maximum number of sequences waiting to be popped
+ */
+reorder_buffer_t *reorder_buffer_new(size_t capacity);
+
+/**
+ * @brief Frees a reorder buffer. Its items must have been popped.
+ */
+void reorder_buffer_free(reorder_buffer_t *buffer);
+
+/**
+ * @brief Assigns the next sequence number to a text batch.
+ *
+ * It must be called in the same order the texts were read from the input file.
+ *
+ * @param begin first character of the text
+ * @param end character after the last one of the text
+ * @param num_records number of records the text will be parsed into
+ * @return The sequence number of the text
+ */
+long reorder_buffer_register_text(const char *begin, const char *end, int num_records, reorder_buffer_t *buffer);
+
+/**
+ * @brief Returns the sequence number of the text a batch of records was parsed from.
+ *
+ * The text is no longer looked up once all its records have been claimed.
+ *
+ * @param pointer pointer to any character of the first record of the batch
+ * @param num_records number of records of the batch
+ * @param[out] offset position of the batch in the text, to be given when putting its results
+ * @return The sequence number of the text, or -1 if the pointer doesn't belong to any text with records left
+ */
+long reorder_buffer_claim_text(const char *pointer, int num_records, int *offset, reorder_buffer_t *buffer);
+
+/**
+ * @brief Unregisters a text that contains no records, so its sequence number has nothing to output.
+ */
+void reorder_buffer_skip_text(long sequence, reorder_buffer_t *buffer);
+
+/**
+ * @brief Waits until a sequence number fits in the window of the buffer.
+ */
+void reorder_buffer_wait(long sequence, reorder_buffer_t *buffer);
+
+/**
+ * @brief Puts the item of a batch of a sequence, which must fit in the window.
+ *
+ * The sequence is complete once the items of all the batches claimed from its text have been put. 
+ * Sequences that were never registered are complete with their first item.
+ *
+ * @param offset position of the batch in its text, as returned when claimed
+ * @param item item of the batch, may be NULL if it has nothing to output
+ */
+void reorder_buffer_put(long sequence, int offset, void *item, reorder_buffer_t *buffer);
+
+/**
+ * @brief Pops the next item of the next sequence, if the sequence is complete.
+ * @param[out] item item of a batch of the sequence, may be NULL
+ * @return Whether an item was popped
+ */
+int reorder_buffer_pop(void **item, reorder_buffer_t *buffer);
+
+/**
+ * @brief Checks that every sequence has been popped, once all items have been put.
+ *
+ * Results that were never received mean some batch was not given the sequence of its text, so the 
+ * output would be incomplete or out of order: it is a fatal error.
+ */
+void reorder_buffer_finish(reorder_buffer_t *buffer);
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chromosome_order.h"
+
+KHASH_MAP_INIT_STR(contig_nodes, int);
+
+static char *get_contig_id(vcf_header_entry_t *entry);
+
+static char *get_value_id(const char *value);
+
+static char *get_cache_filename(shared_options_data_t *shared_options_data);
+
+/**
+ * Contigs in a linked list, so new ones can be inserted after the contig that precedes them.
+ */
+typedef struct {
+    khash_t(contig_nodes) *nodes;   /**< Node of each contig */
+    char **names;
+    int *next;
+    int capacity;
+    int num_nodes;
+    int head;
+} contig_list_t;
+
+static contig_list_t *contig_list_new(void);
+
+static int contig_list_insert(char *id, int previous, contig_list_t *list);
+
+static char **contig_list_free(contig_list_t *list, int *num_chromosomes);
+
+
+char **resolve_chromosome_order(vcf_file_t **files, int num_files, const char *order_filename,
+                                shared_options_data_t *shared_options_data, int *num_chromosomes) {
+    char **chromosome_order = NULL;
+    *num_chromosomes = 0;
+    
+    if (order_filename) {
+        chromosome_order = read_chromosome_order(order_filename, num_chromosomes);
+        if (chromosome_order) {
+            LOG_INFO_F("Chromosome order read from %s\n", order_filename);
+            return chromosome_order;
+        }
+        LOG_ERROR_F("Chromosome order file %s can't be read\n", order_filename);
+    }
+    
+    chromosome_order = get_contig_order(files, num_files, num_chromosomes);
+    if (chromosome_order) {
+        LOG_INFO("Chromosome order read from the ##contig lines of the input files\n");
+        return chromosome_order;
+    }
+    
+    char *cache_filename = get_cache_filename(shared_options_data);
+    if (cache_filename) {
+        chromosome_order = read_chromosome_order(cache_filename, num_chromosomes);
+        if (chromosome_order) {
+            LOG_INFO_F("Chromosome order read from %s\n", cache_filename);
+            free(cache_filename);
+            return chromosome_order;
+        }
+    }
+    
+    // Last resort: query the web service and keep its answer for the next runs
+    if (shared_options_data->host_url) {
+        LOG_INFO("Chromosome order not found locally, querying the web service\n");
+        chromosome_order = get_chromosome_order(shared_options_data->host_url, shared_options_data->species,
+                                                shared_options_data->version, num_chromosomes);
+        if (chromosome_order && *num_chromosomes > 0 && cache_filename) {
+            if (write_chromosome_order(cache_filename, chromosome_order, *num_chromosomes)) {
+                LOG_WARN_F("Chromosome order can't be cached in %s\n", cache_filename);
+            }
+        }
+    }
+    
+    free(cache_filename);
+    return chromosome_order;
+}
+
+char **read_chromosome_order(const char *filename, int *num_chromosomes) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return NULL;
+    }
+    
+    int capacity = 64;
+    char **chromosome_order = (char**) malloc (capacity * sizeof(char*));
+    *num_chromosomes = 0;
+    
+    char *line = NULL;
+    size_t line_capacity = 0;
+    while (getline(&line, &line_capacity, file) != -1) {
+        // The name is the first column, the rest of the columns of a FASTA index are ignored
+        size_t length = strcspn(line, " \t\r\n");
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        
+        if (*num_chromosomes == capacity) {
+            capacity *= 2;
+            chromosome_order = (char**) realloc (chromosome_order, capacity * sizeof(char*));
+        }
+        chromosome_order[(*num_chromosomes)++] = strndup(line, length);
+    }
+    
+    free(line);
+    fclose(file);
+    
+    if (*num_chromosomes == 0) {
+        free(chromosome_order);
+        return NULL;
+    }
+    return chromosome_order;
+}
+
+int write_chromosome_order(const char *filename, char **chromosome_order, int num_chromosomes) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return errno;
+    }
+    
+    for (int i = 0; i < num_chromosomes; i++) {
+        fprintf(file, "%s\n", chromosome_order[i]);
+    }
+    
+    return fclose(file) ? errno : 0;
+}
+
+char **get_contig_order(vcf_file_t **files, int num_files, int *num_chromosomes) {
+    contig_list_t *list = contig_list_new();
+    
+    for (int i = 0; i < num_files; i++) {
+        int previous = -1;
+        
+        for (int j = 0; j < files[i]->header_entries->size; j++) {
+            vcf_header_entry_t *entry = array_list_get(j, files[i]->header_entries);
+            if (entry->name_len != 6 || strncmp("contig", entry->name, entry->name_len)) {
+                continue;
+            }
+            
+            char *id = get_contig_id(entry);
+            if (id) {
+                previous = contig_list_insert(id, previous, list);
+            }
+        }
+    }
+    
+    return contig_list_free(list, num_chromosomes);
+}
+
+char **read_contig_order(const char *filename, int *num_chromosomes) {
+    *num_chromosomes = 0;
+    gzFile file = gzopen(filename, "r");
+    if (!file) {
+        return NULL;
+    }
+    
+    int capacity = 64;
+    char **chromosome_order = (char**) malloc (capacity * sizeof(char*));
+    
+    // Lines longer than the buffer are read in several pieces, only the first one of them is checked
+    char line[CONTIG_LINE_BUFFER_SIZE];
+    int line_start = 1;
+    while (gzgets(file, line, CONTIG_LINE_BUFFER_SIZE)) {
+        if (line_start) {
+            if (line[0] != '#' || !strncmp("#CHROM", line, 6)) {
+                break;
+            }
+            
+            char *id = strncmp("##contig=", line, 9) ? NULL : get_value_id(line + 9);
+            if (id) {
+                if (*num_chromosomes == capacity) {
+                    capacity *= 2;
+                    chromosome_order = (char**) realloc (chromosome_order, capacity * sizeof(char*));
+                }
+                chromosome_order[(*num_chromosomes)++] = id;
+            }
+        }
+        size_t length = strlen(line);
+        line_start = (length > 0 && line[length - 1] == '\n');
+    }
+    
+    gzclose(file);
+    
+    if (*num_chromosomes == 0) {
+        free(chromosome_order);
+        return NULL;
+    }
+    return chromosome_order;
+}
+
+char **merge_chromosome_orders(char ***chromosome_orders, int *num_chromosomes_per_order, int num_orders, int *num_chromosomes) {
+    contig_list_t *list = contig_list_new();
+    
+    for (int i = 0; i < num_orders; i++) {
+        int previous = -1;
+        for (int j = 0; j < num_chromosomes_per_order[i]; j++) {
+            previous = contig_list_insert(strdup(chromosome_orders[i][j]), previous, list);
+        }
+    }
+    
+    return contig_list_free(list, num_chromosomes);
+}
+
+void free_chromosome_order(char **chromosome_order, int num_chromosomes) {
+    if (!chromosome_order) {
+        return;
+    }
+    for (int i = 0; i < num_chromosomes; i++) {
+        free(chromosome_order[i]);
+    }
+    free(chromosome_order);
+}
+
+
+/**
+ * Gets the value of the ID field of a ##contig=<ID=...,length=...> line.
+ */
+static char *get_contig_id(vcf_header_entry_t *entry) {
+    for (int i = 0; i < entry->values->size; i++) {
+        char *id = get_value_id(array_list_get(i, entry->values));
+        if (id) {
+            return id;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Gets the ID field of the value of a ##contig line, which may be enclosed in angle brackets.
+ */
+static char *get_value_id(const char *value) {
+    for (const char *field = strstr(value, "ID="); field; field = strstr(field + 1, "ID=")) {
+        if (field == value || field[-1] == '<' || field[-1] == ',') {
+            size_t length = strcspn(field + 3, ",>\r\n");
+            return (length > 0) ? strndup(field + 3, length) : NULL;
+        }
+    }
+    return NULL;
+}
+
+static char *get_cache_filename(shared_options_data_t *shared_options_data) {
+    if (!getenv("HOME") || !shared_options_data->species || !shared_options_data->version) {
+        return NULL;
+    }
+    
+    char *filename = (char*) malloc (1024 * sizeof(char));
+    snprintf(filename, 1024, "%s/.hpg-variant", getenv("HOME"));
+    int ret_code = create_directory(filename);
+    if (ret_code != 0 && errno != EEXIST) {
+        free(filename);
+        return NULL;
+    }
+    
+    snprintf(filename, 1024, "%s/.hpg-variant/chromosomes_%s_%s.txt", getenv("HOME"), 
+             shared_options_data->species, shared_options_data->version);
+    return filename;
+}
+
+static contig_list_t *contig_list_new(void) {
+    contig_list_t *list = (contig_list_t*) malloc (sizeof(contig_list_t));
+    list->nodes = kh_init(contig_nodes);
+    list->capacity = 64;
+    list->num_nodes = 0;
+    list->head = -1;
+    list->names = (char**) malloc (list->capacity * sizeof(char*));
+    list->next = (int*) malloc (list->capacity * sizeof(int));
+    return list;
+}
+
+/**
+ * Inserts a contig after the one in a given node, or at the head if it is negative. If the contig is 
+ * already in the list, it is not moved and its ID is freed. Returns the node of the contig.
+ */
+static int contig_list_insert(char *id, int previous, contig_list_t *list) {
+    khiter_t iter = kh_get(contig_nodes, list->nodes, id);
+    if (iter != kh_end(list->nodes)) {
+        free(id);
+        return kh_value(list->nodes, iter);
+    }
+    
+    if (list->num_nodes == list->capacity) {
+        list->capacity *= 2;
+        list->names = (char**) realloc (list->names, list->capacity * sizeof(char*));
+        list->next = (int*) realloc (list->next, list->capacity * sizeof(int));
+    }
+    
+    int node = list->num_nodes++;
+    list->names[node] = id;
+    if (previous < 0) {
+        list->next[node] = list->head;
+        list->head = node;
+    } else {
+        list->next[node] = list->next[previous];
+        list->next[previous] = node;
+    }
+    
+    int ret;
+    iter = kh_put(contig_nodes, list->nodes, id, &ret);
+    kh_value(list->nodes, iter) = node;
+    return node;
+}
+
+/**
+ * Frees a list of contigs, returning them in order, or NULL if it is empty.
+ */
+static char **contig_list_free(contig_list_t *list, int *num_chromosomes) {
+    char **chromosome_order = NULL;
+    *num_chromosomes = list->num_nodes;
+    if (list->num_nodes > 0) {
+        chromosome_order = (char**) malloc (list->num_nodes * sizeof(char*));
+        int k = 0;
+        for (int node = list->head; node >= 0; node = list->next[node]) {
+            chromosome_order[k++] = list->names[node];
+        }
+    }
+    
+    kh_destroy(contig_nodes, list->nodes);
+    free(list->next);
+    free(list->names);
+    free(list);
+    
+    return chromosome_order;
+}
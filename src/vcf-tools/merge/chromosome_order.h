@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VCF_TOOLS_CHROMOSOME_ORDER_H
+#define VCF_TOOLS_CHROMOSOME_ORDER_H
+
+/**
+ * @file chromosome_order.h
+ * @brief Order of the chromosomes the input files of a merge are sorted by
+ *
+ * The order is resolved from the first of these sources that provides it:
+ * - A file given by the user, with a chromosome per line or a FASTA index (.fai), whose first column is
+ *   the name of each sequence.
+ * - The ##contig lines of the headers of the input files.
+ * - The order cached in the hpg-variant folder of the user from a previous run.
+ * - The web service, whose answer is cached for the next runs.
+ *
+ * So the web service is only queried the first time files without ##contig lines are merged.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <bioformats/features/region/region.h>
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <commons/file_utils.h>
+#include <commons/log.h>
+#include <containers/khash.h>
+
+#include "shared_options.h"
+
+/**
+ * Size of the buffer the header lines are read into when looking for ##contig lines.
+ */
+#define CONTIG_LINE_BUFFER_SIZE     4096
+
+
+/**
+ * @brief Resolves the order of the chromosomes of the files to merge, from the first source that provides it.
+ * @param files files to merge, whose headers have been already parsed
+ * @param num_files number of files
+ * @param order_filename file with the chromosome order given by the user, NULL if none
+ * @param shared_options_data species, version and URL of the web service
+ * @param[out] num_chromosomes number of chromosomes in the order
+ * @return The chromosomes in order, or NULL if it could not be resolved
+ */
+char **resolve_chromosome_order(vcf_file_t **files, int num_files, const char *order_filename,
+                                shared_options_data_t *shared_options_data, int *num_chromosomes);
+
+/**
+ * @brief Reads a chromosome order from a file with a chromosome per line, or a FASTA index.
+ * 
+ * Only the first tab-separated column of each line is used. Empty lines and lines starting with '#' are skipped.
+ * 
+ * @return The chromosomes in order, or NULL if the file could not be read
+ */
+char **read_chromosome_order(const char *filename, int *num_chromosomes);
+
+/**
+ * @brief Writes a chromosome order to a file, a chromosome per line.
+ * @return 0 if the file was written, an errno code otherwise
+ */
+int write_chromosome_order(const char *filename, char **chromosome_order, int num_chromosomes);
+
+/**
+ * @brief Gets the order of the chromosomes from the ##contig lines of the headers of several files.
+ * 
+ * Contigs missing from the first files are placed after the contig that precedes them in the file where 
+ * they are found.
+ * 
+ * @return The chromosomes in order, or NULL if no file has ##contig lines
+ */
+char **get_contig_order(vcf_file_t **files, int num_files, int *num_chromosomes);
+
+/**
+ * @brief Reads the order of the chromosomes from the ##contig lines of a VCF file, compressed or not.
+ * 
+ * Only the header of the file is read, without parsing it, so the files can be read one by one 
+ * when there are too many to be opened at the same time.
+ * 
+ * @return The chromosomes in order, or NULL if the file can't be read or has no ##contig lines
+ */
+char **read_contig_order(const char *filename, int *num_chromosomes);
+
+/**
+ * @brief Merges several chromosome orders into one, in the same way the orders of the ##contig lines of 
+ * several files are merged.
+ * 
+ * @param chromosome_orders orders to merge
+ * @param num_chromosomes_per_order number of chromosomes in each order
+ * @param num_orders number of orders
+ * @param[out] num_chromosomes number of chromosomes in the merged order
+ * @return The chromosomes in order, or NULL if all the orders are empty
+ */
+char **merge_chromosome_orders(char ***chromosome_orders, int *num_chromosomes_per_order, int num_orders, int *num_chromosomes);
+
+/**
+ * @brief Frees a chromosome order.
+ */
+void free_chromosome_order(char **chromosome_order, int num_chromosomes);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chromosome_table.h"
+
+static uint64_t hash_name(const char *name, int length, uint64_t seed);
+
+static int build_table(char **names, int *lengths, int *ranks, int num_names, chromosome_table_t *table);
+
+
+chromosome_table_t *chromosome_table_new(char **chromosome_order, int num_chromosomes) {
+    chromosome_table_t *table = (chromosome_table_t*) calloc (1, sizeof(chromosome_table_t));
+    table->num_chromosomes = num_chromosomes;
+    
+    int *lengths = (int*) malloc ((num_chromosomes + 1) * sizeof(int));
+    int *ranks = (int*) malloc ((num_chromosomes + 1) * sizeof(int));
+    for (int i = 0; i < num_chromosomes; i++) {
+        lengths[i] = strlen(chromosome_order[i]);
+        ranks[i] = i;
+    }
+    
+    // Start with twice as many slots as chromosomes, and double them in the unlikely case no displacement is found
+    table->num_slots = 1;
+    while (table->num_slots < 2 * (size_t) num_chromosomes) {
+        table->num_slots *= 2;
+    }
+    table->num_buckets = num_chromosomes / CHROMOSOME_TABLE_BUCKET_SIZE + 1;
+    
+    while (!build_table(chromosome_order, lengths, ranks, num_chromosomes, table)) {
+        table->num_slots *= 2;
+        LOG_DEBUG_F("Chromosome table rebuilt with %zu slots\n", table->num_slots);
+    }
+    
+    free(ranks);
+    free(lengths);
+    return table;
+}
+
+void chromosome_table_free(chromosome_table_t *table) {
+    for (size_t i = 0; i < table->num_slots; i++) {
+        free(table->names[i]);
+    }
+    free(table->names);
+    free(table->lengths);
+    free(table->ranks);
+    free(table->displacements);
+    free(table);
+}
+
+int chromosome_table_rank(const char *chromosome, int length, chromosome_table_t *table) {
+    if (table->num_chromosomes == 0) {
+        return CHROMOSOME_UNKNOWN_RANK;
+    }
+    
+    size_t bucket = hash_name(chromosome, length, 0) % table->num_buckets;
+    size_t slot = hash_name(chromosome, length, table->displacements[bucket]) & (table->num_slots - 1);
+    
+    if (table->names[slot] && table->lengths[slot] == length && !strncmp(table->names[slot], chromosome, length)) {
+        return table->ranks[slot];
+    }
+    return CHROMOSOME_UNKNOWN_RANK;
+}
+
+
+/**
+ * FNV-1a hash of a name, with a final mix so the low bits used as slot depend on all the characters.
+ */
+static uint64_t hash_name(const char *name, int length, uint64_t seed) {
+    uint64_t hash = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Places the names in the slots of the table, finding the displacement of each bucket from the largest 
+ * bucket to the smallest one.
+ * 
+ * @return Whether a displacement was found for every bucket
+ */
+static int build_table(char **names, int *lengths, int *ranks, int num_names, chromosome_table_t *table) {
+    size_t num_slots = table->num_slots, num_buckets = table->num_buckets;
+    
+    // Names of each bucket, in counting sort order
+    size_t *bucket_of = (size_t*) malloc ((num_names + 1) * sizeof(size_t));
+    size_t *bucket_start = (size_t*) calloc (num_buckets + 1, sizeof(size_t));
+    int *bucket_names = (int*) malloc ((num_names + 1) * sizeof(int));
+    for (int i = 0; i < num_names; i++) {
+        bucket_of[i] = hash_name(names[i], lengths[i], 0) % num_buckets;
+        bucket_start[bucket_of[i] + 1]++;
+    }
+    for (size_t b = 0; b < num_buckets; b++) {
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    size_t *filled = (size_t*) calloc (num_buckets, sizeof(size_t));
+    for (int i = 0; i < num_names; i++) {
+        bucket_names[bucket_start[bucket_of[i]] + filled[bucket_of[i]]++] = i;
+    }
+    
+    // Largest buckets are placed first, while most slots are free
+    size_t *order = (size_t*) malloc (num_buckets * sizeof(size_t));
+    size_t max_size = 0;
+    for (size_t b = 0; b < num_buckets; b++) {
+        size_t size = bucket_start[b + 1] - bucket_start[b];
+        max_size = (size > max_size) ? size : max_size;
+    }
+    size_t num_ordered = 0;
+    for (size_t size = max_size; size > 0; size--) {
+        for (size_t b = 0; b < num_buckets; b++) {
+            if (bucket_start[b + 1] - bucket_start[b] == size) {
+                order[num_ordered++] = b;
+            }
+        }
+    }
+    
+    free(table->names);
+    free(table->lengths);
+    free(table->ranks);
+    free(table->displacements);
+    table->names = (char**) calloc (num_slots, sizeof(char*));
+    table->lengths = (int*) calloc (num_slots, sizeof(int));
+    table->ranks = (int*) calloc (num_slots, sizeof(int));
+    table->displacements = (uint32_t*) calloc (num_buckets, sizeof(uint32_t));
+    
+    size_t *slots = (size_t*) malloc ((max_size + 1) * sizeof(size_t));
+    int success = 1;
+    
+    for (size_t k = 0; k < num_ordered && success; k++) {
+        size_t b = order[k];
+        int *members = bucket_names + bucket_start[b];
+        size_t size = bucket_start[b + 1] - bucket_start[b];
+        
+        // A repeated chromosome would never fit in different slots, so only its first occurrence is kept
+        int num_members = 0;
+        for (size_t i = 0; i < size; i++) {
+            int repeated = 0;
+            for (int j = 0; j < num_members && !repeated; j++) {
+                repeated = lengths[members[j]] == lengths[members[i]] && !strcmp(names[members[j]], names[members[i]]);
+            }
+            if (!repeated) {
+                members[num_members++] = members[i];
+            }
+        }
+        
+        uint32_t displacement;
+        for (displacement = 1; displacement < (1 << 20); displacement++) {
+            int fits = 1;
+            for (int i = 0; i < num_members && fits; i++) {
+                slots[i] = hash_name(names[members[i]], lengths[members[i]], displacement) & (num_slots - 1);
+                fits = (table->names[slots[i]] == NULL);
+                for (int j = 0; j < i && fits; j++) {
+                    fits = (slots[j] != slots[i]);
+                }
+            }
+            if (fits) {
+                break;
+            }
+        }
+        
+        if (displacement == (1 << 20)) {
+            success = 0;
+            break;
+        }
+        
+        table->displacements[b] = displacement;
+        for (int i = 0; i < num_members; i++) {
+            table->names[slots[i]] = strdup(names[members[i]]);
+            table->lengths[slots[i]] = lengths[members[i]];
+            table->ranks[slots[i]] = ranks[members[i]];
+        }
+    }
+    
+    if (!success) {
+        for (size_t i = 0; i < num_slots; i++) {
+            free(table->names[i]);
+            table->names[i] = NULL;
+        }
+    }
+    
+    free(slots);
+    free(order);
+    free(filled);
+    free(bucket_names);
+    free(bucket_start);
+    free(bucket_of);
+    
+    return success;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VCF_TOOLS_CHROMOSOME_TABLE_H
+#define VCF_TOOLS_CHROMOSOME_TABLE_H
+
+/**
+ * @file chromosome_table.h
+ * @brief Ranks of the chromosomes of an assembly, found with a perfect hash of their names
+ *
+ * The names in the chromosome order are interned once into a perfect hash: a first hash assigns each
+ * name to a bucket, and the displacement of the bucket, chosen when the table is built, sends every name
+ * to its own slot. Looking up a name takes two hashes and a single string comparison, regardless of the
+ * number of chromosomes, so assemblies with thousands of contigs are as fast as the human one.
+ *
+ * The rank of a chromosome and a position are packed into a 64-bit sort key, so records can be sorted
+ * with integer comparisons.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <commons/log.h>
+
+/**
+ * Bits of a sort key used by the position, the rest are used by the rank of the chromosome.
+ */
+#define CHROMOSOME_POSITION_BITS    40
+
+/**
+ * Rank of the chromosomes not included in the chromosome order, which are sorted after the rest.
+ */
+#define CHROMOSOME_UNKNOWN_RANK     ((1 << (64 - CHROMOSOME_POSITION_BITS)) - 1)
+
+/**
+ * Average number of chromosomes in each bucket of the first hash.
+ */
+#define CHROMOSOME_TABLE_BUCKET_SIZE    4
+
+typedef struct chromosome_table {
+    char **names;               /**< Chromosome stored in each slot, NULL if it is empty */
+    int *lengths;               /**< Length of the name of the chromosome in each slot */
+    int *ranks;                 /**< Rank of the chromosome in each slot */
+    size_t num_slots;           /**< Number of slots, a power of 2 */
+    
+    uint32_t *displacements;    /**< Displacement that sends the chromosomes of each bucket to their slots */
+    size_t num_buckets;
+    
+    int num_chromosomes;
+} chromosome_table_t;
+
+
+/**
+ * @brief Builds the table of ranks of the chromosomes in an order.
+ * 
+ * If a chromosome is repeated, its first rank is kept.
+ * 
+ * @param chromosome_order chromosomes in the order they are sorted
+ * @param num_chromosomes number of chromosomes in the order
+ */
+chromosome_table_t *chromosome_table_new(char **chromosome_order, int num_chromosomes);
+
+/**
+ * @brief Frees a table of chromosomes.
+ */
+void chromosome_table_free(chromosome_table_t *table);
+
+/**
+ * @brief Returns the rank of a chromosome, or CHROMOSOME_UNKNOWN_RANK if it is not in the table.
+ * @param chromosome name of the chromosome, doesn't need to be null-terminated
+ * @param length length of the name
+ */
+int chromosome_table_rank(const char *chromosome, int length, chromosome_table_t *table);
+
+/**
+ * @brief Packs the rank of a chromosome and a position into a sort key.
+ */
+static inline uint64_t chromosome_sort_key(int rank, long position) {
+    assert(position >= 0 && position < (1L << CHROMOSOME_POSITION_BITS));
+    return ((uint64_t) rank << CHROMOSOME_POSITION_BITS) | (uint64_t) position;
+}
+
+/**
+ * @brief Returns the rank of the chromosome of a sort key.
+ */
+static inline int chromosome_key_rank(uint64_t key) {
+    return (int) (key >> CHROMOSOME_POSITION_BITS);
+}
+
+/**
+ * @brief Returns the position of a sort key.
+ */
+static inline long chromosome_key_position(uint64_t key) {
+    return (long) (key & ((1ULL << CHROMOSOME_POSITION_BITS) - 1));
+}
+
+#endif
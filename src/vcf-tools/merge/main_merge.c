@@ -36,7 +36,7 @@ int vcf_tool_merge(int argc, char *argv[], const char *configuration_file, array
     if (argc == 1 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         argtable = merge_merge_options(merge_options, shared_options, arg_end(merge_options->num_options + shared_options->num_options));
         show_usage("hpg-var-vcf merge", argtable, merge_options->num_options + shared_options->num_options);
-        arg_freetable(argtable, 19);
+        arg_freetable(argtable, 22);
         return 0;
     }
 
@@ -77,7 +77,7 @@ int vcf_tool_merge(int argc, char *argv[], const char *configuration_file, array
 
     free_merge_options_data(options_data);
     free_shared_options_data(shared_options_data);
-    arg_freetable(argtable, 19);
+    arg_freetable(argtable, 22);
 
     return 0;
 }
@@ -91,6 +91,9 @@ merge_options_t *new_merge_cli_options() {
     options->strict_reference = arg_lit0(NULL, "strict-ref", "Whether to reject variants whose reference allele is not the same in all files");
     options->copy_filter = arg_lit0(NULL, "copy-filter", "Whether to copy the FILTER column from the original files into the samples");
     options->copy_info = arg_lit0(NULL, "copy-info", "Whether to copy the INFO column from the original files into the samples");
+    options->chromosome_order = arg_str0(NULL, "chromosome-order", NULL, "File with the chromosomes in the order they are sorted, one per line, or a FASTA index (.fai)");
+    options->fan_in = arg_int0(NULL, "fan-in", NULL, "Maximum number of files merged at once, more files are merged in several levels (default 128)");
+    options->temp_directory = arg_str0(NULL, "temp-dir", NULL, "Directory where the intermediate files of a merge in several levels are stored (default the output directory)");
     return options;
 }
 
@@ -111,6 +114,11 @@ merge_options_data_t *new_merge_options_data(merge_options_t *options, array_lis
     options_data->strict_reference = options->strict_reference->count;
     options_data->copy_filter = options->copy_filter->count;
     options_data->copy_info = options->copy_info->count;
+    options_data->chromosome_order_file = (options->chromosome_order->count > 0 || strlen(*(options->chromosome_order->sval)) > 0) ? 
+                                          strdup(*(options->chromosome_order->sval)) : NULL;
+    options_data->fan_in = (*(options->fan_in->ival) > 0) ? *(options->fan_in->ival) : MERGE_DEFAULT_FAN_IN;
+    options_data->temp_directory = (options->temp_directory->count > 0 || strlen(*(options->temp_directory->sval)) > 0) ? 
+                                   strdup(*(options->temp_directory->sval)) : NULL;
     options_data->config_search_paths = config_search_paths;
     return options_data;
 }
@@ -126,6 +134,8 @@ void free_merge_options_data(merge_options_data_t *options_data) {
     }
     free(options_data->info_fields);
     
+    if (options_data->chromosome_order_file) { free(options_data->chromosome_order_file); }
+    if (options_data->temp_directory) { free(options_data->temp_directory); }
     free(options_data);
 }
 
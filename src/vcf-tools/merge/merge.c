@@ -405,31 +405,46 @@ char* merge_alternate_field(vcf_record_file_link** position_in_files, int positi
 
 
 float merge_quality_field(vcf_record_file_link** position_in_files, int position_occurrences) {
+    double accum_quality;
+    int total_samples;
+    float result;
+    
+    merge_quality_sum(position_in_files, position_occurrences, &accum_quality, &total_samples);
+    
+    if (total_samples > 0) {
+        result = accum_quality / total_samples;
+    } else {
+        result = -1;
+    }
+    
+    return result;
+}
+
+void merge_quality_sum(vcf_record_file_link** position_in_files, int position_occurrences, double *quality_sum, int *quality_samples) {
     vcf_file_t *file;
     vcf_record_t *input;
-    float accum_quality = 0.0f;
-    int total_samples = 0;
     int file_num_samples;
-    float result;
+    
+    *quality_sum = 0;
+    *quality_samples = 0;
     
     for (int i = 0; i < position_occurrences; i++) {
+        // A spill record already carries the sum of the files merged into it
+        if (position_in_files[i]->quality_samples > 0) {
+            *quality_sum += position_in_files[i]->quality_sum;
+            *quality_samples += position_in_files[i]->quality_samples;
+            continue;
+        }
+        
         file = position_in_files[i]->file;
         input = position_in_files[i]->record;
         file_num_samples = get_num_vcf_samples(file);
         
         if (input->quality > 0) {
-            accum_quality += input->quality * file_num_samples;
+            *quality_sum += (double) input->quality * file_num_samples;
         }
-        total_samples += file_num_samples;
+        *quality_samples += file_num_samples;
     }
-    
-    if (total_samples > 0) {
-        result = accum_quality / total_samples;
-    } else {
-        result = -1;
-    }
-    
-    return result;
 }
 
 
@@ -453,13 +468,16 @@ char* merge_filter_field(vcf_record_file_link** position_in_files, int position_
         } else if (!strncmp(input->filter, ".", input->filter_len)) {
             miss_found = 1;
         } else {
-            char *filter = strndup(input->filter, input->filter_len);
-            if (!array_list_contains(filter, failed_filters)) {
-                array_list_insert(filter, failed_filters);
-                filter_text_len += strlen(filter) + 1; // concat field + ","
-            } else {
-                free(filter);
+            // A record may have failed several filters, which are registered one by one
+            char *filters = strndup(input->filter, input->filter_len);
+            char *saveptr;
+            for (char *filter = strtok_r(filters, ";", &saveptr); filter; filter = strtok_r(NULL, ";", &saveptr)) {
+                if (!array_list_contains(filter, failed_filters)) {
+                    array_list_insert(strdup(filter), failed_filters);
+                    filter_text_len += strlen(filter) + 1; // concat field + ";"
+                }
             }
+            free(filters);
         }
     }
     
@@ -901,7 +919,7 @@ static char *get_empty_sample(int num_format_fields, int gt_pos, merge_options_d
 }
 
 vcf_record_file_link *vcf_record_file_link_new(vcf_record_t *record, vcf_file_t *file) {
-    vcf_record_file_link *link = malloc(sizeof(vcf_record_file_link));
+    vcf_record_file_link *link = calloc(1, sizeof(vcf_record_file_link));
     link->record = record;
     link->file = file;
     return link;
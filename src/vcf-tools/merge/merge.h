@@ -44,7 +44,12 @@
 #include "hpg_variant_utils.h"
 #include "shared_options.h"
 
-#define NUM_MERGE_OPTIONS   6
+#define NUM_MERGE_OPTIONS   9
+
+/**
+ * Maximum number of files merged at once if not specified.
+ */
+#define MERGE_DEFAULT_FAN_IN    128
 
 
 #define MERGED_RECORD       1
@@ -62,15 +67,21 @@ typedef struct merge_options {
     struct arg_lit *strict_reference;   /**< Whether to reject variants whose reference allele is not the same in all files */
     struct arg_lit *copy_filter;        /**< Whether to copy the contents of the original FILTER field into the samples */
     struct arg_lit *copy_info;          /**< Whether to copy the contents of the original INFO field into the samples */
+    struct arg_str *chromosome_order;   /**< File with the order of the chromosomes, a chromosome per line or a FASTA index */
+    struct arg_int *fan_in;             /**< Maximum number of files merged at once, more files are merged hierarchically */
+    struct arg_str *temp_directory;     /**< Directory where the intermediate files of a hierarchical merge are stored */
     int num_options;
 } merge_options_t;
 
 typedef struct merge_options_data {
     char **input_files;     /**< List of files used as input */
     char **info_fields;     /**< List of attributes of the new INFO fields generated */
+    char *chromosome_order_file;    /**< File with the order of the chromosomes, NULL to resolve it from other sources */
+    char *temp_directory;   /**< Directory where the intermediate files of a hierarchical merge are stored, NULL to use the output one */
     
     int num_files;          /**< Number of files used as input */
     int num_info_fields;    /**< Number of attributes of the new INFO fields generated */ 
+    int fan_in;             /**< Maximum number of files merged at once */
     
     int strict_reference;   /**< Whether to reject variants whose reference allele is not the same in all files */
     int copy_filter;        /**< Whether to copy the contents of the original FILTER field into the samples */
@@ -85,6 +96,9 @@ typedef struct merge_options_data {
 typedef struct {
     vcf_record_t *record;
     vcf_file_t *file;
+    
+    double quality_sum;     /**< Sum of the qualities merged into a record read from a spill, weighted by their samples */
+    int quality_samples;    /**< Number of samples whose quality is summed, 0 if the record was read from an input file */
 } vcf_record_file_link;
 
 
@@ -125,6 +139,16 @@ char *merge_id_field(vcf_record_file_link **position_in_files, int position_occu
 
 float merge_quality_field(vcf_record_file_link **position_in_files, int position_occurrences);
 
+/**
+ * @brief Sums the qualities of a position, weighted by the number of samples of each file.
+ * @details A record read from a spill contributes the sum and samples of the files merged into it, so 
+ * merging the spills of several groups of files gives the same quality as merging all the files at once.
+ * 
+ * @param[out] quality_sum Sum of the qualities, missing ones counted as 0
+ * @param[out] quality_samples Number of samples of the files the position is found in
+ */
+void merge_quality_sum(vcf_record_file_link **position_in_files, int position_occurrences, double *quality_sum, int *quality_samples);
+
 char *merge_alternate_field(vcf_record_file_link **position_in_files, int position_occurrences, cp_hashtable *alleles_table);
 
 char *merge_filter_field(vcf_record_file_link **position_in_files, int position_occurrences);
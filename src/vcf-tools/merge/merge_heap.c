@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "merge_heap.h"
+
+static int compare_keys(uint64_t key1, const char *chromosome1, uint64_t key2, const char *chromosome2);
+
+static int cursor_precedes(merge_cursor_t *cursor1, merge_cursor_t *cursor2);
+
+static void heap_sift_up(int position, merge_heap_t *heap);
+
+static void heap_sift_down(int position, merge_heap_t *heap);
+
+
+/* **********************************************
+ *                  Cursors                     *
+ * **********************************************/
+
+merge_cursor_t *merge_cursor_new(int index, vcf_file_t *file, merge_batch_source_t next_batch, void *source) {
+    merge_cursor_t *cursor = (merge_cursor_t*) calloc (1, sizeof(merge_cursor_t));
+    cursor->index = index;
+    cursor->file = file;
+    cursor->next_batch = next_batch;
+    cursor->source = source;
+    cursor->finished_batches = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    return cursor;
+}
+
+void merge_cursor_free(merge_cursor_t *cursor) {
+    assert(cursor);
+    merge_cursor_release_batches(cursor);
+    array_list_free(cursor->finished_batches, NULL);
+    if (cursor->batch) {
+        vcf_batch_free(cursor->batch);
+    }
+    free(cursor->chromosome);
+    free(cursor);
+}
+
+int merge_cursor_next(merge_cursor_t *cursor) {
+    if (cursor->batch && cursor->record_index + 1 < cursor->batch->records->size) {
+        cursor->record_index++;
+        return 1;
+    }
+    
+    if (cursor->batch) {
+        array_list_insert(cursor->batch, cursor->finished_batches);
+        cursor->batch = NULL;
+    }
+    
+    // Skip the batches without records, such as the ones with only header lines
+    while (!cursor->eof) {
+        vcf_batch_t *batch = cursor->next_batch(cursor);
+        if (!batch) {
+            cursor->eof = 1;
+        } else if (batch->records->size == 0) {
+            vcf_batch_free(batch);
+        } else {
+            cursor->batch = batch;
+            cursor->record_index = 0;
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+vcf_record_t *merge_cursor_record(merge_cursor_t *cursor) {
+    assert(cursor->batch);
+    return array_list_get(cursor->record_index, cursor->batch->records);
+}
+
+void merge_cursor_release_batches(merge_cursor_t *cursor) {
+    for (int i = 0; i < cursor->finished_batches->size; i++) {
+        vcf_batch_free(array_list_get(i, cursor->finished_batches));
+    }
+    cursor->finished_batches->size = 0;
+}
+
+vcf_batch_t *merge_text_batch_source(merge_cursor_t *cursor) {
+    merge_text_source_t *source = cursor->source;
+    
+    // A text may have been parsed into several batches
+    vcf_batch_t *batch;
+    while (!(batch = fetch_vcf_batch_non_blocking(cursor->file))) {
+        list_item_t *item = list_remove_item(source->text_list);
+        if (item == NULL || !strcmp(item->data_p, "")) {
+            LOG_INFO_F("EOF found in file %s\n", cursor->file->filename);
+            if (item != NULL) {
+                free(item->data_p);
+                list_item_free(item);
+            }
+            return NULL;
+        }
+        
+        char *text_begin = item->data_p;
+        char *text_end = text_begin + strlen(text_begin);
+        vcf_reader_status *status = vcf_reader_status_new(source->batch_lines, 0);
+        int ret_code = run_vcf_parser(text_begin, text_end, source->batch_lines, cursor->file, status);
+        if (ret_code) {
+            LOG_ERROR_F("Error %d while reading the file %s\n", ret_code, cursor->file->filename);
+        }
+        
+        vcf_reader_status_free(status);
+        list_item_free(item);
+    }
+    
+    return batch;
+}
+
+
+/* **********************************************
+ *                    Heap                      *
+ * **********************************************/
+
+merge_heap_t *merge_heap_new(int capacity, chromosome_table_t *chromosomes) {
+    merge_heap_t *heap = (merge_heap_t*) malloc (sizeof(merge_heap_t));
+    heap->cursors = (merge_cursor_t**) malloc (capacity * sizeof(merge_cursor_t*));
+    heap->size = 0;
+    heap->capacity = capacity;
+    heap->chromosomes = chromosomes;
+    return heap;
+}
+
+void merge_heap_free(merge_heap_t *heap) {
+    free(heap->cursors);
+    free(heap);
+}
+
+void merge_heap_push(merge_cursor_t *cursor, merge_heap_t *heap) {
+    assert(heap->size < heap->capacity);
+    vcf_record_t *record = merge_cursor_record(cursor);
+    
+    // The chromosome is looked up only when it changes, which happens once per chromosome in a sorted file
+    char *chromosome = cursor->chromosome;
+    int rank = chromosome_key_rank(cursor->key);
+    if (!chromosome || strncmp(chromosome, record->chromosome, record->chromosome_len) || chromosome[record->chromosome_len]) {
+        chromosome = strndup(record->chromosome, record->chromosome_len);
+        rank = chromosome_table_rank(record->chromosome, record->chromosome_len, heap->chromosomes);
+    }
+    uint64_t key = chromosome_sort_key(rank, record->position);
+    
+    if (cursor->chromosome && compare_keys(key, chromosome, cursor->key, cursor->chromosome) < 0) {
+        LOG_FATAL_F("File %s is not sorted: %s:%ld found after %s:%ld\n", cursor->file->filename, 
+                    chromosome, record->position, cursor->chromosome, chromosome_key_position(cursor->key));
+    }
+    
+    if (chromosome != cursor->chromosome) {
+        free(cursor->chromosome);
+        cursor->chromosome = chromosome;
+    }
+    cursor->key = key;
+    
+    heap->cursors[heap->size] = cursor;
+    heap_sift_up(heap->size++, heap);
+}
+
+merge_cursor_t *merge_heap_pop(merge_heap_t *heap) {
+    if (heap->size == 0) {
+        return NULL;
+    }
+    
+    merge_cursor_t *top = heap->cursors[0];
+    heap->cursors[0] = heap->cursors[--heap->size];
+    if (heap->size > 0) {
+        heap_sift_down(0, heap);
+    }
+    return top;
+}
+
+int merge_heap_pop_position(merge_heap_t *heap, merge_cursor_t **cursors) {
+    int num_cursors = 0;
+    if (heap->size == 0) {
+        return 0;
+    }
+    
+    // Ties are broken by file index, so the cursors come out sorted by it
+    cursors[num_cursors++] = merge_heap_pop(heap);
+    while (heap->size > 0 && !compare_keys(heap->cursors[0]->key, heap->cursors[0]->chromosome, cursors[0]->key, cursors[0]->chromosome)) {
+        cursors[num_cursors++] = merge_heap_pop(heap);
+    }
+    
+    return num_cursors;
+}
+
+
+static int compare_keys(uint64_t key1, const char *chromosome1, uint64_t key2, const char *chromosome2) {
+    // Chromosomes not in the chromosome order share the same rank
+    if (chromosome_key_rank(key1) == CHROMOSOME_UNKNOWN_RANK && chromosome_key_rank(key2) == CHROMOSOME_UNKNOWN_RANK) {
+        int cmp = strcmp(chromosome1, chromosome2);
+        if (cmp) {
+            return cmp;
+        }
+    }
+    return (key1 > key2) - (key1 < key2);
+}
+
+static int cursor_precedes(merge_cursor_t *cursor1, merge_cursor_t *cursor2) {
+    int cmp = compare_keys(cursor1->key, cursor1->chromosome, cursor2->key, cursor2->chromosome);
+    return (cmp != 0) ? cmp < 0 : cursor1->index < cursor2->index;
+}
+
+static void heap_sift_up(int position, merge_heap_t *heap) {
+    merge_cursor_t **cursors = heap->cursors;
+    merge_cursor_t *cursor = cursors[position];
+    
+    while (position > 0 && cursor_precedes(cursor, cursors[(position - 1) / 2])) {
+        cursors[position] = cursors[(position - 1) / 2];
+        position = (position - 1) / 2;
+    }
+    cursors[position] = cursor;
+}
+
+static void heap_sift_down(int position, merge_heap_t *heap) {
+    merge_cursor_t **cursors = heap->cursors;
+    merge_cursor_t *cursor = cursors[position];
+    
+    while (2 * position + 1 < heap->size) {
+        int child = 2 * position + 1;
+        if (child + 1 < heap->size && cursor_precedes(cursors[child + 1], cursors[child])) {
+            child++;
+        }
+        if (!cursor_precedes(cursors[child], cursor)) {
+            break;
+        }
+        cursors[position] = cursors[child];
+        position = child;
+    }
+    cursors[position] = cursor;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VCF_TOOLS_MERGE_HEAP_H
+#define VCF_TOOLS_MERGE_HEAP_H
+
+/**
+ * @file merge_heap.h
+ * @brief Streaming k-way merge of coordinate-sorted VCF files
+ *
+ * Every input file is traversed by a cursor that points to its current record. The cursors are kept in
+ * a min-heap ordered by the sort key of chromosome rank and position, so the cursors at the top of the heap hold all the
+ * records of the smallest position not merged yet. Those records can be merged as soon as they are
+ * popped, without waiting for the rest of the files. Chromosomes not in the chromosome order share the
+ * same rank and are sorted by name.
+ *
+ * A cursor only keeps the batch of its current record, plus the batches it has finished while their
+ * records are still being merged, so memory depends on the number of files and the batch size but not
+ * on how the positions of the files interleave.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_file.h>
+#include <bioformats/vcf/vcf_reader.h>
+#include <commons/log.h>
+#include <containers/array_list.h>
+#include <containers/list.h>
+
+#include "chromosome_table.h"
+
+typedef struct merge_cursor merge_cursor_t;
+
+/**
+ * @brief Gets the next batch of records of the file traversed by a cursor.
+ * @return The batch, or NULL when the end of the file has been reached
+ */
+typedef vcf_batch_t *(*merge_batch_source_t)(merge_cursor_t *cursor);
+
+/**
+ * @brief Text batches of a file, as read by vcf_multiread_batches, which are parsed on demand.
+ */
+typedef struct merge_text_source {
+    list_t *text_list;      /**< List the text batches are read into */
+    int batch_lines;        /**< Number of lines of each text batch */
+} merge_text_source_t;
+
+struct merge_cursor {
+    int index;                      /**< Index of the file among the files being merged */
+    vcf_file_t *file;               /**< File whose records are traversed */
+    
+    merge_batch_source_t next_batch; /**< Function that gets the batches of the file */
+    void *source;                   /**< Data of the batches source, such as a merge_text_source_t */
+    
+    vcf_batch_t *batch;             /**< Batch of the current record */
+    size_t record_index;            /**< Index of the current record in its batch */
+    array_list_t *finished_batches; /**< Batches already traversed whose records may be still referenced */
+    int eof;                        /**< Whether all the records of the file have been traversed */
+    
+    char *chromosome;               /**< Chromosome of the current record */
+    uint64_t key;                   /**< Sort key of the chromosome and position of the current record */
+};
+
+typedef struct merge_heap {
+    merge_cursor_t **cursors;       /**< Cursors in heap order, the one with the smallest position first */
+    int size;
+    int capacity;
+    
+    chromosome_table_t *chromosomes; /**< Ranks of the chromosomes in the order they are sorted in the files */
+} merge_heap_t;
+
+
+/* **********************************************
+ *                  Cursors                     *
+ * **********************************************/
+
+/**
+ * @brief Creates a cursor before the first record of a file.
+ * @param index index of the file among the files being merged
+ * @param file file whose records are traversed
+ * @param next_batch function that gets the batches of the file
+ * @param source data passed to next_batch through the cursor
+ */
+merge_cursor_t *merge_cursor_new(int index, vcf_file_t *file, merge_batch_source_t next_batch, void *source);
+
+/**
+ * @brief Frees a cursor and the batches it still keeps.
+ */
+void merge_cursor_free(merge_cursor_t *cursor);
+
+/**
+ * @brief Moves a cursor to the next record of its file.
+ * 
+ * When the current batch is finished it is kept until merge_cursor_release_batches is called, because 
+ * the records already popped from the heap may belong to it.
+ * 
+ * @return Whether there is a next record
+ */
+int merge_cursor_next(merge_cursor_t *cursor);
+
+/**
+ * @brief Returns the current record of a cursor.
+ */
+vcf_record_t *merge_cursor_record(merge_cursor_t *cursor);
+
+/**
+ * @brief Frees the batches a cursor has finished, once their records are not needed anymore.
+ */
+void merge_cursor_release_batches(merge_cursor_t *cursor);
+
+/**
+ * @brief Source of batches that parses the text batches read into a list, given as a merge_text_source_t.
+ */
+vcf_batch_t *merge_text_batch_source(merge_cursor_t *cursor);
+
+
+/* **********************************************
+ *                    Heap                      *
+ * **********************************************/
+
+/**
+ * @brief Creates an empty heap.
+ * @param capacity maximum number of cursors, usually the number of files
+ * @param chromosomes ranks of the chromosomes in the order they are sorted in the files
+ */
+merge_heap_t *merge_heap_new(int capacity, chromosome_table_t *chromosomes);
+
+/**
+ * @brief Frees a heap, but not its cursors nor its table of chromosomes.
+ */
+void merge_heap_free(merge_heap_t *heap);
+
+/**
+ * @brief Inserts a cursor, which must point to a record, in its place of the heap.
+ */
+void merge_heap_push(merge_cursor_t *cursor, merge_heap_t *heap);
+
+/**
+ * @brief Removes the cursor with the smallest position.
+ * @return The cursor, or NULL if the heap is empty
+ */
+merge_cursor_t *merge_heap_pop(merge_heap_t *heap);
+
+/**
+ * @brief Removes all the cursors whose records are in the smallest position, sorted by file index.
+ * @param[out] cursors cursors removed, there must be room for as many as files
+ * @return The number of cursors removed, 0 if the heap is empty
+ */
+int merge_heap_pop_position(merge_heap_t *heap, merge_cursor_t **cursors);
+
+#endif
@@ -70,6 +70,26 @@ int read_merge_configuration(const char *filename, merge_options_t *options, sha
         LOG_DEBUG_F("missing mode = %s (%zu chars)\n",
                    *(options->missing_mode->sval), strlen(*(options->missing_mode->sval)));
     }
+    
+    // Read file with the chromosome order (optional, it is resolved from the input files otherwise)
+    ret_code = config_lookup_string(config, "vcf-tools.merge.chromosome-order", &tmp_string);
+    if (ret_code != CONFIG_FALSE) {
+        *(options->chromosome_order->sval) = strdup(tmp_string);
+        LOG_DEBUG_F("chromosome order = %s\n", *(options->chromosome_order->sval));
+    }
+    
+    // Read maximum number of files merged at once (optional)
+    ret_code = config_lookup_int(config, "vcf-tools.merge.fan-in", options->fan_in->ival);
+    if (ret_code != CONFIG_FALSE) {
+        LOG_DEBUG_F("fan-in = %ld\n", *(options->fan_in->ival));
+    }
+    
+    // Read directory of the intermediate files (optional, the output directory is used otherwise)
+    ret_code = config_lookup_string(config, "vcf-tools.merge.temp-dir", &tmp_string);
+    if (ret_code != CONFIG_FALSE) {
+        *(options->temp_directory->sval) = strdup(tmp_string);
+        LOG_DEBUG_F("temporary directory = %s\n", *(options->temp_directory->sval));
+    }
 
     config_destroy(config);
     free(config);
@@ -92,7 +112,7 @@ void **parse_merge_options(int argc, char *argv[], merge_options_t *merge_option
 }
 
 void **merge_merge_options(merge_options_t *merge_options, shared_options_t *shared_options, struct arg_end *arg_end) {
-    void **tool_options = malloc (19 * sizeof(void*));
+    void **tool_options = malloc (22 * sizeof(void*));
     // Input/output files
     tool_options[0] = merge_options->input_files;
     tool_options[1] = shared_options->output_filename;
@@ -107,21 +127,24 @@ void **merge_merge_options(merge_options_t *merge_options, shared_options_t *sha
     tool_options[6] = merge_options->copy_filter;
     tool_options[7] = merge_options->copy_info;
     tool_options[8] = merge_options->info_fields;
+    tool_options[9] = merge_options->chromosome_order;
     
     // Configuration file
-    tool_options[9] = shared_options->log_level;
-    tool_options[10] = shared_options->config_file;
+    tool_options[10] = shared_options->log_level;
+    tool_options[11] = shared_options->config_file;
     
     // Advanced configuration
-    tool_options[11] = shared_options->host_url;
-    tool_options[12] = shared_options->version;
-    tool_options[13] = shared_options->max_batches;
-    tool_options[14] = shared_options->batch_lines;
-    tool_options[15] = shared_options->batch_bytes;
-    tool_options[16] = shared_options->num_threads;
-    tool_options[17] = shared_options->mmap_vcf_files;
+    tool_options[12] = shared_options->host_url;
+    tool_options[13] = shared_options->version;
+    tool_options[14] = shared_options->max_batches;
+    tool_options[15] = shared_options->batch_lines;
+    tool_options[16] = shared_options->batch_bytes;
+    tool_options[17] = shared_options->num_threads;
+    tool_options[18] = shared_options->mmap_vcf_files;
+    tool_options[19] = merge_options->fan_in;
+    tool_options[20] = merge_options->temp_directory;
     
-    tool_options[18] = arg_end;
+    tool_options[21] = arg_end;
     
     return tool_options;
 }
@@ -140,5 +163,11 @@ int verify_merge_options(merge_options_t *merge_options, shared_options_t *share
         return MISSING_MODE_NOT_SPECIFIED;
     }
     
+    // Check whether the number of files merged at once is valid (0 means not specified)
+    if (*(merge_options->fan_in->ival) < 0 || *(merge_options->fan_in->ival) == 1) {
+        LOG_ERROR("Please specify a fan-in of at least 2 files.\n");
+        return MERGE_INVALID_FAN_IN;
+    }
+    
     return 0;
 }
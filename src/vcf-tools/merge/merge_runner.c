@@ -20,13 +20,6 @@
 
 #include "merge_runner.h"
 
-#define TREE_LIMIT         (shared_options_data->batch_lines)
-
-static int num_chromosomes;
-static char **chromosome_order;
-
-static void free_merge_tree(kh_pos_t* positions_read);
-
 
 int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *options_data) {
     if (options_data->num_files == 1) {
@@ -34,19 +27,34 @@ int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *
         return 0;
     }
     
-    list_t *read_list[options_data->num_files];
-    memset(read_list, 0, options_data->num_files * sizeof(list_t*));
+    // Too many files to be opened at once are merged in several levels
+    int fan_in = get_max_fan_in(options_data->fan_in, shared_options_data->num_threads);
+    if (options_data->num_files > fan_in) {
+        if (options_data->copy_filter || options_data->copy_info) {
+            LOG_WARN("FILTER and INFO columns can't be copied into the samples when merging in several levels, all the files will be merged at once\n");
+        } else {
+            return run_merge_tree(fan_in, shared_options_data, options_data);
+        }
+    }
+    
+    // Uncompressed files can be split into region shards that are merged in parallel
+    int seekable = shared_options_data->num_threads > 1;
+    for (int i = 0; i < options_data->num_files && seekable; i++) {
+        seekable = merge_file_is_seekable(options_data->input_files[i]);
+    }
+    if (seekable) {
+        return run_merge_shards(shared_options_data, options_data);
+    }
+    
+    list_t **read_list = (list_t**) calloc (options_data->num_files, sizeof(list_t*));
     list_t *output_header_list = (list_t*) malloc (sizeof(list_t));
     list_init("headers", shared_options_data->num_threads, INT_MAX, output_header_list);
     list_t *output_list = (list_t*) malloc (sizeof(list_t));
     list_init("output", shared_options_data->num_threads, shared_options_data->max_batches * shared_options_data->batch_lines, output_list);
-    list_t *merge_tokens_list = (list_t*) malloc (sizeof(list_t));
-    list_init("tokens", 1, INT_MAX, merge_tokens_list);
     
     int ret_code = 0;
     double start, stop, total;
-    vcf_file_t *files[options_data->num_files];
-    memset(files, 0, options_data->num_files * sizeof(vcf_file_t*));
+    vcf_file_t **files = (vcf_file_t**) calloc (options_data->num_files, sizeof(vcf_file_t*));
     
     // Initialize variables related to the different files
     for (int i = 0; i < options_data->num_files; i++) {
@@ -64,9 +72,6 @@ int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *
         LOG_FATAL_F("Can't create output directory: %s\n", shared_options_data->output_directory);
     }
 
-    chromosome_order = get_chromosome_order(shared_options_data->host_url, shared_options_data->species,
-                                            shared_options_data->version, &num_chromosomes);
-    
 #pragma omp parallel sections private(start, stop, total)
     {
 #pragma omp section
@@ -95,229 +100,78 @@ int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *
             
             LOG_DEBUG_F("Thread %d processes data\n", omp_get_thread_num());
             
-            int num_eof_found = 0;
-            int eof_found[options_data->num_files];
-            memset(eof_found, 0, options_data->num_files * sizeof(int));
+            start = omp_get_wtime();
             
-            list_item_t *items[options_data->num_files];
-            memset(items, 0, options_data->num_files * sizeof(list_item_t*));
-            char *texts[options_data->num_files];
-            memset(texts, 0, options_data->num_files * sizeof(char*));
+            /* Process:
+             * - A cursor per file points to its current record, and the cursors are sorted in a heap by chromosome 
+             * and position, so all the records in the smallest position are at its top.
+             * - Positions are popped from the heap in a window of batch_lines positions, and the window is merged 
+             * in parallel. The merged records are already sorted, so they can be written in the same order.
+             */
+            merge_text_source_t *text_sources = (merge_text_source_t*) malloc (options_data->num_files * sizeof(merge_text_source_t));
+            merge_cursor_t **cursors = (merge_cursor_t**) malloc (options_data->num_files * sizeof(merge_cursor_t*));
             
-            // Positions read and to merge
-            khash_t(pos) *positions_read = kh_init(pos);
-            // Last chromosome and positions read from each file (to block file reading when necessary)
-            char *last_chromosome_read[options_data->num_files];
-            long last_position_read[options_data->num_files];
-            memset(last_chromosome_read, 0, options_data->num_files * sizeof(char*));
-            memset(last_position_read, 0, options_data->num_files * sizeof(long));
-            // Last chromosome and position merged
-            char *max_chromosome_merged = NULL;
-            long max_position_merged = LONG_MAX;
-            // Whether each file was ahead the last merged position
-            int file_ahead_last_merged[options_data->num_files];
-            memset(file_ahead_last_merged, 0, options_data->num_files * sizeof(int));
-            // Whether the headers of all files have been merged
-            int header_merged = 0;
-            // Token returned from the merging process: notifies that the output 
-            // can be written to file and the number of records to write
-            int token = 0;
+            // Getting the first record of each file also parses its header
+            for (int i = 0; i < options_data->num_files; i++) {
+                text_sources[i].text_list = read_list[i];
+                text_sources[i].batch_lines = shared_options_data->batch_lines;
+                cursors[i] = merge_cursor_new(i, files[i], merge_text_batch_source, &text_sources[i]);
+                merge_cursor_next(cursors[i]);
+            }
             
+            // The chromosome order may come from the ##contig lines of the headers
+            int num_chromosomes;
+            char **chromosome_order = resolve_chromosome_order(files, options_data->num_files, options_data->chromosome_order_file,
+                                                               shared_options_data, &num_chromosomes);
+            if (!chromosome_order) {
+                LOG_FATAL("The order of the chromosomes can't be resolved, please specify it with --chromosome-order\n");
+            }
+            chromosome_table_t *chromosome_table = chromosome_table_new(chromosome_order, num_chromosomes);
             
-            start = omp_get_wtime();
-
-            while (num_eof_found < options_data->num_files) {
-                /* Process:
-                 * - N threads getting batches of VCF records and inserting them in a data structure. The common minimum 
-                 * position of each group of batches will also be stored.
-                 * - If the data structure reaches certain size or the end of a chromosome, merge positions prior to the 
-                 * last minimum registered.
-                 */
-                
-                // Getting text elements in a critical region guarantees that each thread gets variants in positions in the same range
-                for (int i = 0; i < options_data->num_files; i++) {
-                    if (eof_found[i] || file_ahead_last_merged[i] > 0) {
-                        continue;
-                    }
-                    
-                    items[i] = list_remove_item(read_list[i]);
-                    if (items[i] == NULL || !strcmp(items[i]->data_p, "")) {
-                        LOG_INFO_F("[%d] EOF found in file %s\n", omp_get_thread_num(), options_data->input_files[i]);
-                        // Mark as finished
-                        eof_found[i] = 1;
-                        num_eof_found++;
-                        // Set last chromosome and position to the maximum possible so they do not disturb pending files
-                        last_chromosome_read[i] = chromosome_order[num_chromosomes-1];
-                        last_position_read[i] = LONG_MAX;
-                        
-                        if(items[i] != NULL && !strcmp(items[i]->data_p, "")) {
-                            free(items[i]->data_p);
-                            list_item_free(items[i]);
-                            LOG_DEBUG_F("[%d] Text batch freed\n", omp_get_thread_num());
-                        } else {
-                            LOG_DEBUG_F("[%d] No need to free text batch\n", omp_get_thread_num());
-                        }
-                        
-                        continue;
-                    }
-                    
-                    assert(items[i]->data_p != NULL);
-                    texts[i] = items[i]->data_p;
-                    
-//                     printf("[%d] text batch from file %d\tcontents = '%s'\n", omp_get_thread_num(), i, texts[i]);
+            merge_heap_t *heap = merge_heap_new(options_data->num_files, chromosome_table);
+            for (int i = 0; i < options_data->num_files; i++) {
+                if (!cursors[i]->eof) {
+                    merge_heap_push(cursors[i], heap);
                 }
-                
-                for (int i = 0; i < options_data->num_files; i++) {
-                    if (eof_found[i] || file_ahead_last_merged[i] > 0) {
-                        continue;
-                    }
-                    
-                    char *text_begin = texts[i];
-                    char *text_end = text_begin + strlen(text_begin);
-                    assert(text_end != NULL);
-                    
-//                     printf("batch = '%.*s'\n", text_end - text_begin, text_begin);
-                    
-                    // Get VCF batches from text batches
-                    vcf_reader_status *status = vcf_reader_status_new(shared_options_data->batch_lines, 0);
-                    ret_code = run_vcf_parser(text_begin, text_end, shared_options_data->batch_lines, files[i], status);
-                    
-                    if (ret_code) {
-                        // TODO stop?
-                        LOG_ERROR_F("Error %d while reading the file %s\n", ret_code, files[i]->filename);
-                        continue;
-                    }
-
-//                     printf("batches = %d\n", files[i]->record_batches->length);
-                    vcf_batch_t *batch = fetch_vcf_batch_non_blocking(files[i]);
-                    if (!batch) {
-                        continue;
-                    }
-                    
-                    // Insert records into hashtable
-                    for (int j = 0; j < batch->records->size; j++) {
-                        vcf_record_t *record = vcf_record_copy(array_list_get(j, batch->records));
-                        vcf_record_file_link *link = vcf_record_file_link_new(record, files[i]);
-                        char key[64];
-                        compose_key_value(record->chromosome, record->position, key);
-                        int ret = insert_position_read(key, link, positions_read);
-                        assert(ret);
-                    }
-                    
-                    vcf_record_t *current_record = (vcf_record_t*) array_list_get(batch->records->size - 1, batch->records);
-                    //int updated = calculate_merge_interval(current_record, &max_chromosome_merged, &max_position_merged, chromosome_order, num_chromosomes);
-                    last_chromosome_read[i] = strndup(current_record->chromosome, current_record->chromosome_len);
-                    last_position_read[i] = current_record->position;
-                    
-                    // Free batch and its contents
-                    vcf_reader_status_free(status);
-                    vcf_batch_free(batch);
-                    list_item_free(items[i]);
-                }
-                
-                // Calculate least common position to merge
-                for (int i = 0; i < options_data->num_files; i++) {
-                    char *file_chromosome = last_chromosome_read[i];
-                    long file_position = last_position_read[i];
-                    if (max_chromosome_merged == NULL) {
-                        // Max merged chrom:position not set, assign without any other consideration
-                        max_chromosome_merged = strdup(file_chromosome);
-                        max_position_merged = file_position;
-                        //return 1;
-                    } else {
-                        char *current_chromosome = file_chromosome;
-                        long unsigned int current_position = file_position;
-
-                //         printf("current = %s:%ld\tmax = %s:%ld\n", current_chromosome, current_position, *max_chromosome_merged, *max_position_merged);
-                        int chrom_comparison = compare_chromosomes(current_chromosome, max_chromosome_merged, chromosome_order, num_chromosomes);
-                        int position_comparison = compare_positions(current_position, max_position_merged);
-
-                        // Max merged chrom:position is greater than the last one in this batch
-                        if (chrom_comparison < 0 || (chrom_comparison == 0 && position_comparison < 0)) {
-                            max_chromosome_merged = strdup(current_chromosome);
-                            max_position_merged = current_position;
-                            //return 1;
-                        }
-                    }
-                }
-                
-                if (num_eof_found == options_data->num_files) {
-                    max_chromosome_merged = chromosome_order[num_chromosomes-1];
-                    max_position_merged = LONG_MAX;
-                }
-                
-                LOG_DEBUG_F("Last position is (%s, %ld). Files ahead: ", max_chromosome_merged, max_position_merged);
-                // Check which files are ahead the last position merged and will not be read in the next iteration
-                for (int i = 0; i < options_data->num_files; i++) {
-                    char *file_chromosome = last_chromosome_read[i];
-                    long file_position = last_position_read[i];
-                    
-                    int chrom_comparison = compare_chromosomes(file_chromosome, max_chromosome_merged, chromosome_order, num_chromosomes);
-                    int position_comparison = compare_positions(file_position, max_position_merged);
-                    
-                    if (chrom_comparison < 0 || (chrom_comparison == 0 && position_comparison <= 0)) {
-                        file_ahead_last_merged[i] = 0;
-                    } else {
-                        file_ahead_last_merged[i] = 1;
-                        LOG_DEBUG_F("%d (%s, %ld), ", i, file_chromosome, file_position);
-                    }
-                }
-                LOG_DEBUG("\n");
-                
-                // Merge headers, if not previously done
-                if (!header_merged) {
-                    // Check correction of input file headers
-                    array_list_t *sample_names = merge_vcf_sample_names(files, options_data->num_files);
-                    if (!sample_names) {
-                        // Avoid as many leaks as possible
-                        array_list_free(sample_names, NULL);
-                        free_merge_tree(positions_read);
-                        free(max_chromosome_merged);
-                        
-                        LOG_FATAL("Files can not be merged!\n");
-                    } else {
-                        array_list_free(sample_names, NULL);
-                    }
-                    
-                    // Run the merge itself
-                    merge_vcf_headers(files, options_data->num_files, options_data, output_header_list);
-                    header_merged = 1;
-                    
-                    // Decrease list writers count
-                    for (int i = 0; i < shared_options_data->num_threads; i++) {
-                        list_decr_writers(output_header_list);
+            }
+            
+            // Check correction of input file headers
+            array_list_t *sample_names = merge_vcf_sample_names(files, options_data->num_files);
+            if (!sample_names) {
+                LOG_FATAL("Files can not be merged!\n");
+            }
+            array_list_free(sample_names, NULL);
+            
+            // Run the merge of headers itself
+            merge_vcf_headers(files, options_data->num_files, options_data, output_header_list);
+            
+            // Decrease list writers count
+            for (int i = 0; i < shared_options_data->num_threads; i++) {
+                list_decr_writers(output_header_list);
+            }
+            
+            vcf_record_t **merged = (vcf_record_t**) malloc (shared_options_data->batch_lines * sizeof(vcf_record_t*));
+            while (heap->size > 0) {
+                int num_positions = merge_window(heap, cursors, files, options_data->num_files, shared_options_data->batch_lines, 
+                                                 shared_options_data->num_threads, options_data, merged, NULL);
+                for (int i = 0; i < num_positions; i++) {
+                    if (merged[i]) {
+                        list_item_t *item = list_item_new(i, MERGED_RECORD, merged[i]);
+                        list_insert_item(item, output_list);
                     }
                 }
-                
-                // If the data structure reaches certain size or the end of a chromosome, 
-                // merge positions prior to the last minimum registered
-                if (num_eof_found < options_data->num_files && kh_size(positions_read) > TREE_LIMIT) {
-                    LOG_INFO_F("Merging until position %s:%ld\n", max_chromosome_merged, max_position_merged);
-                    token = merge_interval(positions_read, max_chromosome_merged, max_position_merged, chromosome_order, num_chromosomes,
-                                   	   	   files, shared_options_data, options_data, output_list);
-                }
-                // When reaching EOF for all files, merge the remaining entries
-                else if (num_eof_found == options_data->num_files && kh_size(positions_read) > 0) {
-                    LOG_INFO_F("Merging remaining positions (last = %s:%ld)\n", chromosome_order[num_chromosomes - 1], LONG_MAX);
-                    token = merge_remaining_interval(positions_read, files, shared_options_data, options_data, output_list);
-                }
-                
-                if (token) {
-                    int *token_ptr = malloc (sizeof(int)); *token_ptr = token;
-                    list_item_t *item = list_item_new(1, 0, token_ptr);
-                    list_insert_item(item, merge_tokens_list);
-                }
-
-                // Set variables ready for next iteration of the algorithm
-                if (max_chromosome_merged) {
-                    free(max_chromosome_merged);
-                }
-            	token = 0;
-                max_chromosome_merged = NULL;
-                max_position_merged = LONG_MAX;
+                LOG_DEBUG_F("%d positions merged\n", num_positions);
             }
+            free(merged);
             
-            kh_destroy(pos, positions_read);
+            for (int i = 0; i < options_data->num_files; i++) {
+                merge_cursor_free(cursors[i]);
+            }
+            merge_heap_free(heap);
+            chromosome_table_free(chromosome_table);
+            free_chromosome_order(chromosome_order, num_chromosomes);
+            free(cursors);
+            free(text_sources);
             
             stop = omp_get_wtime();
 
@@ -330,7 +184,6 @@ int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *
             for (int i = 0; i < shared_options_data->num_threads; i++) {
                 list_decr_writers(output_list);
             }
-            list_decr_writers(merge_tokens_list);
         }
         
 #pragma omp section
@@ -348,50 +201,27 @@ int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *
             LOG_INFO_F("Output filename = %s\n", merge_filename);
             free(merge_filename);
             
-            list_item_t *item1 = NULL, *item2 = NULL;
+            list_item_t *item = NULL;
             vcf_header_entry_t *entry;
             vcf_record_t *record;
-            int *num_records;
             
             // Write headers
-            while ((item1 = list_remove_item(output_header_list))) {
-                entry = item1->data_p;
+            while ((item = list_remove_item(output_header_list))) {
+                entry = item->data_p;
                 write_vcf_header_entry(entry, merge_fd);
-                list_item_free(item1);
+                list_item_free(item);
             }
             
             // Write delimiter
             array_list_t *sample_names = merge_vcf_sample_names(files, options_data->num_files);
             write_vcf_delimiter_from_samples((char**) sample_names->items, sample_names->size, merge_fd);
             
-            // Write records
-            // When a token is present, it means a set of batches has been merged. The token contains the number of records merged.
-            // In this case, the records must be sorted by chromosome and position, and written afterwards.
-            while ((item1 = list_remove_item(merge_tokens_list))) {
-                num_records = item1->data_p;
-                vcf_record_t *records[*num_records];
-                for (int i = 0; i < *num_records; i++) {
-                    item2 = list_remove_item(output_list);
-                    if (!item2) {
-                        break;
-                    }
-
-                    records[i] = item2->data_p;
-                    list_item_free(item2);
-                }
-
-                // Sort records
-                qsort(records, *num_records, sizeof(vcf_record_t*), record_cmp);
-
-                // Write and free sorted records
-                for (int i = 0; i < *num_records; i++) {
-                    record = records[i];
-                    write_vcf_record(record, merge_fd);
-                    vcf_record_free_deep(record);
-                }
-
-                free(num_records);
-                list_item_free(item1);
+            // Write records, which are merged in the order they must be written
+            while ((item = list_remove_item(output_list))) {
+                record = item->data_p;
+                write_vcf_record(record, merge_fd);
+                vcf_record_free_deep(record);
+                list_item_free(item);
             }
             
             // Close file
@@ -412,182 +242,559 @@ int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *
         if(files[i]) { vcf_close(files[i]); }
         if(read_list[i]) { free(read_list[i]); }
     }
+    free(read_list);
+    free(files);
     free(output_list);
     free(output_header_list);
-    free(merge_tokens_list);
     
     return ret_code;
 }
 
 
 
-int insert_position_read(char key[64], vcf_record_file_link* link, kh_pos_t* positions_read) {
-    int ret;
-    array_list_t *records_in_position;
-    khiter_t iter = kh_get(pos, positions_read, key);
-    if (iter != kh_end(positions_read)) {
-        records_in_position = kh_value(positions_read, iter);
-        ret = array_list_insert(link, records_in_position);
-    } else {
-        records_in_position = array_list_new(8, 1.5, COLLECTION_MODE_SYNCHRONIZED);
-        ret = array_list_insert(link, records_in_position);
-        iter = kh_put(pos, positions_read, strdup(key), &ret);
-        if (ret) {
-            kh_value(positions_read, iter) = records_in_position;
+static int merge_window(merge_heap_t *heap, merge_cursor_t **cursors, vcf_file_t **files, int num_files, int window_size, 
+                        int num_threads, merge_options_data_t *options_data, vcf_record_t **merged, 
+                        merge_spill_quality_t *qualities) {
+    // Links to the records of each position, which are stored contiguously: the ones of the i-th position 
+    // start at first_link[i] and end before first_link[i+1]
+    merge_cursor_t **popped = (merge_cursor_t**) malloc (num_files * sizeof(merge_cursor_t*));
+    size_t links_capacity = window_size + num_files;
+    vcf_record_file_link *links = (vcf_record_file_link*) malloc (links_capacity * sizeof(vcf_record_file_link));
+    int *first_link = (int*) malloc ((window_size + 1) * sizeof(int));
+    int num_positions = 0, num_links = 0;
+    
+    while (num_positions < window_size && heap->size > 0) {
+        int num_popped = merge_heap_pop_position(heap, popped);
+        if (num_links + num_popped > links_capacity) {
+            links_capacity = 2 * links_capacity + num_popped;
+            links = (vcf_record_file_link*) realloc (links, links_capacity * sizeof(vcf_record_file_link));
+        }
+        
+        first_link[num_positions++] = num_links;
+        for (int i = 0; i < num_popped; i++) {
+            links[num_links].record = merge_cursor_record(popped[i]);
+            links[num_links].file = popped[i]->file;
+            links[num_links].quality_sum = 0;
+            links[num_links].quality_samples = 0;
+            if (popped[i]->next_batch == merge_spill_batch_source) {
+                merge_spill_quality_t quality = merge_spill_cursor_quality(popped[i]);
+                links[num_links].quality_sum = quality.sum;
+                links[num_links].quality_samples = quality.samples;
+            }
+            num_links++;
+            
+            if (merge_cursor_next(popped[i])) {
+                merge_heap_push(popped[i], heap);
+            }
         }
     }
+    first_link[num_positions] = num_links;
     
-    return ret;
+    vcf_record_file_link **link_pointers = (vcf_record_file_link**) malloc (num_links * sizeof(vcf_record_file_link*));
+    for (int i = 0; i < num_links; i++) {
+        link_pointers[i] = links + i;
+    }
+    
+    #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+    for (int i = 0; i < num_positions; i++) {
+        int err_code = 0;
+        merged[i] = merge_position(link_pointers + first_link[i], first_link[i+1] - first_link[i], 
+                                   files, num_files, options_data, &err_code);
+        if (err_code) {
+            merged[i] = NULL;
+        } else if (qualities) {
+            merge_quality_sum(link_pointers + first_link[i], first_link[i+1] - first_link[i], 
+                              &(qualities[i].sum), &(qualities[i].samples));
+        }
+    }
+    
+    // All the records popped have been merged, so the batches already finished can be freed
+    for (int i = 0; i < num_files; i++) {
+        merge_cursor_release_batches(cursors[i]);
+    }
+    
+    free(link_pointers);
+    free(first_link);
+    free(links);
+    free(popped);
+    
+    return num_positions;
 }
 
+static int merge_heap_to_file(merge_heap_t *heap, merge_cursor_t **cursors, vcf_file_t **files, int num_files, int num_threads, 
+                              shared_options_data_t *shared_options_data, merge_options_data_t *options_data, 
+                              FILE *output, int spill) {
+    int window_size = shared_options_data->batch_lines;
+    vcf_record_t **merged = (vcf_record_t**) malloc (window_size * sizeof(vcf_record_t*));
+    merge_spill_quality_t *qualities = spill ? (merge_spill_quality_t*) malloc (window_size * sizeof(merge_spill_quality_t)) : NULL;
+    int total_positions = 0;
+    
+    while (heap->size > 0) {
+        int num_positions = merge_window(heap, cursors, files, num_files, window_size, num_threads, options_data, merged, qualities);
+        for (int i = 0; i < num_positions; i++) {
+            if (!merged[i]) {
+                continue;
+            }
+            if (spill) {
+                merge_spill_write_record(merged[i], qualities[i].sum, qualities[i].samples, output);
+            } else {
+                write_vcf_record(merged[i], output);
+            }
+            vcf_record_free_deep(merged[i]);
+            total_positions++;
+        }
+    }
+    
+    free(qualities);
+    free(merged);
+    return total_positions;
+}
 
-int calculate_merge_interval(vcf_record_t* current_record, char** max_chromosome_merged, long unsigned int* max_position_merged,
-                              char **chromosome_order, int num_chromosomes) {
-    if (*max_chromosome_merged == NULL) {
-        // Max merged chrom:position not set, assign without any other consideration
-        *max_chromosome_merged = strndup(current_record->chromosome, current_record->chromosome_len);
-        *max_position_merged = current_record->position;
-        return 1;
-    } else {
-        char *current_chromosome = strndup(current_record->chromosome, current_record->chromosome_len);
-        long unsigned int current_position = current_record->position;
+static void write_merged_header(vcf_file_t **files, int num_files, merge_options_data_t *options_data, FILE *output) {
+    // Check correction of input file headers
+    array_list_t *sample_names = merge_vcf_sample_names(files, num_files);
+    if (!sample_names) {
+        LOG_FATAL("Files can not be merged!\n");
+    }
+    
+    list_t *output_header_list = (list_t*) malloc (sizeof(list_t));
+    list_init("headers", 1, INT_MAX, output_header_list);
+    merge_vcf_headers(files, num_files, options_data, output_header_list);
+    list_decr_writers(output_header_list);
+    
+    list_item_t *item;
+    while ((item = list_remove_item(output_header_list))) {
+        write_vcf_header_entry(item->data_p, output);
+        list_item_free(item);
+    }
+    write_vcf_delimiter_from_samples((char**) sample_names->items, sample_names->size, output);
+    
+    array_list_free(sample_names, NULL);
+    free(output_header_list);
+}
+
+static vcf_file_t *open_parsed_file(char *filename, shared_options_data_t *shared_options_data, off_t *data_offset) {
+    vcf_file_t *file = vcf_open(filename, shared_options_data->max_batches);
+    if (!file) {
+        LOG_FATAL_F("VCF file %s does not exist!\n", filename);
+    }
+    
+    int fd = open(filename, O_RDONLY);
+    char *header = (fd < 0) ? NULL : merge_read_header(fd, data_offset);
+    if (!header) {
+        LOG_FATAL_F("VCF file %s can't be read!\n", filename);
+    }
+    close(fd);
+    
+    vcf_reader_status *status = vcf_reader_status_new(shared_options_data->batch_lines, 0);
+    int ret_code = run_vcf_parser(header, header + *data_offset, shared_options_data->batch_lines, file, status);
+    if (ret_code) {
+        LOG_FATAL_F("Error %d while reading the header of the file %s\n", ret_code, filename);
+    }
+    vcf_reader_status_free(status);
+    
+    // A header may be parsed into an empty batch
+    vcf_batch_t *batch;
+    while ((batch = fetch_vcf_batch_non_blocking(file))) {
+        vcf_batch_free(batch);
+    }
+    
+    return file;
+}
+
+
+/* **********************************************
+ *          Merge of region shards              *
+ * **********************************************/
+
+static int run_merge_shards(shared_options_data_t *shared_options_data, merge_options_data_t *options_data) {
+    int num_files = options_data->num_files;
+    int ret_code = 0;
+    double start, stop, total;
+    
+    start = omp_get_wtime();
+    
+    // Initialize variables related to the different files, parsing their headers
+    vcf_file_t **files = (vcf_file_t**) malloc (num_files * sizeof(vcf_file_t*));
+    off_t *data_offsets = (off_t*) malloc (num_files * sizeof(off_t));
+    for (int i = 0; i < num_files; i++) {
+        files[i] = open_parsed_file(options_data->input_files[i], shared_options_data, &data_offsets[i]);
+    }
+    
+    ret_code = create_directory(shared_options_data->output_directory);
+    if (ret_code != 0 && errno != EEXIST) {
+        LOG_FATAL_F("Can't create output directory: %s\n", shared_options_data->output_directory);
+    }
+    ret_code = 0;
+    
+    // The chromosome order may come from the ##contig lines of the headers
+    int num_chromosomes;
+    char **chromosome_order = resolve_chromosome_order(files, num_files, options_data->chromosome_order_file,
+                                                       shared_options_data, &num_chromosomes);
+    if (!chromosome_order) {
+        LOG_FATAL("The order of the chromosomes can't be resolved, please specify it with --chromosome-order\n");
+    }
+    chromosome_table_t *chromosome_table = chromosome_table_new(chromosome_order, num_chromosomes);
+    
+    // Create file streams for results
+    char aux_filename[32]; memset(aux_filename, 0, 32 * sizeof(char));
+    sprintf(aux_filename, "merge_from_%d_files.vcf", num_files);
+    
+    char *merge_filename;
+    FILE *merge_fd = get_output_file(shared_options_data, aux_filename, &merge_filename);
+    LOG_INFO_F("Output filename = %s\n", merge_filename);
+    free(merge_filename);
+    
+    write_merged_header(files, num_files, options_data, merge_fd);
+    
+    /* Process:
+     * - The genome is split into shards, and every thread merges whole shards into temporary files, 
+     * with its own heap of cursors that only read the range of each file in the shard.
+     * - The output of a shard is appended to the final file as soon as all the previous shards have 
+     * been appended too, so the temporary files are removed while the rest of shards are merged.
+     */
+    merge_shard_plan_t *plan = merge_shard_plan_new(options_data->input_files, num_files, data_offsets, 
+                                                    shared_options_data->num_threads * MERGE_SHARDS_PER_THREAD, 
+                                                    chromosome_table);
+    if (!plan) {
+        LOG_FATAL("The input files can't be split into shards\n");
+    }
+    LOG_INFO_F("Files split into %d shards\n", plan->num_shards);
+    
+    FILE **shard_outputs = (FILE**) calloc (plan->num_shards, sizeof(FILE*));
+    int next_shard = 0;
+    
+    #pragma omp parallel for num_threads(shared_options_data->num_threads) schedule(dynamic, 1)
+    for (int i = 0; i < plan->num_shards; i++) {
+        FILE *shard_fd = merge_temporary_file(shared_options_data->output_directory);
+        if (!shard_fd) {
+            LOG_FATAL_F("Can't create a temporary file for shard %d\n", i);
+        }
         
-//         printf("current = %s:%ld\tmax = %s:%ld\n", current_chromosome, current_position, *max_chromosome_merged, *max_position_merged);
-        int chrom_comparison = compare_chromosomes(current_chromosome, *max_chromosome_merged, chromosome_order, num_chromosomes);
-        int position_comparison = compare_positions(current_position, *max_position_merged);
+        int num_positions = merge_shard(i, plan, files, chromosome_table, shared_options_data, options_data, shard_fd);
+        LOG_DEBUG_F("[%d] %d positions merged in shard %d\n", omp_get_thread_num(), num_positions, i);
         
-        // Max merged chrom:position is greater than the last one in this batch
-        if (chrom_comparison < 0 || (chrom_comparison == 0 && position_comparison < 0)) {
-            *max_chromosome_merged = current_chromosome;
-            *max_position_merged = current_position;
-            return 1;
-        } else {
-            assert(current_chromosome);
-            free(current_chromosome);
-            return 0;
+        #pragma omp critical (shard_outputs)
+        {
+            shard_outputs[i] = shard_fd;
+            while (next_shard < plan->num_shards && shard_outputs[next_shard]) {
+                int err_code = merge_append_file(shard_outputs[next_shard], merge_fd);
+                if (err_code) {
+                    LOG_ERROR_F("Error while writing shard %d: %s\n", next_shard, strerror(err_code));
+                    ret_code = err_code;
+                }
+                fclose(shard_outputs[next_shard]);
+                shard_outputs[next_shard] = NULL;
+                next_shard++;
+            }
+        }
+    }
+    
+    if (merge_fd != NULL) { fclose(merge_fd); }
+    
+    stop = omp_get_wtime();
+    total = stop - start;
+    
+    LOG_INFO_F("[%d] Time elapsed = %f s\n", omp_get_thread_num(), total);
+    LOG_INFO_F("[%d] Time elapsed = %e ms\n", omp_get_thread_num(), total*1000);
+    
+    // Free variables related to the different files
+    free(shard_outputs);
+    merge_shard_plan_free(plan);
+    chromosome_table_free(chromosome_table);
+    free_chromosome_order(chromosome_order, num_chromosomes);
+    for (int i = 0; i < num_files; i++) {
+        vcf_close(files[i]);
+    }
+    free(data_offsets);
+    free(files);
+    
+    return ret_code;
+}
+
+static int merge_shard(int shard, merge_shard_plan_t *plan, vcf_file_t **files, chromosome_table_t *chromosome_table, 
+                       shared_options_data_t *shared_options_data, merge_options_data_t *options_data, FILE *output) {
+    int num_files = options_data->num_files;
+    
+    merge_range_source_t *sources = (merge_range_source_t*) malloc (num_files * sizeof(merge_range_source_t));
+    vcf_file_t **shard_files = (vcf_file_t**) malloc (num_files * sizeof(vcf_file_t*));
+    merge_cursor_t **cursors = (merge_cursor_t**) malloc (num_files * sizeof(merge_cursor_t*));
+    merge_heap_t *heap = merge_heap_new(num_files, chromosome_table);
+    
+    // Every file is read by its own cursor, which only gets the records of the range of the shard
+    for (int i = 0; i < num_files; i++) {
+        merge_shard_range(shard, i, plan, &sources[i].offset, &sources[i].end);
+        sources[i].batch_lines = shared_options_data->batch_lines;
+        sources[i].fd = -1;
+        if (sources[i].offset < sources[i].end) {
+            sources[i].fd = open(files[i]->filename, O_RDONLY);
+            if (sources[i].fd < 0) {
+                LOG_FATAL_F("VCF file %s can't be read!\n", files[i]->filename);
+            }
+        }
+        
+        shard_files[i] = merge_shard_file_new(files[i]);
+        cursors[i] = merge_cursor_new(i, shard_files[i], merge_range_batch_source, &sources[i]);
+        if (merge_cursor_next(cursors[i])) {
+            merge_heap_push(cursors[i], heap);
         }
     }
+    
+    // Shards are already merged in parallel
+    int num_positions = merge_heap_to_file(heap, cursors, files, num_files, 1, shared_options_data, options_data, output, 0);
+    
+    for (int i = 0; i < num_files; i++) {
+        merge_cursor_free(cursors[i]);
+        merge_shard_file_free(shard_files[i]);
+        if (sources[i].fd >= 0) { close(sources[i].fd); }
+    }
+    merge_heap_free(heap);
+    free(cursors);
+    free(shard_files);
+    free(sources);
+    
+    return num_positions;
 }
 
 
-int merge_interval(kh_pos_t* positions_read, char *max_chromosome_merged, unsigned long max_position_merged,
-                    char **chromosome_order, int num_chromosomes, vcf_file_t **files, 
-                    shared_options_data_t *shared_options_data, merge_options_data_t *options_data, list_t *output_list) {
-    int num_entries = 0;
+/* **********************************************
+ *            Merge in several levels           *
+ * **********************************************/
 
-    #pragma omp parallel for num_threads(shared_options_data->num_threads) reduction(+:num_entries)
-    for (int k = kh_begin(positions_read); k < kh_end(positions_read); k++) {
-        if (kh_exist(positions_read, k)) {
-            array_list_t *records_in_position = kh_value(positions_read, k);
-            assert(records_in_position);
-            
-            vcf_record_t *record = ((vcf_record_file_link*) array_list_get(0, records_in_position))->record;
-            vcf_record_file_link **links = NULL;
-            int num_links = 0;
-            
-            // Remove positions prior to the last chromosome:position to merge
-            int cmp_chrom = compare_chromosomes(record->chromosome, max_chromosome_merged, chromosome_order, num_chromosomes);
-            if (cmp_chrom < 0 || (cmp_chrom == 0 && compare_positions(record->position, max_position_merged) <= 0)) {
-                links = (vcf_record_file_link**) records_in_position->items;
-                num_links = records_in_position->size;
+static int run_merge_tree(int fan_in, shared_options_data_t *shared_options_data, merge_options_data_t *options_data) {
+    int num_threads = shared_options_data->num_threads;
+    double start, stop, total;
+    
+    start = omp_get_wtime();
+    
+    // Groups are merged in parallel, and every group reads and merges its files in parallel too
+    omp_set_nested(1);
+    
+    char *temp_directory = options_data->temp_directory ? options_data->temp_directory : shared_options_data->output_directory;
+    int ret_code = create_directory(shared_options_data->output_directory);
+    if (ret_code != 0 && errno != EEXIST) {
+        LOG_FATAL_F("Can't create output directory: %s\n", shared_options_data->output_directory);
+    }
+    ret_code = create_directory(temp_directory);
+    if (ret_code != 0 && errno != EEXIST) {
+        LOG_FATAL_F("Can't create temporary directory: %s\n", temp_directory);
+    }
+    ret_code = 0;
+    
+    // The chromosome order is resolved before any file is merged, reading the headers one by one
+    int num_chromosomes = 0;
+    char **chromosome_order = NULL;
+    if (!options_data->chromosome_order_file) {
+        char ***contig_orders = (char***) malloc (options_data->num_files * sizeof(char**));
+        int *num_contigs = (int*) malloc (options_data->num_files * sizeof(int));
+        
+        #pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < options_data->num_files; i++) {
+            contig_orders[i] = read_contig_order(options_data->input_files[i], &num_contigs[i]);
+        }
+        
+        chromosome_order = merge_chromosome_orders(contig_orders, num_contigs, options_data->num_files, &num_chromosomes);
+        for (int i = 0; i < options_data->num_files; i++) {
+            free_chromosome_order(contig_orders[i], num_contigs[i]);
+        }
+        free(num_contigs);
+        free(contig_orders);
+    }
+    if (chromosome_order) {
+        LOG_INFO("Chromosome order read from the ##contig lines of the input files\n");
+    } else {
+        chromosome_order = resolve_chromosome_order(NULL, 0, options_data->chromosome_order_file, shared_options_data, &num_chromosomes);
+    }
+    if (!chromosome_order) {
+        LOG_FATAL("The order of the chromosomes can't be resolved, please specify it with --chromosome-order\n");
+    }
+    chromosome_table_t *chromosome_table = chromosome_table_new(chromosome_order, num_chromosomes);
+    
+    /* Process:
+     * - The files of every level are merged in groups of at most fan_in files into spill files, and the 
+     * spills of a level are the files of the next one.
+     * - The groups of a level are merged in parallel, sharing the threads between them.
+     * - The spills of a group are removed as soon as the group has been merged, so at most two levels 
+     * of spills are stored at the same time.
+     */
+    merge_tree_plan_t *plan = merge_tree_plan_new(options_data->num_files, fan_in);
+    LOG_INFO_F("%d files merged in %d levels of at most %d files\n", options_data->num_files, plan->num_levels + 1, fan_in);
+    
+    char **level_files = options_data->input_files;
+    for (int l = 0; l < plan->num_levels; l++) {
+        int num_groups = plan->num_groups[l];
+        int num_parallel_groups = MIN(num_groups, num_threads);
+        char **spill_filenames = (char**) calloc (num_groups, sizeof(char*));
+        
+        #pragma omp parallel for num_threads(num_parallel_groups) schedule(dynamic, 1)
+        for (int g = 0; g < num_groups; g++) {
+            FILE *spill_fd = merge_spill_create(temp_directory, &spill_filenames[g]);
+            if (!spill_fd) {
+                LOG_FATAL_F("Can't create a spill file for group %d of level %d\n", g, l);
             }
             
-            // Launch merge
-            if (num_links > 0) {
-//                 printf("links[0] = %s:%ld in file %s\n", links[0]->record->chromosome, links[0]->record->position, links[0]->file->filename);
-                int err_code = 0;
-                vcf_record_t *merged = merge_position(links, num_links, files, options_data->num_files, options_data, &err_code);
-                
-                if (!err_code) {
-                    list_item_t *item = list_item_new(k, MERGED_RECORD, merged);
-                    list_insert_item(item, output_list);
-                    num_entries += 1;
-                }
-                
-                // Free empty nodes (lists of records in the same position)
-                free(kh_key(positions_read, k));
-                array_list_free(records_in_position, vcf_record_file_link_free);
-                kh_del(pos, positions_read, k);
+            int first_file = plan->first_file[l][g];
+            int num_group_files = plan->first_file[l][g+1] - first_file;
+            int num_positions = merge_tree_group(level_files + first_file, num_group_files, l > 0, chromosome_table, 
+                                                 MAX(1, num_threads / num_parallel_groups), shared_options_data, options_data, 
+                                                 spill_fd, 1);
+            if (fclose(spill_fd)) {
+                LOG_FATAL_F("Can't write the spill file %s: %s\n", spill_filenames[g], strerror(errno));
             }
-        } // End kh_exist
+            LOG_DEBUG_F("[%d] %d positions merged in group %d of level %d\n", omp_get_thread_num(), num_positions, g, l);
+        }
+        
+        if (l > 0) {
+            free(level_files);
+        }
+        level_files = spill_filenames;
     }
-
-    return num_entries;
+    
+    // Create file streams for results
+    char aux_filename[32]; memset(aux_filename, 0, 32 * sizeof(char));
+    sprintf(aux_filename, "merge_from_%d_files.vcf", options_data->num_files);
+    
+    char *merge_filename;
+    FILE *merge_fd = get_output_file(shared_options_data, aux_filename, &merge_filename);
+    LOG_INFO_F("Output filename = %s\n", merge_filename);
+    free(merge_filename);
+    
+    int num_positions = merge_tree_group(level_files, plan->num_final_files, plan->num_levels > 0, chromosome_table, 
+                                         num_threads, shared_options_data, options_data, merge_fd, 0);
+    LOG_DEBUG_F("%d positions merged\n", num_positions);
+    
+    if (merge_fd != NULL) { fclose(merge_fd); }
+    
+    stop = omp_get_wtime();
+    total = stop - start;
+    
+    LOG_INFO_F("[%d] Time elapsed = %f s\n", omp_get_thread_num(), total);
+    LOG_INFO_F("[%d] Time elapsed = %e ms\n", omp_get_thread_num(), total*1000);
+    
+    if (plan->num_levels > 0) {
+        free(level_files);
+    }
+    merge_tree_plan_free(plan);
+    chromosome_table_free(chromosome_table);
+    free_chromosome_order(chromosome_order, num_chromosomes);
+    
+    return ret_code;
 }
 
-
-int merge_remaining_interval(kh_pos_t* positions_read, vcf_file_t **files, shared_options_data_t *shared_options_data,
-                              merge_options_data_t *options_data, list_t *output_list) {
-    int num_entries = 0;
-
-    #pragma omp parallel for num_threads(shared_options_data->num_threads) reduction(+:num_entries)
-    for (int k = kh_begin(positions_read); k < kh_end(positions_read); k++) {
-        if (kh_exist(positions_read, k)) {
-            array_list_t *records_in_position = kh_value(positions_read, k);
-            assert(records_in_position);
+static int merge_tree_group(char **filenames, int num_files, int spill_inputs, chromosome_table_t *chromosome_table, 
+                            int num_threads, shared_options_data_t *shared_options_data, merge_options_data_t *options_data, 
+                            FILE *output, int spill) {
+    vcf_file_t **files = (vcf_file_t**) malloc (num_files * sizeof(vcf_file_t*));
+    merge_cursor_t **cursors = (merge_cursor_t**) malloc (num_files * sizeof(merge_cursor_t*));
+    merge_heap_t *heap = merge_heap_new(num_files, chromosome_table);
+    int num_positions = 0;
+    
+    if (spill_inputs) {
+        // Spills are read directly, as their headers are parsed when opened and their records need no parsing
+        merge_spill_source_t *sources = (merge_spill_source_t*) malloc (num_files * sizeof(merge_spill_source_t));
+        for (int i = 0; i < num_files; i++) {
+            off_t data_offset;
+            files[i] = open_parsed_file(filenames[i], shared_options_data, &data_offset);
+            sources[i].fd = fopen(filenames[i], "r");
+            sources[i].batch_lines = shared_options_data->batch_lines;
+            sources[i].qualities = NULL;
+            if (!sources[i].fd || merge_spill_seek_records(sources[i].fd, data_offset)) {
+                LOG_FATAL_F("Spill file %s can't be read!\n", filenames[i]);
+            }
             
-            // Launch merge
-            int err_code = 0;
-            vcf_record_t *merged = merge_position((vcf_record_file_link **) records_in_position->items, records_in_position->size, 
-                                                  files, options_data->num_files, options_data, &err_code);
+            cursors[i] = merge_cursor_new(i, files[i], merge_spill_batch_source, &sources[i]);
+            if (merge_cursor_next(cursors[i])) {
+                merge_heap_push(cursors[i], heap);
+            }
+        }
+        
+        write_merged_header(files, num_files, options_data, output);
+        if (spill) {
+            merge_spill_begin_records(output);
+        }
+        num_positions = merge_heap_to_file(heap, cursors, files, num_files, num_threads, shared_options_data, options_data, output, spill);
+        
+        // The spills of the previous level are not needed anymore
+        for (int i = 0; i < num_files; i++) {
+            fclose(sources[i].fd);
+            free(sources[i].qualities);
+            unlink(filenames[i]);
+            free(filenames[i]);
+        }
+        free(sources);
+        
+    } else {
+        // Input files are read as in a merge of all of them at once
+        list_t **read_list = (list_t**) malloc (num_files * sizeof(list_t*));
+        merge_text_source_t *text_sources = (merge_text_source_t*) malloc (num_files * sizeof(merge_text_source_t));
+        for (int i = 0; i < num_files; i++) {
+            files[i] = vcf_open(filenames[i], shared_options_data->max_batches);
+            if (!files[i]) {
+                LOG_FATAL_F("VCF file %s does not exist!\n", filenames[i]);
+            }
             
-            if (!err_code) {
-                list_item_t *item = list_item_new(k, MERGED_RECORD, merged);
-                list_insert_item(item, output_list);
-                num_entries += 1;
+            read_list[i] = (list_t*) malloc(sizeof(list_t));
+            list_init("text", 1, shared_options_data->max_batches, read_list[i]);
+            text_sources[i].text_list = read_list[i];
+            text_sources[i].batch_lines = shared_options_data->batch_lines;
+            cursors[i] = merge_cursor_new(i, files[i], merge_text_batch_source, &text_sources[i]);
+        }
+        
+#pragma omp parallel sections num_threads(2)
+        {
+#pragma omp section
+            {
+                int ret_code = vcf_multiread_batches(read_list, shared_options_data->batch_lines, files, num_files);
+                if (ret_code) {
+                    LOG_ERROR_F("Error %d while reading VCF files\n", ret_code);
+                }
             }
             
-            // Free empty nodes (lists of records in the same position)
-            free(kh_key(positions_read, k));
-            array_list_free(records_in_position, vcf_record_file_link_free);
-            kh_del(pos, positions_read, k);
+#pragma omp section
+            {
+                // Getting the first record of each file also parses its header
+                for (int i = 0; i < num_files; i++) {
+                    if (merge_cursor_next(cursors[i])) {
+                        merge_heap_push(cursors[i], heap);
+                    }
+                }
+                
+                write_merged_header(files, num_files, options_data, output);
+                if (spill) {
+                    merge_spill_begin_records(output);
+                }
+                num_positions = merge_heap_to_file(heap, cursors, files, num_files, num_threads, shared_options_data, options_data, output, spill);
+            }
+        }
+        
+        for (int i = 0; i < num_files; i++) {
+            free(read_list[i]);
         }
+        free(text_sources);
+        free(read_list);
     }
-
-    return num_entries;
-}
-
-
-
-static void compose_key_value(const char *chromosome, const long position, char *key) {
-    assert(key);
-    strcpy(key, chromosome);
-    sprintf(key+strlen(key), "_%ld", position);
-}
-
-static int record_cmp(const void *data1, const void *data2) {
-	vcf_record_t **record1 = (vcf_record_t **) data1;
-	vcf_record_t **record2 = (vcf_record_t **) data2;
-
-	int cmp = 0;
-	for (int i = 0; i < num_chromosomes; i++) {
-		assert(chromosome_order[i]);
-		if (!strncmp(chromosome_order[i], (*record1)->chromosome, (*record1)->chromosome_len)) {
-			if (!strncmp(chromosome_order[i], (*record2)->chromosome, (*record2)->chromosome_len)) {
-				cmp = 0;
-				break;
-			}
-			cmp = -1;
-			break;
-		} else if (!strncmp(chromosome_order[i], (*record2)->chromosome, (*record2)->chromosome_len)) {
-			cmp = 1;
-			break;
-		}
-	}
-
-	if (!cmp) {
-		cmp = (*record1)->position - (*record2)->position;
-	}
-
-	return cmp;
+    
+    for (int i = 0; i < num_files; i++) {
+        merge_cursor_free(cursors[i]);
+        vcf_close(files[i]);
+    }
+    merge_heap_free(heap);
+    free(cursors);
+    free(files);
+    
+    return num_positions;
 }
 
-static void free_merge_tree(kh_pos_t* positions_read) {
-    for (int k = kh_begin(positions_read); k < kh_end(positions_read); k++) {
-        if (kh_exist(positions_read, k)) {
-            array_list_free(kh_value(positions_read, k), vcf_record_file_link_free);
-            free(kh_key(positions_read, k));
-            kh_del(pos, positions_read, k);
+static int get_max_fan_in(int fan_in, int num_threads) {
+    // Every group keeps its files open, and there are as many groups being merged as threads
+    struct rlimit limit;
+    if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur != RLIM_INFINITY) {
+        int max_fan_in = ((int) limit.rlim_cur - MERGE_RESERVED_FDS) / (MERGE_FDS_PER_FILE * num_threads);
+        if (max_fan_in < fan_in) {
+            LOG_WARN_F("Fan-in reduced from %d to %d files to fit in the limit of open files (%d)\n", 
+                       fan_in, MAX(2, max_fan_in), (int) limit.rlim_cur);
+            fan_in = MAX(2, max_fan_in);
         }
     }
-}
\ No newline at end of file
+    return fan_in;
+}
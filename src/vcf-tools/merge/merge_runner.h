@@ -25,6 +25,7 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 
 #include <omp.h>
 
@@ -36,47 +37,156 @@
 #include <commons/file_utils.h>
 #include <commons/log.h>
 #include <containers/array_list.h>
-#include <containers/khash.h>
 #include <containers/list.h>
 #include <containers/cprops/hashtable.h>
 
 #include "hpg_variant_utils.h"
+#include "chromosome_order.h"
 #include "merge.h"
+#include "merge_heap.h"
+#include "merge_shards.h"
+#include "merge_tree.h"
 
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+#define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
 
-KHASH_MAP_INIT_STR(pos, array_list_t*);
+/**
+ * File descriptors kept for the log, the output and the libraries when limiting the fan-in.
+ */
+#define MERGE_RESERVED_FDS      32
+
+/**
+ * File descriptors used by every file of a group: the one of its reader and the one of its header or records.
+ */
+#define MERGE_FDS_PER_FILE      2
 
 int run_merge(shared_options_data_t *shared_options_data, merge_options_data_t *options_data);
 
-static int insert_position_read(char key[64], vcf_record_file_link *link, kh_pos_t* positions_read); 
+/**
+ * @brief Merges the next window of positions of the heap
+ * @details Pops up to window_size positions from the heap, moving forward the cursors popped, and merges them 
+ * in parallel. The merged records are stored in the same order they were popped.
+ * 
+ * @param heap Heap of cursors of the files
+ * @param cursors Cursors of all the files, whose finished batches are freed after merging
+ * @param files Files being merged
+ * @param num_files Number of files being merged
+ * @param window_size Maximum number of positions to merge
+ * @param num_threads Number of threads merging the positions
+ * @param options_data
+ * @param[out] merged Records merged, NULL for the positions that could not be merged
+ * @param[out] qualities Quality sums of the records merged, to be written into a spill, or NULL if not needed
+ * @return Number of positions popped
+ */
+static int merge_window(merge_heap_t *heap, merge_cursor_t **cursors, vcf_file_t **files, int num_files, int window_size, 
+                        int num_threads, merge_options_data_t *options_data, vcf_record_t **merged, 
+                        merge_spill_quality_t *qualities);
 
 /**
- * @brief Given a record, checks that its position is before the last one marked for merging, and updates it in that case
- * @details 
+ * @brief Merges all the positions of the heap and writes them into a file
  * 
- * @param current_record
- * @param max_chromosome_merged
- * @param max_position_merged
- * @param chromosome_order
- * @param num_chromosomes
- * @return Whether the max chromosome and position merged were updated
+ * @param heap Heap of cursors of the files
+ * @param cursors Cursors of all the files
+ * @param files Files being merged
+ * @param num_files Number of files being merged
+ * @param num_threads Number of threads merging every window of positions
+ * @param shared_options_data
+ * @param options_data
+ * @param output File the merged records are written to
+ * @param spill Whether to write the records in the binary format of spill files instead of as VCF text
+ * @return Number of positions written
  */
-static int calculate_merge_interval(vcf_record_t* current_record, char** max_chromosome_merged, long unsigned int* max_position_merged,
-                                     char **chromosome_order, int num_chromosomes);
+static int merge_heap_to_file(merge_heap_t *heap, merge_cursor_t **cursors, vcf_file_t **files, int num_files, int num_threads, 
+                              shared_options_data_t *shared_options_data, merge_options_data_t *options_data, 
+                              FILE *output, int spill);
 
-static int merge_interval(kh_pos_t* positions_read, char *max_chromosome_merged, unsigned long max_position_merged,
-                           char **chromosome_order, int num_chromosomes, vcf_file_t **files, 
-                           shared_options_data_t *shared_options_data, merge_options_data_t *options_data, list_t *output_list);
+/**
+ * @brief Writes the header of the file resulting from merging some files, ending with the line of sample names
+ * 
+ * @param files Files being merged, whose headers have been already parsed
+ * @param num_files Number of files being merged
+ * @param options_data
+ * @param output File the header is written to
+ */
+static void write_merged_header(vcf_file_t **files, int num_files, merge_options_data_t *options_data, FILE *output);
 
-static int merge_remaining_interval(kh_pos_t* positions_read, vcf_file_t **files,
-                                     shared_options_data_t *shared_options_data, merge_options_data_t *options_data, list_t *output_list);
+/**
+ * @brief Opens a VCF file and parses its header, without reading any record
+ * 
+ * @param filename Name of the file
+ * @param shared_options_data
+ * @param[out] data_offset Offset of the first byte after the header
+ * @return The file opened
+ */
+static vcf_file_t *open_parsed_file(char *filename, shared_options_data_t *shared_options_data, off_t *data_offset);
 
+/**
+ * @brief Merges the input files splitting them into region shards, which are merged in parallel
+ * @details Used when all the input files can be accessed randomly. Every thread merges whole shards 
+ * into temporary files, which are concatenated in order into the output file.
+ * 
+ * @param shared_options_data
+ * @param options_data
+ * @return 0 if the files were merged, an error code otherwise
+ */
+static int run_merge_shards(shared_options_data_t *shared_options_data, merge_options_data_t *options_data);
 
+/**
+ * @brief Merges the records of a shard and writes them into a file
+ * @details Opens a cursor on the range of the shard in every file, and merges the positions popped 
+ * from their heap one by one.
+ * 
+ * @param shard Index of the shard to merge
+ * @param plan Plan of the shards
+ * @param files Files being merged, whose headers have been already parsed
+ * @param chromosome_table Ranks of the chromosomes the files are sorted by
+ * @param shared_options_data
+ * @param options_data
+ * @param output File the merged records are written to
+ * @return Number of positions merged
+ */
+static int merge_shard(int shard, merge_shard_plan_t *plan, vcf_file_t **files, chromosome_table_t *chromosome_table, 
+                       shared_options_data_t *shared_options_data, merge_options_data_t *options_data, FILE *output);
 
+/**
+ * @brief Merges the input files in several levels, when there are too many of them to be opened at once
+ * @details The files of every level are merged in groups of at most fan_in files into spill files, which 
+ * are merged by the next level. The last level merges at most fan_in files into the output file.
+ * 
+ * @param fan_in Maximum number of files merged at once
+ * @param shared_options_data
+ * @param options_data
+ * @return 0 if the files were merged, an error code otherwise
+ */
+static int run_merge_tree(int fan_in, shared_options_data_t *shared_options_data, merge_options_data_t *options_data);
 
-static void compose_key_value(const char *chromosome, const long position, char *key);
+/**
+ * @brief Merges a group of files of a level of a hierarchical merge
+ * @details Spill files given as input are removed after merging them.
+ * 
+ * @param filenames Names of the files of the group
+ * @param num_files Number of files of the group
+ * @param spill_inputs Whether the files are spills of a previous level instead of input files
+ * @param chromosome_table Ranks of the chromosomes the files are sorted by
+ * @param num_threads Number of threads merging the positions
+ * @param shared_options_data
+ * @param options_data
+ * @param output File the merged records are written to
+ * @param spill Whether to write a spill file instead of a VCF file
+ * @return Number of positions merged
+ */
+static int merge_tree_group(char **filenames, int num_files, int spill_inputs, chromosome_table_t *chromosome_table, 
+                            int num_threads, shared_options_data_t *shared_options_data, merge_options_data_t *options_data, 
+                            FILE *output, int spill);
 
-static int record_cmp(const void *data1, const void *data2);
+/**
+ * @brief Gets the maximum number of files that can be merged at once by every thread
+ * @details The fan-in is reduced so all the groups merged at the same time fit in the limit of open files.
+ * 
+ * @param fan_in Fan-in requested
+ * @param num_threads Number of groups that may be merged at the same time
+ * @return The fan-in requested, or a lower one (but at least 2) if it exceeds the limit
+ */
+static int get_max_fan_in(int fan_in, int num_threads);
 
 #endif
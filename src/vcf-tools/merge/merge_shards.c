@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "merge_shards.h"
+
+static int compare_sort_keys(const void *key1, const void *key2);
+
+static int parse_line_key(const char *line, size_t length, chromosome_table_t *chromosomes, uint64_t *key);
+
+static int read_line_key(int fd, off_t offset, chromosome_table_t *chromosomes, uint64_t *key);
+
+static off_t next_line(int fd, off_t offset, off_t data_offset, off_t end);
+
+static char *read_lines(int fd, off_t offset, off_t end, size_t *length);
+
+
+/* **********************************************
+ *                 Shard plan                   *
+ * **********************************************/
+
+merge_shard_plan_t *merge_shard_plan_new(char **filenames, int num_files, off_t *data_offsets, int num_shards, 
+                                         chromosome_table_t *chromosomes) {
+    assert(num_shards > 0);
+    
+    off_t *sizes = (off_t*) malloc (num_files * sizeof(off_t));
+    uint64_t *samples = (uint64_t*) malloc ((size_t) num_files * num_shards * sizeof(uint64_t));
+    size_t num_samples = 0;
+    int failed = 0;
+    
+    // Sample the keys at evenly spaced offsets of every file. Chromosomes not in the order are sorted 
+    // by name, so they can't be split and are left for the last shard.
+    for (int i = 0; i < num_files && !failed; i++) {
+        struct stat st;
+        int fd = open(filenames[i], O_RDONLY);
+        if (fd < 0 || fstat(fd, &st)) {
+            LOG_ERROR_F("File %s can't be read: %s\n", filenames[i], strerror(errno));
+            if (fd >= 0) { close(fd); }
+            failed = 1;
+            break;
+        }
+        
+        sizes[i] = st.st_size;
+        off_t data_size = sizes[i] - data_offsets[i];
+        for (int j = 1; j < num_shards; j++) {
+            off_t line = next_line(fd, data_offsets[i] + data_size / num_shards * j, data_offsets[i], sizes[i]);
+            uint64_t key;
+            if (line < sizes[i] && read_line_key(fd, line, chromosomes, &key) && 
+                chromosome_key_rank(key) != CHROMOSOME_UNKNOWN_RANK) {
+                samples[num_samples++] = key;
+            }
+        }
+        close(fd);
+    }
+    
+    if (failed) {
+        free(samples);
+        free(sizes);
+        return NULL;
+    }
+    
+    // The boundaries are the quantiles of the samples, without repetitions
+    qsort(samples, num_samples, sizeof(uint64_t), compare_sort_keys);
+    
+    merge_shard_plan_t *plan = (merge_shard_plan_t*) malloc (sizeof(merge_shard_plan_t));
+    plan->boundaries = (uint64_t*) malloc ((num_shards + 1) * sizeof(uint64_t));
+    plan->boundaries[0] = 0;
+    plan->num_shards = 1;
+    plan->num_files = num_files;
+    for (int j = 1; j < num_shards && num_samples > 0; j++) {
+        uint64_t key = samples[num_samples * j / num_shards];
+        if (key > plan->boundaries[plan->num_shards - 1]) {
+            plan->boundaries[plan->num_shards++] = key;
+        }
+    }
+    plan->boundaries[plan->num_shards] = UINT64_MAX;
+    
+    // Find where each shard starts in each file
+    plan->offsets = (off_t*) malloc ((size_t) num_files * (plan->num_shards + 1) * sizeof(off_t));
+    
+    #pragma omp parallel for
+    for (int i = 0; i < num_files; i++) {
+        off_t *offsets = plan->offsets + (size_t) i * (plan->num_shards + 1);
+        offsets[0] = data_offsets[i];
+        offsets[plan->num_shards] = sizes[i];
+        
+        int fd = open(filenames[i], O_RDONLY);
+        for (int j = 1; j < plan->num_shards; j++) {
+            offsets[j] = (fd < 0) ? sizes[i] : merge_seek_key(fd, plan->boundaries[j], offsets[j-1], sizes[i], chromosomes);
+        }
+        if (fd >= 0) { close(fd); }
+    }
+    
+    free(samples);
+    free(sizes);
+    
+    return plan;
+}
+
+void merge_shard_plan_free(merge_shard_plan_t *plan) {
+    free(plan->offsets);
+    free(plan->boundaries);
+    free(plan);
+}
+
+
+/* **********************************************
+ *              Random access to files          *
+ * **********************************************/
+
+int merge_file_is_seekable(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    
+    // Files compressed with gzip or BGZF are detected by their magic number
+    unsigned char magic[2] = { 0, 0 };
+    FILE *fd = fopen(filename, "rb");
+    if (!fd) {
+        return 0;
+    }
+    size_t read = fread(magic, 1, 2, fd);
+    fclose(fd);
+    
+    return !(read == 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+char *merge_read_header(int fd, off_t *data_offset) {
+    size_t capacity = MERGE_RANGE_CHUNK_SIZE;
+    char *header = (char*) malloc (capacity + 1);
+    size_t length = 0;
+    int line_start = 1;
+    
+    while (1) {
+        if (length == capacity) {
+            capacity *= 2;
+            header = (char*) realloc (header, capacity + 1);
+        }
+        
+        ssize_t bytes = pread(fd, header + length, capacity - length, length);
+        if (bytes < 0) {
+            free(header);
+            return NULL;
+        }
+        
+        // The header finishes at the first line not starting with '#'
+        for (ssize_t i = 0; i < bytes; i++) {
+            if (line_start && header[length + i] != '#') {
+                *data_offset = length + i;
+                header[length + i] = '\0';
+                return header;
+            }
+            line_start = (header[length + i] == '\n');
+        }
+        
+        length += bytes;
+        if (bytes == 0) {
+            *data_offset = length;
+            header[length] = '\0';
+            return header;
+        }
+    }
+}
+
+off_t merge_seek_key(int fd, uint64_t key, off_t data_offset, off_t end, chromosome_table_t *chromosomes) {
+    off_t low = data_offset, high = end;
+    uint64_t line_key;
+    
+    // Bisection over the offsets, moved forward to the next line. All the lines before low are lower 
+    // than the key, and the one at high is not.
+    while (high - low > MERGE_SEEK_SCAN_SIZE) {
+        off_t line = next_line(fd, low + (high - low) / 2, data_offset, high);
+        if (line >= high) {
+            break;  // A very long line, just scan it
+        }
+        
+        if (read_line_key(fd, line, chromosomes, &line_key) && line_key < key) {
+            low = line;
+        } else {
+            high = line;
+        }
+    }
+    
+    // Scan the few lines left
+    for (off_t offset = low; offset < high; ) {
+        size_t length;
+        char *text = read_lines(fd, offset, high, &length);
+        if (!text) {
+            break;
+        }
+        
+        for (char *line = text; line < text + length; ) {
+            if (!parse_line_key(line, text + length - line, chromosomes, &line_key) || line_key >= key) {
+                off_t found = offset + (line - text);
+                free(text);
+                return found;
+            }
+            
+            char *newline = memchr(line, '\n', text + length - line);
+            if (!newline) {
+                break;
+            }
+            line = newline + 1;
+        }
+        
+        offset += length;
+        free(text);
+    }
+    
+    return high;
+}
+
+vcf_batch_t *merge_range_batch_source(merge_cursor_t *cursor) {
+    merge_range_source_t *source = cursor->source;
+    
+    // A text may have been parsed into several batches
+    vcf_batch_t *batch;
+    while (!(batch = fetch_vcf_batch_non_blocking(cursor->file))) {
+        if (source->offset >= source->end) {
+            return NULL;
+        }
+        
+        size_t length;
+        char *text_begin = read_lines(source->fd, source->offset, source->end, &length);
+        if (!text_begin) {
+            LOG_ERROR_F("Error while reading the file %s: %s\n", cursor->file->filename, strerror(errno));
+            return NULL;
+        }
+        source->offset += length;
+        
+        vcf_reader_status *status = vcf_reader_status_new(source->batch_lines, 0);
+        int ret_code = run_vcf_parser(text_begin, text_begin + length, source->batch_lines, cursor->file, status);
+        if (ret_code) {
+            LOG_ERROR_F("Error %d while reading the file %s\n", ret_code, cursor->file->filename);
+        }
+        
+        vcf_reader_status_free(status);
+    }
+    
+    return batch;
+}
+
+vcf_file_t *merge_shard_file_new(vcf_file_t *file) {
+    vcf_file_t *shard_file = (vcf_file_t*) malloc (sizeof(vcf_file_t));
+    memcpy(shard_file, file, sizeof(vcf_file_t));
+    
+    // The batches are consumed by the same thread that parses them, so the list must never block
+    shard_file->record_batches = (list_t*) malloc (sizeof(list_t));
+    list_init("batches", 1, INT_MAX, shard_file->record_batches);
+    
+    return shard_file;
+}
+
+void merge_shard_file_free(vcf_file_t *shard_file) {
+    free(shard_file->record_batches);
+    free(shard_file);
+}
+
+
+/* **********************************************
+ *               Temporary files                *
+ * **********************************************/
+
+FILE *merge_temporary_file(const char *directory) {
+    char *template = (char*) malloc (strlen(directory) + 32);
+    sprintf(template, "%s/.hpg-variant_merge_XXXXXX", directory);
+    
+    int fd = mkstemp(template);
+    if (fd < 0) {
+        LOG_ERROR_F("Can't create a temporary file in %s: %s\n", directory, strerror(errno));
+        free(template);
+        return NULL;
+    }
+    
+    // Once unlinked, the file is removed when closed, even if the program is interrupted
+    unlink(template);
+    free(template);
+    
+    return fdopen(fd, "w+");
+}
+
+int merge_append_file(FILE *source, FILE *destination) {
+    char buffer[MERGE_RANGE_CHUNK_SIZE];
+    size_t bytes;
+    
+    if (fflush(source) || fseek(source, 0, SEEK_SET)) {
+        return errno;
+    }
+    
+    while ((bytes = fread(buffer, 1, MERGE_RANGE_CHUNK_SIZE, source)) > 0) {
+        if (fwrite(buffer, 1, bytes, destination) != bytes) {
+            return errno;
+        }
+    }
+    
+    return ferror(source) ? EIO : 0;
+}
+
+
+/* **********************************************
+ *                 Auxiliary                    *
+ * **********************************************/
+
+static int compare_sort_keys(const void *key1, const void *key2) {
+    uint64_t k1 = *((uint64_t*) key1), k2 = *((uint64_t*) key2);
+    return (k1 > k2) - (k1 < k2);
+}
+
+/**
+ * Gets the sort key of a line from its first two columns, which are not null-terminated.
+ */
+static int parse_line_key(const char *line, size_t length, chromosome_table_t *chromosomes, uint64_t *key) {
+    const char *tab = memchr(line, '\t', length);
+    if (!tab || tab == line || tab + 1 >= line + length || tab[1] < '0' || tab[1] > '9') {
+        return 0;
+    }
+    
+    uint64_t position = 0;
+    for (const char *c = tab + 1; c < line + length && *c >= '0' && *c <= '9'; c++) {
+        position = position * 10 + (*c - '0');
+    }
+    
+    *key = chromosome_sort_key(chromosome_table_rank(line, tab - line, chromosomes), position);
+    return 1;
+}
+
+static int read_line_key(int fd, off_t offset, chromosome_table_t *chromosomes, uint64_t *key) {
+    char buffer[MERGE_KEY_BUFFER_SIZE];
+    ssize_t bytes = pread(fd, buffer, MERGE_KEY_BUFFER_SIZE, offset);
+    return bytes > 0 && parse_line_key(buffer, bytes, chromosomes, key);
+}
+
+/**
+ * Gets the offset of the first line starting at or after a given offset, or end if there is none.
+ */
+static off_t next_line(int fd, off_t offset, off_t data_offset, off_t end) {
+    if (offset <= data_offset) {
+        return data_offset;
+    }
+    
+    // A line starts after the previous byte if it is a newline
+    char buffer[MERGE_KEY_BUFFER_SIZE];
+    for (off_t current = offset - 1; current < end; current += MERGE_KEY_BUFFER_SIZE) {
+        ssize_t bytes = pread(fd, buffer, MERGE_KEY_BUFFER_SIZE, current);
+        if (bytes <= 0) {
+            break;
+        }
+        char *newline = memchr(buffer, '\n', bytes);
+        if (newline) {
+            off_t line = current + (newline - buffer) + 1;
+            return (line < end) ? line : end;
+        }
+    }
+    
+    return end;
+}
+
+/**
+ * Reads the complete lines from an offset of a file, up to a chunk of MERGE_RANGE_CHUNK_SIZE bytes 
+ * unless a line is longer, and without going past the end of a range. The text is null-terminated.
+ */
+static char *read_lines(int fd, off_t offset, off_t end, size_t *length) {
+    size_t chunk_size = MERGE_RANGE_CHUNK_SIZE;
+    
+    while (1) {
+        size_t size = (end - offset < chunk_size) ? end - offset : chunk_size;
+        char *text = (char*) malloc (size + 1);
+        ssize_t bytes = pread(fd, text, size, offset);
+        if (bytes <= 0) {
+            free(text);
+            return NULL;
+        }
+        
+        // Only the last line of the range may be incomplete
+        *length = bytes;
+        if (offset + bytes < end) {
+            while (*length > 0 && text[*length - 1] != '\n') {
+                (*length)--;
+            }
+        }
+        
+        if (*length > 0) {
+            text[*length] = '\0';
+            return text;
+        }
+        
+        free(text);
+        chunk_size *= 2;
+    }
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VCF_TOOLS_MERGE_SHARDS_H
+#define VCF_TOOLS_MERGE_SHARDS_H
+
+/**
+ * @file merge_shards.h
+ * @brief Partition of the files to merge into region shards that can be merged independently
+ *
+ * The genome is split into shards of consecutive sort keys, whose boundaries are sampled from the 
+ * records of the files so every shard holds about the same amount of data. As the input files are 
+ * sorted, the records of a shard are a contiguous range of bytes in each file, which is found by 
+ * bisection over the offsets of the file, without any index. So every shard reads its own ranges 
+ * and is merged by its own heap of cursors, and the outputs of the shards only need to be 
+ * concatenated in order.
+ *
+ * All the records of a position fall into the same shard, and the chromosomes not in the chromosome 
+ * order are always in the last one, because they are sorted by name instead of by sort key.
+ *
+ * Compressed files can't be accessed randomly, so they must be merged as a single stream.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <bioformats/vcf/vcf_file.h>
+#include <bioformats/vcf/vcf_reader.h>
+#include <commons/log.h>
+#include <containers/list.h>
+
+#include "chromosome_table.h"
+#include "merge_heap.h"
+
+/**
+ * Number of shards per thread, so the threads that finish their shards earlier can take some more.
+ */
+#define MERGE_SHARDS_PER_THREAD     4
+
+/**
+ * Bytes read at once from the range of a file, extended when a line doesn't fit.
+ */
+#define MERGE_RANGE_CHUNK_SIZE      (1 << 16)
+
+/**
+ * Size of the ranges of a file scanned line by line when bisecting, instead of splitting them again.
+ */
+#define MERGE_SEEK_SCAN_SIZE        4096
+
+/**
+ * Bytes read at the start of a line to get its chromosome and position.
+ */
+#define MERGE_KEY_BUFFER_SIZE       256
+
+/**
+ * Range of bytes of a file read by a cursor, as source of its batches.
+ */
+typedef struct {
+    int fd;             /**< Descriptor of the file, -1 if the range is empty */
+    off_t offset;       /**< Offset of the next line to read */
+    off_t end;          /**< Offset after the last line of the range */
+    int batch_lines;    /**< Maximum number of records in each batch */
+} merge_range_source_t;
+
+typedef struct {
+    uint64_t *boundaries;   /**< Sort key each shard starts at, plus an upper bound of the keys after the last one */
+    off_t *offsets;         /**< Offset each shard starts at in each file: num_shards + 1 per file, the last is the end of the file */
+    int num_shards;
+    int num_files;
+} merge_shard_plan_t;
+
+
+/**
+ * @brief Splits a set of sorted files into shards with about the same amount of records.
+ * 
+ * Up to num_shards boundaries are sampled from evenly spaced offsets of the files, so fewer shards may 
+ * be planned when the files have few different positions.
+ * 
+ * @param filenames files to split
+ * @param num_files number of files
+ * @param data_offsets offset of the first record of each file, after its header
+ * @param num_shards maximum number of shards
+ * @param chromosomes ranks of the chromosomes the files are sorted by
+ * @return The plan of the shards, or NULL if a file can't be read
+ */
+merge_shard_plan_t *merge_shard_plan_new(char **filenames, int num_files, off_t *data_offsets, int num_shards, 
+                                         chromosome_table_t *chromosomes);
+
+void merge_shard_plan_free(merge_shard_plan_t *plan);
+
+/**
+ * @brief Gets the range of bytes of a file that belongs to a shard.
+ */
+static inline void merge_shard_range(int shard, int file, merge_shard_plan_t *plan, off_t *begin, off_t *end) {
+    off_t *offsets = plan->offsets + (size_t) file * (plan->num_shards + 1);
+    *begin = offsets[shard];
+    *end = offsets[shard + 1];
+}
+
+/**
+ * @brief Checks whether a file can be accessed randomly, which is true for regular files not compressed.
+ */
+int merge_file_is_seekable(const char *filename);
+
+/**
+ * @brief Reads the header of a VCF file, which are the lines starting with '#' at the beginning of the file.
+ * @param fd descriptor of the file
+ * @param[out] data_offset offset of the first record, after the header
+ * @return The text of the header, or NULL if the file can't be read
+ */
+char *merge_read_header(int fd, off_t *data_offset);
+
+/**
+ * @brief Finds the first line of a sorted file whose sort key is not lower than a given one.
+ * 
+ * Lines whose chromosome and position can't be read are considered not lower than any key.
+ * 
+ * @param fd descriptor of the file
+ * @param key sort key to look for
+ * @param data_offset offset of the first record of the file
+ * @param end offset the search is limited to, usually the size of the file
+ * @param chromosomes ranks of the chromosomes the file is sorted by
+ * @return The offset of the line, or end if all the lines are lower than the key
+ */
+off_t merge_seek_key(int fd, uint64_t key, off_t data_offset, off_t end, chromosome_table_t *chromosomes);
+
+/**
+ * @brief Source of batches of a cursor that parses the lines of a range of a file, given as merge_range_source_t.
+ */
+vcf_batch_t *merge_range_batch_source(merge_cursor_t *cursor);
+
+/**
+ * @brief Creates a copy of a file whose header has been already parsed, with its own list of batches.
+ * 
+ * The records of a range of the file can be parsed into the copy while other ranges are parsed into 
+ * other copies. The header is shared with the original file, which must not be closed before the copy.
+ */
+vcf_file_t *merge_shard_file_new(vcf_file_t *file);
+
+void merge_shard_file_free(vcf_file_t *shard_file);
+
+/**
+ * @brief Creates a temporary file in a directory, which is removed as soon as it is closed.
+ * @return The file opened for reading and writing, or NULL if it can't be created
+ */
+FILE *merge_temporary_file(const char *directory);
+
+/**
+ * @brief Appends the whole contents of a file to another one.
+ * @return 0 if the contents were copied, an errno code otherwise
+ */
+int merge_append_file(FILE *source, FILE *destination);
+
+#endif
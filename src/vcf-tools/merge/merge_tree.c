@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "merge_tree.h"
+
+static int varint_size(uint64_t value);
+
+static void write_varint(uint64_t value, FILE *fd);
+
+static int read_varint(FILE *fd, uint64_t *value);
+
+static uint64_t decode_varint(char **data);
+
+static vcf_record_t *decode_record(char *data, merge_spill_quality_t *quality);
+
+
+/* **********************************************
+ *                    Plan                      *
+ * **********************************************/
+
+merge_tree_plan_t *merge_tree_plan_new(int num_files, int fan_in) {
+    assert(fan_in >= 2);
+    
+    merge_tree_plan_t *plan = (merge_tree_plan_t*) calloc (1, sizeof(merge_tree_plan_t));
+    for (int n = num_files; n > fan_in; n = (n + fan_in - 1) / fan_in) {
+        plan->num_levels++;
+    }
+    
+    plan->num_groups = (int*) malloc (plan->num_levels * sizeof(int));
+    plan->first_file = (int**) malloc (plan->num_levels * sizeof(int*));
+    
+    // The files of a level are split evenly, so no group has more than fan_in files
+    int num_level_files = num_files;
+    for (int l = 0; l < plan->num_levels; l++) {
+        int num_groups = (num_level_files + fan_in - 1) / fan_in;
+        plan->num_groups[l] = num_groups;
+        plan->first_file[l] = (int*) malloc ((num_groups + 1) * sizeof(int));
+        for (int g = 0; g <= num_groups; g++) {
+            plan->first_file[l][g] = (long) g * num_level_files / num_groups;
+        }
+        num_level_files = num_groups;
+    }
+    plan->num_final_files = num_level_files;
+    
+    return plan;
+}
+
+void merge_tree_plan_free(merge_tree_plan_t *plan) {
+    for (int l = 0; l < plan->num_levels; l++) {
+        free(plan->first_file[l]);
+    }
+    free(plan->first_file);
+    free(plan->num_groups);
+    free(plan);
+}
+
+
+/* **********************************************
+ *                 Spill files                  *
+ * **********************************************/
+
+FILE *merge_spill_create(const char *directory, char **filename) {
+    *filename = (char*) malloc (strlen(directory) + 32);
+    sprintf(*filename, "%s/.hpg-variant_spill_XXXXXX", directory);
+    
+    int fd = mkstemp(*filename);
+    if (fd < 0) {
+        LOG_ERROR_F("Can't create a spill file in %s: %s\n", directory, strerror(errno));
+        free(*filename);
+        *filename = NULL;
+        return NULL;
+    }
+    
+    return fdopen(fd, "w");
+}
+
+int merge_spill_begin_records(FILE *fd) {
+    return (fputs(MERGE_SPILL_MAGIC, fd) == EOF) ? errno : 0;
+}
+
+int merge_spill_seek_records(FILE *fd, off_t data_offset) {
+    size_t magic_len = strlen(MERGE_SPILL_MAGIC);
+    char magic[magic_len];
+    
+    if (fseeko(fd, data_offset, SEEK_SET) || fread(magic, 1, magic_len, fd) != magic_len) {
+        return 1;
+    }
+    return memcmp(magic, MERGE_SPILL_MAGIC, magic_len);
+}
+
+int merge_spill_write_record(vcf_record_t *record, double quality_sum, int quality_samples, FILE *fd) {
+    char *strings[MERGE_SPILL_STRINGS] = { record->chromosome, record->id, record->reference, record->alternate, 
+                                           record->filter, record->info, record->format };
+    size_t lengths[MERGE_SPILL_STRINGS] = { record->chromosome_len, record->id_len, record->reference_len, record->alternate_len, 
+                                            record->filter_len, record->info_len, record->format_len };
+    int num_samples = record->samples ? record->samples->size : 0;
+    
+    // Size of the record, needed to read it at once
+    uint64_t size = varint_size(record->position) + sizeof(double) + varint_size(quality_samples) + varint_size(num_samples);
+    for (int i = 0; i < MERGE_SPILL_STRINGS; i++) {
+        size += varint_size(lengths[i]) + lengths[i] + 1;
+    }
+    for (int i = 0; i < num_samples; i++) {
+        size_t length = strlen(array_list_get(i, record->samples));
+        size += varint_size(length) + length + 1;
+    }
+    
+    write_varint(size, fd);
+    write_varint(record->position, fd);
+    fwrite(&quality_sum, sizeof(double), 1, fd);
+    write_varint(quality_samples, fd);
+    write_varint(num_samples, fd);
+    
+    // Strings are null-terminated, so they can be used without copying them when read
+    for (int i = 0; i < MERGE_SPILL_STRINGS; i++) {
+        write_varint(lengths[i], fd);
+        fwrite(strings[i], 1, lengths[i], fd);
+        putc('\0', fd);
+    }
+    for (int i = 0; i < num_samples; i++) {
+        char *sample = array_list_get(i, record->samples);
+        size_t length = strlen(sample);
+        write_varint(length, fd);
+        fwrite(sample, 1, length + 1, fd);
+    }
+    
+    return ferror(fd) ? errno : 0;
+}
+
+vcf_batch_t *merge_spill_batch_source(merge_cursor_t *cursor) {
+    merge_spill_source_t *source = cursor->source;
+    
+    // The records of the batch are read into a single text, and decoded once it won't be moved anymore
+    size_t capacity = 4096, length = 0;
+    char *text = (char*) malloc (capacity);
+    size_t *offsets = (size_t*) malloc (source->batch_lines * sizeof(size_t));
+    int num_records = 0;
+    
+    while (num_records < source->batch_lines) {
+        uint64_t size;
+        int ret_code = read_varint(source->fd, &size);
+        if (ret_code > 0) {
+            break;  // End of file
+        }
+        
+        if (ret_code == 0 && length + size > capacity) {
+            capacity = 2 * (length + size);
+            text = (char*) realloc (text, capacity);
+        }
+        if (ret_code < 0 || fread(text + length, 1, size, source->fd) != size) {
+            LOG_ERROR_F("Spill file %s is truncated\n", cursor->file->filename);
+            break;
+        }
+        
+        offsets[num_records++] = length;
+        length += size;
+    }
+    
+    if (num_records == 0) {
+        free(offsets);
+        free(text);
+        return NULL;
+    }
+    
+    // The qualities are kept for the batch being traversed, which is the last one read
+    if (!source->qualities) {
+        source->qualities = (merge_spill_quality_t*) malloc (source->batch_lines * sizeof(merge_spill_quality_t));
+    }
+    
+    vcf_batch_t *batch = vcf_batch_new(num_records);
+    batch->text = text;
+    for (int i = 0; i < num_records; i++) {
+        add_record_to_vcf_batch(decode_record(text + offsets[i], source->qualities + i), batch);
+    }
+    
+    free(offsets);
+    return batch;
+}
+
+merge_spill_quality_t merge_spill_cursor_quality(merge_cursor_t *cursor) {
+    merge_spill_source_t *source = cursor->source;
+    assert(cursor->batch && source->qualities);
+    return source->qualities[cursor->record_index];
+}
+
+
+/* **********************************************
+ *                 Auxiliary                    *
+ * **********************************************/
+
+static int varint_size(uint64_t value) {
+    int size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * Writes an integer 7 bits per byte, from the lowest ones, with the highest bit set in all the bytes 
+ * but the last one.
+ */
+static void write_varint(uint64_t value, FILE *fd) {
+    while (value >= 0x80) {
+        putc((value & 0x7f) | 0x80, fd);
+        value >>= 7;
+    }
+    putc(value, fd);
+}
+
+/**
+ * Reads an integer written by write_varint. Returns 0 if it was read, 1 if the end of the file was 
+ * found before it, and -1 if the file finishes in the middle of the integer.
+ */
+static int read_varint(FILE *fd, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = getc(fd);
+        if (byte == EOF) {
+            return (shift == 0) ? 1 : -1;
+        }
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint64_t decode_varint(char **data) {
+    uint64_t value = 0;
+    unsigned char *byte = (unsigned char*) *data;
+    for (int shift = 0; ; shift += 7, byte++) {
+        value |= (uint64_t) (*byte & 0x7f) << shift;
+        if (!(*byte & 0x80)) {
+            break;
+        }
+    }
+    *data = (char*) byte + 1;
+    return value;
+}
+
+/**
+ * Decodes a record written by merge_spill_write_record. Its fields point to the data, except the 
+ * samples, which are copied like the parser does. Its quality is the mean of the sum stored.
+ */
+static vcf_record_t *decode_record(char *data, merge_spill_quality_t *quality) {
+    vcf_record_t *record = vcf_record_new();
+    
+    set_vcf_record_position(decode_varint(&data), record);
+    memcpy(&(quality->sum), data, sizeof(double));
+    data += sizeof(double);
+    quality->samples = decode_varint(&data);
+    set_vcf_record_quality((quality->samples > 0) ? quality->sum / quality->samples : -1, record);
+    int num_samples = decode_varint(&data);
+    
+    char *strings[MERGE_SPILL_STRINGS];
+    int lengths[MERGE_SPILL_STRINGS];
+    for (int i = 0; i < MERGE_SPILL_STRINGS; i++) {
+        lengths[i] = decode_varint(&data);
+        strings[i] = data;
+        data += lengths[i] + 1;
+    }
+    
+    set_vcf_record_chromosome(strings[0], lengths[0], record);
+    set_vcf_record_id(strings[1], lengths[1], record);
+    set_vcf_record_reference(strings[2], lengths[2], record);
+    set_vcf_record_alternate(strings[3], lengths[3], record);
+    set_vcf_record_filter(strings[4], lengths[4], record);
+    set_vcf_record_info(strings[5], lengths[5], record);
+    set_vcf_record_format(strings[6], lengths[6], record);
+    
+    for (int i = 0; i < num_samples; i++) {
+        int length = decode_varint(&data);
+        add_vcf_record_sample(strndup(data, length), length, record);
+        data += length + 1;
+    }
+    
+    return record;
+}
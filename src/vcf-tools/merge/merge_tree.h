@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2012-2013 Cristina Yenyxe Gonzalez Garcia (ICM-CIPF)
+ * Copyright (c) 2012 Ignacio Medina (ICM-CIPF)
+ *
+ * This file is part of hpg-variant.
+ *
+ * hpg-variant is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * hpg-variant is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hpg-variant. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VCF_TOOLS_MERGE_TREE_H
+#define VCF_TOOLS_MERGE_TREE_H
+
+/**
+ * @file merge_tree.h
+ * @brief Hierarchical merge of more files than can be opened at the same time
+ *
+ * The input files are merged in groups of at most fan-in files, and every group is written into an 
+ * intermediate spill file. The spills are merged in groups again, level after level, until there 
+ * are few enough to be merged into the output file. So no more than fan-in files are read by a merge, 
+ * and the groups of a level can be merged in parallel.
+ *
+ * A spill starts with the merged VCF header as text, so it can be parsed like any other file, 
+ * followed by a line with a magic string and the records in binary form. Every field of a record is 
+ * stored with its length as a variable-length integer, so the records are read back without parsing 
+ * any text, and their fields point directly to the text of their batch. The quality of a record is 
+ * stored as the sum and number of samples it was averaged over, so spills are merged like the files 
+ * they come from.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+#include <commons/log.h>
+#include <containers/array_list.h>
+
+#include "merge_heap.h"
+
+/**
+ * Line between the header and the records of a spill file.
+ */
+#define MERGE_SPILL_MAGIC       "HPG-VARIANT SPILL 2\n"
+
+/**
+ * Number of fields of a record stored as strings, before its samples.
+ */
+#define MERGE_SPILL_STRINGS     7
+
+/**
+ * Groups of files merged at every level of a hierarchical merge. The files merged by a level are the 
+ * spills written by the previous one, and the input files in the first level.
+ */
+typedef struct {
+    int num_levels;         /**< Number of levels with spills, not including the final merge */
+    int *num_groups;        /**< Number of groups of each level, whose spills are the files of the next level */
+    int **first_file;       /**< Index of the first file of each group of each level, plus the number of files */
+    int num_final_files;    /**< Number of files of the final merge */
+} merge_tree_plan_t;
+
+/**
+ * Quality of a spill record, as the weighted sum it is the mean of.
+ */
+typedef struct {
+    double sum;         /**< Sum of the qualities merged into the record, weighted by their number of samples */
+    int samples;        /**< Number of samples of the files merged into the record */
+} merge_spill_quality_t;
+
+/**
+ * Spill file read by a cursor, as source of its batches.
+ */
+typedef struct {
+    FILE *fd;           /**< Spill file, positioned at the next record */
+    int batch_lines;    /**< Maximum number of records in each batch */
+    
+    merge_spill_quality_t *qualities;   /**< Qualities of the records of the last batch read, freed by the owner of the source */
+} merge_spill_source_t;
+
+
+/**
+ * @brief Plans the levels of a hierarchical merge.
+ * 
+ * Files are split into groups of similar size, with the fewest groups of at most fan_in files. If 
+ * num_files is not greater than fan_in, the plan has no levels and all the files are merged at once.
+ * 
+ * @param num_files number of input files
+ * @param fan_in maximum number of files merged at once, at least 2
+ */
+merge_tree_plan_t *merge_tree_plan_new(int num_files, int fan_in);
+
+void merge_tree_plan_free(merge_tree_plan_t *plan);
+
+/**
+ * @brief Creates a spill file in a directory.
+ * @param directory directory of the file
+ * @param[out] filename name of the file, which must be removed when it is not needed anymore
+ * @return The file opened for writing, or NULL if it can't be created
+ */
+FILE *merge_spill_create(const char *directory, char **filename);
+
+/**
+ * @brief Writes the magic line that separates the header of a spill from its records.
+ * @return 0 if the line was written, an errno code otherwise
+ */
+int merge_spill_begin_records(FILE *fd);
+
+/**
+ * @brief Moves a spill file to its first record, checking its magic line.
+ * @param fd spill file
+ * @param data_offset offset of the first line after the header
+ * @return 0 if the file is positioned at its first record, non-zero if it is not a spill
+ */
+int merge_spill_seek_records(FILE *fd, off_t data_offset);
+
+/**
+ * @brief Writes a record in binary form.
+ * @param record merged record
+ * @param quality_sum sum of the qualities merged into the record, as returned by merge_quality_sum
+ * @param quality_samples number of samples of the files merged into the record
+ * @param fd spill file
+ * @return 0 if the record was written, an errno code otherwise
+ */
+int merge_spill_write_record(vcf_record_t *record, double quality_sum, int quality_samples, FILE *fd);
+
+/**
+ * @brief Source of batches of a cursor that reads the records of a spill file, given as merge_spill_source_t.
+ */
+vcf_batch_t *merge_spill_batch_source(merge_cursor_t *cursor);
+
+/**
+ * @brief Returns the quality of the current record of a cursor that reads a spill file.
+ */
+merge_spill_quality_t merge_spill_cursor_quality(merge_cursor_t *cursor);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Micro-benchmark of Fisher's exact test of the association tool: the enumeration of all the tables of
+ * the math library against the walk over the tails of the distribution, without and with the cache of
+ * p-values of each thread and the early exit of tables far from significance. Most variants are rare,
+ * so their tables repeat across the batch. It is not part of the test suite, run it as
+ *
+ *     ./fisher.bench [num_samples] [num_variants] [repetitions]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <omp.h>
+
+#include <stats/fisher.h>
+
+#include "gwas/assoc/assoc_fisher_test.h"
+
+
+/**
+ * Number of alternate alleles among num_alleles with frequency maf, drawn from its Poisson or normal approximation.
+ */
+static int random_count(int num_alleles, double maf) {
+    double mean = num_alleles * maf;
+    int count = 0;
+    if (mean < 30) {
+        double limit = exp(-mean), product = (double) rand() / RAND_MAX;
+        while (product > limit) {
+            count++;
+            product *= (double) rand() / RAND_MAX;
+        }
+    } else {
+        double u1 = ((double) rand() + 1) / ((double) RAND_MAX + 1), u2 = (double) rand() / RAND_MAX;
+        count = (int) round(mean + sqrt(mean * (1 - maf)) * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2));
+    }
+    return (count < 0) ? 0 : (count > num_alleles) ? num_alleles : count;
+}
+
+int main(int argc, char *argv[]) {
+    int num_samples = (argc > 1) ? atoi(argv[1]) : 100000;
+    int num_variants = (argc > 2) ? atoi(argv[2]) : 20000;
+    int repetitions = (argc > 3) ? atoi(argv[3]) : 1;
+
+    // Cases and controls with as many alleles each, 80% of variants with a log-uniform MAF between 0.001% and 1%
+    srand(1);
+    int num_alleles = num_samples;
+    int *tables = (int*) malloc (num_variants * 4 * sizeof(int));
+    for (int i = 0; i < num_variants; i++) {
+        double maf = (rand() % 5) ? pow(10, -5 + 3.0 * rand() / RAND_MAX) : 0.01 + 0.49 * rand() / RAND_MAX;
+        int affected2 = random_count(num_alleles, maf), unaffected2 = random_count(num_alleles, maf);
+        tables[4 * i] = num_alleles - affected2;
+        tables[4 * i + 1] = affected2;
+        tables[4 * i + 2] = num_alleles - unaffected2;
+        tables[4 * i + 3] = unaffected2;
+    }
+
+    printf("%d samples, %d variants\n", num_samples, num_variants);
+
+    double *library_logarithms = init_logarithm_array(num_samples * 10);
+    double *factorial_logarithms = assoc_fisher_factorial_logarithms(2 * num_samples);
+    double *expected = (double*) malloc (num_variants * sizeof(double));
+
+    double start = omp_get_wtime();
+    for (int r = 0; r < repetitions; r++) {
+        for (int i = 0; i < num_variants; i++) {
+            int *t = tables + 4 * i;
+            expected[i] = fisher_test(t[0], t[1], t[2], t[3], TWO_SIDED, library_logarithms);
+        }
+    }
+    printf("%-16s %10.3f ms/batch\n", "enumeration", (omp_get_wtime() - start) * 1000 / repetitions);
+
+    double max_error = 0;
+    start = omp_get_wtime();
+    for (int r = 0; r < repetitions; r++) {
+        for (int i = 0; i < num_variants; i++) {
+            int *t = tables + 4 * i;
+            double p_value = assoc_fisher_p_value(t[0], t[1], t[2], t[3], 0, factorial_logarithms);
+            max_error = fmax(max_error, fabs(p_value - expected[i]));
+        }
+    }
+    printf("%-16s %10.3f ms/batch (max error %.2e)\n", "tails", (omp_get_wtime() - start) * 1000 / repetitions, max_error);
+
+    double early_exits[] = { 0, 0.5 };
+    char *names[] = { "tails+cache", "tails+cache+exit" };
+    for (int k = 0; k < 2; k++) {
+        size_t hits = 0, misses = 0;
+        start = omp_get_wtime();
+        for (int r = 0; r < repetitions; r++) {
+            assoc_fisher_input_t *input = assoc_fisher_input_new(factorial_logarithms, 0, early_exits[k]);
+            for (int i = 0; i < num_variants; i++) {
+                int *t = tables + 4 * i;
+                assoc_fisher_test(t[0], t[1], t[2], t[3], input);
+            }
+            hits += input->hits;
+            misses += input->misses;
+            assoc_fisher_input_free(input);
+        }
+        printf("%-16s %10.3f ms/batch (%.1f%% hits)\n", names[k], (omp_get_wtime() - start) * 1000 / repetitions,
+               100.0 * hits / (hits + misses));
+    }
+
+    free(expected);
+    free(factorial_logarithms);
+    free(library_logarithms);
+    free(tables);
+    return EXIT_SUCCESS;
+}
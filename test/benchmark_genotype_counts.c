@@ -0,0 +1,121 @@
+/*
+ * Micro-benchmark of the case/control allele counting of the association test: the former loop over
+ * individuals (one strdup and get_alleles per sample) against each counting kernel of the packed
+ * genotype matrix. It is not part of the test suite, run it as
+ *
+ *     ./genotype_counts.bench [num_samples] [num_variants] [repetitions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include "gwas/assoc/assoc.h"
+#include "gwas/assoc/genotype_matrix.h"
+
+
+static vcf_record_t **create_variants(int num_variants, int num_samples) {
+    char *genotypes[] = { "0/0", "0/1", "1/1", "./." };
+    vcf_record_t **variants = (vcf_record_t**) malloc (num_variants * sizeof(vcf_record_t*));
+    for (int i = 0; i < num_variants; i++) {
+        variants[i] = (vcf_record_t*) calloc (1, sizeof(vcf_record_t));
+        variants[i]->chromosome = "1";
+        variants[i]->chromosome_len = 1;
+        variants[i]->format = "GT:DP";
+        variants[i]->format_len = 5;
+        variants[i]->samples = array_list_new(num_samples, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+        for (int j = 0; j < num_samples; j++) {
+            char *sample = (char*) malloc (8 * sizeof(char));
+            sprintf(sample, "%s:%d", genotypes[rand() % 4], rand() % 100);
+            array_list_insert(sample, variants[i]->samples);
+        }
+    }
+    return variants;
+}
+
+/**
+ * Counts the alleles as assoc_test used to, branching on the condition of each individual.
+ */
+static long count_per_individual(vcf_record_t **variants, int num_variants, individual_t **samples, int num_samples) {
+    long checksum = 0;
+    for (int i = 0; i < num_variants; i++) {
+        int A1 = 0, A2 = 0, U1 = 0, U2 = 0;
+        char *format = strndup(variants[i]->format, variants[i]->format_len);
+        int gt_position = get_field_position_in_format("GT", format);
+        free(format);
+
+        for (int j = 0; j < num_samples; j++) {
+            int allele1, allele2;
+            char *sample_data = strdup(array_list_get(j, variants[i]->samples));
+            if (!get_alleles(sample_data, gt_position, &allele1, &allele2)) {
+                assoc_count_individual(samples[j], variants[i], allele1, allele2, &A1, &A2, &U1, &U2);
+            }
+            free(sample_data);
+        }
+        checksum += A1 + 3 * A2 + 5 * U1 + 7 * U2;
+    }
+    return checksum;
+}
+
+static long count_packed(genotype_matrix_t *matrix, uint64_t *affected, uint64_t *unaffected) {
+    long checksum = 0;
+    for (int i = 0; i < matrix->num_variants; i++) {
+        int A1, A2, U1, U2;
+        genotype_matrix_count_alleles(matrix, i, affected, 0, &A1, &A2);
+        genotype_matrix_count_alleles(matrix, i, unaffected, 0, &U1, &U2);
+        checksum += A1 + 3 * A2 + 5 * U1 + 7 * U2;
+    }
+    return checksum;
+}
+
+int main(int argc, char *argv[]) {
+    int num_samples = (argc > 1) ? atoi(argv[1]) : 10000;
+    int num_variants = (argc > 2) ? atoi(argv[2]) : 1000;
+    int repetitions = (argc > 3) ? atoi(argv[3]) : 100;
+
+    srand(1);
+    vcf_record_t **variants = create_variants(num_variants, num_samples);
+    individual_t *individuals = (individual_t*) calloc (num_samples, sizeof(individual_t));
+    individual_t **samples = (individual_t**) malloc (num_samples * sizeof(individual_t*));
+    for (int j = 0; j < num_samples; j++) {
+        individuals[j].condition = (j % 3) ? UNAFFECTED : AFFECTED;
+        samples[j] = &individuals[j];
+    }
+
+    printf("%d samples, %d variants\n", num_samples, num_variants);
+
+    double start = omp_get_wtime();
+    long expected = count_per_individual(variants, num_variants, samples, num_samples);
+    printf("%-16s %10.3f ms/batch\n", "per-individual", (omp_get_wtime() - start) * 1000);
+
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    start = omp_get_wtime();
+    genotype_matrix_t *matrix = genotype_matrix_new(variants, num_variants, num_samples, gt_positions);
+    printf("%-16s %10.3f ms/batch\n", "packing", (omp_get_wtime() - start) * 1000);
+    uint64_t *affected = genotype_mask_new(samples, num_samples, AFFECTED);
+    uint64_t *unaffected = genotype_mask_new(samples, num_samples, UNAFFECTED);
+
+    for (int kernel = GENOTYPE_KERNEL_SCALAR; kernel < NUM_GENOTYPE_KERNELS; kernel++) {
+        matrix->count_genotypes = genotype_kernel_get(kernel);
+        if (!matrix->count_genotypes) {
+            printf("%-16s not supported\n", genotype_kernel_name(kernel));
+            continue;
+        }
+
+        long checksum = 0;
+        start = omp_get_wtime();
+        for (int r = 0; r < repetitions; r++) {
+            checksum = count_packed(matrix, affected, unaffected);
+        }
+        printf("%-16s %10.3f ms/batch%s\n", genotype_kernel_name(kernel), (omp_get_wtime() - start) * 1000 / repetitions,
+               (checksum == expected) ? "" : " (WRONG COUNTS)");
+    }
+
+    free(affected);
+    free(unaffected);
+    genotype_matrix_free(matrix);
+    gt_positions_free(gt_positions);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "gwas/assoc/assoc_fisher_test.h"
+
+
+Suite *create_test_suite(void);
+
+
+static double *factorial_logarithms;
+
+
+/* ******************************
+ *       Unchecked fixtures     *
+ * ******************************/
+
+void setup_logarithms(void) {
+    factorial_logarithms = assoc_fisher_factorial_logarithms(2000);
+}
+
+void teardown_logarithms(void) {
+    free(factorial_logarithms);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+/**
+ * Two-sided p-value summing the probabilities of all the tables with the same margins.
+ */
+static double enumerate_tables(int a, int b, int c, int d, int mid_p) {
+    int row1 = a + b, row2 = c + d, column1 = a + c, n = a + b + c + d;
+    double margins = lgamma(row1 + 1) + lgamma(row2 + 1) + lgamma(column1 + 1) + lgamma(n - column1 + 1) - lgamma(n + 1);
+    double observed = exp(margins - lgamma(a + 1) - lgamma(b + 1) - lgamma(c + 1) - lgamma(d + 1));
+
+    double p_value = 0;
+    for (int x = 0; x <= row1 && x <= column1; x++) {
+        if (row2 - column1 + x < 0) {
+            continue;
+        }
+        double probability = exp(margins - lgamma(x + 1) - lgamma(row1 - x + 1) - lgamma(column1 - x + 1) - lgamma(row2 - column1 + x + 1));
+        if (probability < observed * (1 - FISHER_RELATIVE_ERROR)) {
+            p_value += probability;
+        } else if (probability <= observed * (1 + FISHER_RELATIVE_ERROR)) {
+            p_value += mid_p ? 0.5 * probability : probability;
+        }
+    }
+    return p_value;
+}
+
+START_TEST (test_factorial_logarithms) {
+    for (int i = 0; i <= 2000; i += 97) {
+        fail_if(fabs(factorial_logarithms[i] - lgamma(i + 1)) > 1e-9 * (1 + lgamma(i + 1)),
+                "log(%d!) must be %f, not %f", i, lgamma(i + 1), factorial_logarithms[i]);
+    }
+}
+END_TEST
+
+START_TEST (test_known_tables) {
+    // Tables with x = 0..4 have probabilities { 1, 16, 36, 16, 1 } / 70
+    fail_if(fabs(assoc_fisher_p_value(3, 1, 1, 3, 0, factorial_logarithms) - 34.0 / 70) > 1e-12, "P-value must be 34/70");
+    fail_if(fabs(assoc_fisher_p_value(3, 1, 1, 3, 1, factorial_logarithms) - 18.0 / 70) > 1e-12, "Mid-p value must be 18/70");
+    fail_if(fabs(assoc_fisher_p_value(4, 0, 0, 4, 0, factorial_logarithms) - 2.0 / 70) > 1e-12, "P-value must be 2/70");
+    fail_if(fabs(assoc_fisher_p_value(2, 2, 2, 2, 0, factorial_logarithms) - 1) > 1e-12, "P-value must be 1");
+
+    // Empty margins only have one possible table
+    fail_if(fabs(assoc_fisher_p_value(0, 0, 5, 7, 0, factorial_logarithms) - 1) > 1e-12, "P-value with an empty row must be 1");
+    fail_if(fabs(assoc_fisher_p_value(0, 6, 0, 9, 0, factorial_logarithms) - 1) > 1e-12, "P-value with an empty column must be 1");
+}
+END_TEST
+
+START_TEST (test_random_tables) {
+    srand(19);
+    for (int k = 0; k < 500; k++) {
+        int a = rand() % 200, b = rand() % 300, c = rand() % 20, d = rand() % 400;
+        for (int mid_p = 0; mid_p < 2; mid_p++) {
+            double expected = enumerate_tables(a, b, c, d, mid_p);
+            double p_value = assoc_fisher_p_value(a, b, c, d, mid_p, factorial_logarithms);
+            fail_if(fabs(p_value - expected) > 1e-9 * (expected + 1e-300) && fabs(p_value - expected) > 1e-14,
+                    "Table { %d, %d, %d, %d } (mid-p = %d) must have p-value %e, not %e", a, b, c, d, mid_p, expected, p_value);
+        }
+    }
+}
+END_TEST
+
+START_TEST (test_cache) {
+    assoc_fisher_input_t *input = assoc_fisher_input_new(factorial_logarithms, 0, 0);
+
+    double first = assoc_fisher_test(30, 970, 10, 990, input);
+    double second = assoc_fisher_test(30, 970, 10, 990, input);
+    double other = assoc_fisher_test(10, 990, 30, 970, input);
+
+    fail_unless(first == second, "A cached p-value must not change");
+    fail_unless(fabs(first - assoc_fisher_p_value(30, 970, 10, 990, 0, factorial_logarithms)) < 1e-15, "Cached p-value must be exact");
+    fail_unless(fabs(first - other) < 1e-12, "Symmetric tables must have the same p-value");
+    fail_unless(input->hits == 1 && input->misses == 2, "There must be 1 hit and 2 misses, not %zu and %zu", input->hits, input->misses);
+
+    assoc_fisher_input_free(input);
+}
+END_TEST
+
+START_TEST (test_early_exit) {
+    assoc_fisher_input_t *exact = assoc_fisher_input_new(factorial_logarithms, 0, 0);
+    assoc_fisher_input_t *early = assoc_fisher_input_new(factorial_logarithms, 0, 0.5);
+
+    // Significant tables are tested exactly
+    fail_if(assoc_fisher_test(30, 970, 10, 990, early) != assoc_fisher_test(30, 970, 10, 990, exact),
+            "P-values below the threshold must be exact");
+
+    // Tables far from significance keep the chi-square p-value
+    double p_value = assoc_fisher_test(500, 500, 502, 498, early);
+    fail_if(p_value <= 0.5, "P-value must be above the threshold");
+    fail_if(fabs(p_value - assoc_fisher_test(500, 500, 502, 498, exact)) > 0.05, "Chi-square p-value must be close to the exact one");
+
+    assoc_fisher_input_free(early);
+    assoc_fisher_input_free(exact);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_p_values = tcase_create("P-values");
+    tcase_add_unchecked_fixture(tc_p_values, setup_logarithms, teardown_logarithms);
+    tcase_add_test(tc_p_values, test_factorial_logarithms);
+    tcase_add_test(tc_p_values, test_known_tables);
+    tcase_add_test(tc_p_values, test_random_tables);
+
+    TCase *tc_input = tcase_create("Cache and early exit");
+    tcase_add_unchecked_fixture(tc_input, setup_logarithms, teardown_logarithms);
+    tcase_add_test(tc_input, test_cache);
+    tcase_add_test(tc_input, test_early_exit);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Fisher's exact test");
+    suite_add_tcase(fs, tc_p_values);
+    suite_add_tcase(fs, tc_input);
+
+    return fs;
+}
@@ -0,0 +1,210 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "gwas/assoc/assoc_regression_test.h"
+#include "gwas/assoc/covariates.h"
+
+
+#define NUM_SAMPLES     200
+#define NUM_VARIANTS    150
+
+Suite *create_test_suite(void);
+
+static char ids[NUM_SAMPLES][8];
+static individual_t individuals[NUM_SAMPLES];
+static individual_t *samples[NUM_SAMPLES];
+static double covariate_values[NUM_SAMPLES][1];
+static covariate_table_t *covariates;
+static genotype_matrix_t *genotypes;
+
+
+/* ******************************
+ *       Unit test fixtures     *
+ * ******************************/
+
+static unsigned long random_state;
+
+static double next_uniform(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (random_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Variant 0 increases the phenotype and the risk of being affected, variant 1 is monomorphic,
+ * and the rest are noise. Every 20th genotype of variant 2 is missing.
+ */
+void setup_regression(void) {
+    random_state = 88172645463325252UL;
+    covariates = (covariate_table_t*) calloc (1, sizeof(covariate_table_t));
+    covariates->num_covariates = 1;
+    covariates->rows = kh_init(covariate_rows);
+
+    genotypes = (genotype_matrix_t*) calloc (1, sizeof(genotype_matrix_t));
+    genotypes->num_variants = NUM_VARIANTS;
+    genotypes->num_samples = NUM_SAMPLES;
+    genotypes->words_per_variant = (NUM_SAMPLES + GENOTYPES_PER_WORD - 1) / GENOTYPES_PER_WORD;
+    genotypes->genotypes = (uint64_t*) calloc (NUM_VARIANTS * genotypes->words_per_variant, sizeof(uint64_t));
+
+    for (int v = 0; v < NUM_VARIANTS; v++) {
+        for (int j = 0; j < NUM_SAMPLES; j++) {
+            int genotype = (v == 1) ? 0 : (next_uniform() < 0.3) + (next_uniform() < 0.3);
+            if (v == 2 && j % 20 == 0) {
+                genotype = GENOTYPE_MISSING;
+            }
+            genotypes->genotypes[v * genotypes->words_per_variant + j / GENOTYPES_PER_WORD] |=
+                    (uint64_t) genotype << (2 * (j % GENOTYPES_PER_WORD));
+        }
+    }
+
+    for (int j = 0; j < NUM_SAMPLES; j++) {
+        sprintf(ids[j], "S%d", j);
+        covariate_values[j][0] = next_uniform();
+        int ret;
+        khiter_t iter = kh_put(covariate_rows, covariates->rows, ids[j], &ret);
+        kh_value(covariates->rows, iter) = covariate_values[j];
+
+        double predictor = -1 + covariate_values[j][0] + genotype_matrix_get(genotypes, 0, j);
+        individuals[j].id = ids[j];
+        individuals[j].phenotype = predictor + (next_uniform() - 0.5);
+        individuals[j].condition = (next_uniform() < 1 / (1 + exp(-predictor))) ? AFFECTED : UNAFFECTED;
+        samples[j] = &individuals[j];
+    }
+
+    // Samples without condition, phenotype or in the VCF only
+    individuals[10].condition = MISSING_CONDITION;
+    individuals[11].phenotype = MISSING_PHENOTYPE;
+    samples[12] = NULL;
+}
+
+void teardown_regression(void) {
+    kh_destroy(covariate_rows, covariates->rows);
+    free(covariates);
+    genotype_matrix_free(genotypes);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (read_covariates) {
+    char filename[] = "/tmp/covariatesXXXXXX";
+    int fd = mkstemp(filename);
+    FILE *file = fdopen(fd, "w");
+    fprintf(file, "#family\tindividual\tfather\tmother\tsex\tphenotype\tage\tbmi\n");
+    fprintf(file, "F1\tI1\t0\t0\t1\t2\t45\t22.5\n");
+    fprintf(file, "F1\tI2\t0\t0\t2\t1\tNA\t30\n");
+    fclose(file);
+
+    covariate_table_t *table = covariate_table_read(filename);
+    unlink(filename);
+
+    fail_if(table == NULL, "The covariates must be read");
+    fail_unless(table->num_covariates == 2, "There are 2 covariates, not %d", table->num_covariates);
+    fail_unless(!strcmp(table->names[0], "age") && !strcmp(table->names[1], "bmi"), "Covariates are named in the header");
+
+    double *values = covariate_table_get("I1", table);
+    fail_unless(values[0] == 45 && values[1] == 22.5, "Covariates of I1 must be 45 and 22.5");
+    values = covariate_table_get("I2", table);
+    fail_unless(isnan(values[0]) && values[1] == 30, "Covariates of I2 must be missing and 30");
+    fail_unless(covariate_table_get("I3", table) == NULL, "I3 is not in the PED file");
+
+    covariate_table_free(table);
+    fail_unless(covariate_table_read("/nonexistent/file.ped") == NULL, "A missing file can't be read");
+}
+END_TEST
+
+START_TEST (linear_regression) {
+    regression_model_t *model = regression_model_new(samples, NUM_SAMPLES, covariates, 0);
+    fail_if(model == NULL, "The model must be created");
+    fail_unless(model->num_samples == NUM_SAMPLES - 2, "Samples without phenotype must be excluded");
+
+    regression_fit_t fits[NUM_VARIANTS];
+    assoc_regression_test(genotypes, model, fits);
+
+    fail_unless(fabs(fits[0].coefficient - 1) < 0.1, "The effect of variant 0 is 1, not %f", fits[0].coefficient);
+    fail_unless(fits[0].p_value < 1e-10, "Variant 0 must be significant");
+    fail_unless(isnan(fits[1].coefficient) && isnan(fits[1].p_value), "Monomorphic variants can't be fitted");
+    fail_unless(fits[2].num_samples == NUM_SAMPLES - 2 - 10, "Missing genotypes are not counted");
+
+    for (int v = 2; v < NUM_VARIANTS; v++) {
+        fail_unless(fits[v].p_value >= 0 && fits[v].p_value <= 1, "Variant %d has an invalid p-value", v);
+    }
+
+    regression_model_free(model);
+}
+END_TEST
+
+START_TEST (logistic_regression) {
+    regression_model_t *model = regression_model_new(samples, NUM_SAMPLES, covariates, 1);
+    fail_if(model == NULL, "The model must be created");
+    fail_unless(model->num_samples == NUM_SAMPLES - 2, "Samples without condition must be excluded");
+    fail_if(model->null_coefficients == NULL, "The model of the covariates must converge");
+
+    regression_fit_t fits[NUM_VARIANTS];
+    assoc_regression_test(genotypes, model, fits);
+
+    fail_unless(fits[0].coefficient > 0.5, "Variant 0 increases the risk, coefficient = %f", fits[0].coefficient);
+    fail_unless(fits[0].p_value < 1e-3, "Variant 0 must be significant");
+    fail_unless(isnan(fits[1].coefficient), "Monomorphic variants can't be fitted");
+
+    for (int v = 0; v < NUM_VARIANTS; v++) {
+        if (isnan(fits[v].coefficient)) {
+            continue;
+        }
+        fail_unless(fits[v].standard_error > 0, "Variant %d must have a positive standard error", v);
+        fail_unless(fabs(fits[v].statistic - fits[v].coefficient / fits[v].standard_error) < 1e-9,
+                    "The statistic of variant %d is the Wald z", v);
+    }
+
+    regression_model_free(model);
+}
+END_TEST
+
+START_TEST (not_enough_samples) {
+    regression_model_t *model = regression_model_new(samples, 3, covariates, 0);
+    fail_unless(model == NULL, "A model of 3 samples and 3 parameters can't be fitted");
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_covariates = tcase_create("Covariates");
+    tcase_add_test(tc_covariates, read_covariates);
+
+    TCase *tc_regression = tcase_create("Regression models");
+    tcase_add_unchecked_fixture(tc_regression, setup_regression, teardown_regression);
+    tcase_add_test(tc_regression, linear_regression);
+    tcase_add_test(tc_regression, logistic_regression);
+    tcase_add_test(tc_regression, not_enough_samples);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Regression association tests");
+    suite_add_tcase(fs, tc_covariates);
+    suite_add_tcase(fs, tc_regression);
+
+    return fs;
+}
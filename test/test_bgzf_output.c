@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "effect/bgzf_output.h"
+
+
+Suite *create_test_suite(void);
+
+static char *filename = "bgzf_output_test.txt.gz";
+static char *index_filename = "bgzf_output_test.txt.gz.idx";
+
+
+/* ******************************
+ *      Unit test fixtures      *
+ * ******************************/
+
+void setup_bgzf(void) {
+    unlink(filename);
+    unlink(index_filename);
+}
+
+void teardown_bgzf(void) {
+    unlink(filename);
+    unlink(index_filename);
+}
+
+/**
+ * Writes several lines per chromosome, enough to fill more than one block.
+ */
+static void write_test_lines(bgzf_file_t *file) {
+    char line[64];
+    size_t text_len = 0, text_capacity = 8 * BGZF_BLOCK_SIZE;
+    char *text = (char*) malloc (text_capacity);
+
+    for (int i = 1; i <= 20000; i++) {
+        text_len += sprintf(text + text_len, "%d\t%d\tA\tG\tSO:0001583\n", (i % 2) + 1, i * 10);
+        if (text_len > text_capacity - sizeof(line)) {
+            fail_if(bgzf_write_lines(text, text_len, file), "Lines must be written");
+            text_len = 0;
+        }
+    }
+    fail_if(bgzf_write_lines(text, text_len, file), "Lines must be written");
+    free(text);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (gzip_compatible) {
+    bgzf_file_t *file = bgzf_open(filename, 0);
+    fail_if(file == NULL, "The file must be created");
+    write_test_lines(file);
+    bgzf_close(file);
+
+    fail_unless(access(index_filename, F_OK), "Files not indexed must not have an index");
+
+    char command[128], buf[64];
+    sprintf(command, "gzip -dc %s | wc -l", filename);
+    FILE *p = popen(command, "r");
+    fail_if(fgets(buf, sizeof(buf), p) == NULL, "gzip must decompress the file");
+    pclose(p);
+    fail_unless(atoi(buf) == 20000, "All lines must be decompressed by gzip");
+}
+END_TEST
+
+START_TEST (region_query) {
+    bgzf_file_t *file = bgzf_open(filename, 1);
+    write_test_lines(file);
+    bgzf_close(file);
+
+    FILE *output = tmpfile();
+    int num_lines = bgzf_query_region(filename, "2", 1001, 2000, output);
+    fail_unless(num_lines == 50, "Lines in the region must be retrieved");
+
+    char line[64];
+    rewind(output);
+    while (fgets(line, sizeof(line), output)) {
+        fail_unless(line[0] == '2' && line[1] == '\t', "Lines from other chromosomes must not be retrieved");
+        long position = atol(line + 2);
+        fail_unless(position >= 1001 && position <= 2000, "Lines out of the region must not be retrieved");
+    }
+    fclose(output);
+
+    output = tmpfile();
+    fail_unless(bgzf_query_region(filename, "3", 1, 1000000, output) == 0, "Chromosomes not written must have no lines");
+    fclose(output);
+}
+END_TEST
+
+START_TEST (appended_blocks) {
+    bgzf_file_t *file = bgzf_open(filename, 1);
+    write_test_lines(file);
+    bgzf_close(file);
+
+    file = bgzf_open(filename, 1);
+    fail_if(bgzf_write_lines("1\t500005\tC\tT\tSO:0001583\n", 26, file), "Lines must be appended");
+    bgzf_close(file);
+
+    FILE *output = tmpfile();
+    fail_unless(bgzf_query_region(filename, "1", 500000, 500010, output) == 1, "Appended lines must be indexed");
+    fclose(output);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_bgzf = tcase_create("BGZF output");
+    tcase_add_checked_fixture(tc_bgzf, setup_bgzf, teardown_bgzf);
+    tcase_add_test(tc_bgzf, gzip_compatible);
+    tcase_add_test(tc_bgzf, region_query);
+    tcase_add_test(tc_bgzf, appended_blocks);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("BGZF output");
+    suite_add_tcase(fs, tc_bgzf);
+
+    return fs;
+}
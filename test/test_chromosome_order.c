@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <zlib.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+
+#include "vcf-tools/merge/chromosome_order.h"
+
+
+Suite *create_test_suite(void);
+
+
+static char filename[] = "/tmp/chromosome_order_XXXXXX";
+
+
+/* ******************************
+ *       Checked fixtures       *
+ * ******************************/
+
+void setup_file(void) {
+    int fd = mkstemp(filename);
+    close(fd);
+}
+
+void teardown_file(void) {
+    unlink(filename);
+    strcpy(filename, "/tmp/chromosome_order_XXXXXX");
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+/**
+ * Adds a header entry to a file, such as a ##contig line.
+ */
+static void add_header_entry(char *name, char *value, vcf_file_t *file) {
+    vcf_header_entry_t *entry = vcf_header_entry_new();
+    set_vcf_header_entry_name(strdup(name), strlen(name), entry);
+    add_vcf_header_entry_value(strdup(value), strlen(value), entry);
+    array_list_insert(entry, file->header_entries);
+}
+
+static int check_order(char **chromosome_order, int num_chromosomes, char **expected, int num_expected) {
+    if (num_chromosomes != num_expected) {
+        return 0;
+    }
+    for (int i = 0; i < num_expected; i++) {
+        if (strcmp(chromosome_order[i], expected[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+START_TEST (test_read_list) {
+    FILE *file = fopen(filename, "w");
+    fprintf(file, "# Human chromosomes\n1\n2\n\n10\nX\r\nMT\n");
+    fclose(file);
+
+    int num_chromosomes;
+    char **chromosome_order = read_chromosome_order(filename, &num_chromosomes);
+    char *expected[] = { "1", "2", "10", "X", "MT" };
+    fail_unless(check_order(chromosome_order, num_chromosomes, expected, 5), "Comments and empty lines must be skipped");
+
+    free_chromosome_order(chromosome_order, num_chromosomes);
+}
+END_TEST
+
+START_TEST (test_read_fasta_index) {
+    FILE *file = fopen(filename, "w");
+    fprintf(file, "1\t249250621\t52\t60\t61\n2\t243199373\t253404903\t60\t61\nGL000192.1\t547496\t3153925261\t60\t61\n");
+    fclose(file);
+
+    int num_chromosomes;
+    char **chromosome_order = read_chromosome_order(filename, &num_chromosomes);
+    char *expected[] = { "1", "2", "GL000192.1" };
+    fail_unless(check_order(chromosome_order, num_chromosomes, expected, 3), "Names must be read from the first column");
+
+    free_chromosome_order(chromosome_order, num_chromosomes);
+
+    fail_unless(read_chromosome_order("/tmp/this/file/does/not/exist", &num_chromosomes) == NULL, "A missing file can't be read");
+}
+END_TEST
+
+START_TEST (test_write_and_read) {
+    char *order[] = { "chr1", "chr2", "chrX", "chrUn_gl000220" };
+
+    fail_unless(write_chromosome_order(filename, order, 4) == 0, "The order must be written");
+
+    int num_chromosomes;
+    char **chromosome_order = read_chromosome_order(filename, &num_chromosomes);
+    fail_unless(check_order(chromosome_order, num_chromosomes, order, 4), "The order read must be the one written");
+
+    free_chromosome_order(chromosome_order, num_chromosomes);
+}
+END_TEST
+
+START_TEST (test_contig_order) {
+    vcf_file_t files[3];
+    for (int i = 0; i < 3; i++) {
+        memset(&files[i], 0, sizeof(vcf_file_t));
+        files[i].header_entries = array_list_new(8, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    }
+    vcf_file_t *file_pointers[] = { &files[0], &files[1], &files[2] };
+
+    // The first file lacks chromosomes 1 and 3, the last one has no ##contig lines
+    add_header_entry("fileformat", "VCFv4.1", &files[0]);
+    add_header_entry("contig", "<ID=2,length=243199373>", &files[0]);
+    add_header_entry("INFO", "<ID=DP,Number=1,Type=Integer,Description=\"Depth\">", &files[0]);
+    add_header_entry("contig", "<ID=4,length=191154276>", &files[0]);
+    add_header_entry("contig", "<ID=X,length=155270560>", &files[0]);
+
+    add_header_entry("contig", "<ID=1,length=249250621>", &files[1]);
+    add_header_entry("contig", "ID=2,length=243199373", &files[1]);
+    add_header_entry("contig", "<length=198022430,ID=3>", &files[1]);
+    add_header_entry("contig", "<ID=4,length=191154276>", &files[1]);
+
+    add_header_entry("FILTER", "<ID=q10,Description=\"Quality below 10\">", &files[2]);
+
+    int num_chromosomes;
+    char **chromosome_order = get_contig_order(file_pointers, 3, &num_chromosomes);
+    char *expected[] = { "1", "2", "3", "4", "X" };
+    fail_unless(check_order(chromosome_order, num_chromosomes, expected, 5),
+                "Contigs missing in a file must be placed after the ones that precede them in another file");
+    free_chromosome_order(chromosome_order, num_chromosomes);
+
+    fail_unless(get_contig_order(file_pointers + 2, 1, &num_chromosomes) == NULL, "A file without ##contig lines has no order");
+}
+END_TEST
+
+START_TEST (test_read_contigs) {
+    // The piece of a very long line read after the first one must not be confused with a new line
+    char *long_line = (char*) malloc (10000);
+    memset(long_line, 'A', 9999);
+    long_line[9999] = '\0';
+    memcpy(long_line + CONTIG_LINE_BUFFER_SIZE - 15, "##contig=<ID=fake>", 18);
+
+    gzFile file = gzopen(filename, "w");
+    gzprintf(file, "##fileformat=VCFv4.1\n##contig=<ID=1,length=249250621>\n##INFO=<ID=DP,Number=1>\n");
+    gzprintf(file, "##contig=<length=243199373,ID=2>\n##description=");
+    gzwrite(file, long_line, 9999);
+    gzprintf(file, "\n##contig=<ID=X>\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n1\t100\t.\tA\tC\t.\t.\t.\n");
+    gzclose(file);
+    free(long_line);
+
+    int num_chromosomes;
+    char **chromosome_order = read_contig_order(filename, &num_chromosomes);
+    char *expected[] = { "1", "2", "X" };
+    fail_unless(check_order(chromosome_order, num_chromosomes, expected, 3), "Contigs must be read from a compressed header");
+    free_chromosome_order(chromosome_order, num_chromosomes);
+
+    file = gzopen(filename, "w");
+    gzprintf(file, "##fileformat=VCFv4.1\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n");
+    gzclose(file);
+    fail_unless(read_contig_order(filename, &num_chromosomes) == NULL && num_chromosomes == 0, 
+                "A file without ##contig lines has no order");
+}
+END_TEST
+
+START_TEST (test_merge_orders) {
+    char *order1[] = { "2", "4", "X" };
+    char *order2[] = { "1", "2", "3", "4" };
+    char *order3[] = { "X", "Y", "MT" };
+    char **orders[] = { order1, order2, order3 };
+    int num_per_order[] = { 3, 4, 3 };
+
+    int num_chromosomes;
+    char **chromosome_order = merge_chromosome_orders(orders, num_per_order, 3, &num_chromosomes);
+    char *expected[] = { "1", "2", "3", "4", "X", "Y", "MT" };
+    fail_unless(check_order(chromosome_order, num_chromosomes, expected, 7),
+                "Orders must be merged like the ##contig lines of several files");
+    free_chromosome_order(chromosome_order, num_chromosomes);
+
+    num_per_order[0] = 0;
+    fail_unless(merge_chromosome_orders(orders, num_per_order, 1, &num_chromosomes) == NULL, "Empty orders can't be merged");
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_files = tcase_create("Order files");
+    tcase_add_checked_fixture(tc_files, setup_file, teardown_file);
+    tcase_add_test(tc_files, test_read_list);
+    tcase_add_test(tc_files, test_read_fasta_index);
+    tcase_add_test(tc_files, test_write_and_read);
+    tcase_add_test(tc_files, test_read_contigs);
+
+    TCase *tc_headers = tcase_create("VCF headers");
+    tcase_add_test(tc_headers, test_contig_order);
+    tcase_add_test(tc_headers, test_merge_orders);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Chromosome order");
+    suite_add_tcase(fs, tc_files);
+    suite_add_tcase(fs, tc_headers);
+
+    return fs;
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "vcf-tools/merge/chromosome_table.h"
+
+
+Suite *create_test_suite(void);
+
+
+#define NUM_CONTIGS     20000
+
+static char *human_order[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14", "15", "16",
+                               "17", "18", "19", "20", "21", "22", "X", "Y", "MT" };
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (test_human_chromosomes) {
+    chromosome_table_t *table = chromosome_table_new(human_order, 25);
+
+    for (int i = 0; i < 25; i++) {
+        fail_unless(chromosome_table_rank(human_order[i], strlen(human_order[i]), table) == i,
+                    "Chromosome %s must have rank %d", human_order[i], i);
+    }
+
+    // Names in records are not null-terminated
+    fail_unless(chromosome_table_rank("10\t12345", 2, table) == 9, "Chromosome 10 must have rank 9");
+    fail_unless(chromosome_table_rank("1\t12345", 1, table) == 0, "Chromosome 1 must have rank 0");
+
+    fail_unless(chromosome_table_rank("chr1", 4, table) == CHROMOSOME_UNKNOWN_RANK, "Chromosome chr1 must be unknown");
+    fail_unless(chromosome_table_rank("23", 2, table) == CHROMOSOME_UNKNOWN_RANK, "Chromosome 23 must be unknown");
+    fail_unless(chromosome_table_rank("", 0, table) == CHROMOSOME_UNKNOWN_RANK, "An empty chromosome must be unknown");
+
+    chromosome_table_free(table);
+}
+END_TEST
+
+START_TEST (test_many_contigs) {
+    char **contigs = (char**) malloc (NUM_CONTIGS * sizeof(char*));
+    for (int i = 0; i < NUM_CONTIGS; i++) {
+        contigs[i] = (char*) malloc (16 * sizeof(char));
+        sprintf(contigs[i], "contig%05d", i);
+    }
+
+    chromosome_table_t *table = chromosome_table_new(contigs, NUM_CONTIGS);
+    for (int i = 0; i < NUM_CONTIGS; i++) {
+        fail_unless(chromosome_table_rank(contigs[i], strlen(contigs[i]), table) == i, "Contig %s must have rank %d", contigs[i], i);
+    }
+    fail_unless(chromosome_table_rank("contig20000", 11, table) == CHROMOSOME_UNKNOWN_RANK, "Contig 20000 must be unknown");
+
+    chromosome_table_free(table);
+    for (int i = 0; i < NUM_CONTIGS; i++) {
+        free(contigs[i]);
+    }
+    free(contigs);
+}
+END_TEST
+
+START_TEST (test_repeated_chromosomes) {
+    char *order[] = { "1", "2", "1", "3" };
+    chromosome_table_t *table = chromosome_table_new(order, 4);
+
+    fail_unless(chromosome_table_rank("1", 1, table) == 0, "The first rank of a repeated chromosome must be kept");
+    fail_unless(chromosome_table_rank("3", 1, table) == 3, "Chromosome 3 must have rank 3");
+
+    chromosome_table_free(table);
+
+    table = chromosome_table_new(NULL, 0);
+    fail_unless(chromosome_table_rank("1", 1, table) == CHROMOSOME_UNKNOWN_RANK, "An empty table must not contain any chromosome");
+    chromosome_table_free(table);
+}
+END_TEST
+
+START_TEST (test_sort_keys) {
+    uint64_t key = chromosome_sort_key(22, 155270560);
+    fail_unless(chromosome_key_rank(key) == 22, "The rank must be unpacked from the key");
+    fail_unless(chromosome_key_position(key) == 155270560, "The position must be unpacked from the key");
+
+    fail_unless(chromosome_sort_key(0, 249250621) < chromosome_sort_key(1, 1), "Keys must be sorted by chromosome first");
+    fail_unless(chromosome_sort_key(9, 100) < chromosome_sort_key(9, 101), "Keys must be sorted by position");
+    fail_unless(chromosome_sort_key(24, (1L << CHROMOSOME_POSITION_BITS) - 1) < chromosome_sort_key(CHROMOSOME_UNKNOWN_RANK, 0),
+                "Unknown chromosomes must be sorted after the rest");
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_ranks = tcase_create("Chromosome ranks");
+    tcase_add_test(tc_ranks, test_human_chromosomes);
+    tcase_add_test(tc_ranks, test_many_contigs);
+    tcase_add_test(tc_ranks, test_repeated_chromosomes);
+
+    TCase *tc_keys = tcase_create("Sort keys");
+    tcase_add_test(tc_keys, test_sort_keys);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Chromosome table");
+    suite_add_tcase(fs, tc_ranks);
+    suite_add_tcase(fs, tc_keys);
+
+    return fs;
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "effect/effect_alleles.h"
+
+
+Suite *create_test_suite(void);
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+static vcf_record_t *create_record(char *chromosome, long position, char *id, char *reference, char *alternate) {
+    vcf_record_t *record = (vcf_record_t*) calloc (1, sizeof(vcf_record_t));
+    record->chromosome = chromosome;
+    record->chromosome_len = strlen(chromosome);
+    record->position = position;
+    record->id = id;
+    record->id_len = strlen(id);
+    record->reference = reference;
+    record->reference_len = strlen(reference);
+    record->alternate = alternate;
+    record->alternate_len = strlen(alternate);
+    return record;
+}
+
+/**
+ * Returns whether the key of the allele at a position of a list is the expected one.
+ */
+static int allele_key_is(array_list_t *alleles, int index, const char *expected) {
+    char *key = compose_allele_key(alleles->items[index]);
+    int equal = !strcmp(key, expected);
+    free(key);
+    return equal;
+}
+
+START_TEST (normalisation) {
+    long position = 100;
+    char *reference = "CTCC", *alternate = "CCC";
+    int reference_len = 4, alternate_len = 3;
+    normalise_allele(&position, &reference, &reference_len, &alternate, &alternate_len);
+    fail_unless(position == 100 && reference_len == 2 && alternate_len == 1 && !strncmp(reference, "CT", 2),
+                "The common suffix must be trimmed, keeping the anchor base");
+
+    position = 100;
+    reference = "GAT", alternate = "GAC";
+    reference_len = 3, alternate_len = 3;
+    normalise_allele(&position, &reference, &reference_len, &alternate, &alternate_len);
+    fail_unless(position == 102 && reference_len == 1 && *reference == 'T' && *alternate == 'C',
+                "The common prefix of a substitution must be trimmed, moving the position");
+
+    position = 100;
+    reference = "A", alternate = "<DEL>";
+    reference_len = 1, alternate_len = 5;
+    normalise_allele(&position, &reference, &reference_len, &alternate, &alternate_len);
+    fail_unless(position == 100 && alternate_len == 5, "Symbolic alleles must not be modified");
+}
+END_TEST
+
+START_TEST (multiallelic_split) {
+    array_list_t *records = array_list_new(2, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    array_list_insert(create_record("1", 100, "rs1", "AT", "A,ATT,GT"), records);
+
+    array_list_t *alleles = split_alleles(records);
+    fail_unless(alleles->size == 3, "Each alternate allele must be split");
+    fail_unless(allele_key_is(alleles, 0, "1:100:AT:A"), "Deletion must keep its anchor base");
+    fail_unless(allele_key_is(alleles, 1, "1:100:A:AT"), "Insertion must be trimmed to its anchor base");
+    fail_unless(allele_key_is(alleles, 2, "1:100:A:G"), "SNV must be trimmed to a single base");
+
+    array_list_free(alleles, free);
+    array_list_free(records, free);
+}
+END_TEST
+
+START_TEST (deduplication) {
+    array_list_t *records = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    array_list_insert(create_record("1", 100, ".", "A", "G,T"), records);
+    array_list_insert(create_record("1", 100, ".", "AC", "GC"), records);
+    array_list_insert(create_record("1", 200, ".", "C", "T"), records);
+    int first_owner, second_owner;
+    char *annotated_lines;
+
+    queried_alleles_t *queried_alleles = queried_alleles_new();
+    array_list_t *alleles = split_alleles(records);
+    array_list_t *requested = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    fail_unless(claim_queried_alleles(alleles, &first_owner, queried_alleles, requested, &annotated_lines) == 1, 
+                "Equivalent alleles must wait for the first occurrence");
+    fail_unless(requested->size == 3, "Unique alleles must be requested");
+    fail_if(annotated_lines, "No allele has been annotated yet");
+
+    array_list_t *next_alleles = split_alleles(records);
+    array_list_t *next_requested = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    fail_unless(claim_queried_alleles(next_alleles, &second_owner, queried_alleles, next_requested, &annotated_lines) == 4, 
+                "Alleles being annotated must not be requested again");
+    fail_unless(next_requested->size == 0, "Alleles being annotated must not be requested again");
+
+    // The first allele is annotated, and its lines given to the occurrences waiting for it
+    const char *response = "1\t100\tA\tG\tgene1\n"
+                           "1\t100\tA\tG\tgene2\n"
+                           "1\t100\tA\tT\tgene1\n";
+    allele_waiter_t *waiters = annotate_queried_alleles((vcf_record_t**) requested->items, 2, response, queried_alleles);
+    int num_released = 0;
+    while (waiters) {
+        allele_waiter_t *waiter = waiters;
+        waiters = waiter->next;
+        char *key = compose_allele_key(waiter->allele);
+        if (!strcmp(key, "1:100:A:G")) {
+            fail_unless(waiter->lines && !strcmp(waiter->lines, "1\t100\tA\tG\tgene1\n1\t100\tA\tG\tgene2\n"), 
+                        "Waiting alleles must receive only their own lines");
+        } else {
+            fail_unless(waiter->lines && !strcmp(waiter->lines, "1\t100\tA\tT\tgene1\n"), 
+                        "Waiting alleles must receive only their own lines");
+            fail_unless(waiter->owner == &second_owner, "Waiting alleles must keep their batch");
+        }
+        num_released++;
+        free(key);
+        free(waiter);
+    }
+    fail_unless(num_released == 4, "Every occurrence waiting for annotated alleles must be released");
+
+    // The request of the last allele fails, so the ones waiting for it fail, and it is requested again
+    waiters = fail_queried_alleles((vcf_record_t**) requested->items + 2, 1, queried_alleles);
+    fail_unless(waiters && !waiters->next && !waiters->lines, "Alleles waiting for a failed request must fail");
+    free(waiters);
+
+    array_list_free(next_requested, NULL);
+    array_list_free(next_alleles, free);
+    next_alleles = split_alleles(records);
+    next_requested = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    fail_unless(claim_queried_alleles(next_alleles, &second_owner, queried_alleles, next_requested, &annotated_lines) == 0, 
+                "Only the alleles being annotated must wait");
+    fail_unless(next_requested->size == 1 && allele_key_is(next_requested, 0, "1:200:C:T"), 
+                "Alleles whose request failed must be requested again");
+    fail_unless(annotated_lines && !strcmp(annotated_lines, "1\t100\tA\tG\tgene1\n1\t100\tA\tG\tgene2\n"
+                                                            "1\t100\tA\tT\tgene1\n"
+                                                            "1\t100\tA\tG\tgene1\n1\t100\tA\tG\tgene2\n"), 
+                "Annotated alleles must be given the lines of their first occurrence");
+    free(annotated_lines);
+    fail_if(annotate_queried_alleles((vcf_record_t**) next_requested->items, 1, "", queried_alleles), 
+            "No allele must be waiting");
+
+    khash_t(allele_keys) *keys = kh_init(allele_keys);
+    int ret;
+    kh_put(allele_keys, keys, "1:100:A:G", &ret);
+    fail_unless(record_has_allele(records->items[1], keys), "Records must be found by any of their normalised alleles");
+    fail_if(record_has_allele(records->items[2], keys), "Records without the allele must not be found");
+    kh_destroy(allele_keys, keys);
+
+    array_list_free(next_requested, NULL);
+    array_list_free(next_alleles, free);
+    array_list_free(requested, NULL);
+    array_list_free(alleles, free);
+    array_list_free(records, free);
+    queried_alleles_free(queried_alleles);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_alleles = tcase_create("Alleles normalisation");
+    tcase_add_test(tc_alleles, normalisation);
+    tcase_add_test(tc_alleles, multiallelic_split);
+    tcase_add_test(tc_alleles, deduplication);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Effect alleles");
+    suite_add_tcase(fs, tc_alleles);
+
+    return fs;
+}
@@ -0,0 +1,221 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "epistasis/epistasis.h"
+
+
+Suite *create_test_suite(void);
+
+
+#define NUM_AFFECTED    70
+#define NUM_UNAFFECTED  75
+#define NUM_SAMPLES     (NUM_AFFECTED + NUM_UNAFFECTED)
+#define NUM_VARIANTS    40
+
+static uint8_t genotypes[NUM_VARIANTS * NUM_SAMPLES];
+static vcf_record_t records[NUM_VARIANTS];
+static vcf_record_t *records_p[NUM_VARIANTS];
+static epistasis_dataset_t *dataset;
+
+
+/* ******************************
+ *       Unchecked fixtures     *
+ * ******************************/
+
+void setup_dataset(void) {
+    srand(2013);
+
+    // Samples are already grouped: affected first, then unaffected
+    for (int i = 0; i < NUM_VARIANTS * NUM_SAMPLES; i++) {
+        genotypes[i] = (rand() % 20 == 0) ? EPISTASIS_MISSING_GENOTYPE : rand() % EPISTASIS_NUM_GENOTYPES;
+    }
+
+    // Variants 7 and 23 interact: cases carry a genotype of the second that depends on the first
+    for (int j = 0; j < NUM_AFFECTED; j++) {
+        genotypes[7 * NUM_SAMPLES + j] = j % EPISTASIS_NUM_GENOTYPES;
+        genotypes[23 * NUM_SAMPLES + j] = (j + 1) % EPISTASIS_NUM_GENOTYPES;
+    }
+
+    for (int i = 0; i < NUM_VARIANTS; i++) {
+        memset(&records[i], 0, sizeof(vcf_record_t));
+        records[i].chromosome = "1";
+        records[i].chromosome_len = 1;
+        records[i].id = ".";
+        records[i].id_len = 1;
+        records[i].position = 100 + i;
+        records_p[i] = &records[i];
+    }
+
+    // Load the variants in two blocks, as the runner does with each batch
+    dataset = epistasis_dataset_new(NUM_AFFECTED, NUM_UNAFFECTED);
+    epistasis_dataset_t *block = epistasis_dataset_new(NUM_AFFECTED, NUM_UNAFFECTED);
+    epistasis_dataset_add_records(records_p, 15, genotypes, dataset);
+    epistasis_dataset_add_records(records_p + 15, NUM_VARIANTS - 15, genotypes + 15 * NUM_SAMPLES, block);
+    epistasis_dataset_append(block, dataset);
+    epistasis_dataset_free(block);
+}
+
+void teardown_dataset(void) {
+    epistasis_dataset_free(dataset);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (test_contingency_table) {
+    int cases[EPISTASIS_NUM_COMBINATIONS], controls[EPISTASIS_NUM_COMBINATIONS];
+
+    for (int i = 0; i < NUM_VARIANTS; i += 3) {
+        for (int j = i + 1; j < NUM_VARIANTS; j += 5) {
+            int expected_cases[EPISTASIS_NUM_COMBINATIONS] = { 0 }, expected_controls[EPISTASIS_NUM_COMBINATIONS] = { 0 };
+            for (int s = 0; s < NUM_SAMPLES; s++) {
+                uint8_t g1 = genotypes[i * NUM_SAMPLES + s], g2 = genotypes[j * NUM_SAMPLES + s];
+                if (g1 == EPISTASIS_MISSING_GENOTYPE || g2 == EPISTASIS_MISSING_GENOTYPE) {
+                    continue;
+                }
+                if (s < NUM_AFFECTED) {
+                    expected_cases[g1 * EPISTASIS_NUM_GENOTYPES + g2]++;
+                } else {
+                    expected_controls[g1 * EPISTASIS_NUM_GENOTYPES + g2]++;
+                }
+            }
+
+            epistasis_contingency_table(i, j, dataset, cases, controls);
+            for (int k = 0; k < EPISTASIS_NUM_COMBINATIONS; k++) {
+                fail_if(cases[k] != expected_cases[k], "Variants %d and %d: combination %d must have %d cases, not %d",
+                        i, j, k, expected_cases[k], cases[k]);
+                fail_if(controls[k] != expected_controls[k], "Variants %d and %d: combination %d must have %d controls, not %d",
+                        i, j, k, expected_controls[k], controls[k]);
+            }
+        }
+    }
+}
+END_TEST
+
+START_TEST (test_balanced_accuracy) {
+    // Perfect separation
+    int cases1[EPISTASIS_NUM_COMBINATIONS] = { 10, 0, 0, 0, 5, 0, 0, 0, 0 };
+    int controls1[EPISTASIS_NUM_COMBINATIONS] = { 0, 8, 0, 0, 0, 0, 0, 0, 7 };
+    fail_if(fabs(epistasis_balanced_accuracy(cases1, controls1) - 1.0) > 1e-12, "Separated cases and controls must give accuracy 1");
+
+    // Same distribution in cases and controls
+    int cases2[EPISTASIS_NUM_COMBINATIONS] = { 2, 2, 2, 2, 2, 2, 2, 2, 2 };
+    int controls2[EPISTASIS_NUM_COMBINATIONS] = { 4, 4, 4, 4, 4, 4, 4, 4, 4 };
+    fail_if(fabs(epistasis_balanced_accuracy(cases2, controls2) - 0.5) > 1e-12, "Equally distributed samples must give accuracy 0.5");
+
+    // Combinations 0 and 1 are high-risk: TP = 9 of 12 cases, TN = 10 of 14 controls
+    int cases3[EPISTASIS_NUM_COMBINATIONS] = { 6, 3, 0, 0, 0, 0, 0, 0, 3 };
+    int controls3[EPISTASIS_NUM_COMBINATIONS] = { 2, 2, 0, 0, 0, 0, 0, 0, 10 };
+    double expected = 0.5 * (9.0 / 12 + 10.0 / 14);
+    fail_if(fabs(epistasis_balanced_accuracy(cases3, controls3) - expected) > 1e-12, "Accuracy must be %f", expected);
+}
+END_TEST
+
+START_TEST (test_heap) {
+    epistasis_heap_t *heap = epistasis_heap_new(3);
+    double accuracies[6] = { 0.6, 0.9, 0.55, 0.7, 0.9, 0.65 };
+    for (int k = 0; k < 6; k++) {
+        epistasis_interaction_t interaction = { accuracies[k], k, k + 1 };
+        epistasis_heap_push(interaction, heap);
+    }
+    epistasis_heap_sort(heap);
+
+    fail_unless(heap->size == 3, "Only 3 interactions must be kept");
+    fail_unless(heap->interactions[0].first == 1, "Ties must be broken by the first variant");
+    fail_unless(heap->interactions[1].first == 4, "The second best interaction is (4,5)");
+    fail_unless(heap->interactions[2].first == 3, "The third best interaction is (3,4)");
+
+    epistasis_heap_free(heap);
+}
+END_TEST
+
+START_TEST (test_scan) {
+    int top = 25;
+    epistasis_heap_t *single = epistasis_scan(dataset, top, 1);
+    epistasis_heap_t *multiple = epistasis_scan(dataset, top, 4);
+
+    // Exhaustive search of all pairs
+    epistasis_heap_t *expected = epistasis_heap_new(top);
+    int cases[EPISTASIS_NUM_COMBINATIONS], controls[EPISTASIS_NUM_COMBINATIONS];
+    for (int i = 0; i < NUM_VARIANTS; i++) {
+        for (int j = i + 1; j < NUM_VARIANTS; j++) {
+            epistasis_contingency_table(i, j, dataset, cases, controls);
+            epistasis_interaction_t interaction = { epistasis_balanced_accuracy(cases, controls), i, j };
+            epistasis_heap_push(interaction, expected);
+        }
+    }
+    epistasis_heap_sort(expected);
+
+    fail_unless(single->size == top && multiple->size == top, "%d interactions must be reported", top);
+    fail_unless(single->interactions[0].first == 7 && single->interactions[0].second == 23,
+                "The interaction between variants 7 and 23 must be the best one");
+
+    for (int k = 0; k < top; k++) {
+        fail_if(single->interactions[k].first != expected->interactions[k].first ||
+                single->interactions[k].second != expected->interactions[k].second ||
+                single->interactions[k].accuracy != expected->interactions[k].accuracy,
+                "Interaction #%d must be the same found by an exhaustive search", k);
+        fail_if(multiple->interactions[k].first != single->interactions[k].first ||
+                multiple->interactions[k].second != single->interactions[k].second,
+                "Interaction #%d must not depend on the number of threads", k);
+    }
+
+    epistasis_heap_free(expected);
+    epistasis_heap_free(multiple);
+    epistasis_heap_free(single);
+}
+END_TEST
+
+START_TEST (test_result) {
+    epistasis_interaction_t interaction = { 0.75, 7, 23 };
+    epistasis_result_t *result = epistasis_result_new(interaction, dataset);
+
+    fail_unless(result->position1 == 107 && result->position2 == 123, "Positions must be the ones of variants 7 and 23");
+    fail_unless(result->chi_square > 0, "The interaction must have a positive chi-square");
+    fail_unless(result->p_value >= 0 && result->p_value < 0.001, "The interaction must be significant (p = %e)", result->p_value);
+
+    epistasis_result_free(result);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_scores = tcase_create("Interaction scores");
+    tcase_add_unchecked_fixture(tc_scores, setup_dataset, teardown_dataset);
+    tcase_add_test(tc_scores, test_contingency_table);
+    tcase_add_test(tc_scores, test_balanced_accuracy);
+
+    TCase *tc_search = tcase_create("Search of interactions");
+    tcase_add_unchecked_fixture(tc_search, setup_dataset, teardown_dataset);
+    tcase_add_test(tc_search, test_heap);
+    tcase_add_test(tc_search, test_scan);
+    tcase_add_test(tc_search, test_result);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Epistasis");
+    suite_add_tcase(fs, tc_scores);
+    suite_add_tcase(fs, tc_search);
+
+    return fs;
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "gwas/assoc/genotype_matrix.h"
+
+
+Suite *create_test_suite(void);
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+static vcf_record_t *create_record(char *chromosome, char *format, char **samples, int num_samples) {
+    vcf_record_t *record = (vcf_record_t*) calloc (1, sizeof(vcf_record_t));
+    record->chromosome = chromosome;
+    record->chromosome_len = strlen(chromosome);
+    record->format = format;
+    record->format_len = strlen(format);
+    record->samples = array_list_new(num_samples, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    for (int i = 0; i < num_samples; i++) {
+        array_list_insert(samples[i], record->samples);
+    }
+    return record;
+}
+
+START_TEST (genotype_decoding) {
+    fail_unless(decode_genotype("0/0", 0) == GENOTYPE_HOM_REF, "0/0 must be homozygous for the reference");
+    fail_unless(decode_genotype("1|0", 0) == GENOTYPE_HET, "1|0 must be heterozygous");
+    fail_unless(decode_genotype("1/2", 0) == GENOTYPE_HOM_ALT, "1/2 has no reference allele");
+    fail_unless(decode_genotype("12/12", 0) == GENOTYPE_HOM_ALT, "Alleles may have more than one digit");
+    fail_unless(decode_genotype("./1", 0) == GENOTYPE_MISSING, "Genotypes with a missing allele must be missing");
+    fail_unless(decode_genotype("1", 0) == GENOTYPE_MISSING, "Haploid genotypes must be missing");
+    fail_unless(decode_genotype("35:0/1:99", 1) == GENOTYPE_HET, "GT must be found in any position");
+    fail_unless(decode_genotype("35", 1) == GENOTYPE_MISSING, "Samples without GT must be missing");
+}
+END_TEST
+
+START_TEST (gt_position_cache) {
+    char *samples[] = { "0/1" };
+    vcf_record_t *record1 = create_record("1", "DP:GT", samples, 1);
+    vcf_record_t *record2 = create_record("1", "GT", samples, 1);
+
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    fail_unless(get_gt_position(record1, gt_positions) == 1, "GT is the second field");
+    fail_unless(get_gt_position(record2, gt_positions) == 0, "GT is the first field");
+    fail_unless(get_gt_position(record1, gt_positions) == 1, "GT is the second field");
+    fail_unless(kh_size(gt_positions) == 2, "Each distinct FORMAT must be cached once");
+    gt_positions_free(gt_positions);
+
+    array_list_free(record1->samples, NULL);
+    array_list_free(record2->samples, NULL);
+    free(record1);
+    free(record2);
+}
+END_TEST
+
+START_TEST (allele_counts) {
+    // 40 samples so rows take more than one word: odd samples are cases and even ones controls
+    int num_samples = 40;
+    char *genotypes[] = { "0/0", "0/1", "1/1", "./." };
+    char *samples[num_samples];
+    individual_t individuals[num_samples];
+    individual_t *individuals_p[num_samples];
+    for (int i = 0; i < num_samples; i++) {
+        samples[i] = genotypes[(i / 2) % 4];
+        individuals[i].condition = (i % 2) ? AFFECTED : UNAFFECTED;
+        individuals_p[i] = &individuals[i];
+    }
+
+    vcf_record_t *records[2];
+    records[0] = create_record("1", "GT", samples, num_samples);
+    records[1] = create_record("X", "GT", samples, num_samples);
+
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *matrix = genotype_matrix_new(records, 2, num_samples, gt_positions);
+    uint64_t *affected = genotype_mask_new(individuals_p, num_samples, AFFECTED);
+    uint64_t *unaffected = genotype_mask_new(individuals_p, num_samples, UNAFFECTED);
+
+    fail_unless(genotype_matrix_get(matrix, 0, 2) == GENOTYPE_HET, "Genotypes must be stored in order");
+    fail_unless(genotype_matrix_get(matrix, 0, 39) == GENOTYPE_MISSING, "Genotypes must be stored in order");
+
+    // Each group has 5 samples of each genotype
+    int reference, alternate;
+    genotype_matrix_count_alleles(matrix, 0, affected, 0, &reference, &alternate);
+    fail_unless(reference == 15 && alternate == 15, "Cases must have 15 reference and 15 alternate alleles");
+    genotype_matrix_count_alleles(matrix, 0, unaffected, 0, &reference, &alternate);
+    fail_unless(reference == 15 && alternate == 15, "Controls must have 15 reference and 15 alternate alleles");
+    genotype_matrix_count_alleles(matrix, 1, affected, 1, &reference, &alternate);
+    fail_unless(reference == 5 && alternate == 5, "Haploid counts must ignore heterozygous genotypes");
+
+    free(affected);
+    free(unaffected);
+    genotype_matrix_free(matrix);
+    gt_positions_free(gt_positions);
+    for (int i = 0; i < 2; i++) {
+        array_list_free(records[i]->samples, NULL);
+        free(records[i]);
+    }
+}
+END_TEST
+
+START_TEST (split_alleles) {
+    char *samples[] = { "0/0", "0/1", "1/2", "2/2", "0|3", "./2", "4/1", "3/3" };
+    vcf_record_t *records[2];
+    records[0] = create_record("1", "GT", samples, 8);
+    records[0]->alternate = "C,GT,T";
+    records[0]->alternate_len = strlen(records[0]->alternate);
+    records[1] = create_record("1", "GT", samples, 8);
+    records[1]->alternate = "A";
+    records[1]->alternate_len = 1;
+
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *matrix = genotype_matrix_new_split(records, 2, 8, gt_positions);
+
+    fail_unless(matrix->num_variants == 4, "There must be a row per alternate allele");
+    fail_unless(matrix->rows[1].variant == 0 && matrix->rows[1].allele == 2, "Row 1 must be the second allele of variant 0");
+    fail_unless(matrix->rows[1].alternate_len == 2 && !strncmp(matrix->rows[1].alternate, "GT", 2), "Row 1 must be allele GT");
+    fail_unless(matrix->rows[2].alternate_len == 1 && !strncmp(matrix->rows[2].alternate, "T", 1), "Row 2 must be allele T");
+    fail_unless(matrix->rows[3].variant == 1 && matrix->rows[3].allele == 1, "Row 3 must be the only allele of variant 1");
+
+    int expected[3][8] = {
+        { GENOTYPE_HOM_REF, GENOTYPE_HET, GENOTYPE_HET, GENOTYPE_HOM_REF, GENOTYPE_HOM_REF, GENOTYPE_MISSING, GENOTYPE_MISSING, GENOTYPE_HOM_REF },
+        { GENOTYPE_HOM_REF, GENOTYPE_HOM_REF, GENOTYPE_HET, GENOTYPE_HOM_ALT, GENOTYPE_HOM_REF, GENOTYPE_MISSING, GENOTYPE_MISSING, GENOTYPE_HOM_REF },
+        { GENOTYPE_HOM_REF, GENOTYPE_HOM_REF, GENOTYPE_HOM_REF, GENOTYPE_HOM_REF, GENOTYPE_HET, GENOTYPE_MISSING, GENOTYPE_MISSING, GENOTYPE_HOM_ALT }
+    };
+    for (int a = 0; a < 3; a++) {
+        for (int j = 0; j < 8; j++) {
+            fail_unless(genotype_matrix_get(matrix, a, j) == expected[a][j], "Allele %d of sample %d (%s) must be %d",
+                        a + 1, j, samples[j], expected[a][j]);
+        }
+    }
+    fail_unless(genotype_matrix_get(matrix, 3, 1) == GENOTYPE_HET, "Biallelic rows must be decoded as usual");
+
+    genotype_matrix_free(matrix);
+    gt_positions_free(gt_positions);
+    for (int i = 0; i < 2; i++) {
+        array_list_free(records[i]->samples, NULL);
+        free(records[i]);
+    }
+}
+END_TEST
+
+START_TEST (kernels_agreement) {
+    // Rows of 37 words, so the vectorised kernels also process a partial block
+    int num_words = 37;
+    uint64_t row[num_words], mask[num_words];
+    srand(42);
+    for (int w = 0; w < num_words; w++) {
+        row[w] = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ rand();
+        mask[w] = (((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ rand()) & 0x5555555555555555ULL;
+    }
+
+    int expected[3], counts[3];
+    for (int kernel = GENOTYPE_KERNEL_SCALAR + 1; kernel < NUM_GENOTYPE_KERNELS; kernel++) {
+        genotype_count_fn count_genotypes = genotype_kernel_get(kernel);
+        if (!count_genotypes) {
+            continue;   // Not supported by this processor
+        }
+        for (int n = 0; n <= num_words; n++) {
+            genotype_kernel_get(GENOTYPE_KERNEL_SCALAR)(row, mask, n, expected);
+            count_genotypes(row, mask, n, counts);
+            fail_unless(counts[0] == expected[0] && counts[1] == expected[1] && counts[2] == expected[2],
+                        "Kernel %s must count as the scalar one for %d words", genotype_kernel_name(kernel), n);
+        }
+    }
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_genotypes = tcase_create("Packed genotypes");
+    tcase_add_test(tc_genotypes, genotype_decoding);
+    tcase_add_test(tc_genotypes, gt_position_cache);
+    tcase_add_test(tc_genotypes, allele_counts);
+    tcase_add_test(tc_genotypes, split_alleles);
+    tcase_add_test(tc_genotypes, kernels_agreement);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Genotype matrix");
+    suite_add_tcase(fs, tc_genotypes);
+
+    return fs;
+}
@@ -0,0 +1,177 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "gwas/hardy/hardy_weinberg.h"
+
+
+Suite *create_test_suite(void);
+
+
+static hardy_weinberg_buffer_t *buffer;
+
+
+/* ******************************
+ *       Unchecked fixtures     *
+ * ******************************/
+
+void setup_buffer(void) {
+    buffer = hardy_weinberg_buffer_new();
+}
+
+void teardown_buffer(void) {
+    hardy_weinberg_buffer_free(buffer);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+static vcf_record_t *create_record(char *chromosome, char *alternate, char **samples, int num_samples) {
+    vcf_record_t *record = (vcf_record_t*) calloc (1, sizeof(vcf_record_t));
+    record->chromosome = chromosome;
+    record->chromosome_len = strlen(chromosome);
+    record->id = ".";
+    record->id_len = 1;
+    record->reference = "A";
+    record->reference_len = 1;
+    record->alternate = alternate;
+    record->alternate_len = strlen(alternate);
+    record->format = "GT";
+    record->format_len = 2;
+    record->samples = array_list_new(num_samples, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    for (int i = 0; i < num_samples; i++) {
+        array_list_insert(samples[i], record->samples);
+    }
+    return record;
+}
+
+static void check_p_value(int heterozygous, int homozygous1, int homozygous2, double expected) {
+    double p_value = hardy_weinberg_exact_test(heterozygous, homozygous1, homozygous2, buffer);
+    fail_unless(fabs(p_value - expected) <= 1e-6 * expected, 
+                "%d/%d/%d: p-value %e expected, %e returned", homozygous1, heterozygous, homozygous2, expected, p_value);
+}
+
+START_TEST (exact_test) {
+    // Values obtained by enumerating all the samples with the same allele counts
+    check_p_value(57, 14, 29, 0.15068007651576146);
+    check_p_value(30, 35, 35, 5.8824705344018196e-05);
+    check_p_value(10, 45, 45, 2.1260317926714617e-17);
+    check_p_value(0, 50, 50, 1.114224180581398e-30);
+    check_p_value(100, 0, 0, 1.5113908273055255e-29);
+    
+    // The buffer holds the probabilities of a larger variant, and must be reused
+    check_p_value(57, 14, 29, 0.15068007651576146);
+}
+END_TEST
+
+START_TEST (exact_test_limits) {
+    fail_unless(hardy_weinberg_exact_test(0, 0, 0, buffer) == 1.0, "Without genotypes the p-value must be 1");
+    fail_unless(hardy_weinberg_exact_test(0, 100, 0, buffer) == 1.0, "Monomorphic variants must have p-value 1");
+    fail_unless(hardy_weinberg_exact_test(1, 0, 0, buffer) == 1.0, "A single heterozygote must have p-value 1");
+    fail_unless(hardy_weinberg_exact_test(57, 29, 14, buffer) == hardy_weinberg_exact_test(57, 14, 29, buffer), 
+                "The p-value must not depend on the order of the homozygotes");
+}
+END_TEST
+
+START_TEST (multiallelic_counts) {
+    char *samples[] = { "0/0", "0/1", "1/1", "1/2", "2/2", "0/2", "./.", "1|0", "2/1" };
+    vcf_record_t *record = create_record("1", "C,G", samples, 9);
+    int selected[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    
+    list_t *output_list = (list_t*) malloc (sizeof(list_t));
+    list_init("output", 1, 10, output_list);
+    hardy_weinberg_test(&record, 1, selected, 8, buffer, output_list);
+    list_decr_writers(output_list);
+    
+    // Allele C: 1/1 is homozygous; 0/1, 1/2 and 1|0 are heterozygous
+    list_item_t *item = list_remove_item(output_list);
+    fail_if(item == NULL, "A result for allele C must be returned");
+    hardy_weinberg_result_t *result = item->data_p;
+    fail_unless(!strcmp(result->alternate, "C"), "The first result must be the one of allele C");
+    fail_unless(result->homozygous_alternate == 1 && result->heterozygous == 3 && result->homozygous_other == 3, 
+                "Allele C counts must be 1/3/3, not %d/%d/%d", 
+                result->homozygous_alternate, result->heterozygous, result->homozygous_other);
+    fail_unless(fabs(result->observed_heterozygosity - 3.0 / 7) < 1e-9, "Observed heterozygosity of allele C must be 3/7");
+    hardy_weinberg_result_free(result);
+    list_item_free(item);
+    
+    // Allele G: 2/2 is homozygous; 1/2 and 0/2 are heterozygous, and the last sample is not selected
+    item = list_remove_item(output_list);
+    fail_if(item == NULL, "A result for allele G must be returned");
+    result = item->data_p;
+    fail_unless(!strcmp(result->alternate, "G"), "The second result must be the one of allele G");
+    fail_unless(result->homozygous_alternate == 1 && result->heterozygous == 2 && result->homozygous_other == 4, 
+                "Allele G counts must be 1/2/4, not %d/%d/%d", 
+                result->homozygous_alternate, result->heterozygous, result->homozygous_other);
+    hardy_weinberg_result_free(result);
+    list_item_free(item);
+    
+    fail_unless(list_remove_item(output_list) == NULL, "Only one result per alternate allele must be returned");
+    
+    free(output_list);
+    array_list_free(record->samples, NULL);
+    free(record);
+}
+END_TEST
+
+START_TEST (haploid_chromosomes) {
+    char *samples[] = { "0/0", "0/1", "1/1" };
+    int selected[] = { 0, 1, 2 };
+    vcf_record_t *records[] = { create_record("X", "C", samples, 3), create_record("Y", "C", samples, 3), 
+                                create_record("MT", "C", samples, 3) };
+    
+    list_t *output_list = (list_t*) malloc (sizeof(list_t));
+    list_init("output", 1, 10, output_list);
+    hardy_weinberg_test(records, 3, selected, 3, buffer, output_list);
+    list_decr_writers(output_list);
+    
+    fail_unless(list_remove_item(output_list) == NULL, "Chromosomes X, Y and MT must not be tested");
+    
+    free(output_list);
+    for (int i = 0; i < 3; i++) {
+        array_list_free(records[i]->samples, NULL);
+        free(records[i]);
+    }
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_exact = tcase_create("Exact test");
+    tcase_add_unchecked_fixture(tc_exact, setup_buffer, teardown_buffer);
+    tcase_add_test(tc_exact, exact_test);
+    tcase_add_test(tc_exact, exact_test_limits);
+    
+    TCase *tc_counts = tcase_create("Genotype counts");
+    tcase_add_unchecked_fixture(tc_counts, setup_buffer, teardown_buffer);
+    tcase_add_test(tc_counts, multiallelic_counts);
+    tcase_add_test(tc_counts, haploid_chromosomes);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Hardy-Weinberg equilibrium");
+    suite_add_tcase(fs, tc_exact);
+    suite_add_tcase(fs, tc_counts);
+
+    return fs;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "effect/local_annotation.h"
+
+
+Suite *create_test_suite(void);
+
+static gene_model_t *model;
+
+
+/* ******************************
+ *      Unchecked fixtures      *
+ * ******************************/
+
+void setup_gene_model(void) {
+    model = gene_model_load("effect_files/gene_model.gff");
+}
+
+void teardown_gene_model(void) {
+    gene_model_free(model);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+static vcf_record_t *create_record(char *chromosome, long position, char *reference, char *alternate) {
+    vcf_record_t *record = (vcf_record_t*) calloc (1, sizeof(vcf_record_t));
+    record->chromosome = chromosome;
+    record->chromosome_len = strlen(chromosome);
+    record->position = position;
+    record->id = ".";
+    record->id_len = 1;
+    record->reference = reference;
+    record->reference_len = strlen(reference);
+    record->alternate = alternate;
+    record->alternate_len = strlen(alternate);
+    return record;
+}
+
+/**
+ * Returns whether any line of the annotations of a variant has the given SO accession.
+ */
+static int has_consequence(char *chromosome, long position, char *reference, char *alternate, const char *accession) {
+    vcf_record_t *record = create_record(chromosome, position, reference, alternate);
+    char *response = annotate_variants_locally(&record, 1, model, NULL);
+    int found = strstr(response, accession) != NULL;
+    free(response);
+    free(record);
+    return found;
+}
+
+START_TEST (gene_model_loading) {
+    fail_if(model == NULL, "The gene model must be loaded");
+    fail_unless(model->num_transcripts == 2, "The GFF3 and GTF transcripts must be loaded");
+    fail_unless(model->num_genes == 1, "The GFF3 gene must be loaded");
+}
+END_TEST
+
+START_TEST (response_format) {
+    vcf_record_t *record = create_record("1", 1150, "A", "AT,AGTC");
+    char *response = annotate_variants_locally(&record, 1, model, NULL);
+
+    int num_lines = 0;
+    for (char *line = strtok(response, "\n"); line; line = strtok(NULL, "\n")) {
+        int num_columns = 1;
+        for (char *c = line; *c; c++) {
+            if (*c == '\t') { num_columns++; }
+        }
+        fail_unless(num_columns == 25, "Each line must have 25 columns, as the effect web service");
+        num_lines++;
+    }
+    fail_unless(num_lines == 2, "Each alternate allele must be annotated separately");
+
+    free(response);
+    free(record);
+}
+END_TEST
+
+START_TEST (transcript_consequences) {
+    fail_unless(has_consequence("1", 1050, "A", "G", "SO:0001623"), "Variant in the 5' UTR");
+    fail_unless(has_consequence("1", 1100, "A", "C", "SO:0001582"), "Variant in the initiator codon");
+    fail_unless(has_consequence("1", 1150, "A", "AT", "SO:0001589"), "Frameshift insertion");
+    fail_unless(has_consequence("1", 1150, "A", "AGTC", "SO:0001821"), "Inframe insertion");
+    fail_unless(has_consequence("1", 1201, "G", "T", "SO:0001575"), "Variant in the splice donor site");
+    fail_unless(has_consequence("1", 1999, "C", "T", "SO:0001574"), "Variant in the splice acceptor site");
+    fail_unless(has_consequence("1", 1205, "G", "T", "SO:0001630"), "Variant in the splice region");
+    fail_unless(has_consequence("1", 1500, "G", "T", "SO:0001627"), "Variant in an intron");
+    fail_unless(has_consequence("1", 4800, "G", "T", "SO:0001624"), "Variant in the 3' UTR");
+}
+END_TEST
+
+START_TEST (intergenic_consequences) {
+    fail_unless(has_consequence("1", 900, "G", "T", "SO:0001631"), "Variant upstream of a forward transcript");
+    fail_unless(has_consequence("2", 50, "G", "T", "SO:0001632"), "Variant downstream of a reverse transcript");
+    fail_unless(has_consequence("1", 20000, "G", "T", "SO:0001628"), "Variant far from any transcript");
+    fail_unless(has_consequence("X", 100, "G", "T", "SO:0001628"), "Variant in a chromosome without transcripts");
+}
+END_TEST
+
+START_TEST (chromosome_prefix) {
+    fail_unless(has_consequence("chr1", 1050, "A", "G", "SO:0001623"), "The 'chr' prefix must be ignored in the VCF");
+    fail_unless(has_consequence("2", 150, "C", "A", "SO:0001792"), "The 'chr' prefix must be ignored in the GFF");
+}
+END_TEST
+
+START_TEST (excluded_consequences) {
+    vcf_record_t *record = create_record("1", 1500, "G", "T");
+    char *response = annotate_variants_locally(&record, 1, model, "upstream_gene_variant,intron_variant");
+    fail_unless(strlen(response) == 0, "Excluded consequence types must not be reported");
+    free(response);
+    free(record);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_annotation = tcase_create("Local annotation");
+    tcase_add_unchecked_fixture(tc_annotation, setup_gene_model, teardown_gene_model);
+    tcase_add_test(tc_annotation, gene_model_loading);
+    tcase_add_test(tc_annotation, response_format);
+    tcase_add_test(tc_annotation, transcript_consequences);
+    tcase_add_test(tc_annotation, intergenic_consequences);
+    tcase_add_test(tc_annotation, chromosome_prefix);
+    tcase_add_test(tc_annotation, excluded_consequences);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Local annotation of consequence types");
+    suite_add_tcase(fs, tc_annotation);
+
+    return fs;
+}
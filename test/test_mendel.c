@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "gwas/mendel_errors.h"
+
+
+Suite *create_test_suite(void);
+
+
+/**
+ * Trios with every combination of genotypes of father, mother and child (4 x 4 x 4), plus some 
+ * more so the last word of trios is not full.
+ */
+#define NUM_TRIOS   70
+
+static char *genotype_strings[] = { "0/0", "0/1", "1/1", "./." };
+
+static trio_table_t *trios;
+static char *samples[3 * NUM_TRIOS];
+
+
+/* ******************************
+ *       Unchecked fixtures     *
+ * ******************************/
+
+static int trio_genotype(int trio, int member) {
+    return ((trio % 64) >> (2 * (2 - member))) & 3;
+}
+
+void setup_trios(void) {
+    trios = (trio_table_t*) calloc (1, sizeof(trio_table_t));
+    trios->num_trios = NUM_TRIOS;
+    trios->fathers = (int*) malloc (NUM_TRIOS * sizeof(int));
+    trios->mothers = (int*) malloc (NUM_TRIOS * sizeof(int));
+    trios->children = (int*) malloc (NUM_TRIOS * sizeof(int));
+    trios->children_sex = (enum Sex*) malloc (NUM_TRIOS * sizeof(enum Sex));
+    trios->num_families = 1;
+    trios->family_starts = (int*) malloc (2 * sizeof(int));
+    trios->family_starts[0] = 0;
+    trios->family_starts[1] = NUM_TRIOS;
+    
+    for (int t = 0; t < NUM_TRIOS; t++) {
+        trios->fathers[t] = 3 * t;
+        trios->mothers[t] = 3 * t + 1;
+        trios->children[t] = 3 * t + 2;
+        trios->children_sex[t] = (t % 2) ? MALE : FEMALE;
+        for (int member = 0; member < 3; member++) {
+            samples[3 * t + member] = genotype_strings[trio_genotype(t, member)];
+        }
+    }
+}
+
+void teardown_trios(void) {
+    trio_table_free(trios);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+static vcf_record_t *create_record(char *chromosome) {
+    vcf_record_t *record = (vcf_record_t*) calloc (1, sizeof(vcf_record_t));
+    record->chromosome = chromosome;
+    record->chromosome_len = strlen(chromosome);
+    record->format = "GT";
+    record->format_len = 2;
+    record->samples = array_list_new(3 * NUM_TRIOS, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    for (int i = 0; i < 3 * NUM_TRIOS; i++) {
+        array_list_insert(samples[i], record->samples);
+    }
+    return record;
+}
+
+static void free_record(vcf_record_t *record) {
+    array_list_free(record->samples, NULL);
+    free(record);
+}
+
+/**
+ * Whether a trio is inconsistent, checked allele by allele.
+ */
+static int is_mendel_error(int father, int mother, int child, int haploid) {
+    if (father == GENOTYPE_MISSING || mother == GENOTYPE_MISSING || child == GENOTYPE_MISSING ||
+        (haploid && child == GENOTYPE_HET)) {
+        return 0;
+    }
+    
+    int father_reference = (father != GENOTYPE_HOM_ALT), father_alternate = (father != GENOTYPE_HOM_REF);
+    int mother_reference = (mother != GENOTYPE_HOM_ALT), mother_alternate = (mother != GENOTYPE_HOM_REF);
+    if (haploid) {
+        return (child == GENOTYPE_HOM_REF) ? !mother_reference : !mother_alternate;
+    }
+    
+    switch (child) {
+        case GENOTYPE_HOM_REF:
+            return !(father_reference && mother_reference);
+        case GENOTYPE_HOM_ALT:
+            return !(father_alternate && mother_alternate);
+        default:
+            return !((father_reference && mother_alternate) || (father_alternate && mother_reference));
+    }
+}
+
+static void check_errors(char *chromosome, int checked, int haploid_males) {
+    vcf_record_t *record = create_record(chromosome);
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *genotypes = genotype_matrix_new(&record, 1, 3 * NUM_TRIOS, gt_positions);
+    
+    int variant_errors;
+    int trio_errors[NUM_TRIOS] = { 0 };
+    mendel_count_errors(genotypes, &record, trios, &variant_errors, trio_errors);
+    
+    int expected_variant_errors = 0;
+    for (int t = 0; t < NUM_TRIOS; t++) {
+        int expected = checked && is_mendel_error(trio_genotype(t, 0), trio_genotype(t, 1), trio_genotype(t, 2),
+                                                  haploid_males && trios->children_sex[t] == MALE);
+        fail_unless(trio_errors[t] == expected, "Chromosome %s, trio %d: %d errors expected, %d found", 
+                    chromosome, t, expected, trio_errors[t]);
+        expected_variant_errors += expected;
+    }
+    fail_unless(variant_errors == expected_variant_errors, "Chromosome %s: %d errors expected, %d found", 
+                chromosome, expected_variant_errors, variant_errors);
+    
+    genotype_matrix_free(genotypes);
+    gt_positions_free(gt_positions);
+    free_record(record);
+}
+
+START_TEST (autosomal_errors) {
+    check_errors("1", 1, 0);
+}
+END_TEST
+
+START_TEST (chromosome_x_errors) {
+    check_errors("X", 1, 1);
+}
+END_TEST
+
+START_TEST (unchecked_chromosomes) {
+    check_errors("Y", 0, 0);
+    check_errors("MT", 0, 0);
+}
+END_TEST
+
+START_TEST (variant_blocks) {
+    // Variants spanning several words, each one with the genotypes of the trios shifted
+    int num_variants = 2 * VARIANTS_PER_WORD + 2;
+    char *chromosomes[] = { "1", "X", "Y" };
+    vcf_record_t **records = (vcf_record_t**) malloc (num_variants * sizeof(vcf_record_t*));
+    for (int v = 0; v < num_variants; v++) {
+        records[v] = create_record(chromosomes[v % 3]);
+        for (int t = 0; t < NUM_TRIOS; t++) {
+            for (int member = 0; member < 3; member++) {
+                records[v]->samples->items[3 * t + member] = genotype_strings[trio_genotype(t + v, member)];
+            }
+        }
+    }
+    
+    khash_t(gt_positions) *gt_positions = gt_positions_new();
+    genotype_matrix_t *genotypes = genotype_matrix_new(records, num_variants, 3 * NUM_TRIOS, gt_positions);
+    int *variant_errors = (int*) malloc (num_variants * sizeof(int));
+    int trio_errors[NUM_TRIOS] = { 0 };
+    mendel_count_errors(genotypes, records, trios, variant_errors, trio_errors);
+    
+    int expected_trio_errors[NUM_TRIOS] = { 0 };
+    for (int v = 0; v < num_variants; v++) {
+        int expected_variant_errors = 0;
+        for (int t = 0; t < NUM_TRIOS && v % 3 != 2; t++) {
+            int expected = is_mendel_error(trio_genotype(t + v, 0), trio_genotype(t + v, 1), trio_genotype(t + v, 2),
+                                           v % 3 == 1 && trios->children_sex[t] == MALE);
+            expected_variant_errors += expected;
+            expected_trio_errors[t] += expected;
+        }
+        fail_unless(variant_errors[v] == expected_variant_errors, "Variant %d: %d errors expected, %d found", 
+                    v, expected_variant_errors, variant_errors[v]);
+    }
+    for (int t = 0; t < NUM_TRIOS; t++) {
+        fail_unless(trio_errors[t] == expected_trio_errors[t], "Trio %d: %d errors expected, %d found", 
+                    t, expected_trio_errors[t], trio_errors[t]);
+    }
+    
+    free(variant_errors);
+    genotype_matrix_free(genotypes);
+    gt_positions_free(gt_positions);
+    for (int v = 0; v < num_variants; v++) {
+        free_record(records[v]);
+    }
+    free(records);
+}
+END_TEST
+
+START_TEST (errors_filter) {
+    vcf_record_t *records[] = { create_record("1"), create_record("Y") };
+    array_list_t *input_records = array_list_new(2, 1.5, COLLECTION_MODE_ASYNCHRONIZED);
+    array_list_insert(records[0], input_records);
+    array_list_insert(records[1], input_records);
+    
+    array_list_t *failed_records = NULL;
+    array_list_t *passed_records = filter_mendel_errors(input_records, input_records, &failed_records, trios, 0);
+    fail_unless(passed_records->size == 1 && array_list_get(0, passed_records) == records[1], 
+                "Only the variant without errors must pass");
+    fail_unless(failed_records->size == 1 && array_list_get(0, failed_records) == records[0], 
+                "The variant with errors must fail");
+    array_list_free(passed_records, NULL);
+    array_list_free(failed_records, NULL);
+    
+    failed_records = NULL;
+    passed_records = filter_mendel_errors(input_records, input_records, &failed_records, trios, NUM_TRIOS);
+    fail_unless(passed_records->size == 2 && failed_records->size == 0, "Both variants must pass");
+    array_list_free(passed_records, NULL);
+    array_list_free(failed_records, NULL);
+    
+    array_list_free(input_records, NULL);
+    free_record(records[0]);
+    free_record(records[1]);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_mendel = tcase_create("Mendelian errors");
+    tcase_add_unchecked_fixture(tc_mendel, setup_trios, teardown_trios);
+    tcase_add_test(tc_mendel, autosomal_errors);
+    tcase_add_test(tc_mendel, chromosome_x_errors);
+    tcase_add_test(tc_mendel, unchecked_chromosomes);
+    tcase_add_test(tc_mendel, variant_blocks);
+    tcase_add_test(tc_mendel, errors_filter);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Mendelian errors");
+    suite_add_tcase(fs, tc_mendel);
+
+    return fs;
+}
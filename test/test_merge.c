@@ -319,7 +319,7 @@ END_TEST
 
 START_TEST (merge_position_in_one_file) {
     vcf_record_file_link **links = calloc (1, sizeof(vcf_record_file_link*));
-    links[0] = malloc(sizeof(vcf_record_file_link));
+    links[0] = calloc(1, sizeof(vcf_record_file_link));
     links[0]->file = files[1];
     links[0]->record = create_example_record_0();
     
@@ -360,7 +360,7 @@ START_TEST (merge_id_test) {
     
     vcf_record_file_link **links = calloc (3, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 3; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
     }
     
@@ -396,7 +396,7 @@ START_TEST (merge_alternate_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -442,7 +442,7 @@ START_TEST (merge_quality_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -480,7 +480,7 @@ START_TEST (merge_filter_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -520,7 +520,7 @@ START_TEST (merge_format_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -586,7 +586,7 @@ START_TEST (merge_samples_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -720,7 +720,7 @@ START_TEST (merge_info_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -801,7 +801,7 @@ START_TEST (add_filter_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -861,7 +861,7 @@ START_TEST (add_info_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -920,7 +920,7 @@ START_TEST (add_info_filter_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -979,7 +979,7 @@ START_TEST (get_format_indices_per_file_test) {
     
     vcf_record_file_link **links = calloc (4, sizeof(vcf_record_file_link*));
     for (int i = 0; i < 4; i++) {
-        links[i] = malloc(sizeof(vcf_record_file_link));
+        links[i] = calloc(1, sizeof(vcf_record_file_link));
         links[i]->file = files[i];
         links[i]->record = input[i];
     }
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+
+#include "vcf-tools/merge/merge_heap.h"
+
+
+Suite *create_test_suite(void);
+
+
+#define NUM_FILES   3
+#define MAX_BATCHES 3
+
+/**
+ * Batches of a file, given to its cursor one after another.
+ */
+typedef struct {
+    vcf_batch_t *batches[MAX_BATCHES];
+    int num_batches;
+    int next;
+} batches_source_t;
+
+static char *chromosome_order[] = { "1", "2", "10", "X" };
+static vcf_file_t files[NUM_FILES];
+static batches_source_t sources[NUM_FILES];
+static merge_cursor_t *cursors[NUM_FILES];
+static chromosome_table_t *chromosome_table;
+static merge_heap_t *heap;
+
+
+/* ******************************
+ *        Checked fixtures      *
+ * ******************************/
+
+static vcf_batch_t *array_batch_source(merge_cursor_t *cursor) {
+    batches_source_t *source = cursor->source;
+    return (source->next < source->num_batches) ? source->batches[source->next++] : NULL;
+}
+
+/**
+ * Adds a batch with the records given as "chromosome:position" to the source of a file.
+ */
+static void add_batch(int file, int num_records, char **records) {
+    vcf_batch_t *batch = vcf_batch_new(num_records + 1);
+    for (int i = 0; i < num_records; i++) {
+        char *chromosome = strdup(records[i]);
+        char *separator = strchr(chromosome, ':');
+        *separator = '\0';
+
+        vcf_record_t *record = vcf_record_new();
+        set_vcf_record_chromosome(chromosome, strlen(chromosome), record);
+        set_vcf_record_position(atol(separator + 1), record);
+        add_record_to_vcf_batch(record, batch);
+    }
+    sources[file].batches[sources[file].num_batches++] = batch;
+}
+
+void setup_cursors(void) {
+    memset(sources, 0, NUM_FILES * sizeof(batches_source_t));
+
+    char *batch00[] = { "1:100", "1:200" };
+    char *batch01[] = { "2:50", "X:10" };
+    add_batch(0, 2, batch00);
+    add_batch(0, 2, batch01);
+
+    char *batch10[] = { "1:100", "1:150", "2:50" };
+    add_batch(1, 3, batch10);
+
+    // Batches without records, like the ones of the header, must be skipped
+    char *batch21[] = { "1:300", "10:5" };
+    char *batch22[] = { "GL000192.1:1" };
+    add_batch(2, 0, NULL);
+    add_batch(2, 2, batch21);
+    add_batch(2, 1, batch22);
+
+    chromosome_table = chromosome_table_new(chromosome_order, 4);
+    heap = merge_heap_new(NUM_FILES, chromosome_table);
+    for (int i = 0; i < NUM_FILES; i++) {
+        files[i].filename = "test.vcf";
+        cursors[i] = merge_cursor_new(i, &files[i], array_batch_source, &sources[i]);
+        if (merge_cursor_next(cursors[i])) {
+            merge_heap_push(cursors[i], heap);
+        }
+    }
+}
+
+void teardown_cursors(void) {
+    for (int i = 0; i < NUM_FILES; i++) {
+        merge_cursor_free(cursors[i]);
+        for (int j = sources[i].next; j < sources[i].num_batches; j++) {
+            vcf_batch_free(sources[i].batches[j]);
+        }
+    }
+    merge_heap_free(heap);
+    chromosome_table_free(chromosome_table);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (test_pop_positions) {
+    char *expected_chromosomes[] = { "1", "1", "1", "1", "2", "10", "X", "GL000192.1" };
+    long expected_positions[] = { 100, 150, 200, 300, 50, 5, 10, 1 };
+    int expected_files[][NUM_FILES + 1] = { { 2, 0, 1 }, { 1, 1 }, { 1, 0 }, { 1, 2 }, { 2, 0, 1 }, { 1, 2 }, { 1, 0 }, { 1, 2 } };
+
+    merge_cursor_t *popped[NUM_FILES];
+    int num_positions = 0;
+    int num_popped;
+    while ((num_popped = merge_heap_pop_position(heap, popped)) > 0) {
+        fail_if(num_positions >= 8, "There must be only 8 different positions");
+        fail_unless(num_popped == expected_files[num_positions][0], "Position #%d must be in %d files, not %d",
+                    num_positions, expected_files[num_positions][0], num_popped);
+
+        for (int i = 0; i < num_popped; i++) {
+            vcf_record_t *record = merge_cursor_record(popped[i]);
+            fail_unless(popped[i]->index == expected_files[num_positions][i + 1],
+                        "Position #%d must be read from file %d", num_positions, expected_files[num_positions][i + 1]);
+            fail_if(strncmp(record->chromosome, expected_chromosomes[num_positions], record->chromosome_len) ||
+                    record->position != expected_positions[num_positions],
+                    "Position #%d must be %s:%ld", num_positions, expected_chromosomes[num_positions], expected_positions[num_positions]);
+        }
+
+        for (int i = 0; i < num_popped; i++) {
+            if (merge_cursor_next(popped[i])) {
+                merge_heap_push(popped[i], heap);
+            }
+        }
+        num_positions++;
+    }
+
+    fail_unless(num_positions == 8, "There must be 8 different positions, not %d", num_positions);
+    for (int i = 0; i < NUM_FILES; i++) {
+        fail_unless(cursors[i]->eof, "All files must be completely read");
+    }
+}
+END_TEST
+
+START_TEST (test_finished_batches) {
+    merge_cursor_t *cursor = merge_heap_pop(heap);
+    fail_unless(cursor->index == 0, "File 0 must be the first one");
+
+    // Move the cursor of the first file to its second batch
+    merge_cursor_next(cursor);
+    vcf_record_t *last_record = merge_cursor_record(cursor);
+    merge_cursor_next(cursor);
+
+    fail_unless(cursor->finished_batches->size == 1, "The first batch must be kept after finishing it");
+    fail_unless(last_record->position == 200, "Records of a finished batch must be still available");
+    fail_unless(merge_cursor_record(cursor)->position == 50, "The cursor must point to the first record of the second batch");
+
+    merge_cursor_release_batches(cursor);
+    fail_unless(cursor->finished_batches->size == 0, "Finished batches must be freed once released");
+
+    merge_heap_push(cursor, heap);
+    fail_unless(heap->size == NUM_FILES, "The cursor must be back in the heap");
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_heap = tcase_create("Heap of cursors");
+    tcase_add_checked_fixture(tc_heap, setup_cursors, teardown_cursors);
+    tcase_add_test(tc_heap, test_pop_positions);
+    tcase_add_test(tc_heap, test_finished_batches);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Merge heap");
+    suite_add_tcase(fs, tc_heap);
+
+    return fs;
+}
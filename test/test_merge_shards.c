@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "vcf-tools/merge/merge_shards.h"
+
+
+Suite *create_test_suite(void);
+
+
+#define NUM_FILES   3
+#define NUM_SHARDS  8
+
+static char *chromosome_order[] = { "1", "2", "10", "X" };
+static char filenames[NUM_FILES][32];
+static off_t data_offsets[NUM_FILES];
+static chromosome_table_t *chromosome_table;
+
+
+/* ******************************
+ *       Checked fixtures       *
+ * ******************************/
+
+/**
+ * Writes sorted files with a header and the records of several chromosomes, which are covered by the 
+ * files in different proportions. The last chromosome is not in the chromosome order.
+ */
+void setup_files(void) {
+    char *chromosomes[] = { "1", "2", "10", "X", "GL000192.1" };
+    srand(7);
+    
+    for (int i = 0; i < NUM_FILES; i++) {
+        strcpy(filenames[i], "/tmp/merge_shards_XXXXXX");
+        int fd = mkstemp(filenames[i]);
+        FILE *file = fdopen(fd, "w");
+        fprintf(file, "##fileformat=VCFv4.1\n##contig=<ID=1>\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS%d\n", i);
+        data_offsets[i] = ftell(file);
+        
+        for (int c = 0; c < 5; c++) {
+            long position = 0;
+            for (int r = 0; r < 500 * (i + 1) * (c + 1); r++) {
+                position += 1 + rand() % 50;
+                fprintf(file, "%s\t%ld\t.\tA\tC\t.\tPASS\t.\tGT\t0/1\n", chromosomes[c], position);
+            }
+        }
+        fclose(file);
+    }
+    
+    chromosome_table = chromosome_table_new(chromosome_order, 4);
+}
+
+void teardown_files(void) {
+    for (int i = 0; i < NUM_FILES; i++) {
+        unlink(filenames[i]);
+    }
+    chromosome_table_free(chromosome_table);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+/**
+ * Gets the sort key of the line that starts at an offset of a file.
+ */
+static uint64_t get_key(FILE *file, off_t offset) {
+    char chromosome[32];
+    long position;
+    fseek(file, offset, SEEK_SET);
+    fscanf(file, "%31s %ld", chromosome, &position);
+    return chromosome_sort_key(chromosome_table_rank(chromosome, strlen(chromosome), chromosome_table), position);
+}
+
+START_TEST (test_read_header) {
+    int fd = open(filenames[0], O_RDONLY);
+    off_t data_offset;
+    char *header = merge_read_header(fd, &data_offset);
+    close(fd);
+    
+    fail_unless(data_offset == data_offsets[0], "The records must start at offset %ld, not %ld", data_offsets[0], data_offset);
+    fail_unless(strlen(header) == data_offset, "The header must contain all the lines before the records");
+    fail_unless(strstr(header, "#CHROM") != NULL && !strcmp(header + data_offset - 3, "S0\n"), 
+                "The header must finish with the delimiter line");
+    free(header);
+    
+    fail_unless(merge_file_is_seekable(filenames[0]), "A plain text file can be accessed randomly");
+    fail_if(merge_file_is_seekable("/tmp"), "A directory can't be accessed randomly");
+    fail_if(merge_file_is_seekable("/tmp/this/file/does/not/exist"), "A missing file can't be accessed randomly");
+}
+END_TEST
+
+START_TEST (test_seek_key) {
+    FILE *file = fopen(filenames[1], "r");
+    fseek(file, 0, SEEK_END);
+    off_t size = ftell(file);
+    int fd = fileno(file);
+    
+    // Every line must be found by its own key, and a lower key must not find any line after it
+    off_t offsets[200];
+    char line[128];
+    fseek(file, data_offsets[1], SEEK_SET);
+    for (int i = 0; i < 200; i++) {
+        offsets[i] = ftell(file);
+        fgets(line, 128, file);
+    }
+    
+    for (int i = 0; i < 200; i += 20) {
+        uint64_t key = get_key(file, offsets[i]);
+        fail_unless(merge_seek_key(fd, key, data_offsets[1], size, chromosome_table) == offsets[i], 
+                    "Line at offset %ld must be found by its key", offsets[i]);
+        fail_unless(merge_seek_key(fd, key - 1, data_offsets[1], size, chromosome_table) <= offsets[i], 
+                    "A lower key must not be found after line at offset %ld", offsets[i]);
+    }
+    
+    fail_unless(merge_seek_key(fd, 0, data_offsets[1], size, chromosome_table) == data_offsets[1], 
+                "The lowest key must be found in the first record");
+    fail_unless(merge_seek_key(fd, chromosome_sort_key(3, 1), data_offsets[1], size, chromosome_table) > data_offsets[1], 
+                "Chromosome X must start after the first record");
+    
+    fclose(file);
+}
+END_TEST
+
+START_TEST (test_shard_plan) {
+    char *names[NUM_FILES];
+    for (int i = 0; i < NUM_FILES; i++) {
+        names[i] = filenames[i];
+    }
+    
+    merge_shard_plan_t *plan = merge_shard_plan_new(names, NUM_FILES, data_offsets, NUM_SHARDS, chromosome_table);
+    fail_unless(plan->num_shards > 1 && plan->num_shards <= NUM_SHARDS, "Between 2 and %d shards must be planned", NUM_SHARDS);
+    
+    for (int i = 0; i < plan->num_shards; i++) {
+        fail_unless(plan->boundaries[i] < plan->boundaries[i+1], "Shard boundaries must be sorted");
+    }
+    
+    for (int f = 0; f < NUM_FILES; f++) {
+        FILE *file = fopen(filenames[f], "r");
+        fseek(file, 0, SEEK_END);
+        off_t size = ftell(file);
+        
+        off_t begin, end, previous_end = data_offsets[f];
+        for (int i = 0; i < plan->num_shards; i++) {
+            merge_shard_range(i, f, plan, &begin, &end);
+            fail_unless(begin == previous_end, "Shards of file %d must be contiguous", f);
+            previous_end = end;
+            
+            // All the lines in the range must be in the shard
+            char line[128];
+            fseek(file, begin, SEEK_SET);
+            while (ftell(file) < end) {
+                off_t offset = ftell(file);
+                uint64_t key = get_key(file, offset);
+                fail_if(key < plan->boundaries[i] || key >= plan->boundaries[i+1], 
+                        "Line at offset %ld of file %d must not be in shard %d", offset, f, i);
+                fail_if(chromosome_key_rank(key) == CHROMOSOME_UNKNOWN_RANK && i < plan->num_shards - 1,
+                        "Unknown chromosomes must be in the last shard");
+                fseek(file, offset, SEEK_SET);
+                fgets(line, 128, file);
+            }
+        }
+        fail_unless(previous_end == size, "Shards must cover file %d until its end", f);
+        fclose(file);
+    }
+    
+    merge_shard_plan_free(plan);
+}
+END_TEST
+
+START_TEST (test_append_temporary) {
+    FILE *first = merge_temporary_file("/tmp");
+    FILE *second = merge_temporary_file("/tmp");
+    fail_if(first == NULL || second == NULL, "Temporary files must be created");
+    fail_unless(merge_temporary_file("/tmp/this/folder/does/not/exist") == NULL, "A temporary file needs an existing folder");
+    
+    fprintf(first, "1\t100\n");
+    fprintf(second, "1\t200\n2\t50\n");
+    
+    char contents[64];
+    FILE *output = fmemopen(contents, 64, "w");
+    fail_unless(merge_append_file(first, output) == 0 && merge_append_file(second, output) == 0, "Files must be appended");
+    fclose(output);
+    fail_if(strcmp(contents, "1\t100\n1\t200\n2\t50\n"), "Files must be appended in order");
+    
+    fclose(first);
+    fclose(second);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+    
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_files = tcase_create("Random access");
+    tcase_add_checked_fixture(tc_files, setup_files, teardown_files);
+    tcase_add_test(tc_files, test_read_header);
+    tcase_add_test(tc_files, test_seek_key);
+    tcase_add_test(tc_files, test_shard_plan);
+    
+    TCase *tc_outputs = tcase_create("Shard outputs");
+    tcase_add_test(tc_outputs, test_append_temporary);
+    
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Merge shards");
+    suite_add_tcase(fs, tc_files);
+    suite_add_tcase(fs, tc_outputs);
+    
+    return fs;
+}
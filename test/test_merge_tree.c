@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <bioformats/vcf/vcf_file_structure.h>
+
+#include "vcf-tools/merge/merge.h"
+#include "vcf-tools/merge/merge_tree.h"
+
+
+Suite *create_test_suite(void);
+
+
+#define NUM_RECORDS     1000
+
+#define NUM_INPUTS      6
+#define NUM_GROUPS      2
+#define NUM_POSITIONS   200
+
+static char *spill_filename;
+static off_t data_offset;
+
+
+/* ******************************
+ *       Checked fixtures       *
+ * ******************************/
+
+/**
+ * Creates a record with a sample per file in a group, like the ones merged into spills.
+ */
+static vcf_record_t *create_record(int i) {
+    char *chromosomes[] = { "1", "2", "X" };
+    char text[64];
+    vcf_record_t *record = vcf_record_new();
+    
+    set_vcf_record_chromosome(strdup(chromosomes[i * 3 / NUM_RECORDS]), strlen(chromosomes[i * 3 / NUM_RECORDS]), record);
+    set_vcf_record_position(1000 + 137L * i * i, record);
+    sprintf(text, "rs%d", i);
+    set_vcf_record_id(strdup(text), strlen(text), record);
+    set_vcf_record_reference(strdup("A"), 1, record);
+    set_vcf_record_alternate(strdup((i % 2) ? "C,T" : "G"), (i % 2) ? 3 : 1, record);
+    set_vcf_record_quality((i % 5) ? 10.5 * i : -1, record);
+    set_vcf_record_filter(strdup("PASS"), 4, record);
+    set_vcf_record_info(strdup(""), 0, record);
+    set_vcf_record_format(strdup("GT:DP"), 5, record);
+    for (int j = 0; j < i % 4; j++) {
+        sprintf(text, "%d/1:%d", j % 2, i * j);
+        add_vcf_record_sample(strdup(text), strlen(text), record);
+    }
+    return record;
+}
+
+void setup_spill(void) {
+    FILE *fd = merge_spill_create("/tmp", &spill_filename);
+    fprintf(fd, "##fileformat=VCFv4.1\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\tS3\n");
+    data_offset = ftell(fd);
+    merge_spill_begin_records(fd);
+    
+    for (int i = 0; i < NUM_RECORDS; i++) {
+        // Records without quality have been merged from files without samples
+        vcf_record_t *record = create_record(i);
+        fail_if(merge_spill_write_record(record, (i % 5) ? record->quality * 3 : 0, (i % 5) ? 3 : 0, fd), 
+                "Record %d must be written", i);
+        vcf_record_free_deep(record);
+    }
+    fclose(fd);
+}
+
+void teardown_spill(void) {
+    unlink(spill_filename);
+    free(spill_filename);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (test_plan_levels) {
+    // Few files are merged at once
+    merge_tree_plan_t *plan = merge_tree_plan_new(100, 128);
+    fail_unless(plan->num_levels == 0 && plan->num_final_files == 100, "100 files must be merged at once");
+    merge_tree_plan_free(plan);
+    
+    plan = merge_tree_plan_new(2000, 128);
+    fail_unless(plan->num_levels == 1, "2000 files must be merged in 1 level, not %d", plan->num_levels);
+    fail_unless(plan->num_groups[0] == 16 && plan->num_final_files == 16, "2000 files must be merged in 16 groups");
+    merge_tree_plan_free(plan);
+    
+    plan = merge_tree_plan_new(1000, 4);
+    fail_unless(plan->num_levels == 4, "1000 files must be merged in 4 levels, not %d", plan->num_levels);
+    fail_unless(plan->num_final_files == 4, "The final merge must have 4 files, not %d", plan->num_final_files);
+    merge_tree_plan_free(plan);
+}
+END_TEST
+
+START_TEST (test_plan_groups) {
+    int num_files[] = { 2, 129, 1000, 4097, 12345 };
+    int fan_in[] = { 2, 3, 16, 128, 1000 };
+    
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 5; j++) {
+            merge_tree_plan_t *plan = merge_tree_plan_new(num_files[i], fan_in[j]);
+            
+            // The groups of a level must cover all the files of the previous one, without exceeding the fan-in
+            int num_level_files = num_files[i];
+            for (int l = 0; l < plan->num_levels; l++) {
+                int *first_file = plan->first_file[l];
+                fail_unless(first_file[0] == 0 && first_file[plan->num_groups[l]] == num_level_files, 
+                            "The groups of level %d must cover all its files", l);
+                
+                for (int g = 0; g < plan->num_groups[l]; g++) {
+                    int group_size = first_file[g+1] - first_file[g];
+                    fail_unless(group_size >= 1 && group_size <= fan_in[j], 
+                                "Group %d of level %d has %d files, with fan-in %d", g, l, group_size, fan_in[j]);
+                }
+                num_level_files = plan->num_groups[l];
+            }
+            
+            fail_unless(num_level_files == plan->num_final_files && plan->num_final_files <= fan_in[j], 
+                        "The final merge must not exceed the fan-in");
+            merge_tree_plan_free(plan);
+        }
+    }
+}
+END_TEST
+
+START_TEST (test_spill_records) {
+    FILE *fd = fopen(spill_filename, "r");
+    fail_unless(merge_spill_seek_records(fd, 0), "The header of a spill is not its records");
+    fail_unless(merge_spill_seek_records(fd, data_offset) == 0, "The records must start after the magic line");
+    
+    vcf_file_t file = { .filename = spill_filename };
+    merge_spill_source_t source = { .fd = fd, .batch_lines = 64 };
+    merge_cursor_t *cursor = merge_cursor_new(0, &file, merge_spill_batch_source, &source);
+    
+    int num_records = 0;
+    while (merge_cursor_next(cursor)) {
+        vcf_record_t *record = merge_cursor_record(cursor);
+        vcf_record_t *expected = create_record(num_records);
+        
+        fail_if(strncmp(record->chromosome, expected->chromosome, expected->chromosome_len + 1) || 
+                record->position != expected->position, "Record %d must be in %s:%zu", num_records, 
+                expected->chromosome, expected->position);
+        fail_if(strcmp(record->id, expected->id) || strcmp(record->alternate, expected->alternate) ||
+                record->alternate_len != expected->alternate_len || record->info_len != 0 || 
+                strcmp(record->format, "GT:DP"), "Fields of record %d must be read back", num_records);
+        fail_unless(record->quality == expected->quality, "Quality of record %d must be %f", num_records, expected->quality);
+        
+        merge_spill_quality_t quality = merge_spill_cursor_quality(cursor);
+        fail_unless(quality.samples == ((num_records % 5) ? 3 : 0) && quality.sum == ((num_records % 5) ? expected->quality * 3 : 0), 
+                    "Quality sum of record %d must be read back", num_records);
+        
+        int num_samples = expected->samples ? expected->samples->size : 0;
+        fail_unless((record->samples ? record->samples->size : 0) == num_samples, 
+                    "Record %d must have %d samples", num_records, num_samples);
+        for (int j = 0; j < num_samples; j++) {
+            fail_if(strcmp(array_list_get(j, record->samples), array_list_get(j, expected->samples)), 
+                    "Sample %d of record %d must be read back", j, num_records);
+        }
+        
+        vcf_record_free_deep(expected);
+        merge_cursor_release_batches(cursor);
+        num_records++;
+    }
+    
+    fail_unless(num_records == NUM_RECORDS, "%d records must be read, not %d", NUM_RECORDS, num_records);
+    
+    merge_cursor_free(cursor);
+    free(source.qualities);
+    fclose(fd);
+}
+END_TEST
+
+START_TEST (test_tree_equals_flat) {
+    char *filters[] = { "PASS", ".", "q10", "q10;s50", "s50;lowDP" };
+    
+    // Input files have 1 to 3 samples, and are merged into a spill per group of 3 files
+    vcf_file_t inputs[NUM_INPUTS], spills[NUM_GROUPS];
+    for (int f = 0; f < NUM_INPUTS; f++) {
+        inputs[f] = (vcf_file_t) { .filename = "input.vcf", .samples_names = array_list_new(4, 1.5, COLLECTION_MODE_ASYNCHRONIZED) };
+        for (int s = 0; s <= f % 3; s++) {
+            array_list_insert("sample", inputs[f].samples_names);
+        }
+    }
+    
+    // Records of every position in every input file, NULL if the file does not contain it
+    vcf_record_t *records[NUM_POSITIONS][NUM_INPUTS];
+    for (int p = 0; p < NUM_POSITIONS; p++) {
+        int mask = (p * 7 + 3) % 63 + 1;
+        for (int f = 0; f < NUM_INPUTS; f++) {
+            records[p][f] = NULL;
+            if (!(mask & (1 << f))) {
+                continue;
+            }
+            vcf_record_t *record = vcf_record_new();
+            set_vcf_record_chromosome("1", 1, record);
+            set_vcf_record_position(100 + p, record);
+            set_vcf_record_quality(((p + f) % 4) ? (p * 3 + f * 5) % 60 : -1, record);
+            char *filter = filters[(p + 2 * f) % 5];
+            set_vcf_record_filter(filter, strlen(filter), record);
+            records[p][f] = record;
+        }
+    }
+    
+    // First level: merge every group into a spill
+    FILE *spill_fds[NUM_GROUPS];
+    char *spill_filenames[NUM_GROUPS];
+    for (int g = 0; g < NUM_GROUPS; g++) {
+        spill_fds[g] = merge_spill_create("/tmp", &spill_filenames[g]);
+        merge_spill_begin_records(spill_fds[g]);
+        spills[g] = (vcf_file_t) { .filename = spill_filenames[g], .samples_names = array_list_new(8, 1.5, COLLECTION_MODE_ASYNCHRONIZED) };
+        for (int f = g * NUM_INPUTS / NUM_GROUPS; f < (g + 1) * NUM_INPUTS / NUM_GROUPS; f++) {
+            array_list_insert_all(inputs[f].samples_names->items, inputs[f].samples_names->size, spills[g].samples_names);
+        }
+    }
+    
+    for (int p = 0; p < NUM_POSITIONS; p++) {
+        for (int g = 0; g < NUM_GROUPS; g++) {
+            vcf_record_file_link links[NUM_INPUTS], *link_pointers[NUM_INPUTS];
+            int num_links = 0;
+            for (int f = g * NUM_INPUTS / NUM_GROUPS; f < (g + 1) * NUM_INPUTS / NUM_GROUPS; f++) {
+                if (records[p][f]) {
+                    links[num_links] = (vcf_record_file_link) { .record = records[p][f], .file = &inputs[f] };
+                    link_pointers[num_links] = &links[num_links];
+                    num_links++;
+                }
+            }
+            if (num_links == 0) {
+                continue;
+            }
+            
+            double quality_sum;
+            int quality_samples;
+            merge_quality_sum(link_pointers, num_links, &quality_sum, &quality_samples);
+            char *filter = merge_filter_field(link_pointers, num_links);
+            
+            vcf_record_t *merged = vcf_record_new();
+            set_vcf_record_chromosome("1", 1, merged);
+            set_vcf_record_position(100 + p, merged);
+            set_vcf_record_id(".", 1, merged);
+            set_vcf_record_reference("A", 1, merged);
+            set_vcf_record_alternate("C", 1, merged);
+            set_vcf_record_quality(merge_quality_field(link_pointers, num_links), merged);
+            set_vcf_record_filter(filter, strlen(filter), merged);
+            set_vcf_record_info("", 0, merged);
+            set_vcf_record_format("GT", 2, merged);
+            fail_if(merge_spill_write_record(merged, quality_sum, quality_samples, spill_fds[g]), 
+                    "Position %d of group %d must be written", p, g);
+            
+            free(merged);
+            free(filter);
+        }
+    }
+    
+    // Second level: merge the spills and compare with merging all the input files at once
+    merge_spill_source_t sources[NUM_GROUPS];
+    merge_cursor_t *cursors[NUM_GROUPS];
+    for (int g = 0; g < NUM_GROUPS; g++) {
+        fclose(spill_fds[g]);
+        sources[g] = (merge_spill_source_t) { .fd = fopen(spill_filenames[g], "r"), .batch_lines = 16 };
+        fail_if(merge_spill_seek_records(sources[g].fd, 0), "Spill of group %d must be readable", g);
+        cursors[g] = merge_cursor_new(g, &spills[g], merge_spill_batch_source, &sources[g]);
+        merge_cursor_next(cursors[g]);
+    }
+    
+    for (int p = 0; p < NUM_POSITIONS; p++) {
+        vcf_record_file_link flat_links[NUM_INPUTS], *flat_pointers[NUM_INPUTS];
+        int num_flat_links = 0;
+        for (int f = 0; f < NUM_INPUTS; f++) {
+            if (records[p][f]) {
+                flat_links[num_flat_links] = (vcf_record_file_link) { .record = records[p][f], .file = &inputs[f] };
+                flat_pointers[num_flat_links] = &flat_links[num_flat_links];
+                num_flat_links++;
+            }
+        }
+        
+        vcf_record_file_link tree_links[NUM_GROUPS], *tree_pointers[NUM_GROUPS];
+        int num_tree_links = 0;
+        for (int g = 0; g < NUM_GROUPS; g++) {
+            if (cursors[g]->eof || merge_cursor_record(cursors[g])->position != 100 + p) {
+                continue;
+            }
+            merge_spill_quality_t quality = merge_spill_cursor_quality(cursors[g]);
+            tree_links[num_tree_links] = (vcf_record_file_link) { .record = merge_cursor_record(cursors[g]), .file = &spills[g], 
+                                                                  .quality_sum = quality.sum, .quality_samples = quality.samples };
+            tree_pointers[num_tree_links] = &tree_links[num_tree_links];
+            num_tree_links++;
+        }
+        
+        float flat_quality = merge_quality_field(flat_pointers, num_flat_links);
+        float tree_quality = merge_quality_field(tree_pointers, num_tree_links);
+        fail_unless(flat_quality == tree_quality, "Quality of position %d must be %f, not %f", p, flat_quality, tree_quality);
+        
+        char *flat_filter = merge_filter_field(flat_pointers, num_flat_links);
+        char *tree_filter = merge_filter_field(tree_pointers, num_tree_links);
+        fail_if(strcmp(flat_filter, tree_filter), "Filter of position %d must be %s, not %s", p, flat_filter, tree_filter);
+        free(flat_filter);
+        free(tree_filter);
+        
+        for (int g = 0; g < num_tree_links; g++) {
+            merge_cursor_t *cursor = cursors[tree_links[g].file - spills];
+            merge_cursor_next(cursor);
+        }
+    }
+    
+    for (int g = 0; g < NUM_GROUPS; g++) {
+        fail_unless(cursors[g]->eof, "All the positions of group %d must be merged", g);
+        merge_cursor_free(cursors[g]);
+        free(sources[g].qualities);
+        fclose(sources[g].fd);
+        unlink(spill_filenames[g]);
+        free(spill_filenames[g]);
+        array_list_free(spills[g].samples_names, NULL);
+    }
+    for (int p = 0; p < NUM_POSITIONS; p++) {
+        for (int f = 0; f < NUM_INPUTS; f++) {
+            free(records[p][f]);
+        }
+    }
+    for (int f = 0; f < NUM_INPUTS; f++) {
+        array_list_free(inputs[f].samples_names, NULL);
+    }
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+    
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void) {
+    TCase *tc_plan = tcase_create("Plan of levels");
+    tcase_add_test(tc_plan, test_plan_levels);
+    tcase_add_test(tc_plan, test_plan_groups);
+    
+    TCase *tc_spill = tcase_create("Spill files");
+    tcase_add_checked_fixture(tc_spill, setup_spill, teardown_spill);
+    tcase_add_test(tc_spill, test_spill_records);
+    
+    TCase *tc_tree = tcase_create("Tree merge");
+    tcase_add_test(tc_tree, test_tree_equals_flat);
+    
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Merge tree");
+    suite_add_tcase(fs, tc_plan);
+    suite_add_tcase(fs, tc_spill);
+    suite_add_tcase(fs, tc_tree);
+    
+    return fs;
+}
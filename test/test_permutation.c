@@ -0,0 +1,187 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "gwas/permutation.h"
+
+
+Suite *create_test_suite(void);
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (condition_permutations) {
+    // 100 samples: a third are cases, a third controls and the rest have no known condition or are missing
+    int num_samples = 100;
+    individual_t individuals[num_samples];
+    individual_t *samples[num_samples];
+    int num_cases = 0;
+    for (int j = 0; j < num_samples; j++) {
+        individuals[j].condition = (j % 3 == 0) ? AFFECTED : (j % 3 == 1) ? UNAFFECTED : MISSING_CONDITION;
+        samples[j] = (j % 10 == 9) ? NULL : &individuals[j];
+        if (samples[j] && samples[j]->condition == AFFECTED) {
+            num_cases++;
+        }
+    }
+
+    permutation_set_t *permutations = permutation_set_new_conditions(samples, num_samples, 200, 1);
+    fail_unless(permutations->words_per_permutation == 2, "100 samples need 2 words per permutation");
+
+    uint64_t rows[200 * 2];
+    for (int first = 0; first < 200; first += PERMUTATIONS_PER_BLOCK) {
+        int count = (200 - first < PERMUTATIONS_PER_BLOCK) ? 200 - first : PERMUTATIONS_PER_BLOCK;
+        permutation_set_generate(first, count, rows + first * 2, permutations);
+    }
+
+    int times_case[num_samples];
+    memset(times_case, 0, num_samples * sizeof(int));
+    for (int p = 0; p < permutations->num_permutations; p++) {
+        uint64_t *row = rows + p * 2;
+        int cases = __builtin_popcountll(row[0]) + __builtin_popcountll(row[1]);
+        fail_unless(cases == num_cases, "Permutation %d must have %d cases, not %d", p, num_cases, cases);
+        for (int j = 0; j < num_samples; j++) {
+            times_case[j] += (row[j / 64] >> (j % 64)) & 1;
+        }
+    }
+
+    for (int j = 0; j < num_samples; j++) {
+        if (!samples[j] || samples[j]->condition == MISSING_CONDITION) {
+            fail_unless(times_case[j] == 0, "Sample %d has no known condition and can't be a case", j);
+        } else {
+            fail_if(times_case[j] == 0 || times_case[j] == permutations->num_permutations,
+                    "Sample %d must be a case in some permutations only", j);
+        }
+    }
+
+    permutation_set_free(permutations);
+}
+END_TEST
+
+START_TEST (family_flips) {
+    permutation_set_t *permutations = permutation_set_new_flips(70, 1000, 1);
+    uint64_t rows[PERMUTATIONS_PER_BLOCK * 2];
+    int flipped = 0;
+    for (int p = 0; p < permutations->num_permutations; p++) {
+        if (p % PERMUTATIONS_PER_BLOCK == 0) {
+            permutation_set_generate(p, PERMUTATIONS_PER_BLOCK, rows, permutations);
+        }
+        uint64_t *row = rows + (p % PERMUTATIONS_PER_BLOCK) * 2;
+        fail_unless((row[1] >> 6) == 0, "Only 70 families can be flipped");
+        flipped += __builtin_popcountll(row[0]) + __builtin_popcountll(row[1]);
+    }
+    fail_unless(abs(flipped - 35000) < 1000, "Families must be flipped half of the times, not %d of 70000", flipped);
+    permutation_set_free(permutations);
+}
+END_TEST
+
+START_TEST (mask_expansion) {
+    permutation_set_t *permutations = permutation_set_new_flips(100, 3, 1);
+    uint64_t masks[3 * 4], rows[3 * 2];
+    permutation_set_expand(0, 3, 4, masks, permutations);
+    permutation_set_generate(0, 3, rows, permutations);
+
+    for (int p = 0; p < 3; p++) {
+        uint64_t *row = rows + p * 2;
+        for (int j = 0; j < 100; j++) {
+            int bit = (row[j / 64] >> (j % 64)) & 1;
+            int mask_bit = (masks[p * 4 + j / 32] >> (2 * (j % 32))) & 3;
+            fail_unless(bit == mask_bit, "Unit %d of permutation %d must be in the lower bit of its genotype", j, p);
+        }
+    }
+    permutation_set_free(permutations);
+}
+END_TEST
+
+START_TEST (regenerated_blocks) {
+    // 10000 samples, half of them cases
+    int num_samples = 10000;
+    individual_t *individuals = (individual_t*) malloc (num_samples * sizeof(individual_t));
+    individual_t **samples = (individual_t**) malloc (num_samples * sizeof(individual_t*));
+    for (int j = 0; j < num_samples; j++) {
+        individuals[j].condition = (j % 2) ? AFFECTED : UNAFFECTED;
+        samples[j] = &individuals[j];
+    }
+
+    // A million permutations don't take any memory until their blocks are generated
+    permutation_set_t *permutations = permutation_set_new_conditions(samples, num_samples, 1000000, 4);
+    int num_words = permutations->words_per_permutation;
+    uint64_t *rows = (uint64_t*) malloc (PERMUTATIONS_PER_BLOCK * num_words * sizeof(uint64_t));
+    uint64_t *again = (uint64_t*) malloc (PERMUTATIONS_PER_BLOCK * num_words * sizeof(uint64_t));
+
+    permutation_set_generate(640000, PERMUTATIONS_PER_BLOCK, rows, permutations);
+    permutation_set_generate(0, PERMUTATIONS_PER_BLOCK, again, permutations);
+    fail_if(!memcmp(rows, again, PERMUTATIONS_PER_BLOCK * num_words * sizeof(uint64_t)), "Different blocks must be different");
+    permutation_set_generate(640000, PERMUTATIONS_PER_BLOCK, again, permutations);
+    fail_if(memcmp(rows, again, PERMUTATIONS_PER_BLOCK * num_words * sizeof(uint64_t)), "A block must be the same every time");
+
+    // The last block may be generated partially
+    permutation_set_generate(640000, 10, again, permutations);
+    fail_if(memcmp(rows, again, 10 * num_words * sizeof(uint64_t)), "A partial block must start like the whole one");
+
+    fail_unless(permutation_threads_per_batch(1000000, 8) == 8, "A million permutations must be shared by all threads");
+    fail_unless(permutation_threads_per_batch(100, 8) == 2, "100 permutations can only be shared by 2 threads");
+    fail_unless(permutation_threads_per_batch(0, 8) == 1, "Batches without permutations are processed by a thread");
+
+    free(again);
+    free(rows);
+    permutation_set_free(permutations);
+    free(samples);
+    free(individuals);
+}
+END_TEST
+
+START_TEST (p_values) {
+    permutation_set_t *permutations = permutation_set_new_flips(10, 9, 1);
+    double batch1[] = { 1.0, 5.0, 2.0, 0.5, 3.0, 0.0, 8.0, 1.5, 4.0 };
+    double batch2[] = { 2.0, 1.0, 2.5, 0.0, 3.5, 0.5, 1.0, 1.0, 0.0 };
+    permutation_set_update_max(batch1, permutations);
+    permutation_set_update_max(batch2, permutations);
+    permutation_set_finish(permutations);
+
+    // Maximums are 2.0 5.0 2.5 0.5 3.5 0.5 8.0 1.5 4.0
+    fail_unless(fabs(permutation_corrected_p_value(3.5, permutations) - 0.5) < 1e-9, "4 of 9 maximums reach 3.5");
+    fail_unless(fabs(permutation_corrected_p_value(9.0, permutations) - 0.1) < 1e-9, "No maximum reaches 9.0");
+    fail_unless(fabs(permutation_corrected_p_value(0.0, permutations) - 1.0) < 1e-9, "All maximums reach 0.0");
+    fail_unless(isnan(permutation_corrected_p_value(NAN, permutations)), "Missing statistics have no p-value");
+    fail_unless(fabs(permutation_empirical_p_value(4, permutations) - 0.5) < 1e-9, "EMP1 must be (R+1)/(N+1)");
+
+    permutation_set_free(permutations);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_permutations = tcase_create("Permutations");
+    tcase_add_test(tc_permutations, condition_permutations);
+    tcase_add_test(tc_permutations, family_flips);
+    tcase_add_test(tc_permutations, mask_expansion);
+    tcase_add_test(tc_permutations, regenerated_blocks);
+    tcase_add_test(tc_permutations, p_values);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Max(T) permutations");
+    suite_add_tcase(fs, tc_permutations);
+
+    return fs;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "reorder_buffer.h"
+
+
+Suite *create_test_suite(void);
+
+static reorder_buffer_t *buffer;
+
+static int values[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+
+/* ******************************
+ *       Unit tests setup       *
+ * ******************************/
+
+void create_reorder_buffer(void) {
+    buffer = reorder_buffer_new(4);
+}
+
+void free_reorder_buffer(void) {
+    reorder_buffer_free(buffer);
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+START_TEST (pop_in_sequence_order) {
+    void *item;
+    reorder_buffer_put(2, 0, &values[2], buffer);
+    reorder_buffer_put(1, 0, &values[1], buffer);
+    fail_if(reorder_buffer_pop(&item, buffer), "Sequence 0 has not been put yet");
+    
+    reorder_buffer_put(0, 0, &values[0], buffer);
+    for (int i = 0; i < 3; i++) {
+        fail_unless(reorder_buffer_pop(&item, buffer), "Sequence %d must be popped", i);
+        fail_unless(*((int*) item) == i, "Sequence %d must be popped in order", i);
+    }
+    fail_if(reorder_buffer_pop(&item, buffer), "All sequences have been popped");
+    
+    // The window moves forward as items are popped
+    reorder_buffer_put(6, 0, &values[6], buffer);
+    reorder_buffer_put(3, 0, NULL, buffer);
+    fail_unless(reorder_buffer_pop(&item, buffer) && item == NULL, "Empty sequences must be popped as NULL");
+}
+END_TEST
+
+START_TEST (claim_texts) {
+    int offset;
+    char text[] = "1\t100\n1\t200\n1\t300\n";
+    long first = reorder_buffer_register_text(text, text + 6, 1, buffer);
+    long second = reorder_buffer_register_text(text + 6, text + 12, 1, buffer);
+    long third = reorder_buffer_register_text(text + 12, text + 18, 1, buffer);
+    fail_unless(first == 0 && second == 1 && third == 2, "Sequences must be assigned in registration order");
+    
+    fail_unless(reorder_buffer_claim_text(text + 8, 1, &offset, buffer) == second && offset == 2, 
+                "A pointer must claim the text it belongs to");
+    fail_unless(reorder_buffer_claim_text(text + 8, 1, &offset, buffer) < 0, "A text completely claimed can't be claimed again");
+    fail_unless(reorder_buffer_claim_text(NULL, 1, &offset, buffer) < 0, "NULL can't claim any text");
+    fail_unless(reorder_buffer_claim_text(text + 18, 1, &offset, buffer) < 0, "A pointer out of all texts can't claim any");
+    fail_unless(reorder_buffer_claim_text(text, 1, &offset, buffer) == first && offset == 0, "The first text must be claimed");
+}
+END_TEST
+
+START_TEST (claim_several_batches) {
+    void *item;
+    int offsets[3];
+    char text[] = "1\t100\n1\t200\n1\t300\n1\t400\n";
+    long sequence = reorder_buffer_register_text(text, text + 24, 4, buffer);
+    
+    // The text is parsed into three batches, which are claimed and put in any order
+    fail_unless(reorder_buffer_claim_text(text + 18, 1, &offsets[2], buffer) == sequence, "The last batch must claim the text");
+    fail_unless(reorder_buffer_claim_text(text, 2, &offsets[0], buffer) == sequence, "The first batch must claim the text");
+    reorder_buffer_put(sequence, offsets[2], &values[2], buffer);
+    reorder_buffer_put(sequence, offsets[0], &values[0], buffer);
+    fail_if(reorder_buffer_pop(&item, buffer), "A sequence can't be popped before all its records are claimed");
+    
+    fail_unless(reorder_buffer_claim_text(text + 12, 1, &offsets[1], buffer) == sequence, "The text must be kept until fully claimed");
+    fail_if(reorder_buffer_pop(&item, buffer), "A sequence can't be popped before all its batches are put");
+    reorder_buffer_put(sequence, offsets[1], &values[1], buffer);
+    
+    for (int i = 0; i < 3; i++) {
+        fail_unless(reorder_buffer_pop(&item, buffer), "Batch %d must be popped", i);
+        fail_unless(*((int*) item) == i, "Batches must be popped in the order of their text");
+    }
+    fail_if(reorder_buffer_pop(&item, buffer), "All batches have been popped");
+    fail_unless(reorder_buffer_claim_text(text, 1, &offsets[0], buffer) < 0, "The text must be unregistered once popped");
+}
+END_TEST
+
+START_TEST (skip_texts) {
+    void *item;
+    int offset;
+    char text[] = "#header\n1\t100\n";
+    long header = reorder_buffer_register_text(text, text + 8, 0, buffer);
+    long records = reorder_buffer_register_text(text + 8, text + 14, 1, buffer);
+    reorder_buffer_skip_text(header, buffer);
+    
+    fail_unless(reorder_buffer_claim_text(text, 1, &offset, buffer) < 0, "Skipped texts can't be claimed");
+    fail_unless(reorder_buffer_pop(&item, buffer) && item == NULL, "Skipped texts must be popped as NULL");
+    fail_unless(reorder_buffer_claim_text(text + 8, 1, &offset, buffer) == records, "Texts with records must be claimed");
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_order = tcase_create("Ordered output");
+    tcase_add_checked_fixture(tc_order, create_reorder_buffer, free_reorder_buffer);
+    tcase_add_test(tc_order, pop_in_sequence_order);
+    tcase_add_test(tc_order, claim_texts);
+    tcase_add_test(tc_order, claim_several_batches);
+    tcase_add_test(tc_order, skip_texts);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Reorder buffer");
+    suite_add_tcase(fs, tc_order);
+
+    return fs;
+}
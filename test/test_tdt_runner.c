@@ -31,6 +31,11 @@ static int *pos0, *pos1, *pos2;
 static int *pos3, *pos4, *pos5;
 
 
+static trio_table_t *create_trios(void) {
+    return trio_table_new((family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), sample_ids, 1);
+}
+
+
 /* ******************************
  *       Unchecked fixtures     *
  * ******************************/
@@ -115,8 +120,9 @@ START_TEST (family_unaffected_child) {
     cp_hashtable_put(sample_ids, "CHILD00", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -150,8 +156,9 @@ START_TEST (family_01_01_00) {
     cp_hashtable_put(sample_ids, "CHILD00", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -185,8 +192,9 @@ START_TEST (family_01_00_00) {
     cp_hashtable_put(sample_ids, "CHILD00", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -220,8 +228,9 @@ START_TEST (family_01_01_01) {
     cp_hashtable_put(sample_ids, "CHILD01", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -255,8 +264,9 @@ START_TEST (family_01_00_01) {
     cp_hashtable_put(sample_ids, "CHILD01", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -290,8 +300,9 @@ START_TEST (family_01_11_01) {
     cp_hashtable_put(sample_ids, "CHILD01", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -325,8 +336,9 @@ START_TEST (family_00_01_01) {
     cp_hashtable_put(sample_ids, "CHILD01", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -360,8 +372,9 @@ START_TEST (family_11_01_01) {
     cp_hashtable_put(sample_ids, "CHILD01", pos2);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -422,8 +435,9 @@ START_TEST (combined_families) {
     cp_hashtable_put(sample_ids, "CHILD00B", pos5);
     
     // Launch and verify execution
-    fail_unless(tdt_test(&record, 1, (family_t **) cp_hashtable_get_values(ped->families), get_num_families(ped), 
-                         sample_ids, output_list) == 0, "TDT test terminated with errors");
+    trio_table_t *trios = create_trios();
+    fail_unless(tdt_test(&record, 1, trios, NULL, output_list) == 0, "TDT test terminated with errors");
+    trio_table_free(trios);
     fail_if(output_list->length == 0, "There must be one result inserted");
     
     tdt_result_t *result = output_list->first_p->data_p;
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <check.h>
+#include <omp.h>
+
+#include "effect/ws_scheduler.h"
+
+
+Suite *create_test_suite(void);
+
+static pid_t server_pid;
+static char base_url[64];
+
+static int num_finished, num_succeeded;
+static int max_attempts_seen;
+static int wrong_responses;
+
+
+/* ******************************
+ *       Stub HTTP server       *
+ * ******************************/
+
+/**
+ * Answers every connection with the body of the request (path /echo), an error (path /error) or
+ * an error only the first time a body is received (path /flaky).
+ */
+static void run_stub_server(int listen_fd) {
+    char *seen_flaky[256];
+    int num_seen_flaky = 0;
+
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+
+        // Read headers and body
+        char request[65536];
+        size_t len = 0;
+        char *body = NULL;
+        long content_length = 0;
+        ssize_t n;
+        while ((n = read(fd, request + len, sizeof(request) - len - 1)) > 0) {
+            len += n;
+            request[len] = '\0';
+            char *headers_end = strstr(request, "\r\n\r\n");
+            if (headers_end) {
+                char *cl = strcasestr(request, "Content-Length:");
+                content_length = cl ? atol(cl + 15) : 0;
+                body = headers_end + 4;
+                if (request + len - body >= content_length) {
+                    break;
+                }
+            }
+        }
+        if (!body) {
+            close(fd);
+            continue;
+        }
+        body[content_length] = '\0';
+
+        int status = 200;
+        if (!strncmp(request, "POST /error", 11)) {
+            status = 503;
+        } else if (!strncmp(request, "POST /flaky", 11)) {
+            status = 503;
+            for (int i = 0; i < num_seen_flaky; i++) {
+                if (!strcmp(seen_flaky[i], body)) {
+                    status = 200;
+                }
+            }
+            if (status == 503 && num_seen_flaky < 256) {
+                seen_flaky[num_seen_flaky++] = strdup(body);
+            }
+        }
+
+        char response[70000];
+        int response_len = sprintf(response, "HTTP/1.1 %d %s\r\nContent-Length: %ld\r\nConnection: close\r\n\r\n%s",
+                                   status, (status == 200) ? "OK" : "Service Unavailable",
+                                   (status == 200) ? content_length : 0, (status == 200) ? body : "");
+        write(fd, response, response_len);
+        close(fd);
+    }
+}
+
+
+/* ******************************
+ *      Unchecked fixtures      *
+ * ******************************/
+
+void setup_server(void) {
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    bind(listen_fd, (struct sockaddr*) &address, sizeof(address));
+    listen(listen_fd, 128);
+
+    socklen_t address_len = sizeof(address);
+    getsockname(listen_fd, (struct sockaddr*) &address, &address_len);
+    sprintf(base_url, "http://127.0.0.1:%d", ntohs(address.sin_port));
+
+    server_pid = fork();
+    if (server_pid == 0) {
+        run_stub_server(listen_fd);
+        exit(0);
+    }
+    close(listen_fd);
+}
+
+void teardown_server(void) {
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+}
+
+
+/* ******************************
+ *        Checked fixtures      *
+ * ******************************/
+
+void setup_counters(void) {
+    num_finished = num_succeeded = max_attempts_seen = wrong_responses = 0;
+}
+
+
+/* ******************************
+ *          Unit tests         *
+ * ******************************/
+
+static void count_response(ws_request_t *request, void *data) {
+    num_finished++;
+    if (ws_request_succeeded(request)) {
+        num_succeeded++;
+        if (strcmp(request->response, request->body)) {
+            wrong_responses++;
+        }
+    }
+    if (request->attempts > max_attempts_seen) {
+        max_attempts_seen = request->attempts;
+    }
+    ws_request_free(request);
+}
+
+static int run_scheduler_requests(char *url, int num_requests, ws_scheduler_t *scheduler) {
+    int num_failed = 0;
+
+#pragma omp parallel sections num_threads(2)
+    {
+#pragma omp section
+        {
+            for (int i = 0; i < num_requests; i++) {
+                char body[64];
+                sprintf(body, "variants=1%%3A%d%%3AA%%3AT", i);
+                ws_scheduler_submit(ws_request_new(url, strdup(body), 0, NULL), scheduler);
+            }
+            ws_scheduler_close(scheduler);
+        }
+#pragma omp section
+        {
+            num_failed = ws_scheduler_run(scheduler);
+        }
+    }
+
+    return num_failed;
+}
+
+static int run_requests(char *url, int num_requests, int max_in_flight, int max_attempts) {
+    ws_scheduler_t *scheduler = ws_scheduler_new(max_in_flight, max_attempts, 0, count_response, NULL);
+    int num_failed = run_scheduler_requests(url, num_requests, scheduler);
+    ws_scheduler_free(scheduler);
+    return num_failed;
+}
+
+START_TEST (post_body_composition) {
+    char *params[3] = { "of", "variants", "exclude" };
+    char *values[3] = { "txt", "1:100:A:T,X:5:C:G", NULL };
+    char *body = compose_ws_post_body(params, values, 3);
+    fail_if(strcmp(body, "of=txt&variants=1%3A100%3AA%3AT%2CX%3A5%3AC%3AG"),
+            "Parameter values must be URL-encoded and NULL values skipped");
+    free(body);
+}
+END_TEST
+
+START_TEST (all_responses_delivered) {
+    char url[128];
+    sprintf(url, "%s/echo", base_url);
+
+    int num_failed = run_requests(url, 100, 8, 3);
+
+    fail_unless(num_failed == 0, "No request should fail");
+    fail_unless(num_finished == 100, "All requests must be delivered to the callback");
+    fail_unless(num_succeeded == 100, "All requests must succeed");
+    fail_unless(wrong_responses == 0, "Each response must correspond to its request");
+    fail_unless(max_attempts_seen == 1, "No request should be retried");
+}
+END_TEST
+
+START_TEST (failed_requests_retried) {
+    char url[128];
+    sprintf(url, "%s/flaky", base_url);
+
+    int num_failed = run_requests(url, 20, 4, 3);
+
+    fail_unless(num_failed == 0, "All requests must succeed after being retried");
+    fail_unless(num_succeeded == 20, "All requests must succeed after being retried");
+    fail_unless(max_attempts_seen == 2, "Requests must be sent twice");
+}
+END_TEST
+
+START_TEST (failed_requests_reported) {
+    char url[128];
+    sprintf(url, "%s/error", base_url);
+
+    int num_failed = run_requests(url, 10, 4, 2);
+
+    fail_unless(num_failed == 10, "All requests must fail");
+    fail_unless(num_finished == 10, "Failed requests must also be delivered to the callback");
+    fail_unless(num_succeeded == 0, "No request should succeed");
+    fail_unless(max_attempts_seen == 2, "Requests must be sent the maximum number of times");
+}
+END_TEST
+
+START_TEST (limits_adapted_to_errors) {
+    char url[128];
+    sprintf(url, "%s/error", base_url);
+
+    ws_scheduler_t *scheduler = ws_scheduler_new(8, 2, 0, count_response, NULL);
+    ws_scheduler_adapt_chunk_size(200, 10, 1000, 60, scheduler);
+    run_scheduler_requests(url, 20, scheduler);
+
+    fail_unless(scheduler->max_in_flight < 8, "Requests in flight must be reduced when requests fail");
+    fail_unless(ws_scheduler_chunk_size(scheduler) < 200, "Variants per request must be reduced when requests fail");
+    fail_unless(scheduler->error_rate > 0.5, "Error rate must reflect the failed requests");
+    ws_scheduler_free(scheduler);
+}
+END_TEST
+
+START_TEST (limits_adapted_to_successes) {
+    char url[128];
+    sprintf(url, "%s/echo", base_url);
+
+    ws_scheduler_t *scheduler = ws_scheduler_new(8, 2, 0, count_response, NULL);
+    ws_scheduler_adapt_chunk_size(200, 10, 1000, 60, scheduler);
+    run_scheduler_requests(url, 100, scheduler);
+
+    fail_unless(scheduler->max_in_flight == 8, "Requests in flight must not exceed their limit");
+    fail_unless(ws_scheduler_chunk_size(scheduler) > 200, "Variants per request must grow while requests succeed on time");
+    fail_unless(scheduler->mean_latency > 0 && scheduler->mean_payload > 0, "Latency and payload must be measured");
+    ws_scheduler_free(scheduler);
+}
+END_TEST
+
+
+/* ******************************
+ *      Main entry point        *
+ * ******************************/
+
+int main (int argc, char *argv) {
+    Suite *fs = create_test_suite();
+    SRunner *fs_runner = srunner_create(fs);
+    srunner_run_all(fs_runner, CK_NORMAL);
+    int number_failed = srunner_ntests_failed (fs_runner);
+    srunner_free (fs_runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+Suite *create_test_suite(void)
+{
+    TCase *tc_composition = tcase_create("Request composition");
+    tcase_add_test(tc_composition, post_body_composition);
+
+    TCase *tc_scheduling = tcase_create("Request scheduling");
+    tcase_add_unchecked_fixture(tc_scheduling, setup_server, teardown_server);
+    tcase_add_checked_fixture(tc_scheduling, setup_counters, NULL);
+    tcase_add_test(tc_scheduling, all_responses_delivered);
+    tcase_add_test(tc_scheduling, failed_requests_retried);
+    tcase_add_test(tc_scheduling, failed_requests_reported);
+    tcase_add_test(tc_scheduling, limits_adapted_to_errors);
+    tcase_add_test(tc_scheduling, limits_adapted_to_successes);
+    tcase_set_timeout(tc_scheduling, 60);
+
+    // Add test cases to a test suite
+    Suite *fs = suite_create("Web services scheduler");
+    suite_add_tcase(fs, tc_composition);
+    suite_add_tcase(fs, tc_scheduling);
+
+    return fs;
+}